@@ -68,6 +68,8 @@ int		verbose = 0;
 int		ldif = 0;
 ber_len_t	ldif_wrap = 0;
 char		*prog = NULL;
+int		parallel = 0;
+int		parallel_depth = TOOL_PARALLEL_DEPTH;
 
 /* connection */
 char		*ldapuri = NULL;
@@ -795,6 +797,24 @@ tool_args( int argc, char **argv )
 			}
 			ldapuri = ber_strdup( optarg );
 			break;
+		case 'J':	/* connections[,depth] for parallel operation */
+			ival = strtol( optarg, &next, 10 );
+			if ( next == NULL || ival < 1 ||
+				( next[0] != '\0' && next[0] != ',' ) )
+			{
+				fprintf( stderr, "%s: unable to parse parallel value \"%s\"\n", prog, optarg);
+				exit(EXIT_FAILURE);
+			}
+			parallel = ival;
+			if ( next[0] == ',' ) {
+				ival = strtol( &next[1], &next, 10 );
+				if ( next == NULL || next[0] != '\0' || ival < 1 ) {
+					fprintf( stderr, "%s: unable to parse parallel depth \"%s\"\n", prog, optarg);
+					exit(EXIT_FAILURE);
+				}
+				parallel_depth = ival;
+			}
+			break;
 		case 'I':
 #ifdef HAVE_CYRUS_SASL
 			if( authmethod != -1 && authmethod != LDAP_AUTH_SASL ) {
@@ -1485,8 +1505,8 @@ tool_bind( LDAP *ld )
 
 	assert( nsctrls < (int) (sizeof(sctrls)/sizeof(sctrls[0])) );
 
-	if ( pw_file || want_bindpw ) {
-		assert( passwd.bv_val == NULL && passwd.bv_len == 0 );
+	/* the password is only read once when binding several connections */
+	if ( ( pw_file || want_bindpw ) && BER_BVISNULL( &passwd ) ) {
 
 		if ( pw_file ) {
 			if ( lutil_get_filed_password( pw_file, &passwd ) ) {
@@ -1695,6 +1715,36 @@ tool_exit( LDAP *ld, int status )
 }
 
 
+/* Wait at most tv for input on any of the nlds sessions in lds, NULL
+ * entries are skipped. Returns the result of select(). */
+int
+tool_wait_any( LDAP **lds, int nlds, struct timeval *tv )
+{
+	fd_set		rfds;
+	ber_socket_t	sd, maxsd = AC_SOCKET_INVALID;
+	int		i;
+
+	FD_ZERO( &rfds );
+	for ( i = 0; i < nlds; i++ ) {
+		if ( lds[i] == NULL ||
+			ldap_get_option( lds[i], LDAP_OPT_DESC, &sd ) != LDAP_OPT_SUCCESS ||
+			sd == AC_SOCKET_INVALID )
+		{
+			continue;
+		}
+		FD_SET( sd, &rfds );
+		if ( maxsd == AC_SOCKET_INVALID || sd > maxsd ) {
+			maxsd = sd;
+		}
+	}
+	if ( maxsd == AC_SOCKET_INVALID ) {
+		return -1;
+	}
+
+	return select( maxsd + 1, &rfds, NULL, NULL, tv );
+}
+
+
 /* Set server controls.  Add controls extra_c[0..count-1], if set. */
 void
 tool_server_controls( LDAP *ld, LDAPControl *extra_c, int count )
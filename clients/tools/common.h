@@ -58,6 +58,11 @@ extern int		verbose;
 extern int		ldif;
 extern ber_len_t	ldif_wrap;
 extern char		*prog;
+extern int		parallel;
+extern int		parallel_depth;
+
+/* default number of operations outstanding per connection with -J */
+#define TOOL_PARALLEL_DEPTH	8
 
 /* connection */
 extern char		*ldapuri;
@@ -123,6 +128,7 @@ void tool_destroy LDAP_P(( void ));
 void tool_exit LDAP_P(( LDAP *ld, int status )) LDAP_GCCATTR((noreturn));
 void tool_server_controls LDAP_P(( LDAP *, LDAPControl *, int ));
 int tool_check_abandon LDAP_P(( LDAP *ld, int msgid ));
+int tool_wait_any LDAP_P(( LDAP **lds, int nlds, struct timeval *tv ));
 void tool_perror LDAP_P((
 	const char *func,
 	int err,
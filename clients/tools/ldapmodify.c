@@ -71,6 +71,7 @@
 
 static int	ldapadd;
 static char *rejfile = NULL;
+static FILE	*rejfp = NULL;
 static LDAP	*ld = NULL;
 
 static int process_ldif_rec LDAP_P(( char *rbuf, unsigned long lineno ));
@@ -93,6 +94,13 @@ static int process_response(
 	int msgid,
 	int res,
 	const struct berval *dn );
+static int parse_response(
+	LDAP *ld,
+	LDAPMessage *res,
+	int op,
+	const char *dn,
+	char **matchedp,
+	char **textp );
 
 static long interval;
 static struct timeval interval_tv;
@@ -101,6 +109,38 @@ static int txnabort = 0;
 struct berval *txn_id = NULL;
 static unsigned long jumpline;
 
+/*
+ * With -J operations are spread over several connections, each with up
+ * to parallel_depth operations outstanding. An operation is held back
+ * while one on the same entry, or on one of its superiors or
+ * subordinates, is in progress, so the outcome is the same as when
+ * the records are processed one at a time.
+ */
+typedef struct par_op {
+	struct par_op	*po_next;
+	int		po_conn;
+	int		po_msgid;
+	int		po_op;
+	unsigned long	po_lineno;
+	char		*po_entry;
+	char		*po_dn;		/* normalized, lowercase */
+	char		*po_newdn;	/* the same, for the new DN of a rename */
+	char		*po_rejbuf;
+} par_op;
+
+static LDAP	**par_lds;
+static int	*par_busy;
+static par_op	*par_ops;	/* in progress */
+static par_op	*par_new;	/* being sent */
+static par_op	*par_sent;	/* just sent, for main() */
+static int	par_err;
+
+static int par_reserve( LDIFRecord *lr, unsigned long lineno );
+static int par_wait( void );
+static void par_free( par_op *po );
+static void reject( int rc, unsigned long lineno, const char *matched,
+	const char *info, const char *rejbuf );
+
 void
 usage( void )
 {
@@ -118,6 +158,9 @@ usage( void )
 	fprintf( stderr, _("  -f file    read operations from `file'\n"));
 	fprintf( stderr, _("  -i time    wait `time' microseconds between operations\n"));
 	fprintf( stderr, _("  -j lineno  jump to lineno before processing\n"));
+	fprintf( stderr, _("  -J n[,depth] spread operations over n connections, with up to\n"
+		"             depth operations outstanding on each (default: %d)\n"),
+		TOOL_PARALLEL_DEPTH );
 	fprintf( stderr, _("  -M         enable Manage DSA IT control (-MM to make critical)\n"));
 	fprintf( stderr, _("  -P version protocol version (default: 3)\n"));
  	fprintf( stderr,
@@ -130,7 +173,7 @@ usage( void )
 
 
 const char options[] = "aE:rS:"
-	"cd:D:e:f:H:i:Ij:MnNO:o:P:QR:U:vVw:WxX:y:Y:Z";
+	"cd:D:e:f:H:i:Ij:J:MnNO:o:P:QR:U:vVw:WxX:y:Y:Z";
 
 int
 handle_private_option( int i )
@@ -238,7 +281,6 @@ int
 main( int argc, char **argv )
 {
 	char		*rbuf = NULL, *rejbuf = NULL;
-	FILE		*rejfp;
 	struct LDIFFP *ldiffp = NULL, ldifdummy = {0};
 	char		*matched_msg, *error_msg;
 	int		rc, retval, ldifrc;
@@ -258,14 +300,18 @@ main( int argc, char **argv )
 
 	if ( argc != optind ) usage();
 
+	if ( parallel > 1 && txn ) {
+		fprintf( stderr, _("%s: -J incompatible with the txn extension\n"),
+			prog );
+		exit( EXIT_FAILURE );
+	}
+
 	if ( rejfile != NULL ) {
 		if (( rejfp = fopen( rejfile, "w" )) == NULL ) {
 			perror( rejfile );
 			retval = EXIT_FAILURE;
 			goto fail;
 		}
-	} else {
-		rejfp = NULL;
 	}
 
 	if ( infile != NULL ) {
@@ -309,6 +355,24 @@ main( int argc, char **argv )
 
 	tool_server_controls( ld, c, i );
 
+	if ( parallel > 1 && !dont ) {
+		int	n;
+
+		par_lds = ber_memcalloc( parallel, sizeof( LDAP * ) );
+		par_busy = ber_memcalloc( parallel, sizeof( int ) );
+		if ( par_lds == NULL || par_busy == NULL ) {
+			perror( "malloc" );
+			retval = EXIT_FAILURE;
+			goto fail;
+		}
+		par_lds[0] = ld;
+		for ( n = 1; n < parallel; n++ ) {
+			par_lds[n] = tool_conn_setup( 0, 0 );
+			tool_bind( par_lds[n] );
+			tool_server_controls( par_lds[n], c, i );
+		}
+	}
+
 	rc = 0;
 	retval = 0;
 	lineno = 1;
@@ -334,37 +398,49 @@ main( int argc, char **argv )
 
 		rc = process_ldif_rec( rbuf, lineno );
 
-		if ( rc ) retval = rc;
-		if ( rc && rejfp ) {
-			fprintf(rejfp, _("# Error: %s (%d) (line=%lu)"), ldap_err2string(rc), rc, lineno);
+		if ( par_sent != NULL ) {
+			/* the result is dealt with when it arrives */
+			par_sent->po_rejbuf = rejbuf;
+			par_sent = NULL;
+			rejbuf = NULL;
+		}
 
+		if ( rc ) retval = rc;
+		if ( rc && rejfp && rejbuf ) {
 			matched_msg = NULL;
 			ldap_get_option(ld, LDAP_OPT_MATCHED_DN, &matched_msg);
+			error_msg = NULL;
+			ldap_get_option(ld, LDAP_OPT_DIAGNOSTIC_MESSAGE, &error_msg);
+
+			reject( rc, lineno, matched_msg, error_msg, rejbuf );
+
 			if ( matched_msg != NULL ) {
-				if ( *matched_msg != '\0' ) {
-					fprintf( rejfp, _(", matched DN: %s"), matched_msg );
-				}
 				ldap_memfree( matched_msg );
 			}
-
-			error_msg = NULL;
-			ldap_get_option(ld, LDAP_OPT_DIAGNOSTIC_MESSAGE, &error_msg);
 			if ( error_msg != NULL ) {
-				if ( *error_msg != '\0' ) {
-					fprintf( rejfp, _(", additional info: %s"), error_msg );
-				}
 				ldap_memfree( error_msg );
 			}
-			fprintf( rejfp, "\n%s\n", rejbuf );
 		}
 
 		if (rejfp) ber_memfree( rejbuf );
 
+		/* stop on a failure reported meanwhile */
+		if ( rc == 0 ) rc = par_err;
+
 next:
 		lineno = nextline+1;
 	}
 	ber_memfree( rbuf );
 
+	while ( par_ops != NULL ) {
+		if ( par_wait() ) {
+			break;
+		}
+	}
+	if ( par_err ) {
+		retval = par_err;
+	}
+
 	if ( ldifrc < 0 )
 		retval = LDAP_OTHER;
 
@@ -391,10 +467,44 @@ fail:;
 		ldif_close( ldiffp );
 	}
 
+	if ( par_lds != NULL ) {
+		ld = par_lds[0];
+		while ( par_ops != NULL ) {
+			par_op *po = par_ops;
+			par_ops = po->po_next;
+			par_free( po );
+		}
+		for ( i = 1; i < parallel; i++ ) {
+			tool_unbind( par_lds[i] );
+		}
+		ber_memfree( par_lds );
+		ber_memfree( par_busy );
+	}
+
 	tool_exit( ld, retval );
 }
 
 
+static void
+reject(
+	int rc,
+	unsigned long lineno,
+	const char *matched,
+	const char *info,
+	const char *rejbuf )
+{
+	fprintf(rejfp, _("# Error: %s (%d) (line=%lu)"), ldap_err2string(rc), rc, lineno);
+
+	if ( matched != NULL && *matched != '\0' ) {
+		fprintf( rejfp, _(", matched DN: %s"), matched );
+	}
+	if ( info != NULL && *info != '\0' ) {
+		fprintf( rejfp, _(", additional info: %s"), info );
+	}
+	fprintf( rejfp, "\n%s\n", rejbuf );
+}
+
+
 static int
 process_ldif_rec( char *rbuf, unsigned long linenum )
 {
@@ -452,6 +562,17 @@ process_ldif_rec( char *rbuf, unsigned long linenum )
 		}
 	}
 
+	if ( rc == 0 && par_lds != NULL ) {
+		switch ( lr.lr_op ) {
+		case LDAP_REQ_ADD:
+		case LDAP_REQ_MODIFY:
+		case LDAP_REQ_DELETE:
+		case LDAP_REQ_RENAME:
+			rc = par_reserve( &lr, linenum );
+			break;
+		}
+	}
+
 	if ( rc == 0 ) {
 		if ( LDAP_REQ_DELETE == lr.lr_op ) {
 			rc = dodelete( &lr.lr_dn, lr.lr_ctrls );
@@ -468,6 +589,12 @@ process_ldif_rec( char *rbuf, unsigned long linenum )
 		}
 	}
 
+	if ( par_new != NULL ) {
+		/* not sent */
+		par_free( par_new );
+		par_new = NULL;
+	}
+
 	ldap_ldif_record_done( &lr );
 
 	return( rc );
@@ -565,7 +692,7 @@ domodify(
 		rc = process_response( ld, msgid,
 			newentry ? LDAP_RES_ADD : LDAP_RES_MODIFY, dn );
 
-		if ( verbose && rc == LDAP_SUCCESS ) {
+		if ( verbose && rc == LDAP_SUCCESS && par_lds == NULL ) {
 			printf( _("modify complete\n") );
 		}
 
@@ -599,7 +726,7 @@ dodelete(
 		}
 		rc = process_response( ld, msgid, LDAP_RES_DELETE, dn );
 
-		if ( verbose && rc == LDAP_SUCCESS ) {
+		if ( verbose && rc == LDAP_SUCCESS && par_lds == NULL ) {
 			printf( _("delete complete\n") );
 		}
 	} else {
@@ -643,7 +770,7 @@ dorename(
 		}
 		rc = process_response( ld, msgid, LDAP_RES_RENAME, dn );
 
-		if ( verbose && rc == LDAP_SUCCESS ) {
+		if ( verbose && rc == LDAP_SUCCESS && par_lds == NULL ) {
 			printf( _("rename complete\n") );
 		}
 	} else {
@@ -680,13 +807,23 @@ static int process_response(
 	const struct berval *dn )
 {
 	LDAPMessage	*res;
-	int		rc = LDAP_OTHER, msgtype;
+	int		rc = LDAP_OTHER;
 	struct timeval	tv = { 0, 0 };
-	int		err;
-	char		*text = NULL, *matched = NULL, **refs = NULL;
-	LDAPControl	**ctrls = NULL;
 
 	assert( dn != NULL );
+
+	if ( par_new != NULL ) {
+		/* collected by par_wait() */
+		par_new->po_msgid = msgid;
+		par_new->po_op = op;
+		par_new->po_next = par_ops;
+		par_ops = par_new;
+		par_busy[par_new->po_conn]++;
+		par_sent = par_new;
+		par_new = NULL;
+		return LDAP_SUCCESS;
+	}
+
 	for ( ; ; ) {
 		tv.tv_sec = 0;
 		tv.tv_usec = 100000;
@@ -707,6 +844,27 @@ static int process_response(
 		}
 	}
 
+	return parse_response( ld, res, op, NULL, NULL, NULL );
+}
+
+/*
+ * Check the result res of an op operation and report a failure. If dn
+ * is set, it is mentioned along with lineno. The matched DN and text are
+ * returned in *matchedp and *textp if these are set.
+ */
+static int
+parse_response(
+	LDAP *ld,
+	LDAPMessage *res,
+	int op,
+	const char *dn,
+	char **matchedp,
+	char **textp )
+{
+	int		rc, err, msgtype;
+	char		*text = NULL, *matched = NULL, **refs = NULL;
+	LDAPControl	**ctrls = NULL;
+
 	msgtype = ldap_msgtype( res );
 
 	rc = ldap_parse_result( ld, res, &err, &matched, &text, &refs, &ctrls, 1 );
@@ -715,6 +873,9 @@ static int process_response(
 	if ( rc == LDAP_TXN_SPECIFY_OKAY ) {
 		rc = LDAP_SUCCESS;
 	} else if ( rc != LDAP_SUCCESS ) {
+		if ( dn != NULL ) {
+			fprintf( stderr, _("%s: update failed: %s\n"), prog, dn );
+		}
 		tool_perror( res2str( op ), rc, NULL, matched, text, refs );
 	} else if ( msgtype != op ) {
 		fprintf( stderr, "%s: msgtype: expected %d got %d\n",
@@ -722,8 +883,16 @@ static int process_response(
 		rc = LDAP_OTHER;
 	}
 
-	if ( text ) ldap_memfree( text );
-	if ( matched ) ldap_memfree( matched );
+	if ( textp ) {
+		*textp = text;
+	} else if ( text ) {
+		ldap_memfree( text );
+	}
+	if ( matchedp ) {
+		*matchedp = matched;
+	} else if ( matched ) {
+		ldap_memfree( matched );
+	}
 	if ( refs ) ber_memvfree( (void **)refs );
 
 	if ( ctrls ) {
@@ -733,3 +902,248 @@ static int process_response(
 
 	return rc;
 }
+
+/* Normalize dn for par_related(), ordering is only needed between
+ * entries anyway so failing to parse dn is not fatal */
+static char *
+par_dn( const char *dn )
+{
+	char	*ndn = NULL, *p;
+
+	if ( dn == NULL ) {
+		return NULL;
+	}
+	if ( ldap_dn_normalize( dn, LDAP_DN_FORMAT_LDAP, &ndn,
+		LDAP_DN_FORMAT_LDAPV3 ) != LDAP_SUCCESS || ndn == NULL )
+	{
+		ndn = ber_strdup( dn );
+		if ( ndn == NULL ) {
+			return NULL;
+		}
+	}
+	for ( p = ndn; *p; p++ ) {
+		*p = TOLOWER( (unsigned char) *p );
+	}
+	return ndn;
+}
+
+/* Whether the entries x and y are the same or one is superior to the other */
+static int
+par_related( const char *x, const char *y )
+{
+	size_t	xlen, ylen;
+
+	if ( x == NULL || y == NULL ) {
+		return 0;
+	}
+	xlen = strlen( x );
+	ylen = strlen( y );
+	if ( xlen > ylen ) {
+		const char *t = x;
+		size_t tlen = xlen;
+
+		x = y;
+		xlen = ylen;
+		y = t;
+		ylen = tlen;
+	}
+
+	if ( xlen == 0 ) {
+		return 1;
+	}
+	if ( strcmp( &y[ylen - xlen], x ) != 0 ) {
+		return 0;
+	}
+	return xlen == ylen || y[ylen - xlen - 1] == ',';
+}
+
+static int
+par_conflict( par_op *a, par_op *b )
+{
+	return par_related( a->po_dn, b->po_dn ) ||
+		par_related( a->po_dn, b->po_newdn ) ||
+		par_related( a->po_newdn, b->po_dn ) ||
+		par_related( a->po_newdn, b->po_newdn );
+}
+
+static void
+par_free( par_op *po )
+{
+	ber_memfree( po->po_entry );
+	ber_memfree( po->po_dn );
+	ber_memfree( po->po_newdn );
+	ber_memfree( po->po_rejbuf );
+	ber_memfree( po );
+}
+
+/*
+ * Wait until the record lr can be sent, that is until no related
+ * operation is in progress and a connection has room for it, and
+ * point ld at that connection. The operation is recorded when it is
+ * sent by process_response().
+ */
+static int
+par_reserve( LDIFRecord *lr, unsigned long lineno )
+{
+	par_op	*po, *p;
+	int	i, conn, rc;
+
+	po = ber_memcalloc( 1, sizeof( par_op ) );
+	if ( po == NULL ) {
+		return LDAP_NO_MEMORY;
+	}
+	po->po_lineno = lineno;
+	if ( lr->lr_dn.bv_val != NULL ) {
+		po->po_entry = ber_strdup( lr->lr_dn.bv_val );
+		po->po_dn = par_dn( lr->lr_dn.bv_val );
+	}
+
+	if ( lr->lr_op == LDAP_REQ_RENAME && po->po_dn != NULL &&
+		lr->lrop_newrdn.bv_val != NULL )
+	{
+		const char	*sup = lr->lrop_newsup.bv_val;
+		char		*newdn;
+
+		if ( sup == NULL ) {
+			/* same superior */
+			for ( sup = po->po_dn; *sup; sup++ ) {
+				if ( *sup == '\\' && sup[1] ) {
+					sup++;
+				} else if ( *sup == ',' ) {
+					sup++;
+					break;
+				}
+			}
+		}
+
+		newdn = ber_memalloc( lr->lrop_newrdn.bv_len + strlen( sup ) + 2 );
+		if ( newdn != NULL ) {
+			sprintf( newdn, *sup ? "%s,%s" : "%s%s",
+				lr->lrop_newrdn.bv_val, sup );
+			po->po_newdn = par_dn( newdn );
+			ber_memfree( newdn );
+		}
+	}
+
+	for ( ;; ) {
+		conn = -1;
+		for ( p = par_ops; p != NULL; p = p->po_next ) {
+			if ( par_conflict( po, p ) ) {
+				break;
+			}
+		}
+		if ( p == NULL ) {
+			for ( i = 0; i < parallel; i++ ) {
+				if ( par_busy[i] < parallel_depth &&
+					( conn < 0 || par_busy[i] < par_busy[conn] ) )
+				{
+					conn = i;
+				}
+			}
+			if ( conn >= 0 ) {
+				break;
+			}
+		}
+
+		rc = par_wait();
+		if ( rc != LDAP_SUCCESS ) {
+			par_free( po );
+			return rc;
+		}
+	}
+
+	po->po_conn = conn;
+	ld = par_lds[conn];
+	par_new = po;
+	return LDAP_SUCCESS;
+}
+
+/* Deal with the result res that arrived on connection conn */
+static void
+par_done( int conn, LDAPMessage *res )
+{
+	par_op		*po, **prev;
+	char		*matched = NULL, *text = NULL;
+	int		rc, msgid = ldap_msgid( res );
+
+	for ( prev = &par_ops; *prev != NULL; prev = &(*prev)->po_next ) {
+		if ( (*prev)->po_conn == conn && (*prev)->po_msgid == msgid ) {
+			break;
+		}
+	}
+	po = *prev;
+	if ( po == NULL ) {
+		/* e.g. a notice of disconnection */
+		fprintf( stderr, _("%s: unexpected response (msgid %d)\n"),
+			prog, msgid );
+		if ( !par_err ) {
+			par_err = LDAP_OTHER;
+		}
+		ldap_msgfree( res );
+		return;
+	}
+	*prev = po->po_next;
+	par_busy[conn]--;
+
+	rc = parse_response( par_lds[conn], res, po->po_op,
+		po->po_entry ? po->po_entry : "", &matched, &text );
+
+	if ( rc != LDAP_SUCCESS ) {
+		if ( rejfp && po->po_rejbuf ) {
+			reject( rc, po->po_lineno, matched, text, po->po_rejbuf );
+		}
+		par_err = rc;
+	}
+
+	if ( text ) ldap_memfree( text );
+	if ( matched ) ldap_memfree( matched );
+	par_free( po );
+}
+
+/*
+ * Collect the results that have arrived, waiting for at least one.
+ * Fails if a connection is lost or on an interrupt.
+ */
+static int
+par_wait( void )
+{
+	LDAPMessage	*res;
+	struct timeval	tv;
+	par_op		*po;
+	int		i, rc, n = 0;
+
+	for ( ;; ) {
+		for ( i = 0; i < parallel; i++ ) {
+			tv.tv_sec = 0;
+			tv.tv_usec = 0;
+			while (( rc = ldap_result( par_lds[i], LDAP_RES_ANY,
+				LDAP_MSG_ALL, &tv, &res )) > 0 )
+			{
+				par_done( i, res );
+				n++;
+			}
+
+			if ( rc == -1 ) {
+				ldap_get_option( par_lds[i], LDAP_OPT_RESULT_CODE, &rc );
+				tool_perror( "ldap_result", rc, NULL, NULL, NULL, NULL );
+				if ( !par_err ) {
+					par_err = rc;
+				}
+				return rc;
+			}
+		}
+		if ( n ) {
+			return LDAP_SUCCESS;
+		}
+
+		for ( po = par_ops; po != NULL; po = po->po_next ) {
+			if ( tool_check_abandon( par_lds[po->po_conn], po->po_msgid ) ) {
+				return LDAP_CANCELLED;
+			}
+		}
+
+		tv.tv_sec = 0;
+		tv.tv_usec = 100000;
+		tool_wait_any( par_lds, parallel, &tv );
+	}
+}
@@ -159,6 +159,9 @@ usage( void )
 	fprintf( stderr, _("             [!]<oid>[=:<value>|::<b64value>] (generic control; no response handling)\n"));
 	fprintf( stderr, _("  -f file    read operations from `file'\n"));
 	fprintf( stderr, _("  -F prefix  URL prefix for files (default: %s)\n"), def_urlpre);
+	fprintf( stderr, _("  -J n[,depth] split a subtree search over n connections, with up to\n"
+		"             depth searches outstanding on each (default: %d)\n"),
+		TOOL_PARALLEL_DEPTH );
 	fprintf( stderr, _("  -l limit   time limit (in seconds, or \"none\" or \"max\") for search\n"));
 	fprintf( stderr, _("  -L         print responses in LDIFv1 format\n"));
 	fprintf( stderr, _("  -LL        print responses in LDIF format without comments\n"));
@@ -215,6 +218,19 @@ static int dosearch LDAP_P((
 	struct timeval *timeout,
 	int	sizelimit ));
 
+static int par_search LDAP_P((
+	LDAP	*ld,
+	char	*base,
+	int		scope,
+	char	*filter,
+	char	**attrs,
+	int		attrsonly,
+	struct timeval *timeout,
+	int	sizelimit ));
+
+/* connections of a partitioned search (-J) */
+static LDAP **par_lds = NULL;
+
 static char *tmpdir = NULL;
 static char *urlpre = NULL;
 static char	*base = NULL;
@@ -363,7 +379,7 @@ parse_vlv(char *cvalue)
 }
 
 const char options[] = "a:Ab:cE:F:l:Ls:S:tT:uz:"
-	"Cd:D:e:f:H:IMnNO:o:P:QR:U:vVw:WxX:y:Y:Z";
+	"Cd:D:e:f:H:IJ:MnNO:o:P:QR:U:vVw:WxX:y:Y:Z";
 
 int
 handle_private_option( int i )
@@ -1038,6 +1054,12 @@ main( int argc, char **argv )
 		return EXIT_FAILURE;
 	}
 
+	if ( parallel > 1 && ( sortattr || sss || vlv || ldapsync || psearch ) ) {
+		fprintf( stderr,
+			_("-J is incompatible with sorting, VLV, sync and persistent search\n" ));
+		return EXIT_FAILURE;
+	}
+
 	if (( argc - optind < 1 ) ||
 		( *argv[optind] != '(' /*')'*/ &&
 		( strchr( argv[optind], '=' ) == NULL ) ) )
@@ -1108,6 +1130,21 @@ main( int argc, char **argv )
 
 	tool_bind( ld );
 
+	if ( parallel > 1 && !dont &&
+		( scope == LDAP_SCOPE_SUBTREE || scope == LDAP_SCOPE_SUBORDINATE ) )
+	{
+		par_lds = calloc( parallel, sizeof( LDAP * ) );
+		if ( par_lds == NULL ) {
+			perror( "calloc" );
+			tool_exit( ld, EXIT_FAILURE );
+		}
+		par_lds[0] = ld;
+		for ( i = 1; i < parallel; i++ ) {
+			par_lds[i] = tool_conn_setup( 0, &private_conn_setup );
+			tool_bind( par_lds[i] );
+		}
+	}
+
 getNextPage:
 	/* fp may have been closed, need to reopen if code jumps
 	 * back here to getNextPage.
@@ -1275,7 +1312,8 @@ getNextPage:
 			i++;
 		}
 
-		if ( pagedResults ) {
+		/* partitioned searches page on their own */
+		if ( pagedResults && par_lds == NULL ) {
 			if ( ctrl_add() ) {
 				tool_exit( ld, EXIT_FAILURE );
 			}
@@ -1437,6 +1475,13 @@ getNextPage:
 	}
 
 	tool_server_controls( ld, c, i );
+	if ( par_lds != NULL ) {
+		int	n;
+
+		for ( n = 1; n < parallel; n++ ) {
+			tool_server_controls( par_lds[n], c, i );
+		}
+	}
 
 	/* free any controls we added */
 	for ( ; nctrls-- > save_nctrls; ) {
@@ -1669,6 +1714,13 @@ getNextPage:
 		c = NULL;
 	}
 
+	if ( par_lds != NULL ) {
+		for ( i = 1; i < parallel; i++ ) {
+			tool_unbind( par_lds[i] );
+		}
+		free( par_lds );
+	}
+
 	tool_exit( ld, rc );
 }
 
@@ -1742,6 +1794,15 @@ static int dosearch(
 		tv_timelimitp = &tv_timelimit;
 	}
 
+	if ( par_lds != NULL ) {
+		rc = par_search( ld, base, scope, filter, attrs, attrsonly,
+			tv_timelimitp, sizelimit );
+		if ( filtpatt != NULL ) {
+			free( filter );
+		}
+		return rc;
+	}
+
 again:
 	rc = ldap_search_ext( ld, base, scope, filter, attrs, attrsonly,
 		sctrls, cctrls, tv_timelimitp, sizelimit, &msgid );
@@ -1926,6 +1987,478 @@ done:
 	return( rc2 );
 }
 
+/*
+ * A partitioned search (-J) runs a subtree search as separate searches
+ * of the base entry and of the subtree of each entry immediately below
+ * it, spread over several connections. Entries are printed as they
+ * arrive, so their order differs from that of a single search. With
+ * paged results each of the searches is paged on its own.
+ */
+typedef struct par_part {
+	struct par_part	*pp_next;
+	char		*pp_base;
+	int		pp_scope;
+	int		pp_conn;
+	int		pp_msgid;
+	int		pp_subs;	/* hasSubordinates, -1 if unknown */
+	int		pp_listed;	/* found by par_list() */
+	struct berval	pp_cookie;
+} par_part;
+
+static void
+par_part_free( par_part *pp )
+{
+	ldap_memfree( pp->pp_base );
+	ber_memfree( pp->pp_cookie.bv_val );
+	free( pp );
+}
+
+static par_part *
+par_part_new( const char *dn, int scope )
+{
+	par_part	*pp;
+
+	pp = calloc( 1, sizeof( par_part ) );
+	if ( pp == NULL ) {
+		return NULL;
+	}
+	pp->pp_base = ber_strdup( dn );
+	pp->pp_scope = scope;
+	pp->pp_msgid = -1;
+	pp->pp_subs = -1;
+	if ( pp->pp_base == NULL ) {
+		free( pp );
+		return NULL;
+	}
+	return pp;
+}
+
+/*
+ * List the entries immediately below base as partitions at *tailp.
+ * The listing is made with the same server controls as the searches,
+ * so that it finds the entries they would. Anything short of a complete
+ * listing is returned as an error, that includes continuation
+ * references: what is below them cannot be split.
+ */
+static int
+par_list( LDAP *ld, char *base, struct timeval *timeout,
+	par_part ***tailp )
+{
+	LDAPMessage	*res;
+	char		*attrs[] = { "hasSubordinates", NULL };
+	int		rc, err = LDAP_OTHER, msgid;
+
+	rc = ldap_search_ext( ld, base, LDAP_SCOPE_ONELEVEL, NULL, attrs, 0,
+		NULL, NULL, timeout, LDAP_NO_LIMIT, &msgid );
+	if ( rc != LDAP_SUCCESS ) {
+		return rc;
+	}
+
+	while (( rc = ldap_result( ld, msgid, LDAP_MSG_ONE, NULL, &res )) > 0 ) {
+		struct berval	dn, **vals;
+		par_part	*pp;
+
+		switch ( rc ) {
+		case LDAP_RES_SEARCH_ENTRY:
+			if ( ldap_get_dn_ber( ld, res, NULL, &dn ) != LDAP_SUCCESS ||
+				( pp = par_part_new( dn.bv_val, LDAP_SCOPE_SUBTREE )) == NULL )
+			{
+				ldap_msgfree( res );
+				ldap_abandon_ext( ld, msgid, NULL, NULL );
+				return LDAP_NO_MEMORY;
+			}
+			pp->pp_listed = 1;
+			vals = ldap_get_values_len( ld, res, "hasSubordinates" );
+			if ( vals != NULL && vals[0] != NULL ) {
+				pp->pp_subs = strcasecmp( vals[0]->bv_val, "FALSE" ) != 0;
+			}
+			ldap_value_free_len( vals );
+			**tailp = pp;
+			*tailp = &pp->pp_next;
+			break;
+
+		case LDAP_RES_SEARCH_REFERENCE:
+			ldap_msgfree( res );
+			ldap_abandon_ext( ld, msgid, NULL, NULL );
+			return LDAP_REFERRAL;
+
+		case LDAP_RES_SEARCH_RESULT:
+			rc = ldap_parse_result( ld, res, &err, NULL, NULL, NULL, NULL, 1 );
+			return rc == LDAP_SUCCESS ? err : rc;
+		}
+		ldap_msgfree( res );
+	}
+
+	/* no final result, the list may be short of some entries */
+	ldap_get_option( ld, LDAP_OPT_RESULT_CODE, &err );
+	return err != LDAP_SUCCESS ? err : LDAP_OTHER;
+}
+
+static int
+par_send( par_part *pp, char *filter, char **attrs, int attrsonly,
+	struct timeval *timeout, int sizelimit )
+{
+	LDAP		*ld = par_lds[pp->pp_conn];
+	LDAPControl	**defctrls = NULL, **ctrls, *pctrl = NULL;
+	int		rc, i, n = 0;
+
+	ldap_get_option( ld, LDAP_OPT_SERVER_CONTROLS, &defctrls );
+	for ( ; defctrls && defctrls[n]; n++ )
+		/* count */ ;
+	ctrls = calloc( n + 2, sizeof( LDAPControl * ) );
+	if ( ctrls == NULL ) {
+		ldap_controls_free( defctrls );
+		return LDAP_NO_MEMORY;
+	}
+	for ( i = 0, n = 0; defctrls && defctrls[i]; i++ ) {
+		/* the assertion is about the base of the whole search */
+		if ( pp->pp_listed &&
+			strcmp( defctrls[i]->ldctl_oid, LDAP_CONTROL_ASSERT ) == 0 )
+		{
+			continue;
+		}
+		ctrls[n++] = defctrls[i];
+	}
+
+	if ( pagedResults ) {
+		rc = ldap_create_page_control( ld, pageSize, &pp->pp_cookie,
+			pagedResults > 1, &pctrl );
+		if ( rc != LDAP_SUCCESS ) {
+			ldap_controls_free( defctrls );
+			free( ctrls );
+			return rc;
+		}
+		ctrls[n] = pctrl;
+	}
+
+	rc = ldap_search_ext( ld, pp->pp_base, pp->pp_scope, filter, attrs,
+		attrsonly, ctrls, NULL, timeout, sizelimit, &pp->pp_msgid );
+
+	if ( pctrl != NULL ) {
+		ldap_control_free( pctrl );
+	}
+	ldap_controls_free( defctrls );
+	free( ctrls );
+	if ( rc != LDAP_SUCCESS ) {
+		tool_perror( "ldap_search_ext", rc, NULL, NULL, NULL, NULL );
+	}
+	return rc;
+}
+
+/*
+ * Deal with the result msg of partition pp. Returns 0 when pp is done,
+ * 1 when the next page was requested, or the error to report.
+ */
+static int
+par_result( par_part *pp, LDAPMessage *msg, char *filter, char **attrs,
+	int attrsonly, struct timeval *timeout, int sizelimit )
+{
+	LDAP		*ld = par_lds[pp->pp_conn];
+	LDAPControl	**ctrls = NULL, *ctrl;
+	int		rc, err;
+
+	rc = ldap_parse_result( ld, msg, &err, NULL, NULL, NULL, &ctrls, 0 );
+	if ( rc != LDAP_SUCCESS ) {
+		return rc;
+	}
+
+	if ( err == LDAP_SUCCESS && pagedResults &&
+		( ctrl = ldap_control_find( LDAP_CONTROL_PAGEDRESULTS, ctrls, NULL ))
+			!= NULL )
+	{
+		ber_int_t	estimate;
+
+		ber_memfree( pp->pp_cookie.bv_val );
+		BER_BVZERO( &pp->pp_cookie );
+		rc = ldap_parse_pageresponse_control( ld, ctrl, &estimate,
+			&pp->pp_cookie );
+		if ( rc == LDAP_SUCCESS && !BER_BVISEMPTY( &pp->pp_cookie ) ) {
+			ldap_controls_free( ctrls );
+			rc = par_send( pp, filter, attrs, attrsonly, timeout, sizelimit );
+			return rc == LDAP_SUCCESS ? 1 : rc;
+		}
+	}
+	ldap_controls_free( ctrls );
+
+	/* an entry may have been removed since it was listed */
+	if ( err == LDAP_NO_SUCH_OBJECT && pp->pp_listed ) {
+		err = LDAP_SUCCESS;
+	}
+	return err;
+}
+
+static int
+par_search(
+	LDAP	*ld,
+	char	*base,
+	int		scope,
+	char	*filter,
+	char	**attrs,
+	int		attrsonly,
+	struct timeval *timeout,
+	int sizelimit )
+{
+	par_part	*parts = NULL, **tail = &parts, *pp, *next,
+			*running = NULL;
+	LDAPMessage	*msg;
+	char		*defbase = NULL;
+	struct timeval	tv;
+	int		*busy, i, rc, rc2 = LDAP_SUCCESS,
+			nresponses = 0, nentries = 0, nreferences = 0,
+			nextended = 0, npartial = 0, printed = 0, stop = 0;
+
+	busy = calloc( parallel, sizeof( int ) );
+	if ( busy == NULL ) {
+		return LDAP_NO_MEMORY;
+	}
+
+	if ( base == NULL ) {
+		ldap_get_option( ld, LDAP_OPT_DEFBASE, &defbase );
+		base = defbase ? defbase : "";
+	}
+
+	if ( scope == LDAP_SCOPE_SUBTREE ) {
+		parts = par_part_new( base, LDAP_SCOPE_BASE );
+		if ( parts == NULL ) {
+			free( busy );
+			ldap_memfree( defbase );
+			return LDAP_NO_MEMORY;
+		}
+		tail = &parts->pp_next;
+	}
+
+	rc = par_list( ld, base, timeout, &tail );
+	if ( rc != LDAP_SUCCESS ) {
+		/* search the whole scope at once instead */
+		if ( verbose ) {
+			fprintf( stderr, _("listing below base failed (%d), "
+				"not partitioning the search\n"), rc );
+		}
+		for ( pp = parts; pp != NULL; pp = next ) {
+			next = pp->pp_next;
+			par_part_free( pp );
+		}
+		parts = par_part_new( base, scope );
+		if ( parts == NULL ) {
+			free( busy );
+			ldap_memfree( defbase );
+			return LDAP_NO_MEMORY;
+		}
+	}
+
+	/*
+	 * When the server tells which entries have subordinates, a single
+	 * one level search covers the entries below base and only the
+	 * subordinates of the others need searches of their own.
+	 */
+	for ( pp = parts; pp != NULL; pp = pp->pp_next ) {
+		if ( pp->pp_scope == LDAP_SCOPE_SUBTREE && pp->pp_subs < 0 ) {
+			break;
+		}
+	}
+	if ( rc == LDAP_SUCCESS && pp == NULL ) {
+		for ( tail = &parts; *tail != NULL; ) {
+			pp = *tail;
+			if ( pp->pp_scope != LDAP_SCOPE_SUBTREE ) {
+				tail = &pp->pp_next;
+			} else if ( pp->pp_subs ) {
+				pp->pp_scope = LDAP_SCOPE_SUBORDINATE;
+				tail = &pp->pp_next;
+			} else {
+				*tail = pp->pp_next;
+				par_part_free( pp );
+			}
+		}
+		pp = par_part_new( base, LDAP_SCOPE_ONELEVEL );
+		if ( pp == NULL ) {
+			rc2 = LDAP_NO_MEMORY;
+			stop = 1;
+		} else {
+			*tail = pp;
+		}
+	}
+
+	while ( !stop && ( parts != NULL || running != NULL ) ) {
+		int	n = 0;
+
+		/* start what fits */
+		while ( parts != NULL ) {
+			int	conn = -1;
+
+			for ( i = 0; i < parallel; i++ ) {
+				if ( busy[i] < parallel_depth &&
+					( conn < 0 || busy[i] < busy[conn] ) )
+				{
+					conn = i;
+				}
+			}
+			if ( conn < 0 ) {
+				break;
+			}
+
+			pp = parts;
+			parts = pp->pp_next;
+			pp->pp_conn = conn;
+			rc = par_send( pp, filter, attrs, attrsonly, timeout, sizelimit );
+			if ( rc != LDAP_SUCCESS ) {
+				par_part_free( pp );
+				rc2 = rc;
+				stop = !contoper;
+				break;
+			}
+			busy[conn]++;
+			pp->pp_next = running;
+			running = pp;
+		}
+
+		/* collect what has arrived */
+		for ( i = 0; !stop && i < parallel; i++ ) {
+			tv.tv_sec = 0;
+			tv.tv_usec = 0;
+			while ( !stop && ( rc = ldap_result( par_lds[i], LDAP_RES_ANY,
+				LDAP_MSG_ONE, &tv, &msg )) > 0 )
+			{
+				par_part	**prev;
+
+				n++;
+				switch ( rc ) {
+				case LDAP_RES_SEARCH_ENTRY:
+					if ( nresponses++ ) putchar( '\n' );
+					nentries++;
+					print_entry( par_lds[i], msg, attrsonly );
+					if ( sizelimit > 0 && nentries >= sizelimit ) {
+						rc2 = LDAP_SIZELIMIT_EXCEEDED;
+						stop = 1;
+					}
+					break;
+
+				case LDAP_RES_SEARCH_REFERENCE:
+					if ( nresponses++ ) putchar( '\n' );
+					nreferences++;
+					print_reference( par_lds[i], msg );
+					break;
+
+				case LDAP_RES_INTERMEDIATE:
+					if ( nresponses++ ) putchar( '\n' );
+					npartial++;
+					print_partial( par_lds[i], msg );
+					break;
+
+				case LDAP_RES_EXTENDED:
+					if ( nresponses++ ) putchar( '\n' );
+					nextended++;
+					print_extended( par_lds[i], msg );
+					if ( ldap_msgid( msg ) == 0 ) {
+						/* unsolicited extended operation */
+						rc2 = LDAP_OTHER;
+						stop = 1;
+					}
+					break;
+
+				case LDAP_RES_SEARCH_RESULT:
+					for ( prev = &running; *prev != NULL;
+						prev = &(*prev)->pp_next )
+					{
+						if ( (*prev)->pp_conn == i &&
+							(*prev)->pp_msgid == ldap_msgid( msg ) )
+						{
+							break;
+						}
+					}
+					pp = *prev;
+					if ( pp == NULL ) {
+						break;
+					}
+
+					rc = par_result( pp, msg, filter, attrs, attrsonly,
+						timeout, sizelimit );
+					if ( rc == 1 ) {
+						/* next page requested */
+						break;
+					}
+
+					*prev = pp->pp_next;
+					busy[i]--;
+					if ( rc != LDAP_SUCCESS ) {
+						if ( nresponses++ ) putchar( '\n' );
+						print_result( par_lds[i], msg, 1 );
+						printed = 1;
+						rc2 = rc;
+						stop = !contoper;
+					}
+					par_part_free( pp );
+					break;
+				}
+				ldap_msgfree( msg );
+			}
+
+			if ( rc == -1 ) {
+				ldap_get_option( par_lds[i], LDAP_OPT_RESULT_CODE, &rc2 );
+				tool_perror( "ldap_result", rc2, NULL, NULL, NULL, NULL );
+				printed = 1;
+				stop = 1;
+			}
+		}
+		fflush( stdout );
+
+		if ( stop || n ) {
+			continue;
+		}
+
+		for ( pp = running; pp != NULL; pp = pp->pp_next ) {
+			if ( tool_check_abandon( par_lds[pp->pp_conn], pp->pp_msgid ) ) {
+				rc2 = -1;
+				printed = 1;
+				stop = 1;
+				break;
+			}
+		}
+		if ( !stop && running != NULL ) {
+			tv.tv_sec = 0;
+			tv.tv_usec = 100000;
+			tool_wait_any( par_lds, parallel, &tv );
+		}
+	}
+
+	for ( pp = running; pp != NULL; pp = next ) {
+		next = pp->pp_next;
+		ldap_abandon_ext( par_lds[pp->pp_conn], pp->pp_msgid, NULL, NULL );
+		par_part_free( pp );
+	}
+	for ( pp = parts; pp != NULL; pp = next ) {
+		next = pp->pp_next;
+		par_part_free( pp );
+	}
+	free( busy );
+	ldap_memfree( defbase );
+
+	/* one result for the whole search, unless reported already */
+	if ( !printed ) {
+		if ( nresponses++ ) putchar( '\n' );
+		if ( ldif < 2 ) {
+			printf( _("# search result\n") );
+		}
+		if ( !ldif ) {
+			printf( _("result: %d %s\n"), rc2, ldap_err2string( rc2 ) );
+		} else if ( rc2 != LDAP_SUCCESS ) {
+			fprintf( stderr, "%s (%d)\n", ldap_err2string( rc2 ), rc2 );
+		}
+	}
+
+	if ( ldif < 2 ) {
+		printf( _("\n# numResponses: %d\n"), nresponses );
+		if( nentries ) printf( _("# numEntries: %d\n"), nentries );
+		if( nextended ) printf( _("# numExtended: %d\n"), nextended );
+		if( npartial ) printf( _("# numPartial: %d\n"), npartial );
+		if( nreferences ) printf( _("# numReferences: %d\n"), nreferences );
+	}
+
+	/* there are no further pages to prompt for */
+	pr_morePagedResults = 0;
+
+	return rc2;
+}
+
 /* This is the proposed new way of doing things.
  * It is more efficient, but the API is non-standard.
  */
@@ -173,6 +173,8 @@ typedef struct sockbuf Sockbuf;
 
 typedef struct sockbuf_io Sockbuf_IO;
 
+struct berval;
+
 /* Structure for LBER IO operation descriptor */
 typedef struct sockbuf_io_desc {
 	int			sbiod_level;
@@ -431,6 +433,25 @@ LBER_F( int )
 ber_put_set LDAP_P((
 	BerElement *ber ));
 
+/* Constructed elements whose length is known up front: the header
+ * is written directly and the contents follow, no fixup is needed.
+ */
+LBER_F( int )
+ber_put_header LDAP_P((
+	BerElement *ber,
+	ber_tag_t tag,
+	ber_len_t len ));
+
+LBER_F( ber_len_t )
+ber_sizeof_header LDAP_P((
+	ber_tag_t tag,
+	ber_len_t len ));
+
+LBER_F( ber_len_t )
+ber_sizeof_int LDAP_P((
+	ber_int_t num,
+	ber_tag_t tag ));
+
 LBER_F( int )
 ber_printf LDAP_P((
 	BerElement *ber,
@@ -478,6 +499,13 @@ ber_flush2 LDAP_P((
 #define LBER_FLUSH_FREE_ON_ERROR	(0x2)
 #define LBER_FLUSH_FREE_ALWAYS		(LBER_FLUSH_FREE_ON_SUCCESS|LBER_FLUSH_FREE_ON_ERROR)
 
+LBER_F( int )
+ber_flushv LDAP_P((
+	Sockbuf *sb,
+	BerElement **bers,
+	int nbers,
+	int freeit ));
+
 LBER_F( int )
 ber_flush LDAP_P((
 	Sockbuf *sb,
@@ -586,6 +614,12 @@ ber_sockbuf_ctrl LDAP_P((
 	int opt,
 	void *arg ));
 
+LBER_F( ber_slen_t )
+ber_sockbuf_io_writev LDAP_P((
+	Sockbuf_IO_Desc *sbiod,
+	struct berval *bv,
+	int nbv ));
+
 LBER_V( Sockbuf_IO ) ber_sockbuf_io_tcp;
 LBER_V( Sockbuf_IO ) ber_sockbuf_io_readahead;
 LBER_V( Sockbuf_IO ) ber_sockbuf_io_fd;
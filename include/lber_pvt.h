@@ -78,6 +78,33 @@ ber_pvt_sb_grow_buffer LDAP_P(( Sockbuf_Buf *buf, ber_len_t minsize ));
 LBER_F( ber_len_t )
 ber_pvt_sb_copy_out LDAP_P(( Sockbuf_Buf *sbb, char *buf, ber_len_t len ));
 
+/*
+ * Vectored writes are not part of Sockbuf_IO, whose size is fixed by the
+ * ABI. A layer that has a handler hands it out from its sbi_ctrl, naming
+ * itself, so that replies forwarded from further down the stack are
+ * ignored by ber_sockbuf_io_writev().
+ */
+#define LBER_SB_OPT_GET_WRITEV	0x100
+
+typedef ber_slen_t (BER_SB_WRITEV_FN) LDAP_P(( Sockbuf_IO_Desc *sbiod,
+	struct berval *bv, int nbv ));
+
+typedef struct sockbuf_io_writev {
+	Sockbuf_IO_Desc		*sbw_sbiod;
+	BER_SB_WRITEV_FN	*sbw_writev;
+} Sockbuf_IO_Writev;
+
+#define LBER_SB_WRITEV_REPLY( sbiod, arg, fn ) \
+	( ((Sockbuf_IO_Writev *)(arg))->sbw_sbiod = (sbiod), \
+	  ((Sockbuf_IO_Writev *)(arg))->sbw_writev = (fn), 1 )
+
+#define LBER_SBIOD_WRITEV_NEXT( sbiod, bv, nbv ) \
+	( ber_sockbuf_io_writev( (sbiod)->sbiod_next, bv, nbv ) )
+
+LBER_F( ber_slen_t )
+ber_pvt_sb_coalesce_writev LDAP_P(( Sockbuf_IO_Desc *sbiod,
+	struct berval *bv, int nbv ));
+
 LBER_F( int )
 ber_pvt_socket_set_nonblock LDAP_P(( ber_socket_t sd, int nb ));
 
@@ -164,6 +164,9 @@ LDAP_BEGIN_DECL
 #define LDAP_OPT_X_TLS_PEERKEY_HASH	0x6019
 #define LDAP_OPT_X_TLS_REQUIRE_SAN	0x601a
 #define LDAP_OPT_X_TLS_PROTOCOL_MAX	0x601b
+#define LDAP_OPT_X_TLS_SESSION_CACHE	0x601c	/* OpenSSL only */
+#define LDAP_OPT_X_TLS_SESSION_LIFETIME	0x601d	/* OpenSSL only */
+#define LDAP_OPT_X_TLS_KTLS		0x601e	/* OpenSSL only */
 
 #define LDAP_OPT_X_TLS_NEVER	0
 #define LDAP_OPT_X_TLS_HARD		1
@@ -1865,6 +1868,22 @@ ldap_result LDAP_P((
 	struct timeval *timeout,
 	LDAPMessage **result ));
 
+/*
+ * Streamed search responses, the message is only valid until the
+ * callback returns. A non-zero return abandons the search.
+ */
+typedef int (LDAP_STREAM_PROC) LDAP_P((
+	LDAP *ld, LDAPMessage *msg, void *arg ));
+
+LDAP_F( int )
+ldap_result_stream LDAP_P((
+	LDAP *ld,
+	int msgid,
+	struct timeval *timeout,
+	LDAP_STREAM_PROC *proc,
+	void *arg,
+	LDAPMessage **result ));
+
 LDAP_F( int )
 ldap_msgtype LDAP_P((
 	LDAPMessage *lm ));
@@ -1883,6 +1902,39 @@ ldap_msgdelete LDAP_P((
 	int msgid ));
 
 
+/*
+ * in async.c:
+ */
+#define LDAP_ASYNC_WANT_READ	0x01	/* poll the descriptor for reading */
+#define LDAP_ASYNC_WANT_WRITE	0x02	/* poll the descriptor for writing */
+#define LDAP_ASYNC_CONNECTING	0x04	/* connection not usable yet */
+
+/*
+ * Completion callback, result is freed once it returns. It is NULL if
+ * the operation failed without a response, see LDAP_OPT_RESULT_CODE.
+ */
+typedef void (LDAP_ASYNC_PROC) LDAP_P((
+	LDAP *ld, int msgid, LDAPMessage *result, void *arg ));
+
+LDAP_F( int )
+ldap_async_register LDAP_P((
+	LDAP *ld,
+	int msgid,
+	LDAP_STREAM_PROC *proc,
+	LDAP_ASYNC_PROC *done,
+	void *arg ));
+
+LDAP_F( int )
+ldap_async_cancel LDAP_P((
+	LDAP *ld,
+	int msgid ));
+
+LDAP_F( int )
+ldap_async_process LDAP_P((
+	LDAP *ld,
+	int *want ));
+
+
 /*
  * in search.c:
  */
@@ -2343,6 +2395,39 @@ ldap_whoami_s LDAP_P((
 	LDAPControl **sctrls,
 	LDAPControl **cctrls ));
 
+/*
+ * LDAP connection pool
+ *	in pool.c
+ */
+typedef struct ldap_pool LDAPPool;
+
+LDAP_F( int )
+ldap_pool_initialize LDAP_P((
+	LDAPPool **poolp,
+	LDAP_CONST char *uris,
+	int size,
+	int check_interval ));
+
+LDAP_F( int )
+ldap_pool_bind_s LDAP_P((
+	LDAPPool *pool,
+	LDAP_CONST char *dn,
+	LDAP_CONST char *mechanism,
+	struct berval *cred ));
+
+LDAP_F( LDAP * )
+ldap_pool_get LDAP_P((
+	LDAPPool *pool ));
+
+LDAP_F( int )
+ldap_pool_put LDAP_P((
+	LDAPPool *pool,
+	LDAP *ld ));
+
+LDAP_F( int )
+ldap_pool_destroy LDAP_P((
+	LDAPPool *pool ));
+
 /*
  * LDAP Password Modify
  *	in passwd.c
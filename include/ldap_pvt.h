@@ -337,6 +337,7 @@ struct sb_sasl_generic_data {
 	Sockbuf_Buf				buf_out;
 	unsigned int				flags;
 #define LDAP_PVT_SASL_PARTIAL_WRITE	1
+	ber_len_t				partial_len;
 };
  
 #ifndef LDAP_PVT_SASL_LOCAL_SSF
@@ -341,6 +341,68 @@ ber_put_boolean(
 }
 
 
+/* Number of tag and length octets of an element with len content octets */
+ber_len_t
+ber_sizeof_header( ber_tag_t tag, ber_len_t len )
+{
+	ber_len_t size = 2;
+
+	while ( (tag >>= 8) != 0 ) {
+		size++;
+	}
+	if ( len >= 0x80 ) {
+		do {
+			size++;
+		} while ( (len >>= 8) != 0 );
+	}
+
+	return size;
+}
+
+/* Number of octets of the element ber_put_int() would write */
+ber_len_t
+ber_sizeof_int( ber_int_t num, ber_tag_t tag )
+{
+	ber_uint_t unum = num;
+	ber_len_t len = 1;
+
+	if ( tag == LBER_DEFAULT ) {
+		tag = LBER_INTEGER;
+	}
+	if ( num < 0 ) {
+		unum = ~unum;
+	}
+	while ( unum >= 0x80 ) {
+		unum >>= 8;
+		len++;
+	}
+
+	return ber_sizeof_header( tag, len ) + len;
+}
+
+/*
+ * Write the tag and length of a constructed element whose contents,
+ * len octets long, are written next.  Unlike ber_start_seq() the
+ * contents need not be moved when the element is complete.
+ */
+int
+ber_put_header(
+	BerElement *ber,
+	ber_tag_t tag,
+	ber_len_t len )
+{
+	unsigned char header[HEADER_SIZE], *ptr;
+
+	if ( len > MAXINT_BERSIZE ) {
+		return -1;
+	}
+
+	ptr = ber_prepend_len( &header[sizeof(header)], len );
+	ptr = ber_prepend_tag( ptr, tag );
+
+	return ber_write( ber, (char *) ptr, &header[sizeof(header)] - ptr, 0 );
+}
+
 /* Max number of length octets in a sequence or set, normally 5 */
 #define SOS_LENLEN (1 + (sizeof(ber_elem_size_t) > MAXINT_BERSIZE_OCTETS ? \
 		(ber_len_t) sizeof(ber_elem_size_t) : MAXINT_BERSIZE_OCTETS))
@@ -188,7 +188,8 @@ ber_free_buf( BerElement *ber )
 {
 	assert( LBER_VALID( ber ) );
 
-	if ( ber->ber_buf) ber_memfree_x( ber->ber_buf, ber->ber_memctx );
+	if ( ber->ber_buf && !( ber->ber_options & LBER_BUF_FOREIGN ))
+		ber_memfree_x( ber->ber_buf, ber->ber_memctx );
 
 	ber->ber_buf = NULL;
 	ber->ber_sos_ptr = NULL;
@@ -261,6 +262,84 @@ ber_flush2( Sockbuf *sb, BerElement *ber, int freeit )
 	return 0;
 }
 
+/*
+ * Write several encoded elements with as few calls down the Sockbuf
+ * stack as possible. As with ber_flush2, a failed call may be
+ * repeated with the same elements once the socket is writable again;
+ * the elements already written are skipped.
+ */
+#ifndef LBER_FLUSHV_MAX
+#define LBER_FLUSHV_MAX	64
+#endif
+
+int
+ber_flushv( Sockbuf *sb, BerElement **bers, int nbers, int freeit )
+{
+	struct berval	bv[LBER_FLUSHV_MAX];
+	ber_len_t	towrite;
+	ber_slen_t	rc;
+	int		i, n, first = 0;
+
+	assert( sb != NULL );
+	assert( bers != NULL );
+	assert( SOCKBUF_VALID( sb ) );
+
+	for ( i = 0; i < nbers; i++ ) {
+		BerElement *ber = bers[i];
+
+		assert( LBER_VALID( ber ) );
+
+		if ( ber->ber_rwptr == NULL ) {
+			ber->ber_rwptr = ber->ber_buf;
+		}
+		if ( sb->sb_debug ) {
+			towrite = ber->ber_ptr - ber->ber_rwptr;
+			ber_log_printf( LDAP_DEBUG_TRACE, sb->sb_debug,
+				"ber_flushv: %ld bytes to sd %ld%s\n",
+				towrite, (long) sb->sb_fd,
+				ber->ber_rwptr != ber->ber_buf ?  " (re-flush)" : "" );
+			ber_log_bprint( LDAP_DEBUG_BER, sb->sb_debug,
+				ber->ber_rwptr, towrite );
+		}
+	}
+
+	for ( ;; ) {
+		while ( first < nbers && bers[first]->ber_rwptr == bers[first]->ber_ptr ) {
+			first++;
+		}
+		if ( first == nbers ) break;
+
+		for ( i = first, n = 0; i < nbers && n < LBER_FLUSHV_MAX; i++ ) {
+			towrite = bers[i]->ber_ptr - bers[i]->ber_rwptr;
+			if ( towrite == 0 ) continue;
+			bv[n].bv_val = bers[i]->ber_rwptr;
+			bv[n].bv_len = towrite;
+			n++;
+		}
+
+		rc = ber_int_sb_writev( sb, bv, n );
+		if ( rc <= 0 ) {
+			if ( freeit & LBER_FLUSH_FREE_ON_ERROR ) {
+				for ( i = 0; i < nbers; i++ ) ber_free( bers[i], 1 );
+			}
+			return -1;
+		}
+
+		for ( i = first; rc > 0; i++ ) {
+			towrite = bers[i]->ber_ptr - bers[i]->ber_rwptr;
+			if ( towrite > (ber_len_t)rc ) towrite = rc;
+			bers[i]->ber_rwptr += towrite;
+			rc -= towrite;
+		}
+	}
+
+	if ( freeit & LBER_FLUSH_FREE_ON_SUCCESS ) {
+		for ( i = 0; i < nbers; i++ ) ber_free( bers[i], 1 );
+	}
+
+	return 0;
+}
+
 BerElement *
 ber_alloc_t( int options )
 {
@@ -515,6 +594,7 @@ ber_get_next(
 
 	if (ber->ber_rwptr == NULL) {
 		assert( ber->ber_buf == NULL );
+		ber->ber_options &= ~LBER_BUF_FOREIGN;
 		ber->ber_rwptr = (char *) &ber->ber_len-1;
 		ber->ber_ptr = ber->ber_rwptr;
 		ber->ber_tag = 0;
@@ -632,9 +712,26 @@ ber_get_next(
 				sock_errset(ERANGE);
 				return LBER_DEFAULT;
 			}
-			ber->ber_buf = (char *) ber_memalloc_x( ber->ber_len + 1, ber->ber_memctx );
-			if (ber->ber_buf==NULL) {
-				return LBER_DEFAULT;
+			if ( ber->ber_bufalloc != NULL ) {
+				char hbuf[LENSIZE*2];
+				struct berval head;
+
+				head.bv_val = hbuf;
+				head.bv_len = sblen + l;
+				AC_MEMCPY( hbuf, buf, sblen );
+				AC_MEMCPY( hbuf + sblen, ber->ber_ptr, l );
+				ber->ber_buf = ber->ber_bufalloc( ber->ber_len, &head,
+					ber->ber_bufarg );
+				if ( ber->ber_buf != NULL ) {
+					ber->ber_options |= LBER_BUF_FOREIGN;
+				}
+			}
+			if ( ber->ber_buf == NULL ) {
+				ber->ber_buf = (char *) ber_memalloc_x( ber->ber_len + 1,
+					ber->ber_memctx );
+				if ( ber->ber_buf == NULL ) {
+					return LBER_DEFAULT;
+				}
 			}
 			ber->ber_end = ber->ber_buf + ber->ber_len;
 			if (sblen) {
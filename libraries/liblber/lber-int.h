@@ -73,6 +73,17 @@ LBER_F( int ) ber_pvt_log_output(
 LBER_V (struct lber_options) ber_int_options;
 #define ber_int_debug ber_int_options.lbo_debug
 
+/* ber_buf was supplied by ber_bufalloc, ber_free() leaves it */
+#define LBER_BUF_FOREIGN	0x8000
+
+/*
+ * Asked by ber_get_next() for the buffer once the length of the contents
+ * is known, head holds the octets of the contents already read. Returns
+ * at least len + 1 octets, or NULL to have them allocated as usual.
+ */
+typedef void *(BER_BUFALLOC_FN) LDAP_P((
+	ber_len_t len, struct berval *head, void *arg ));
+
 /* Data encoded in ASN.1 BER format */
 struct berelement {
 	struct		lber_options ber_opts;
@@ -120,6 +131,9 @@ struct berelement {
 
 	char		*ber_rwptr;
 	void		*ber_memctx;
+
+	BER_BUFALLOC_FN	*ber_bufalloc;	/* see ber_get_next() */
+	void		*ber_bufarg;
 };
 #define LBER_VALID(ber)	((ber)->ber_valid==LBER_VALID_BERELEMENT)
 
@@ -220,6 +234,9 @@ ber_int_sb_read LDAP_P(( Sockbuf *sb, void *buf, ber_len_t len ));
 LBER_F( ber_slen_t )
 ber_int_sb_write LDAP_P(( Sockbuf *sb, void *buf, ber_len_t len ));
 
+LBER_F( ber_slen_t )
+ber_int_sb_writev LDAP_P(( Sockbuf *sb, struct berval *bv, int nbv ));
+
 LDAP_END_DECL
 
 #endif /* _LBER_INT_H */
@@ -34,6 +34,10 @@
 #include <fcntl.h>
 #endif
 
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif
+
 #if defined( HAVE_SYS_FILIO_H )
 #include <sys/filio.h>
 #elif defined( HAVE_SYS_IOCTL_H )
@@ -51,6 +55,13 @@
 #ifndef LBER_DEFAULT_READAHEAD
 #define LBER_DEFAULT_READAHEAD	16384
 #endif
+#ifndef LBER_IOV_MAX
+#define LBER_IOV_MAX			64
+#endif
+/* The largest TLS record payload */
+#ifndef LBER_COALESCE_SIZE
+#define LBER_COALESCE_SIZE		16384
+#endif
 
 Sockbuf *
 ber_sockbuf_alloc( void )
@@ -336,6 +347,74 @@ ber_pvt_sb_do_write( Sockbuf_IO_Desc *sbiod, Sockbuf_Buf *buf_out )
 	return ret;
 }
 
+/* Write the buffers through the given layer, falling back to one
+ * sbi_write per buffer for layers that have no vectored handler. Returns
+ * the number of bytes written, stopping at the first short write.
+ */
+ber_slen_t
+ber_sockbuf_io_writev( Sockbuf_IO_Desc *sbiod, struct berval *bv, int nbv )
+{
+	Sockbuf_IO_Writev	sbw = { NULL, NULL };
+	ber_slen_t		ret, total = 0;
+	int			i;
+
+	assert( sbiod != NULL );
+	assert( bv != NULL );
+
+	if ( sbiod->sbiod_io->sbi_ctrl &&
+		sbiod->sbiod_io->sbi_ctrl( sbiod, LBER_SB_OPT_GET_WRITEV, &sbw ) > 0 &&
+		sbw.sbw_sbiod == sbiod && sbw.sbw_writev != NULL )
+	{
+		return sbw.sbw_writev( sbiod, bv, nbv );
+	}
+
+	for ( i = 0; i < nbv; i++ ) {
+		if ( bv[i].bv_len == 0 ) continue;
+
+		ret = sbiod->sbiod_io->sbi_write( sbiod, bv[i].bv_val, bv[i].bv_len );
+		if ( ret < 0 ) {
+			/* Report the error on the next call */
+			return total ? total : ret;
+		}
+		total += ret;
+		if ( (ber_len_t)ret < bv[i].bv_len ) break;
+	}
+	return total;
+}
+
+/* For layers that frame their output: copy as many small buffers as
+ * fit into a single record and hand that to the layer's own sbi_write.
+ * The caller will retry with the same leading data after a transient
+ * error, as it would with sbi_write.
+ */
+ber_slen_t
+ber_pvt_sb_coalesce_writev( Sockbuf_IO_Desc *sbiod, struct berval *bv, int nbv )
+{
+	char			buf[LBER_COALESCE_SIZE];
+	ber_len_t		len = 0, n;
+	int			i;
+
+	assert( sbiod != NULL );
+	assert( bv != NULL );
+
+	for ( i = 0; i < nbv && bv[i].bv_len == 0; i++ )
+		/* EMPTY */ ;
+	if ( i == nbv ) return 0;
+
+	/* Large enough on its own, no point copying it */
+	if ( bv[i].bv_len >= sizeof( buf ) || i + 1 == nbv ) {
+		return sbiod->sbiod_io->sbi_write( sbiod, bv[i].bv_val, bv[i].bv_len );
+	}
+
+	for ( ; i < nbv && len < sizeof( buf ); i++ ) {
+		n = sizeof( buf ) - len;
+		if ( n > bv[i].bv_len ) n = bv[i].bv_len;
+		AC_MEMCPY( buf + len, bv[i].bv_val, n );
+		len += n;
+	}
+	return sbiod->sbiod_io->sbi_write( sbiod, buf, len );
+}
+
 int
 ber_pvt_socket_set_nonblock( ber_socket_t sd, int nb )
 {
@@ -453,6 +532,51 @@ ber_int_sb_write( Sockbuf *sb, void *buf, ber_len_t len )
 	return ret;
 }
 
+ber_slen_t
+ber_int_sb_writev( Sockbuf *sb, struct berval *bv, int nbv )
+{
+	ber_slen_t		ret;
+
+	assert( bv != NULL );
+	assert( sb != NULL);
+	assert( sb->sb_iod != NULL );
+	assert( SOCKBUF_VALID( sb ) );
+
+	for (;;) {
+		ret = ber_sockbuf_io_writev( sb->sb_iod, bv, nbv );
+
+#ifdef EINTR	
+		if ( ( ret < 0 ) && ( errno == EINTR ) ) continue;
+#endif
+		break;
+	}
+
+	return ret;
+}
+
+#if defined( HAVE_SYS_UIO_H ) && !defined( HAVE_WINSOCK )
+/* Also used for plain file descriptors */
+static ber_slen_t
+sb_stream_writev( Sockbuf_IO_Desc *sbiod, struct berval *bv, int nbv )
+{
+	struct iovec		iov[LBER_IOV_MAX];
+	int			i;
+
+	assert( sbiod != NULL);
+	assert( SOCKBUF_VALID( sbiod->sbiod_sb ) );
+
+	if ( nbv > LBER_IOV_MAX ) nbv = LBER_IOV_MAX;
+	for ( i = 0; i < nbv; i++ ) {
+		iov[i].iov_base = bv[i].bv_val;
+		iov[i].iov_len = bv[i].bv_len;
+	}
+	return writev( sbiod->sbiod_sb->sb_fd, iov, nbv );
+}
+#define SB_STREAM_WRITEV	sb_stream_writev
+#else
+#define SB_STREAM_WRITEV	NULL
+#endif
+
 /*
  * Support for TCP
  */
@@ -559,6 +683,9 @@ sb_stream_setup( Sockbuf_IO_Desc *sbiod, void *arg ) {
 
 static int
 sb_stream_ctrl( Sockbuf_IO_Desc *sbiod, int opt, void *arg ) {
+	if ( opt == LBER_SB_OPT_GET_WRITEV ) {
+		return LBER_SB_WRITEV_REPLY( sbiod, arg, SB_STREAM_WRITEV );
+	}
 	/* This is an end IO descriptor */
 	return 0;
 }
@@ -667,6 +794,15 @@ sb_rdahead_write( Sockbuf_IO_Desc *sbiod, void *buf, ber_len_t len )
 	return LBER_SBIOD_WRITE_NEXT( sbiod, buf, len );
 }
 
+static ber_slen_t
+sb_rdahead_writev( Sockbuf_IO_Desc *sbiod, struct berval *bv, int nbv )
+{
+	assert( sbiod != NULL );
+	assert( sbiod->sbiod_next != NULL );
+
+	return LBER_SBIOD_WRITEV_NEXT( sbiod, bv, nbv );
+}
+
 static int
 sb_rdahead_close( Sockbuf_IO_Desc *sbiod )
 {
@@ -695,6 +831,9 @@ sb_rdahead_ctrl( Sockbuf_IO_Desc *sbiod, int opt, void *arg )
 		}
 		return ( ber_pvt_sb_grow_buffer( p, *((int *)arg) ) ?
 			-1 : 1 );
+
+	} else if ( opt == LBER_SB_OPT_GET_WRITEV ) {
+		return LBER_SB_WRITEV_REPLY( sbiod, arg, sb_rdahead_writev );
 	}
 
 	return LBER_SBIOD_CTRL_NEXT( sbiod, opt, arg );
@@ -772,6 +911,9 @@ sb_fd_setup( Sockbuf_IO_Desc *sbiod, void *arg ) {
 
 static int
 sb_fd_ctrl( Sockbuf_IO_Desc *sbiod, int opt, void *arg ) {
+	if ( opt == LBER_SB_OPT_GET_WRITEV ) {
+		return LBER_SB_WRITEV_REPLY( sbiod, arg, SB_STREAM_WRITEV );
+	}
 	/* This is an end IO descriptor */
 	return 0;
 }
@@ -814,9 +956,15 @@ sb_debug_remove( Sockbuf_IO_Desc *sbiod )
 	return 0;
 }
 
+static ber_slen_t sb_debug_writev( Sockbuf_IO_Desc *sbiod,
+	struct berval *bv, int nbv );
+
 static int
 sb_debug_ctrl( Sockbuf_IO_Desc *sbiod, int opt, void *arg )
 {
+	if ( opt == LBER_SB_OPT_GET_WRITEV ) {
+		return LBER_SB_WRITEV_REPLY( sbiod, arg, sb_debug_writev );
+	}
 	return LBER_SBIOD_CTRL_NEXT( sbiod, opt, arg );
 }
 
@@ -872,6 +1020,41 @@ sb_debug_write( Sockbuf_IO_Desc *sbiod, void *buf, ber_len_t len )
 	return ret;
 }
 
+static ber_slen_t
+sb_debug_writev( Sockbuf_IO_Desc *sbiod, struct berval *bv, int nbv )
+{
+	ber_slen_t		ret, left;
+	ber_len_t		want = 0;
+	int			i;
+	char ebuf[128];
+
+	ret = LBER_SBIOD_WRITEV_NEXT( sbiod, bv, nbv );
+	if (sbiod->sbiod_sb->sb_debug & LDAP_DEBUG_PACKETS) {
+		int err = sock_errno();
+		for ( i = 0; i < nbv; i++ )
+			want += bv[i].bv_len;
+		if ( ret < 0 ) {
+			ber_log_printf( LDAP_DEBUG_PACKETS, sbiod->sbiod_sb->sb_debug,
+				"%swritev: want=%ld error=%s\n",
+				(char *)sbiod->sbiod_pvt, (long)want,
+				AC_STRERROR_R( err, ebuf, sizeof ebuf ) );
+		} else {
+			ber_log_printf( LDAP_DEBUG_PACKETS, sbiod->sbiod_sb->sb_debug,
+				"%swritev: want=%ld in %d, written=%ld\n",
+				(char *)sbiod->sbiod_pvt, (long)want, nbv, (long)ret );
+			for ( i = 0, left = ret; i < nbv && left > 0; i++ ) {
+				ber_len_t len = bv[i].bv_len < (ber_len_t)left ? bv[i].bv_len : left;
+				ber_log_bprint( LDAP_DEBUG_PACKETS, sbiod->sbiod_sb->sb_debug,
+					(const char *)bv[i].bv_val, len );
+				left -= len;
+			}
+		}
+		sock_errset(err);
+	}
+
+	return ret;
+}
+
 Sockbuf_IO ber_sockbuf_io_debug = {
 	sb_debug_setup,		/* sbi_setup */
 	sb_debug_remove,	/* sbi_remove */
@@ -0,0 +1,424 @@
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1998-2024 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/*
+ * Completion callbacks for applications running their own event loop.
+ * Operations are started as usual and registered here with callbacks;
+ * ldap_async_process() is called whenever the session's descriptor is
+ * ready, reads what has arrived without waiting and hands it to the
+ * callbacks. Connections opened with LDAP_OPT_CONNECT_ASYNC, including
+ * their TLS handshake, are moved on from there as well.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/stdlib.h>
+#include <ac/errno.h>
+#include <ac/socket.h>
+#include <ac/string.h>
+#include <ac/time.h>
+
+#include "ldap-int.h"
+
+static int
+ldap_async_cmp( const void *l, const void *r )
+{
+	const LDAPAsyncOp *left = l, *right = r;
+	return left->lao_msgid - right->lao_msgid;
+}
+
+/*
+ * Call proc for each search entry, reference and intermediate response
+ * and done with the final result of the operation msgid, from within
+ * ldap_async_process(). If proc returns non-zero the operation is
+ * abandoned. Registering LDAP_RES_UNSOLICITED passes each unsolicited
+ * notification to done until it is cancelled.
+ */
+int
+ldap_async_register(
+	LDAP *ld,
+	int msgid,
+	LDAP_STREAM_PROC *proc,
+	LDAP_ASYNC_PROC *done,
+	void *arg )
+{
+	LDAPAsyncOp	*op;
+	int		rc;
+
+	assert( ld != NULL );
+	assert( done != NULL );
+
+	Debug2( LDAP_DEBUG_TRACE, "ldap_async_register ld %p msgid %d\n",
+		(void *)ld, msgid );
+
+	if ( msgid < 0 ) {
+		return ld->ld_errno = LDAP_PARAM_ERROR;
+	}
+
+	op = LDAP_MALLOC( sizeof( LDAPAsyncOp ) );
+	if ( op == NULL ) {
+		return ld->ld_errno = LDAP_NO_MEMORY;
+	}
+	op->lao_msgid = msgid;
+	op->lao_proc = proc;
+	op->lao_done = done;
+	op->lao_arg = arg;
+	op->lao_err = LDAP_SUCCESS;
+
+	LDAP_MUTEX_LOCK( &ld->ld_res_mutex );
+	rc = ldap_tavl_insert( &ld->ld_async, op, ldap_async_cmp,
+		ldap_avl_dup_error );
+	LDAP_MUTEX_UNLOCK( &ld->ld_res_mutex );
+
+	if ( rc != 0 ) {
+		LDAP_FREE( op );
+		return ld->ld_errno = LDAP_ALREADY_EXISTS;
+	}
+	return LDAP_SUCCESS;
+}
+
+/*
+ * Forget the callbacks of msgid and abandon the operation, done is not
+ * called.
+ */
+int
+ldap_async_cancel( LDAP *ld, int msgid )
+{
+	LDAPAsyncOp	*op, needle;
+
+	assert( ld != NULL );
+
+	Debug2( LDAP_DEBUG_TRACE, "ldap_async_cancel ld %p msgid %d\n",
+		(void *)ld, msgid );
+
+	needle.lao_msgid = msgid;
+	LDAP_MUTEX_LOCK( &ld->ld_res_mutex );
+	op = ldap_tavl_delete( &ld->ld_async, &needle, ldap_async_cmp );
+	LDAP_MUTEX_UNLOCK( &ld->ld_res_mutex );
+
+	if ( op == NULL ) {
+		return ld->ld_errno = LDAP_NO_SUCH_OPERATION;
+	}
+	LDAP_FREE( op );
+
+	if ( msgid == LDAP_RES_UNSOLICITED ) {
+		return LDAP_SUCCESS;
+	}
+	return ldap_abandon_ext( ld, msgid, NULL, NULL );
+}
+
+/*
+ * Pass msgs, linked through lm_next, to their callbacks. The callbacks
+ * are looked up again for each message since a callback may cancel
+ * other operations or start new ones. Returns the number of operations
+ * completed.
+ */
+static int
+async_dispatch( LDAP *ld, LDAPMessage *msgs )
+{
+	LDAPMessage	*lm, *next;
+	LDAPAsyncOp	*op, needle, cur;
+	int		n = 0;
+
+	for ( lm = msgs; lm != NULL; lm = next ) {
+		next = lm->lm_next;
+		lm->lm_next = NULL;
+
+		needle.lao_msgid = lm->lm_msgid;
+		LDAP_MUTEX_LOCK( &ld->ld_res_mutex );
+		op = ldap_tavl_find( ld->ld_async, &needle, ldap_async_cmp );
+		if ( op != NULL ) {
+			cur = *op;
+			switch ( lm->lm_msgtype ) {
+			case LDAP_RES_SEARCH_ENTRY:
+			case LDAP_RES_SEARCH_REFERENCE:
+			case LDAP_RES_INTERMEDIATE:
+				break;
+
+			default:
+				if ( lm->lm_msgid != LDAP_RES_UNSOLICITED ) {
+					ldap_tavl_delete( &ld->ld_async, op, ldap_async_cmp );
+					LDAP_FREE( op );
+				}
+				op = NULL;
+				break;
+			}
+		} else {
+			cur.lao_done = NULL;
+		}
+		LDAP_MUTEX_UNLOCK( &ld->ld_res_mutex );
+
+		if ( cur.lao_done == NULL ) {
+			/* cancelled meanwhile */
+
+		} else if ( op == NULL ) {
+			cur.lao_done( ld, cur.lao_msgid, lm, cur.lao_arg );
+			if ( cur.lao_msgid != LDAP_RES_UNSOLICITED ) {
+				n++;
+			}
+
+		} else if ( cur.lao_proc != NULL &&
+			cur.lao_proc( ld, lm, cur.lao_arg ) )
+		{
+			LDAP_MUTEX_LOCK( &ld->ld_res_mutex );
+			op = ldap_tavl_delete( &ld->ld_async, &needle, ldap_async_cmp );
+			LDAP_MUTEX_UNLOCK( &ld->ld_res_mutex );
+			if ( op != NULL ) {
+				LDAP_FREE( op );
+				ldap_abandon_ext( ld, cur.lao_msgid, NULL, NULL );
+				ld->ld_errno = LDAP_USER_CANCELLED;
+				cur.lao_done( ld, cur.lao_msgid, NULL, cur.lao_arg );
+				n++;
+			}
+		}
+		ldap_msgfree( lm );
+	}
+	return n;
+}
+
+/*
+ * Mark the operations that have a request outstanding on lc, which just
+ * failed with ld_errno, or all of them if lc is NULL. Operations on the
+ * other connections carry on. The requests of the marked operations are
+ * dropped, none may be left pointing at lc once it is freed.
+ */
+/* protected by res_mutex and req_mutex */
+void
+ldap_int_async_conn_failed( LDAP *ld, LDAPConn *lc )
+{
+	LDAPAsyncOp	*op, needle;
+	LDAPRequest	*lr;
+	TAvlnode	*node;
+
+	LDAP_ASSERT_MUTEX_OWNER( &ld->ld_res_mutex );
+	LDAP_ASSERT_MUTEX_OWNER( &ld->ld_req_mutex );
+
+	if ( lc == NULL ) {
+		for ( node = ldap_tavl_end( ld->ld_async, TAVL_DIR_LEFT );
+			node != NULL;
+			node = ldap_tavl_next( node, TAVL_DIR_RIGHT ) )
+		{
+			op = node->avl_data;
+			if ( op->lao_err == LDAP_SUCCESS ) {
+				op->lao_err = ld->ld_errno;
+			}
+		}
+		return;
+	}
+
+	node = ldap_tavl_end( ld->ld_requests, TAVL_DIR_LEFT );
+	while ( node != NULL ) {
+		lr = node->avl_data;
+		node = ldap_tavl_next( node, TAVL_DIR_RIGHT );
+		if ( lr->lr_conn != lc ) {
+			continue;
+		}
+		/* referrals being chased count against the original operation */
+		needle.lao_msgid = lr->lr_origid;
+		op = ldap_tavl_find( ld->ld_async, &needle, ldap_async_cmp );
+		if ( op == NULL ) {
+			continue;
+		}
+		if ( op->lao_err == LDAP_SUCCESS ) {
+			op->lao_err = ld->ld_errno;
+		}
+
+		/* this takes the whole tree of requests, start over */
+		while ( lr->lr_parent != NULL ) {
+			lr = lr->lr_parent;
+		}
+		ldap_free_request( ld, lr );
+		node = ldap_tavl_end( ld->ld_requests, TAVL_DIR_LEFT );
+	}
+}
+
+/*
+ * Complete the operations marked by ldap_int_async_conn_failed(), their
+ * error is passed on to the completion callbacks in ld_errno.
+ */
+static int
+async_fail( LDAP *ld )
+{
+	LDAPAsyncOp	*op;
+	TAvlnode	*node;
+	int		err = ld->ld_errno, n = 0;
+
+	for ( ;; ) {
+		LDAP_MUTEX_LOCK( &ld->ld_res_mutex );
+		op = NULL;
+		for ( node = ldap_tavl_end( ld->ld_async, TAVL_DIR_LEFT );
+			node != NULL;
+			node = ldap_tavl_next( node, TAVL_DIR_RIGHT ) )
+		{
+			op = node->avl_data;
+			if ( op->lao_msgid != LDAP_RES_UNSOLICITED &&
+				op->lao_err != LDAP_SUCCESS )
+			{
+				ldap_tavl_delete( &ld->ld_async, op, ldap_async_cmp );
+				break;
+			}
+			op = NULL;
+		}
+		LDAP_MUTEX_UNLOCK( &ld->ld_res_mutex );
+
+		if ( op == NULL ) {
+			break;
+		}
+		ld->ld_errno = op->lao_err;
+		op->lao_done( ld, op->lao_msgid, NULL, op->lao_arg );
+		LDAP_FREE( op );
+		n++;
+	}
+	ld->ld_errno = err;
+	return n;
+}
+
+/*
+ * Do whatever can be done without waiting: move connections being opened
+ * on, finish writing a request and read the responses that have arrived,
+ * then call their callbacks. Callbacks are called without any lock held
+ * and may start or cancel operations. *want is set to the events the
+ * application should wait for on the descriptor before calling again,
+ * LDAP_ASYNC_CONNECTING is set in it while the connection is not ready
+ * for operations. Returns the number of operations completed, or -1 if
+ * a connection failed, after calling the completion callbacks of the
+ * operations that were using it.
+ */
+int
+ldap_async_process( LDAP *ld, int *want )
+{
+	LDAPMessage	*lm, *head = NULL, **tail = &head;
+	LDAPConn	*lc;
+	TAvlnode	*node;
+	int		nconns = 0, wr = 0, rc = 0, n;
+
+	assert( ld != NULL );
+	assert( want != NULL );
+
+	Debug1( LDAP_DEBUG_TRACE, "ldap_async_process ld %p\n", (void *)ld );
+
+	*want = 0;
+#ifdef LDAP_CONNECTIONLESS
+	if ( LDAP_IS_UDP( ld ) ) {
+		ld->ld_errno = LDAP_NOT_SUPPORTED;
+		return -1;
+	}
+#endif
+
+	LDAP_MUTEX_LOCK( &ld->ld_res_mutex );
+	LDAP_MUTEX_LOCK( &ld->ld_conn_mutex );
+	for ( lc = ld->ld_conns; lc != NULL; lc = lc->lconn_next ) {
+		if ( lc->lconn_status == LDAP_CONNST_CONNECTING ) {
+			int w;
+
+			switch ( ldap_int_async_open_step( ld, lc, &w ) ) {
+			case 0:
+				break;
+
+			case -2:
+				*want |= LDAP_ASYNC_CONNECTING |
+					( w ? LDAP_ASYNC_WANT_WRITE : LDAP_ASYNC_WANT_READ );
+				continue;
+
+			default:
+				LDAP_MUTEX_LOCK( &ld->ld_req_mutex );
+				ldap_int_async_conn_failed( ld, lc );
+				LDAP_MUTEX_UNLOCK( &ld->ld_req_mutex );
+				rc = -1;
+				continue;
+			}
+		}
+
+		if ( lc->lconn_status != LDAP_CONNST_CONNECTED ) {
+			continue;
+		}
+		nconns++;
+
+		/* reads must not block the application's loop */
+		if ( !lc->lconn_nonblock ) {
+			ber_sockbuf_ctrl( lc->lconn_sb, LBER_SB_OPT_SET_NONBLOCK,
+				(void *)1 );
+			lc->lconn_nonblock = 1;
+		}
+	}
+	LDAP_MUTEX_UNLOCK( &ld->ld_conn_mutex );
+
+	if ( ldap_int_read_ready( ld, &wr ) < 0 ) {
+		rc = -1;
+	}
+
+	/*
+	 * Leave the sockets as the rest of libldap expects them, callbacks
+	 * and the application may use the synchronous calls in between.
+	 */
+	LDAP_MUTEX_LOCK( &ld->ld_conn_mutex );
+	for ( lc = ld->ld_conns; lc != NULL; lc = lc->lconn_next ) {
+		if ( lc->lconn_nonblock ) {
+			ber_sockbuf_ctrl( lc->lconn_sb, LBER_SB_OPT_SET_NONBLOCK,
+				NULL );
+			lc->lconn_nonblock = 0;
+		}
+	}
+	LDAP_MUTEX_UNLOCK( &ld->ld_conn_mutex );
+	if ( wr ) {
+		*want |= LDAP_ASYNC_WANT_WRITE;
+	}
+	if ( nconns ) {
+		*want |= LDAP_ASYNC_WANT_READ;
+	}
+
+	/*
+	 * Collect what has been queued for registered operations. Synchronous
+	 * calls made from the callbacks can queue more of it, which the
+	 * descriptor will not tell the application about.
+	 */
+	for ( n = 0;; ) {
+		for ( node = ldap_tavl_end( ld->ld_async, TAVL_DIR_LEFT );
+			node != NULL;
+			node = ldap_tavl_next( node, TAVL_DIR_RIGHT ) )
+		{
+			LDAPAsyncOp *op = node->avl_data;
+
+			while ( ( lm = ldap_int_next_response( ld, op->lao_msgid ) ) != NULL ) {
+				*tail = lm;
+				tail = &lm->lm_next;
+			}
+		}
+		LDAP_MUTEX_UNLOCK( &ld->ld_res_mutex );
+
+		if ( head == NULL ) {
+			break;
+		}
+		n += async_dispatch( ld, head );
+		head = NULL;
+		tail = &head;
+		LDAP_MUTEX_LOCK( &ld->ld_res_mutex );
+	}
+
+	if ( rc < 0 ) {
+		async_fail( ld );
+		return -1;
+	}
+	return n;
+}
+
+/* protected by res_mutex */
+void
+ldap_int_async_free( LDAP *ld )
+{
+	ldap_tavl_free( ld->ld_async, ldap_memfree );
+	ld->ld_async = NULL;
+}
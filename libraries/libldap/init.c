@@ -135,6 +135,9 @@ static const struct ol_attribute {
 
 #ifdef HAVE_OPENSSL
 	{0, ATTR_TLS,	"TLS_CRLCHECK",		NULL,	LDAP_OPT_X_TLS_CRLCHECK},
+	{0, ATTR_TLS,	"TLS_SESSION_CACHE",	NULL,	LDAP_OPT_X_TLS_SESSION_CACHE},
+	{0, ATTR_TLS,	"TLS_SESSION_LIFETIME",	NULL,	LDAP_OPT_X_TLS_SESSION_LIFETIME},
+	{0, ATTR_TLS,	"TLS_KTLS",		NULL,	LDAP_OPT_X_TLS_KTLS},
 #endif
 #ifdef HAVE_GNUTLS
 	{0, ATTR_TLS,	"TLS_CRLFILE",			NULL,	LDAP_OPT_X_TLS_CRLFILE},
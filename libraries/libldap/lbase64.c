@@ -34,7 +34,8 @@
 #define RIGHT2			0x03
 #define RIGHT4			0x0f
 
-static const unsigned char b642nib[0x80] = {
+/* values above 0x3f mark characters outside the base64 alphabet */
+static const unsigned char b642nib[0x100] = {
 	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
 	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
 	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
@@ -50,7 +51,23 @@ static const unsigned char b642nib[0x80] = {
 	0xff, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20,
 	0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
 	0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30,
-	0x31, 0x32, 0x33, 0xff, 0xff, 0xff, 0xff, 0xff
+	0x31, 0x32, 0x33, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
 };
 
 int
@@ -61,15 +78,39 @@ ldap_int_decode_b64_inplace( struct berval *value )
 
 	byte = value->bv_val;
 	end = value->bv_val + value->bv_len;
+	value->bv_len = 0;
+
+	/*
+	 * Only the last group may carry padding: decode the ones before it
+	 * a whole group at a time with a single check of all four digits,
+	 * anything unusual is left to the digit by digit loop below.
+	 */
+	for ( p = value->bv_val; end - p > 4; p += 4 ) {
+		unsigned char	n0, n1, n2, n3;
+		unsigned long	bits;
+
+		n0 = b642nib[ (unsigned char) p[0] ];
+		n1 = b642nib[ (unsigned char) p[1] ];
+		n2 = b642nib[ (unsigned char) p[2] ];
+		n3 = b642nib[ (unsigned char) p[3] ];
+		if ( ( n0 | n1 | n2 | n3 ) > 0x3f ) {
+			break;
+		}
+
+		bits = ( (unsigned long) n0 << 18 ) | ( n1 << 12 ) | ( n2 << 6 ) | n3;
+		byte[0] = bits >> 16;
+		byte[1] = bits >> 8;
+		byte[2] = bits;
+
+		byte += 3;
+		value->bv_len += 3;
+	}
 
-	for ( p = value->bv_val, value->bv_len = 0;
-		p < end;
-		p += 4, value->bv_len += 3 )
-	{
+	for ( ; p < end; p += 4, value->bv_len += 3 ) {
 		int i;
 		for ( i = 0; i < 4; i++ ) {
-			if ( p[i] != '=' && (p[i] & 0x80 ||
-			    b642nib[ p[i] & 0x7f ] > 0x3f) ) {
+			if ( p[i] != '=' &&
+			    b642nib[ (unsigned char) p[i] ] > 0x3f ) {
 				Debug2( LDAP_DEBUG_ANY,
 					_("ldap_pvt_decode_b64_inplace: invalid base64 encoding"
 					" char (%c) 0x%x\n"), p[i], p[i] );
@@ -78,10 +119,10 @@ ldap_int_decode_b64_inplace( struct berval *value )
 		}
 
 		/* first digit */
-		nib = b642nib[ p[0] & 0x7f ];
+		nib = b642nib[ (unsigned char) p[0] ];
 		byte[0] = nib << 2;
 		/* second digit */
-		nib = b642nib[ p[1] & 0x7f ];
+		nib = b642nib[ (unsigned char) p[1] ];
 		byte[0] |= nib >> 4;
 		byte[1] = (nib & RIGHT4) << 4;
 		/* third digit */
@@ -89,7 +130,7 @@ ldap_int_decode_b64_inplace( struct berval *value )
 			value->bv_len += 1;
 			break;
 		}
-		nib = b642nib[ p[2] & 0x7f ];
+		nib = b642nib[ (unsigned char) p[2] ];
 		byte[1] |= nib >> 2;
 		byte[2] = (nib & RIGHT2) << 6;
 		/* fourth digit */
@@ -97,7 +138,7 @@ ldap_int_decode_b64_inplace( struct berval *value )
 			value->bv_len += 2;
 			break;
 		}
-		nib = b642nib[ p[3] & 0x7f ];
+		nib = b642nib[ (unsigned char) p[3] ];
 		byte[2] |= nib;
 
 		byte += 3;
@@ -172,7 +172,10 @@ struct ldapmsg {
 	struct ldapmsg	*lm_chain;	/* for search - next msg in the resp */
 	struct ldapmsg	*lm_chain_tail;
 	struct ldapmsg	*lm_next;	/* next response */
+	struct ldapmsg	*lm_prev;	/* previous response */
+	struct ldapmsg	*lm_dup;	/* older response, same msgid */
 	time_t	lm_time;	/* used to maintain cache */
+	struct ldap_arena	*lm_arena;	/* block holding msg, ber and PDU */
 };
 
 #ifdef HAVE_TLS
@@ -188,6 +191,9 @@ struct ldaptls {
 	char		*lt_ecname;		/* OpenSSL only */
 	int		lt_protocol_min;
 	int		lt_protocol_max;
+	int		lt_session_cache;	/* OpenSSL only */
+	int		lt_session_lifetime;	/* OpenSSL only */
+	int		lt_ktls;		/* OpenSSL only */
 	struct berval	lt_cacert;
 	struct berval	lt_cert;
 	struct berval	lt_key;
@@ -309,6 +315,9 @@ struct ldapoptions {
 #define ldo_tls_ciphersuite	ldo_tls_info.lt_ciphersuite
 #define ldo_tls_protocol_min	ldo_tls_info.lt_protocol_min
 #define ldo_tls_protocol_max	ldo_tls_info.lt_protocol_max
+#define ldo_tls_session_cache	ldo_tls_info.lt_session_cache
+#define ldo_tls_session_lifetime	ldo_tls_info.lt_session_lifetime
+#define ldo_tls_ktls	ldo_tls_info.lt_ktls
 #define ldo_tls_crlfile	ldo_tls_info.lt_crlfile
 #define ldo_tls_randfile	ldo_tls_info.lt_randfile
 #define ldo_tls_cacert	ldo_tls_info.lt_cacert
@@ -370,11 +379,34 @@ typedef struct ldap_conn {
 #define LDAP_CONNST_CONNECTED		3
 	LDAPURLDesc		*lconn_server;
 	BerElement		*lconn_ber;	/* ber receiving on this conn. */
+	struct ldap_arena	*lconn_arena;	/* block lconn_ber is read into */
+	int			lconn_nonblock;	/* switched by ldap_async_process() */
 
 	struct ldap_conn *lconn_next;
 } LDAPConn;
 
 
+/*
+ * a search whose responses are handed to a callback as they are read
+ */
+typedef struct ldapstream {
+	ber_int_t	ls_msgid;
+	LDAP_STREAM_PROC	*ls_proc;
+	void		*ls_arg;
+	int		ls_stopped;	/* set once the callback returned non-zero */
+} LDAPStream;
+
+/*
+ * callbacks registered for an operation with ldap_async_register()
+ */
+typedef struct ldapasyncop {
+	ber_int_t	lao_msgid;
+	LDAP_STREAM_PROC	*lao_proc;
+	LDAP_ASYNC_PROC	*lao_done;
+	void		*lao_arg;
+	int		lao_err;	/* set once its connection failed */
+} LDAPAsyncOp;
+
 /*
  * structure used to track outstanding requests
  */
@@ -390,6 +422,7 @@ typedef struct ldapreq {
 	int		lr_outrefcnt;	/* count of outstanding referrals */
 	int		lr_abandoned;	/* the request has been abandoned */
 	ber_int_t	lr_origid;	/* original request's message id */
+	ber_tag_t	lr_msgtype;	/* request type */
 	int		lr_parentcnt;	/* count of parent requests */
 	ber_tag_t	lr_res_msgtype;	/* result message type */
 	ber_int_t	lr_res_errno;	/* result LDAP errno */
@@ -398,6 +431,7 @@ typedef struct ldapreq {
 	BerElement	*lr_ber;	/* ber encoded request contents */
 	LDAPConn	*lr_conn;	/* connection used to send request */
 	struct berval	lr_dn;		/* DN of request, in lr_ber */
+	struct ldap_arena	*lr_arena;	/* block responses are read into */
 	struct ldapreq	*lr_parent;	/* request that spawned this referral */
 	struct ldapreq	*lr_child;	/* first child request */
 	struct ldapreq	*lr_refnext;	/* next referral spawned */
@@ -450,8 +484,13 @@ struct ldap_common {
 	TAvlnode	*ldc_requests;	/* list of outstanding requests */
 	/* protected by res_mutex */
 	LDAPMessage	*ldc_responses;	/* list of outstanding responses */
+	TAvlnode	*ldc_resindex;	/* outstanding responses by msgid */
 #define	ld_requests		ldc->ldc_requests
 #define	ld_responses		ldc->ldc_responses
+#define	ld_resindex		ldc->ldc_resindex
+	/* protected by res_mutex */
+	TAvlnode	*ldc_async;	/* operations with callbacks, by msgid */
+#define	ld_async		ldc->ldc_async
 
 	/* protected by abandon_mutex */
 	ber_len_t	ldc_nabandoned;
@@ -724,6 +763,7 @@ LDAP_F (int) ldap_open_defconn( LDAP *ld );
 LDAP_F (int) ldap_int_open_connection( LDAP *ld,
 	LDAPConn *conn, LDAPURLDesc *srvlist, int async );
 LDAP_F (int) ldap_int_check_async_open( LDAP *ld, ber_socket_t sd );
+LDAP_F (int) ldap_int_async_open_step( LDAP *ld, LDAPConn *lc, int *wr );
 
 /*
  * in os-ip.c
@@ -802,6 +842,15 @@ LDAP_F (int) ldap_int_flush_request( LDAP *ld, LDAPRequest *lr );
  * in result.c:
  */
 LDAP_F (const char *) ldap_int_msgtype2str( ber_tag_t tag );
+LDAP_F (void) ldap_int_arena_release( struct ldap_arena *la, int n );
+LDAP_F (int) ldap_int_read_ready( LDAP *ld, int *wr );
+LDAP_F (LDAPMessage *) ldap_int_next_response( LDAP *ld, int msgid );
+
+/*
+ * in async.c:
+ */
+LDAP_F (void) ldap_int_async_free( LDAP *ld );
+LDAP_F (void) ldap_int_async_conn_failed( LDAP *ld, LDAPConn *lc );
 
 /*
  * in search.c
@@ -911,6 +960,8 @@ LDAP_F (char *) ldap_int_parse_numericoid LDAP_P((
  */
 LDAP_F (int) ldap_int_tls_start LDAP_P(( LDAP *ld,
 	LDAPConn *conn, LDAPURLDesc *srv ));
+LDAP_F (int) ldap_int_tls_step LDAP_P(( LDAP *ld,
+	LDAPConn *conn, LDAPURLDesc *srv ));
 
 LDAP_F (void) ldap_int_tls_destroy LDAP_P(( struct ldapoptions *lo ));
 
@@ -154,12 +154,27 @@ ldif_parse_line2(
 		s++;
 	}
 
-	/* check for continued line markers that should be deleted */
-	for ( p = s, d = s; *p; p++ ) {
-		if ( *p != CONTINUED_LINE_MARKER )
-			*d++ = *p;
+	/* check for continued line markers that should be deleted,
+	 * moving the runs between them down at once */
+	d = s + strlen( s );
+	p = memchr( s, CONTINUED_LINE_MARKER, d - s );
+	if ( p != NULL ) {
+		char *end = d, *run;
+
+		for ( d = p; p < end; ) {
+			while ( p < end && *p == CONTINUED_LINE_MARKER ) {
+				p++;
+			}
+			run = memchr( p, CONTINUED_LINE_MARKER, end - p );
+			if ( run == NULL ) {
+				run = end;
+			}
+			AC_MEMCPY( d, p, run - p );
+			d += run - p;
+			p = run;
+		}
+		*d = '\0';
 	}
-	*d = '\0';
 
 	if ( b64 ) {
 		char *byte = s;
@@ -462,7 +477,7 @@ ldif_sput_wrap(
 
 	ber_len_t savelen;
 	ber_len_t len=0;
-	ber_len_t i;
+	ber_len_t i, n;
 
 	if ( !wrap )
 		wrap = LDIF_LINE_WIDTH;
@@ -535,16 +550,21 @@ ldif_sput_wrap(
 		/* fall-thru */
 
 	case LDIF_PUT_COMMENT:
-		/* pre-encoded names */
-		for ( i=0; i < vlen; i++ ) {
+		/* pre-encoded names, copied a line at a time */
+		for ( i=0; i < vlen; i += n ) {
 			if ( len > wrap ) {
 				*(*out)++ = '\n';
 				*(*out)++ = ' ';
 				len = 1;
 			}
 
-			*(*out)++ = val[i];
-			len++;
+			n = wrap - len + 1;
+			if ( n > vlen - i ) {
+				n = vlen - i;
+			}
+			AC_MEMCPY( *out, &val[i], n );
+			*out += n;
+			len += n;
 		}
 		*(*out)++ = '\n';
 		return;
@@ -568,24 +588,29 @@ ldif_sput_wrap(
 		&& !ldif_must_b64_encode( name )
 #endif
 	) {
-		int b64 = 0;
-
-		for ( byte = (const unsigned char *) val; byte < stop;
-		    byte++, len++ )
-		{
+		/* check the whole value first, then copy it a line at a time */
+		for ( byte = (const unsigned char *) val; byte < stop; byte++ ) {
 			if ( !isascii( *byte ) || !isprint( *byte ) ) {
-				b64 = 1;
 				break;
 			}
-			if ( len >= wrap ) {
-				*(*out)++ = '\n';
-				*(*out)++ = ' ';
-				len = 1;
-			}
-			*(*out)++ = *byte;
 		}
 
-		if( !b64 ) {
+		if ( byte == stop ) {
+			for ( i = 0; i < vlen; i += n ) {
+				if ( len >= wrap ) {
+					*(*out)++ = '\n';
+					*(*out)++ = ' ';
+					len = 1;
+				}
+
+				n = wrap > len ? wrap - len : 1;
+				if ( n > vlen - i ) {
+					n = vlen - i;
+				}
+				AC_MEMCPY( *out, &val[i], n );
+				*out += n;
+				len += n;
+			}
 			*(*out)++ = '\n';
 			return;
 		}
@@ -597,10 +622,37 @@ ldif_sput_wrap(
 	len = savelen + 2;
 
 	/* convert to base 64 (3 bytes => 4 base 64 digits) */
-	for ( byte = (const unsigned char *) val;
-		byte < stop - 2;
-	    byte += 3 )
-	{
+	byte = (const unsigned char *) val;
+	while ( byte < stop - 2 ) {
+		/* groups that fit on the current line need no wrap checks */
+		if ( len >= wrap && wrap > 4 ) {
+			*(*out)++ = '\n';
+			*(*out)++ = ' ';
+			len = 1;
+		}
+
+		n = len < wrap ? ( wrap - len ) / 4 : 0;
+		if ( n > (ber_len_t) ( stop - byte ) / 3 ) {
+			n = ( stop - byte ) / 3;
+		}
+		if ( n > 0 ) {
+			char *o = *out;
+
+			for ( i = 0; i < n; i++, byte += 3, o += 4 ) {
+				bits = (byte[0] & 0xff) << 16;
+				bits |= (byte[1] & 0xff) << 8;
+				bits |= (byte[2] & 0xff);
+
+				o[0] = nib2b64[ (bits >> 18) & 0x3f ];
+				o[1] = nib2b64[ (bits >> 12) & 0x3f ];
+				o[2] = nib2b64[ (bits >> 6) & 0x3f ];
+				o[3] = nib2b64[ bits & 0x3f ];
+			}
+			*out = o;
+			len += 4 * n;
+			continue;
+		}
+
 		bits = (byte[0] & 0xff) << 16;
 		bits |= (byte[1] & 0xff) << 8;
 		bits |= (byte[2] & 0xff);
@@ -615,6 +667,7 @@ ldif_sput_wrap(
 			/* get b64 digit from high order 6 bits */
 			*(*out)++ = nib2b64[ (bits & 0xfc0000L) >> 18 ];
 		}
+		byte += 3;
 	}
 
 	/* add padding if necessary */
@@ -904,14 +957,20 @@ pop:
 
 last:
 		if ( *buflenp - lcur <= len ) {
-			*buflenp += len + LDIF_MAXLINE;
-			nbufp = ber_memrealloc( *bufp, *buflenp );
+			/* grow geometrically, records with large values are
+			 * otherwise copied over again for every line */
+			int newlen = *buflenp + len + LDIF_MAXLINE;
+			if ( newlen < 2 * *buflenp ) {
+				newlen = 2 * *buflenp;
+			}
+			nbufp = ber_memrealloc( *bufp, newlen );
 			if( nbufp == NULL ) {
 				return 0;
 			}
 			*bufp = nbufp;
+			*buflenp = newlen;
 		}
-		strcpy( *bufp + lcur, line );
+		AC_MEMCPY( *bufp + lcur, line, len + 1 );
 		lcur += len;
 	}
 
@@ -641,6 +641,59 @@ ldap_dup( LDAP *old )
 	return ( ld );
 }
 
+/*
+ * Take a connection opened with LDAP_OPT_CONNECT_ASYNC as far as it gets
+ * without waiting, TLS handshake included, for ldap_async_process().
+ * Returns 0 once it can be used, -2 while in progress with *wr set if it
+ * waits for the socket to become writable, -1 on failure.
+ */
+/* Protected by ld_conn_mutex */
+int
+ldap_int_async_open_step( LDAP *ld, LDAPConn *lc, int *wr )
+{
+	struct timeval tv = { 0 };
+	ber_socket_t sd = AC_SOCKET_INVALID;
+	int rc;
+
+	*wr = 1;
+	ber_sockbuf_ctrl( lc->lconn_sb, LBER_SB_OPT_GET_FD, &sd );
+	rc = ldap_int_poll( ld, sd, &tv, 1 );
+	if ( rc == -2 ) {
+		return rc;
+	}
+	if ( rc != 0 ) {
+		ld->ld_errno = LDAP_CONNECT_ERROR;
+		return -1;
+	}
+
+	/* ldap_int_poll() made it blocking again */
+	ber_sockbuf_ctrl( lc->lconn_sb, LBER_SB_OPT_SET_NONBLOCK, (void *)1 );
+
+#ifdef HAVE_TLS
+	if ( ld->ld_options.ldo_tls_mode == LDAP_OPT_X_TLS_HARD ||
+		!strcmp( lc->lconn_server->lud_scheme, "ldaps" )) {
+
+		++lc->lconn_refcnt;	/* avoid premature free */
+
+		rc = ldap_int_tls_step( ld, lc, lc->lconn_server );
+
+		--lc->lconn_refcnt;
+
+		if ( rc == LDAP_X_CONNECTING ) {
+			*wr = lc->lconn_sb->sb_trans_needs_write;
+			return -2;
+		}
+		if ( rc != LDAP_SUCCESS ) {
+			return -1;
+		}
+	}
+#endif
+
+	lc->lconn_status = LDAP_CONNST_CONNECTED;
+	lc->lconn_nonblock = 1;
+	return 0;
+}
+
 int
 ldap_int_check_async_open( LDAP *ld, ber_socket_t sd )
 {
@@ -1072,6 +1072,10 @@ ldap_mark_select_clear( LDAP *ld, Sockbuf *sb )
 	sip = (struct selectinfo *)ld->ld_selectinfo;
 
 	ber_sockbuf_ctrl( sb, LBER_SB_OPT_GET_FD, &sd );
+	if ( sd == AC_SOCKET_INVALID ) {
+		/* never got as far as a socket */
+		return;
+	}
 
 #ifdef HAVE_POLL
 	/* for UNIX poll(2) */
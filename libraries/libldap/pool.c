@@ -0,0 +1,428 @@
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1998-2024 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/*
+ * A pool of sessions to the same set of servers, bound with the same
+ * identity. Callers are lent a duplicate of a member's handle, see
+ * ldap_dup(), preferring idle members and otherwise sharing the least
+ * loaded one. Sessions that lost their
+ * connection are reopened and rebound on demand, idle ones are probed
+ * with a Who Am I? request before being lent out again.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/stdlib.h>
+#include <ac/string.h>
+#include <ac/time.h>
+
+#include "ldap-int.h"
+
+#define LDAP_POOL_DOWN		0
+#define LDAP_POOL_CONNECTING	1
+#define LDAP_POOL_UP		2
+
+typedef struct ldap_pool_member {
+	LDAP		*lpm_ld;
+	int		lpm_state;
+	int		lpm_refcnt;
+	time_t		lpm_lastused;
+} LDAPPoolMember;
+
+struct ldap_pool {
+#ifdef LDAP_R_COMPILE
+	ldap_pvt_thread_mutex_t	lp_mutex;
+#endif
+	char		*lp_uris;
+	int		lp_interval;
+
+	/* identity every member is bound as, set by ldap_pool_bind_s() */
+	int		lp_bind;
+	char		*lp_binddn;
+	char		*lp_mech;
+	struct berval	lp_cred;
+
+	int		lp_size;
+	LDAPPoolMember	*lp_members;
+};
+
+/*
+ * Move the first n URLs of the session's list to its end, so that the
+ * members of a pool spread over the servers listed instead of all using
+ * the first one that answers.
+ */
+static void
+pool_rotate( LDAP *ld, int n )
+{
+	LDAPURLDesc	**ludp = &ld->ld_options.ldo_defludp, *first, *last;
+
+	for ( ; n > 0; n-- ) {
+		first = *ludp;
+		if ( first == NULL || first->lud_next == NULL ) {
+			break;
+		}
+		*ludp = first->lud_next;
+		for ( last = *ludp; last->lud_next != NULL; last = last->lud_next )
+			/* EMPTY */ ;
+		last->lud_next = first;
+		first->lud_next = NULL;
+	}
+}
+
+/*
+ * Called without lp_mutex, the member is marked as connecting. The bind
+ * parameters are a copy, ldap_pool_bind_s() may replace them meanwhile.
+ */
+static int
+pool_open( LDAPPool *pool, int i, int bind, char *dn, char *mech,
+	struct berval *cred, LDAP **ldp )
+{
+	LDAP	*ld;
+	int	rc, version = LDAP_VERSION3;
+
+	*ldp = NULL;
+	rc = ldap_initialize( &ld, pool->lp_uris );
+	if ( rc != LDAP_SUCCESS ) {
+		return rc;
+	}
+	pool_rotate( ld, i );
+	ldap_set_option( ld, LDAP_OPT_PROTOCOL_VERSION, &version );
+
+	if ( bind ) {
+		rc = ldap_sasl_bind_s( ld, dn, mech, cred, NULL, NULL, NULL );
+	} else {
+		rc = ldap_connect( ld );
+	}
+	if ( rc != LDAP_SUCCESS ) {
+		Debug3( LDAP_DEBUG_ANY, "ldap_pool: member %d failed to open: %s (%d)\n",
+			i, ldap_err2string( rc ), rc );
+		ldap_unbind_ext( ld, NULL, NULL );
+		return rc;
+	}
+
+	*ldp = ld;
+	return LDAP_SUCCESS;
+}
+
+/*
+ * Reopen an idle member, lp_mutex is dropped meanwhile.
+ */
+static int
+pool_reopen( LDAPPool *pool, LDAPPoolMember *lpm )
+{
+	LDAP		*old = lpm->lpm_ld, *ld;
+	char		*dn = NULL, *mech = NULL;
+	struct berval	cred = BER_BVNULL;
+	int		rc, bind = pool->lp_bind;
+
+	assert( lpm->lpm_refcnt == 0 );
+
+	if ( bind ) {
+		if ( pool->lp_binddn != NULL ) dn = LDAP_STRDUP( pool->lp_binddn );
+		if ( pool->lp_mech != NULL ) mech = LDAP_STRDUP( pool->lp_mech );
+		if ( pool->lp_cred.bv_val != NULL ) ber_dupbv( &cred, &pool->lp_cred );
+	}
+	lpm->lpm_state = LDAP_POOL_CONNECTING;
+	lpm->lpm_ld = NULL;
+	LDAP_MUTEX_UNLOCK( &pool->lp_mutex );
+
+	if ( old != NULL ) {
+		ldap_unbind_ext( old, NULL, NULL );
+	}
+	rc = pool_open( pool, lpm - pool->lp_members, bind, dn, mech, &cred, &ld );
+
+	LDAP_FREE( dn );
+	LDAP_FREE( mech );
+	if ( cred.bv_val != NULL ) {
+		memset( cred.bv_val, 0, cred.bv_len );
+		LDAP_FREE( cred.bv_val );
+	}
+
+	LDAP_MUTEX_LOCK( &pool->lp_mutex );
+	lpm->lpm_ld = ld;
+	lpm->lpm_state = ( rc == LDAP_SUCCESS ) ? LDAP_POOL_UP : LDAP_POOL_DOWN;
+	lpm->lpm_lastused = time( NULL );
+	return rc;
+}
+
+int
+ldap_pool_initialize( LDAPPool **poolp, LDAP_CONST char *uris, int size,
+	int check_interval )
+{
+	LDAPPool	*pool;
+
+	assert( poolp != NULL );
+
+	*poolp = NULL;
+	if ( uris == NULL || size <= 0 || check_interval < 0 ) {
+		return LDAP_PARAM_ERROR;
+	}
+
+	if ( ldap_int_global_options.ldo_valid != LDAP_INITIALIZED ) {
+		ldap_int_initialize( &ldap_int_global_options, NULL );
+	}
+
+	pool = LDAP_CALLOC( 1, sizeof( LDAPPool ) );
+	if ( pool == NULL ) {
+		return LDAP_NO_MEMORY;
+	}
+	pool->lp_members = LDAP_CALLOC( size, sizeof( LDAPPoolMember ) );
+	pool->lp_uris = LDAP_STRDUP( uris );
+	if ( pool->lp_members == NULL || pool->lp_uris == NULL ) {
+		LDAP_FREE( pool->lp_members );
+		LDAP_FREE( pool->lp_uris );
+		LDAP_FREE( pool );
+		return LDAP_NO_MEMORY;
+	}
+	pool->lp_size = size;
+	pool->lp_interval = check_interval;
+#ifdef LDAP_R_COMPILE
+	ldap_pvt_thread_mutex_init( &pool->lp_mutex );
+#endif
+
+	*poolp = pool;
+	return LDAP_SUCCESS;
+}
+
+/*
+ * Remember the identity to use and (re)bind all members that are not
+ * lent out, the others are rebound once they have been returned.
+ * Succeeds if at least one member could be bound.
+ */
+int
+ldap_pool_bind_s(
+	LDAPPool *pool,
+	LDAP_CONST char *dn,
+	LDAP_CONST char *mechanism,
+	struct berval *cred )
+{
+	char		*binddn = NULL, *mech = NULL;
+	struct berval	bv = BER_BVNULL;
+	int		i, rc = LDAP_SUCCESS, bound = 0;
+
+	assert( pool != NULL );
+
+	if ( ( dn != NULL && ( binddn = LDAP_STRDUP( dn ) ) == NULL ) ||
+		( mechanism != NULL && ( mech = LDAP_STRDUP( mechanism ) ) == NULL ) ||
+		( cred != NULL && cred->bv_val != NULL &&
+			ber_dupbv( &bv, cred ) == NULL ) )
+	{
+		LDAP_FREE( binddn );
+		LDAP_FREE( mech );
+		return LDAP_NO_MEMORY;
+	}
+
+	LDAP_MUTEX_LOCK( &pool->lp_mutex );
+	LDAP_FREE( pool->lp_binddn );
+	LDAP_FREE( pool->lp_mech );
+	if ( pool->lp_cred.bv_val != NULL ) {
+		memset( pool->lp_cred.bv_val, 0, pool->lp_cred.bv_len );
+		LDAP_FREE( pool->lp_cred.bv_val );
+	}
+	pool->lp_bind = 1;
+	pool->lp_binddn = binddn;
+	pool->lp_mech = mech;
+	pool->lp_cred = bv;
+
+	for ( i = 0; i < pool->lp_size; i++ ) {
+		LDAPPoolMember *lpm = &pool->lp_members[i];
+
+		if ( lpm->lpm_state == LDAP_POOL_CONNECTING ) {
+			continue;
+		}
+		lpm->lpm_state = LDAP_POOL_DOWN;
+		if ( lpm->lpm_refcnt ) {
+			continue;
+		}
+		rc = pool_reopen( pool, lpm );
+		if ( rc == LDAP_SUCCESS ) {
+			bound++;
+		} else if ( !LDAP_API_ERROR( rc ) ) {
+			/* The server refused the identity, no point going on */
+			break;
+		}
+	}
+	LDAP_MUTEX_UNLOCK( &pool->lp_mutex );
+
+	return bound ? LDAP_SUCCESS : rc;
+}
+
+/*
+ * Lend out a session: an idle member if there is one, otherwise one that
+ * is down gets reopened, or else the least loaded member is shared.
+ * Returns NULL if no member could be connected.
+ */
+LDAP *
+ldap_pool_get( LDAPPool *pool )
+{
+	LDAPPoolMember	*lpm, *best, *down;
+	LDAP		*ld = NULL;
+	time_t		now;
+	int		i, rc, tries = 0;
+
+	assert( pool != NULL );
+
+	LDAP_MUTEX_LOCK( &pool->lp_mutex );
+	while ( tries++ <= pool->lp_size ) {
+		best = down = NULL;
+		for ( i = 0; i < pool->lp_size; i++ ) {
+			lpm = &pool->lp_members[i];
+			if ( lpm->lpm_state == LDAP_POOL_UP ) {
+				if ( best == NULL || lpm->lpm_refcnt < best->lpm_refcnt ) {
+					best = lpm;
+				}
+			} else if ( lpm->lpm_state == LDAP_POOL_DOWN &&
+				lpm->lpm_refcnt == 0 && ( down == NULL ||
+					lpm->lpm_lastused < down->lpm_lastused ) )
+			{
+				down = lpm;
+			}
+		}
+		now = time( NULL );
+
+		/*
+		 * Restore capacity before sharing, but do not retry a member
+		 * that failed to reopen more often than it would be checked.
+		 */
+		if ( down != NULL && ( best == NULL || ( best->lpm_refcnt &&
+				now - down->lpm_lastused >= pool->lp_interval ) ) )
+		{
+			/* Every member tries all the servers, one failure will do */
+			if ( pool_reopen( pool, down ) == LDAP_SUCCESS ) {
+				best = down;
+			} else if ( best != NULL && best->lpm_state != LDAP_POOL_UP ) {
+				continue;
+			}
+		}
+		if ( best == NULL ) {
+			break;
+		}
+
+		lpm = best;
+		lpm->lpm_refcnt++;
+		if ( pool->lp_interval && lpm->lpm_refcnt == 1 &&
+			now - lpm->lpm_lastused >= pool->lp_interval )
+		{
+			LDAP *check = lpm->lpm_ld;
+			struct berval *authzid = NULL;
+
+			lpm->lpm_lastused = now;
+			LDAP_MUTEX_UNLOCK( &pool->lp_mutex );
+			rc = ldap_whoami_s( check, &authzid, NULL, NULL );
+			ber_bvfree( authzid );
+			LDAP_MUTEX_LOCK( &pool->lp_mutex );
+
+			/* Only care whether the server answered at all */
+			if ( LDAP_API_ERROR( rc ) ) {
+				Debug2( LDAP_DEBUG_TRACE, "ldap_pool_get: "
+					"member %d failed the check (%d)\n",
+					(int)( lpm - pool->lp_members ), rc );
+				lpm->lpm_refcnt--;
+				lpm->lpm_state = LDAP_POOL_DOWN;
+				lpm->lpm_lastused = 0;
+				continue;
+			}
+		}
+		ld = ldap_dup( lpm->lpm_ld );
+		if ( ld == NULL ) {
+			lpm->lpm_refcnt--;
+		}
+		break;
+	}
+	LDAP_MUTEX_UNLOCK( &pool->lp_mutex );
+
+	return ld;
+}
+
+/*
+ * Return a session obtained from ldap_pool_get(). If its connection has
+ * been lost, it is reopened before being lent out again.
+ */
+int
+ldap_pool_put( LDAPPool *pool, LDAP *ld )
+{
+	LDAPPoolMember	*lpm = NULL;
+	int		i;
+
+	assert( pool != NULL );
+	assert( ld != NULL );
+
+	LDAP_MUTEX_LOCK( &pool->lp_mutex );
+	for ( i = 0; i < pool->lp_size; i++ ) {
+		if ( pool->lp_members[i].lpm_ld != NULL &&
+			pool->lp_members[i].lpm_ld->ldc == ld->ldc )
+		{
+			lpm = &pool->lp_members[i];
+			break;
+		}
+	}
+	if ( lpm == NULL || lpm->lpm_refcnt == 0 ) {
+		LDAP_MUTEX_UNLOCK( &pool->lp_mutex );
+		return LDAP_PARAM_ERROR;
+	}
+
+	/* Drop the duplicate before the member can be reopened */
+	lpm->lpm_refcnt--;
+	lpm->lpm_lastused = time( NULL );
+	if ( ld->ld_errno == LDAP_SERVER_DOWN ||
+		ld->ld_errno == LDAP_CONNECT_ERROR )
+	{
+		/*
+		 * libldap would reconnect on its own, but not rebind. No reopen
+		 * has failed yet, so the next ldap_pool_get() may try at once.
+		 */
+		lpm->lpm_state = LDAP_POOL_DOWN;
+		lpm->lpm_lastused = 0;
+	}
+	ldap_destroy( ld );
+	LDAP_MUTEX_UNLOCK( &pool->lp_mutex );
+
+	return LDAP_SUCCESS;
+}
+
+/*
+ * Unbind all members, none may be lent out anymore.
+ */
+int
+ldap_pool_destroy( LDAPPool *pool )
+{
+	int	i;
+
+	assert( pool != NULL );
+
+	for ( i = 0; i < pool->lp_size; i++ ) {
+		LDAPPoolMember *lpm = &pool->lp_members[i];
+
+		assert( lpm->lpm_refcnt == 0 );
+		if ( lpm->lpm_ld != NULL ) {
+			ldap_unbind_ext( lpm->lpm_ld, NULL, NULL );
+		}
+	}
+	LDAP_FREE( pool->lp_members );
+	LDAP_FREE( pool->lp_uris );
+	LDAP_FREE( pool->lp_binddn );
+	LDAP_FREE( pool->lp_mech );
+	if ( pool->lp_cred.bv_val != NULL ) {
+		memset( pool->lp_cred.bv_val, 0, pool->lp_cred.bv_len );
+		LDAP_FREE( pool->lp_cred.bv_val );
+	}
+#ifdef LDAP_R_COMPILE
+	ldap_pvt_thread_mutex_destroy( &pool->lp_mutex );
+#endif
+	LDAP_FREE( pool );
+
+	return LDAP_SUCCESS;
+}
@@ -327,6 +327,10 @@ ldap_send_server_request(
 	 * dealing with the new request. If we don't finish here, return
 	 * LDAP_BUSY and let the caller retry later. We only allow a single
 	 * request to be in WRITING state.
+	 *
+	 * When it is on the same connection the new request is written along
+	 * with it, whatever part of it goes out now is skipped when it is
+	 * flushed below.
 	 */
 	rc = 0;
 	if ( ld->ld_requests != NULL ) {
@@ -335,9 +339,18 @@ ldap_send_server_request(
 
 		assert( node != NULL );
 		lr = node->avl_data;
-		if ( lr->lr_status == LDAP_REQST_WRITING &&
-				ldap_int_flush_request( ld, lr ) < 0 ) {
-			rc = -1;
+		if ( lr->lr_status == LDAP_REQST_WRITING ) {
+			if ( lr->lr_conn == lc ) {
+				BerElement *bers[2];
+
+				bers[0] = lr->lr_ber;
+				bers[1] = ber;
+				(void)ber_flushv( lc->lconn_sb, bers, 2,
+					LBER_FLUSH_FREE_NEVER );
+			}
+			if ( ldap_int_flush_request( ld, lr ) < 0 ) {
+				rc = -1;
+			}
 		}
 	}
 	if ( rc ) {
@@ -388,6 +401,7 @@ ldap_send_server_request(
 
 		ber_reset( &tmpber, 1 );
 		rtag = ber_scanf( &tmpber, "{it", /*}*/ &bint, &tag );
+		lr->lr_msgtype = tag;
 		switch ( tag ) {
 		case LDAP_REQ_BIND:
 			rtag = ber_scanf( &tmpber, "{i" /*}*/, &bint );
@@ -786,8 +800,9 @@ ldap_free_connection( LDAP *ld, LDAPConn *lc, int force, int unbind )
 			LDAP_MUTEX_UNLOCK( &lo->ldo_mutex );
 		}
 
+		/* a failed read leaves it unconnected, but still selected */
+		ldap_mark_select_clear( ld, lc->lconn_sb );
 		if ( lc->lconn_status == LDAP_CONNST_CONNECTED ) {
-			ldap_mark_select_clear( ld, lc->lconn_sb );
 			if ( unbind ) {
 				ldap_send_unbind( ld, lc->lconn_sb,
 						NULL, NULL );
@@ -798,6 +813,10 @@ ldap_free_connection( LDAP *ld, LDAPConn *lc, int force, int unbind )
 			ber_free( lc->lconn_ber, 1 );
 		}
 
+		if ( lc->lconn_arena != NULL ) {
+			ldap_int_arena_release( lc->lconn_arena, 1 );
+		}
+
 		ldap_int_sasl_close( ld, lc );
 
 		ldap_free_urllist( lc->lconn_server );
@@ -987,6 +1006,11 @@ ldap_do_free_request( void *arg )
 		lr->lr_res_matched = NULL;
 	}
 
+	if ( lr->lr_arena != NULL ) {
+		ldap_int_arena_release( lr->lr_arena, 1 );
+		lr->lr_arena = NULL;
+	}
+
 	LDAP_FREE( lr );
 }
 
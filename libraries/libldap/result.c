@@ -69,12 +69,20 @@
 static int ldap_abandoned LDAP_P(( LDAP *ld, ber_int_t msgid ));
 static int ldap_mark_abandoned LDAP_P(( LDAP *ld, ber_int_t msgid ));
 static int wait4msg LDAP_P(( LDAP *ld, ber_int_t msgid, int all, struct timeval *timeout,
-	LDAPMessage **result ));
+	LDAPMessage **result, LDAPStream *ls ));
 static ber_tag_t try_read1msg LDAP_P(( LDAP *ld, ber_int_t msgid,
-	int all, LDAPConn *lc, LDAPMessage **result ));
+	int all, LDAPConn *lc, LDAPMessage **result, LDAPStream *ls ));
+static ber_tag_t read1msg LDAP_P(( LDAP *ld, ber_int_t msgid, int all,
+	LDAPConn *lc, LDAPMessage **result, LDAPStream *ls,
+	struct ldap_arena **lap ));
+static int try_stream1msg LDAP_P(( LDAP *ld, LDAPConn *lc, LDAPStream *ls ));
 static ber_tag_t build_result_ber LDAP_P(( LDAP *ld, BerElement **bp, LDAPRequest *lr ));
 static void merge_error_info LDAP_P(( LDAP *ld, LDAPRequest *parentr, LDAPRequest *lr ));
 static LDAPMessage * chkResponseList LDAP_P(( LDAP *ld, int msgid, int all));
+static int ldap_res_cmp LDAP_P(( const void *l, const void *r ));
+static void ldap_res_link LDAP_P(( LDAP *ld, LDAPMessage *lm ));
+static void ldap_res_replace LDAP_P(( LDAP *ld, LDAPMessage *lm, LDAPMessage *by ));
+#define ldap_res_unlink( ld, lm )	ldap_res_replace( (ld), (lm), NULL )
 
 #define LDAP_MSG_X_KEEP_LOOKING		(-2)
 
@@ -117,12 +125,640 @@ ldap_result(
 		return -1;
 
 	LDAP_MUTEX_LOCK( &ld->ld_res_mutex );
-	rc = wait4msg( ld, msgid, all, timeout, result );
+	rc = wait4msg( ld, msgid, all, timeout, result, NULL );
 	LDAP_MUTEX_UNLOCK( &ld->ld_res_mutex );
 
 	return rc;
 }
 
+/*
+ * Read-ahead layer used while streaming. Search responses that are
+ * complete in its buffer are decoded where they are and the space is
+ * reused once the callback has returned, anything else is read out of it
+ * by ber_get_next() as usual. One byte is always kept spare after the
+ * buffered data, see try_stream1msg(). The layer is taken off again once
+ * no stream uses it and the buffer has been drained, see stream_pop().
+ */
+#define LDAP_STREAM_BUFSIZE	(64*1024)
+
+typedef struct ldap_stream_buf {
+	Sockbuf_IO_Desc	*lsb_sbiod;
+	Sockbuf_Buf	lsb_buf;
+	int		lsb_streams;	/* ldap_result_stream() calls using it */
+} LDAPStreamBuf;
+
+static Sockbuf_IO ldap_int_sockbuf_io_stream;
+
+/*
+ * Find the length of the message at the start of bv, returns 0 when the
+ * buffered data is not enough to tell.
+ */
+static ber_len_t
+stream_msglen( struct berval *bv )
+{
+	BerElementBuffer	berbuf;
+	BerElement	*ber = (BerElement *)&berbuf;
+	ber_len_t	len;
+
+	ber_init2( ber, bv, 0 );
+	if ( ber_skip_tag( ber, &len ) == LBER_DEFAULT ) {
+		return 0;
+	}
+	return ( ber->ber_ptr - bv->bv_val ) + len;
+}
+
+static int
+stream_fill( LDAPStreamBuf *lsb, ber_len_t need )
+{
+	Sockbuf_Buf	*buf = &lsb->lsb_buf;
+	ber_slen_t	ret;
+
+	if ( buf->buf_ptr ) {
+		AC_MEMCPY( buf->buf_base, buf->buf_base + buf->buf_ptr,
+			buf->buf_end - buf->buf_ptr );
+		buf->buf_end -= buf->buf_ptr;
+		buf->buf_ptr = 0;
+	}
+	if ( need >= buf->buf_size &&
+		ber_pvt_sb_grow_buffer( buf, need + 1 ) < 0 )
+	{
+		return -1;
+	}
+
+	do {
+		ret = LBER_SBIOD_READ_NEXT( lsb->lsb_sbiod,
+			buf->buf_base + buf->buf_end,
+			buf->buf_size - buf->buf_end - 1 );
+#ifdef EINTR
+	} while ( ret < 0 && errno == EINTR );
+#else
+	} while ( 0 );
+#endif
+	if ( ret > 0 ) {
+		buf->buf_end += ret;
+	}
+	return ret;
+}
+
+static int
+sb_stream_setup( Sockbuf_IO_Desc *sbiod, void *arg )
+{
+	LDAPStreamBuf	*lsb;
+
+	lsb = LDAP_MALLOC( sizeof( *lsb ) );
+	if ( lsb == NULL ) return -1;
+
+	ber_pvt_sb_buf_init( &lsb->lsb_buf );
+	if ( ber_pvt_sb_grow_buffer( &lsb->lsb_buf, LDAP_STREAM_BUFSIZE ) < 0 ) {
+		LDAP_FREE( lsb );
+		return -1;
+	}
+	lsb->lsb_sbiod = sbiod;
+	lsb->lsb_streams = 0;
+	sbiod->sbiod_pvt = lsb;
+	return 0;
+}
+
+static int
+sb_stream_remove( Sockbuf_IO_Desc *sbiod )
+{
+	LDAPStreamBuf	*lsb = sbiod->sbiod_pvt;
+
+	ber_pvt_sb_buf_destroy( &lsb->lsb_buf );
+	LDAP_FREE( lsb );
+	sbiod->sbiod_pvt = NULL;
+	return 0;
+}
+
+static ber_slen_t
+sb_stream_writev( Sockbuf_IO_Desc *sbiod, struct berval *bv, int nbv )
+{
+	return LBER_SBIOD_WRITEV_NEXT( sbiod, bv, nbv );
+}
+
+static int
+sb_stream_ctrl( Sockbuf_IO_Desc *sbiod, int opt, void *arg )
+{
+	LDAPStreamBuf	*lsb = sbiod->sbiod_pvt;
+	Sockbuf_Buf	*buf = &lsb->lsb_buf;
+
+	if ( opt == LBER_SB_OPT_DATA_READY && buf->buf_ptr != buf->buf_end ) {
+		struct berval	bv;
+		ber_len_t	len;
+
+		/* Only a whole message can be read without blocking */
+		bv.bv_val = buf->buf_base + buf->buf_ptr;
+		bv.bv_len = buf->buf_end - buf->buf_ptr;
+		len = stream_msglen( &bv );
+		if ( len && len <= bv.bv_len ) {
+			return 1;
+		}
+
+	} else if ( opt == LBER_SB_OPT_GET_WRITEV ) {
+		return LBER_SB_WRITEV_REPLY( sbiod, arg, sb_stream_writev );
+	}
+	return LBER_SBIOD_CTRL_NEXT( sbiod, opt, arg );
+}
+
+static ber_slen_t
+sb_stream_read( Sockbuf_IO_Desc *sbiod, void *buf, ber_len_t len )
+{
+	LDAPStreamBuf	*lsb = sbiod->sbiod_pvt;
+	ber_slen_t	ret;
+
+	if ( lsb->lsb_buf.buf_ptr == lsb->lsb_buf.buf_end ) {
+		/* Large reads bypass the buffer */
+		if ( len >= lsb->lsb_buf.buf_size ) {
+			return LBER_SBIOD_READ_NEXT( sbiod, buf, len );
+		}
+		ret = stream_fill( lsb, 0 );
+		if ( ret <= 0 ) {
+			return ret;
+		}
+	}
+	return ber_pvt_sb_copy_out( &lsb->lsb_buf, buf, len );
+}
+
+static ber_slen_t
+sb_stream_write( Sockbuf_IO_Desc *sbiod, void *buf, ber_len_t len )
+{
+	return LBER_SBIOD_WRITE_NEXT( sbiod, buf, len );
+}
+
+static Sockbuf_IO ldap_int_sockbuf_io_stream = {
+	sb_stream_setup,	/* sbi_setup */
+	sb_stream_remove,	/* sbi_remove */
+	sb_stream_ctrl,		/* sbi_ctrl */
+	sb_stream_read,		/* sbi_read */
+	sb_stream_write,	/* sbi_write */
+	NULL			/* sbi_close */
+};
+
+/* protected by conn_mutex */
+static LDAPStreamBuf *
+stream_layer( LDAPConn *lc )
+{
+	Sockbuf_IO_Desc	*sbiod;
+
+	for ( sbiod = lc->lconn_sb->sb_iod; sbiod != NULL;
+		sbiod = sbiod->sbiod_next )
+	{
+		if ( sbiod->sbiod_io == &ldap_int_sockbuf_io_stream ) {
+			return sbiod->sbiod_pvt;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Remove the read-ahead layer when nothing needs it anymore, so that later
+ * reads on the connection do not pay for the extra copy. Data it still
+ * buffers has to be read out through it first.
+ */
+/* protected by conn_mutex */
+static void
+stream_pop( LDAPConn *lc )
+{
+	LDAPStreamBuf	*lsb = stream_layer( lc );
+
+	if ( lsb != NULL && lsb->lsb_streams == 0 &&
+		lsb->lsb_buf.buf_ptr == lsb->lsb_buf.buf_end )
+	{
+		ber_sockbuf_remove_io( lc->lconn_sb, &ldap_int_sockbuf_io_stream,
+			LBER_SBIOD_LEVEL_APPLICATION );
+	}
+}
+
+static int
+stream_deliver(
+	LDAP *ld,
+	LDAPStream *ls,
+	ber_int_t id,
+	ber_tag_t tag,
+	BerElement *ber )
+{
+	LDAPMessage	msg = { 0 };
+
+	msg.lm_msgid = id;
+	msg.lm_msgtype = tag;
+	msg.lm_ber = ber;
+	msg.lm_chain_tail = &msg;
+
+	if ( ls->ls_proc( ld, &msg, ls->ls_arg ) ) {
+		ls->ls_stopped = 1;
+		ld->ld_errno = LDAP_USER_CANCELLED;
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Hand the next message over without copying it if it is a complete
+ * search response for the stream. Returns 1 if it was, 0 if it has to be
+ * read as usual and -1 if the callback asked to stop.
+ */
+/* protected by res_mutex, conn_mutex and req_mutex */
+static int
+try_stream1msg( LDAP *ld, LDAPConn *lc, LDAPStream *ls )
+{
+	Sockbuf_IO_Desc	*sbiod = lc->lconn_sb->sb_iod;
+	LDAPStreamBuf	*lsb;
+	Sockbuf_Buf	*buf;
+	BerElementBuffer	berbuf;
+	BerElement	*ber = (BerElement *)&berbuf;
+	struct berval	bv;
+	ber_len_t	len, msglen;
+	ber_tag_t	tag;
+	ber_int_t	id;
+	char		next;
+	int		rc;
+
+	/* The trace layer only copies bytes through, look beneath it */
+	while ( sbiod != NULL && sbiod->sbiod_io == &ber_sockbuf_io_debug ) {
+		sbiod = sbiod->sbiod_next;
+	}
+
+	/* A layer above ours, or a message already half read, owns the data */
+	if ( sbiod == NULL || sbiod->sbiod_io != &ldap_int_sockbuf_io_stream ||
+		( lc->lconn_ber != NULL && lc->lconn_ber->ber_rwptr != NULL ) )
+	{
+		return 0;
+	}
+	lsb = sbiod->sbiod_pvt;
+	buf = &lsb->lsb_buf;
+
+	bv.bv_val = buf->buf_base + buf->buf_ptr;
+	bv.bv_len = buf->buf_end - buf->buf_ptr;
+	msglen = stream_msglen( &bv );
+	if ( msglen == 0 || msglen > bv.bv_len ) {
+		if ( stream_fill( lsb, msglen ) <= 0 ) {
+			return 0;
+		}
+		bv.bv_val = buf->buf_base;
+		bv.bv_len = buf->buf_end;
+		msglen = stream_msglen( &bv );
+		if ( msglen == 0 || msglen > bv.bv_len ) {
+			return 0;
+		}
+	}
+	if ( lc->lconn_sb->sb_max_incoming &&
+		msglen > lc->lconn_sb->sb_max_incoming )
+	{
+		return 0;
+	}
+
+	bv.bv_len = msglen;
+	ber_init2( ber, &bv, ld->ld_lberoptions );
+	if ( ber_skip_tag( ber, &len ) != LDAP_TAG_MESSAGE ||
+		ber_get_int( ber, &id ) == LBER_ERROR || id != ls->ls_msgid )
+	{
+		return 0;
+	}
+
+	tag = ber_peek_tag( ber, &len );
+	switch ( tag ) {
+	case LDAP_RES_SEARCH_REFERENCE:
+		/* let try_read1msg() chase it */
+		if ( LDAP_BOOL_GET( &ld->ld_options, LDAP_BOOL_REFERRALS ) ) {
+			return 0;
+		}
+		/* FALLTHRU */
+	case LDAP_RES_SEARCH_ENTRY:
+	case LDAP_RES_INTERMEDIATE:
+		break;
+
+	default:
+		return 0;
+	}
+	if ( ldap_abandoned( ld, id ) ) {
+		return 0;
+	}
+
+	Debug3( LDAP_DEBUG_TRACE,
+		"read1msg: ld %p msgid %d message type %s (streamed)\n",
+		(void *)ld, id, ldap_int_msgtype2str( tag ) );
+
+	/*
+	 * Decoding may terminate the last value in place, which would overwrite
+	 * the first octet of the next message.
+	 */
+	next = bv.bv_val[msglen];
+	buf->buf_ptr += msglen;
+	rc = stream_deliver( ld, ls, id, tag, ber );
+	bv.bv_val[msglen] = next;
+	if ( buf->buf_ptr == buf->buf_end ) {
+		buf->buf_ptr = buf->buf_end = 0;
+	}
+
+	return rc ? -1 : 1;
+}
+
+/*
+ * ldap_result_stream - wait for the result of the search msgid like
+ * ldap_result( ld, msgid, LDAP_MSG_ALL, ... ) would, but pass each entry,
+ * reference and intermediate response to proc as it arrives instead of
+ * collecting them. Entries are decoded straight from a connection buffer
+ * that is reused once proc returns, so the message, and anything
+ * ldap_get_dn_ber() or ldap_get_attribute_ber() returned from it, must not
+ * be used afterwards. proc is called with the handle locked and must not
+ * start or wait for other operations on it. Only the final result is
+ * returned in result. If proc returns non-zero, the search is abandoned
+ * and -1 returned with LDAP_USER_CANCELLED. On timeout 0 is returned and
+ * the call can be repeated.
+ */
+int
+ldap_result_stream(
+	LDAP *ld,
+	int msgid,
+	struct timeval *timeout,
+	LDAP_STREAM_PROC *proc,
+	void *arg,
+	LDAPMessage **result )
+{
+	LDAPStream	ls = { 0 }, *lsp = &ls;
+	LDAPMessage	*lm, *next, needle;
+	LDAPConn	*lc = NULL;
+	LDAPStreamBuf	*lsb;
+	int		rc;
+
+	assert( ld != NULL );
+	assert( proc != NULL );
+	assert( result != NULL );
+
+	Debug2( LDAP_DEBUG_TRACE, "ldap_result_stream ld %p msgid %d\n", (void *)ld, msgid );
+
+	*result = NULL;
+	if ( msgid <= 0 ) {
+		ld->ld_errno = LDAP_PARAM_ERROR;
+		return -1;
+	}
+
+	if (ld->ld_errno == LDAP_LOCAL_ERROR || ld->ld_errno == LDAP_SERVER_DOWN)
+		return -1;
+
+	ls.ls_msgid = msgid;
+	ls.ls_proc = proc;
+	ls.ls_arg = arg;
+
+	LDAP_MUTEX_LOCK( &ld->ld_res_mutex );
+	needle.lm_msgid = msgid;
+	if ( ldap_tavl_find( ld->ld_resindex, &needle, ldap_res_cmp ) != NULL
+#ifdef LDAP_CONNECTIONLESS
+		|| LDAP_IS_UDP( ld )
+#endif
+		)
+	{
+		/* Responses already queued have to be passed on first */
+		lsp = NULL;
+
+	} else {
+		LDAPRequest	*lr, lrneedle;
+
+		LDAP_MUTEX_LOCK( &ld->ld_conn_mutex );
+		LDAP_MUTEX_LOCK( &ld->ld_req_mutex );
+		lrneedle.lr_msgid = msgid;
+		lr = ldap_tavl_find( ld->ld_requests, &lrneedle, ldap_req_cmp );
+		if ( lr != NULL && lr->lr_conn != NULL ) {
+			lc = lr->lr_conn;
+			if ( ber_sockbuf_ctrl( lc->lconn_sb, LBER_SB_OPT_HAS_IO,
+					&ldap_int_sockbuf_io_stream ) == 0 )
+			{
+				ber_sockbuf_add_io( lc->lconn_sb,
+					&ldap_int_sockbuf_io_stream,
+					LBER_SBIOD_LEVEL_APPLICATION, NULL );
+			}
+			lsb = stream_layer( lc );
+			if ( lsb != NULL ) {
+				lsb->lsb_streams++;
+			} else {
+				lc = NULL;
+			}
+		}
+		LDAP_MUTEX_UNLOCK( &ld->ld_req_mutex );
+		LDAP_MUTEX_UNLOCK( &ld->ld_conn_mutex );
+	}
+
+	rc = wait4msg( ld, msgid, LDAP_MSG_ALL, timeout, result, lsp );
+
+	if ( lc != NULL ) {
+		LDAPConn	*c;
+
+		LDAP_MUTEX_LOCK( &ld->ld_conn_mutex );
+		/* The connection might have gone away in the meantime */
+		for ( c = ld->ld_conns; c != NULL && c != lc; c = c->lconn_next )
+			;
+		if ( c != NULL && ( lsb = stream_layer( lc ) ) != NULL ) {
+			lsb->lsb_streams--;
+			stream_pop( lc );
+		}
+		LDAP_MUTEX_UNLOCK( &ld->ld_conn_mutex );
+	}
+	LDAP_MUTEX_UNLOCK( &ld->ld_res_mutex );
+
+	if ( ls.ls_stopped ) {
+		ldap_abandon_ext( ld, msgid, NULL, NULL );
+		ld->ld_errno = LDAP_USER_CANCELLED;
+		return -1;
+	}
+
+	if ( rc > 0 && *result != NULL ) {
+		/* Whatever could not be streamed is chained before the result */
+		for ( lm = *result; lm->lm_chain != NULL; lm = next ) {
+			next = lm->lm_chain;
+			lm->lm_chain = NULL;
+			if ( !ls.ls_stopped && proc( ld, lm, arg ) ) {
+				ls.ls_stopped = 1;
+			}
+			ldap_msgfree( lm );
+		}
+		lm->lm_chain_tail = lm;
+		*result = lm;
+		rc = lm->lm_msgtype;
+	}
+
+	return rc;
+}
+
+/*
+ * Read what has arrived on the connections without waiting and queue it
+ * with the other responses, for ldap_async_process(). *wr is set if a
+ * request is still waiting to be written. Returns -1 if a connection
+ * failed, the operations sent over it are marked with the error.
+ */
+/* protected by res_mutex */
+int
+ldap_int_read_ready( LDAP *ld, int *wr )
+{
+	struct timeval	tv = { 0 };
+	LDAPMessage	*lm = NULL;
+	LDAPConn	*lc, *lnext;
+	int		rc = 0;
+
+	LDAP_ASSERT_MUTEX_OWNER( &ld->ld_res_mutex );
+
+	*wr = 0;
+	LDAP_MUTEX_LOCK( &ld->ld_conn_mutex );
+	LDAP_MUTEX_LOCK( &ld->ld_req_mutex );
+	if ( ldap_int_select( ld, &tv ) < 0 && sock_errno() != EINTR ) {
+		/* no telling which one it was */
+		ld->ld_errno = LDAP_SERVER_DOWN;
+		ldap_int_async_conn_failed( ld, NULL );
+		LDAP_MUTEX_UNLOCK( &ld->ld_req_mutex );
+		LDAP_MUTEX_UNLOCK( &ld->ld_conn_mutex );
+		return -1;
+	}
+
+	if ( ld->ld_requests != NULL ) {
+		TAvlnode *node = ldap_tavl_end( ld->ld_requests, TAVL_DIR_RIGHT );
+		LDAPRequest *lr = node->avl_data;
+
+		if ( lr->lr_status == LDAP_REQST_WRITING ) {
+			if ( ldap_is_write_ready( ld, lr->lr_conn->lconn_sb ) ) {
+				ldap_int_flush_request( ld, lr );
+			}
+			*wr = ( lr->lr_status == LDAP_REQST_WRITING );
+		}
+	}
+
+	for ( lc = ld->ld_conns; lc != NULL; lc = lnext ) {
+		lnext = lc->lconn_next;
+		if ( lc->lconn_status != LDAP_CONNST_CONNECTED ||
+			!ldap_is_read_ready( ld, lc->lconn_sb ) )
+		{
+			continue;
+		}
+
+		/*
+		 * No msgid matches LDAP_RES_ANY - 1, everything gets queued.
+		 * Whatever the TLS or SASL layers have already decrypted will
+		 * not show on the socket again, read it all as wait4msg does.
+		 */
+		++lc->lconn_refcnt;
+		do {
+			if ( try_read1msg( ld, LDAP_RES_ANY - 1, LDAP_MSG_ONE,
+					lc, &lm, NULL ) == -1 )
+			{
+				ldap_int_async_conn_failed( ld, lc );
+				rc = -1;
+				break;
+			}
+		} while ( lc->lconn_status == LDAP_CONNST_CONNECTED &&
+			ber_sockbuf_ctrl( lc->lconn_sb, LBER_SB_OPT_DATA_READY, NULL ) );
+		lnext = lc->lconn_next;
+
+		if ( lc->lconn_refcnt <= 1 ) {
+			ldap_free_connection( ld, lc, 0, 1 );
+		} else {
+			--lc->lconn_refcnt;
+		}
+	}
+	LDAP_MUTEX_UNLOCK( &ld->ld_req_mutex );
+	LDAP_MUTEX_UNLOCK( &ld->ld_conn_mutex );
+
+	return rc;
+}
+
+/*
+ * Take the next queued message for msgid off the queue, one at a time
+ * like ldap_result( ld, msgid, LDAP_MSG_ONE, ... ) would.
+ */
+/* protected by res_mutex */
+LDAPMessage *
+ldap_int_next_response( LDAP *ld, int msgid )
+{
+	return chkResponseList( ld, msgid, LDAP_MSG_ONE );
+}
+
+static int
+ldap_res_cmp( const void *l, const void *r )
+{
+	const LDAPMessage *left = l, *right = r;
+	return ( left->lm_msgid < right->lm_msgid ) ? -1 :
+		( left->lm_msgid > right->lm_msgid );
+}
+
+/*
+ * Responses are kept in ld_responses, newest first, for LDAP_RES_ANY and
+ * indexed by msgid in ld_resindex. Only the first message of each response
+ * is queued, the rest hang off its lm_chain.
+ *
+ * CLDAP datagrams can repeat a msgid. The index then points at the newest
+ * response, as a walk of ld_responses would find, and the older ones hang
+ * off its lm_dup so they can take its place once it is gone.
+ */
+
+/* protected by res_mutex */
+static void
+ldap_res_link( LDAP *ld, LDAPMessage *lm )
+{
+	TAvlnode	*node;
+
+	lm->lm_prev = NULL;
+	lm->lm_next = ld->ld_responses;
+	if ( lm->lm_next != NULL ) {
+		lm->lm_next->lm_prev = lm;
+	}
+	ld->ld_responses = lm;
+
+	lm->lm_dup = NULL;
+	node = ldap_tavl_find2( ld->ld_resindex, lm, ldap_res_cmp );
+	if ( node != NULL ) {
+		lm->lm_dup = node->avl_data;
+		node->avl_data = lm;
+	} else {
+		(void)ldap_tavl_insert( &ld->ld_resindex, lm, ldap_res_cmp,
+			ldap_avl_dup_error );
+	}
+}
+
+/*
+ * Take lm off the queue, putting by in its place if it is not NULL.
+ */
+/* protected by res_mutex */
+static void
+ldap_res_replace( LDAP *ld, LDAPMessage *lm, LDAPMessage *by )
+{
+	TAvlnode	*node;
+
+	if ( by != NULL ) {
+		by->lm_prev = lm->lm_prev;
+		by->lm_next = lm->lm_next;
+	}
+	if ( lm->lm_prev != NULL ) {
+		lm->lm_prev->lm_next = by ? by : lm->lm_next;
+	} else {
+		ld->ld_responses = by ? by : lm->lm_next;
+	}
+	if ( lm->lm_next != NULL ) {
+		lm->lm_next->lm_prev = by ? by : lm->lm_prev;
+	}
+	lm->lm_prev = lm->lm_next = NULL;
+
+	if ( by != NULL ) {
+		by->lm_dup = lm->lm_dup;
+	}
+	node = ldap_tavl_find2( ld->ld_resindex, lm, ldap_res_cmp );
+	if ( node != NULL && node->avl_data == lm ) {
+		if ( by != NULL ) {
+			node->avl_data = by;
+		} else if ( lm->lm_dup != NULL ) {
+			node->avl_data = lm->lm_dup;
+		} else {
+			ldap_tavl_delete( &ld->ld_resindex, lm, ldap_res_cmp );
+		}
+	} else if ( node != NULL ) {
+		LDAPMessage	*dup;
+
+		for ( dup = node->avl_data; dup != NULL; dup = dup->lm_dup ) {
+			if ( dup->lm_dup == lm ) {
+				dup->lm_dup = by ? by : lm->lm_dup;
+				break;
+			}
+		}
+	}
+	lm->lm_dup = NULL;
+}
+
 /* protected by res_mutex */
 static LDAPMessage *
 chkResponseList(
@@ -130,8 +766,7 @@ chkResponseList(
 	int msgid,
 	int all)
 {
-	LDAPMessage	*lm, **lastlm, *nextlm;
-	int		cnt = 0;
+	LDAPMessage	*lm, *nextlm, *tmp;
 
 	/*
 	 * Look through the list of responses we have received on
@@ -146,10 +781,17 @@ chkResponseList(
 		"ldap_chkResponseList ld %p msgid %d all %d\n",
 		(void *)ld, msgid, all );
 
-	lastlm = &ld->ld_responses;
-	for ( lm = ld->ld_responses; lm != NULL; lm = nextlm ) {
-		nextlm = lm->lm_next;
-		++cnt;
+	if ( msgid == LDAP_RES_ANY ) {
+		lm = ld->ld_responses;
+	} else {
+		LDAPMessage	needle;
+
+		needle.lm_msgid = msgid;
+		lm = ldap_tavl_find( ld->ld_resindex, &needle, ldap_res_cmp );
+	}
+
+	for ( ; lm != NULL; lm = nextlm ) {
+		nextlm = ( msgid == LDAP_RES_ANY ) ? lm->lm_next : NULL;
 
 		if ( ldap_abandoned( ld, lm->lm_msgid ) ) {
 			Debug2( LDAP_DEBUG_ANY,
@@ -171,54 +813,47 @@ chkResponseList(
 			}
 
 			/* Remove this entry from list */
-			*lastlm = nextlm;
+			ldap_res_unlink( ld, lm );
 
 			ldap_msgfree( lm );
 
 			continue;
 		}
 
-		if ( msgid == LDAP_RES_ANY || lm->lm_msgid == msgid ) {
-			LDAPMessage	*tmp;
-
-			if ( all == LDAP_MSG_ONE ||
-				all == LDAP_MSG_RECEIVED ||
-				msgid == LDAP_RES_UNSOLICITED )
-			{
-				break;
-			}
+		if ( all == LDAP_MSG_ONE ||
+			all == LDAP_MSG_RECEIVED ||
+			msgid == LDAP_RES_UNSOLICITED )
+		{
+			break;
+		}
 
-			tmp = lm->lm_chain_tail;
-			if ( tmp->lm_msgtype == LDAP_RES_SEARCH_ENTRY ||
-				tmp->lm_msgtype == LDAP_RES_SEARCH_REFERENCE ||
-				tmp->lm_msgtype == LDAP_RES_INTERMEDIATE )
-			{
-				tmp = NULL;
-			}
+		tmp = lm->lm_chain_tail;
+		if ( tmp->lm_msgtype == LDAP_RES_SEARCH_ENTRY ||
+			tmp->lm_msgtype == LDAP_RES_SEARCH_REFERENCE ||
+			tmp->lm_msgtype == LDAP_RES_INTERMEDIATE )
+		{
+			tmp = NULL;
+		}
 
-			if ( tmp == NULL && msgid != LDAP_RES_ANY ) {
-				lm = NULL;
-			}
+		if ( tmp == NULL && msgid != LDAP_RES_ANY ) {
+			lm = NULL;
+		}
 
-			if ( tmp || msgid != LDAP_RES_ANY ) {
-				break;
-			}
+		if ( tmp || msgid != LDAP_RES_ANY ) {
+			break;
 		}
-		lastlm = &lm->lm_next;
 	}
 
 	if ( lm != NULL ) {
 		/* Found an entry, remove it from the list */
 		if ( all == LDAP_MSG_ONE && lm->lm_chain != NULL ) {
-			*lastlm = lm->lm_chain;
-			lm->lm_chain->lm_next = lm->lm_next;
 			lm->lm_chain->lm_chain_tail = ( lm->lm_chain_tail != lm ) ? lm->lm_chain_tail : lm->lm_chain;
+			ldap_res_replace( ld, lm, lm->lm_chain );
 			lm->lm_chain = NULL;
 			lm->lm_chain_tail = NULL;
 		} else {
-			*lastlm = lm->lm_next;
+			ldap_res_unlink( ld, lm );
 		}
-		lm->lm_next = NULL;
 	}
 
 #ifdef LDAP_DEBUG
@@ -242,7 +877,8 @@ wait4msg(
 	ber_int_t msgid,
 	int all,
 	struct timeval *timeout,
-	LDAPMessage **result )
+	LDAPMessage **result,
+	LDAPStream *ls )
 {
 	int		rc;
 	struct timeval	tv = { 0 },
@@ -372,7 +1008,7 @@ wait4msg(
 						serviced = 1;
 						/* Don't let it get freed out from under us */
 						++lc->lconn_refcnt;
-						rc = try_read1msg( ld, msgid, all, lc, result );
+						rc = try_read1msg( ld, msgid, all, lc, result, ls );
 						lnext = lc->lconn_next;
 
 						/* Only take locks if we're really freeing */
@@ -444,6 +1080,165 @@ wait4msg(
 }
 
 
+/*
+ * Responses to a search are read straight into blocks owned by the
+ * search request, together with room for their LDAPMessage and
+ * BerElement, so a search result takes a few blocks rather than three
+ * allocations per entry and ldap_msgfree() hands a chain back a block at
+ * a time. The first block only fits the first response, each next one is
+ * twice the size of the last, up to LDAP_ARENA_MAXBLK. Blocks are
+ * reference counted: the request holds one while it is filling the
+ * block, and so does each message in it, and the connection while a PDU
+ * is being read into it. A kept message keeps its whole block, but only
+ * the responses to its own search share it. Responses to other requests,
+ * PDUs whose message id is not among the octets read with the length,
+ * and those too large to share a block, are allocated on their own.
+ */
+#define LDAP_ARENA_MAXBLK	(64*1024)
+#define LDAP_ARENA_MAXMSG	(LDAP_ARENA_MAXBLK/4)
+#define LDAP_ARENA_ALIGN(n)	(((n) + 7) & ~(ber_len_t)7)
+
+struct ldap_arena {
+#ifdef LDAP_R_COMPILE
+	ldap_pvt_thread_mutex_t	la_mutex;
+#endif
+	int		la_refcnt;
+	ber_len_t	la_size;
+	ber_len_t	la_used;	/* protected by req_mutex */
+};
+
+#define LDAP_ARENA_HDRSIZE	LDAP_ARENA_ALIGN( sizeof(struct ldap_arena) )
+#define LDAP_ARENA_MSGSIZE	LDAP_ARENA_ALIGN( sizeof(LDAPMessage) )
+#define LDAP_ARENA_BERSIZE	LDAP_ARENA_ALIGN( sizeof(BerElement) )
+
+typedef struct arena_arg {
+	LDAP	*aa_ld;
+	LDAPConn	*aa_lc;
+} ArenaArg;
+
+/* drop n references to the block, may be called without any lock held */
+void
+ldap_int_arena_release( struct ldap_arena *la, int n )
+{
+	int		refcnt;
+
+	LDAP_MUTEX_LOCK( &la->la_mutex );
+	la->la_refcnt -= n;
+	refcnt = la->la_refcnt;
+	LDAP_MUTEX_UNLOCK( &la->la_mutex );
+
+	if ( refcnt == 0 ) {
+#ifdef LDAP_R_COMPILE
+		ldap_pvt_thread_mutex_destroy( &la->la_mutex );
+#endif
+		LDAP_FREE( la );
+	}
+}
+
+/*
+ * ber_bufalloc of lconn_ber: find the search the PDU answers and carve
+ * its buffer out of the request's block.
+ */
+/* protected by conn_mutex and req_mutex */
+static void *
+arena_bufalloc( ber_len_t len, struct berval *head, void *arg )
+{
+	ArenaArg	*aa = arg;
+	LDAPConn	*lc = aa->aa_lc;
+	LDAPRequest	*lr, needle = { 0 };
+	BerElementBuffer	berbuf;
+	BerElement	*ber = (BerElement *)&berbuf;
+	struct ldap_arena	*la;
+	ber_len_t	need, size;
+	char		*p;
+
+	need = LDAP_ARENA_MSGSIZE + LDAP_ARENA_BERSIZE +
+		LDAP_ARENA_ALIGN( len + 1 );
+	if ( need > LDAP_ARENA_MAXMSG ) {
+		return NULL;
+	}
+
+	ber_init2( ber, head, 0 );
+	if ( ber_get_int( ber, &needle.lr_msgid ) == LBER_ERROR ||
+		needle.lr_msgid <= 0 )
+	{
+		return NULL;
+	}
+	lr = ldap_tavl_find( aa->aa_ld->ld_requests, &needle, ldap_req_cmp );
+	if ( lr == NULL || lr->lr_msgtype != LDAP_REQ_SEARCH ||
+		lr->lr_status == LDAP_REQST_COMPLETED || lr->lr_abandoned )
+	{
+		return NULL;
+	}
+
+	la = lr->lr_arena;
+	if ( la == NULL || la->la_used + need > la->la_size ) {
+		size = LDAP_ARENA_HDRSIZE + need;
+		if ( la != NULL && size < la->la_size * 2 ) {
+			size = la->la_size * 2;
+			if ( size > LDAP_ARENA_MAXBLK ) {
+				size = LDAP_ARENA_MAXBLK;
+			}
+		}
+		la = LDAP_MALLOC( size );
+		if ( la == NULL ) {
+			return NULL;
+		}
+#ifdef LDAP_R_COMPILE
+		ldap_pvt_thread_mutex_init( &la->la_mutex );
+#endif
+		la->la_refcnt = 1;
+		la->la_size = size;
+		la->la_used = LDAP_ARENA_HDRSIZE;
+		if ( lr->lr_arena != NULL ) {
+			ldap_int_arena_release( lr->lr_arena, 1 );
+		}
+		lr->lr_arena = la;
+	}
+
+	p = (char *)la + la->la_used;
+	la->la_used += need;
+
+	LDAP_MUTEX_LOCK( &la->la_mutex );
+	la->la_refcnt++;
+	LDAP_MUTEX_UNLOCK( &la->la_mutex );
+
+	assert( lc->lconn_arena == NULL );
+	lc->lconn_arena = la;
+
+	return p + LDAP_ARENA_MSGSIZE + LDAP_ARENA_BERSIZE;
+}
+
+/*
+ * Make the message for a PDU that arena_bufalloc() placed, the reference
+ * in *lap becomes the message's.
+ */
+static LDAPMessage *
+arena_msg( BerElement *ber, struct ldap_arena **lap )
+{
+	LDAPMessage	*lm;
+	BerElement	*aber;
+
+	assert( *lap != NULL );
+
+	lm = (LDAPMessage *)( ber->ber_buf -
+		LDAP_ARENA_BERSIZE - LDAP_ARENA_MSGSIZE );
+	aber = (BerElement *)( (char *)lm + LDAP_ARENA_MSGSIZE );
+
+	*aber = *ber;	/* struct copy */
+	ber_free( ber, 0 );
+
+	memset( lm, 0, sizeof(LDAPMessage) );
+	lm->lm_ber = aber;
+	lm->lm_arena = *lap;
+	*lap = NULL;
+	return lm;
+}
+
+/*
+ * The block of the PDU being handled is held in la, so that it stays
+ * around even if the request goes away meanwhile.
+ */
 /* protected by res_mutex, conn_mutex and req_mutex */
 static ber_tag_t
 try_read1msg(
@@ -451,10 +1246,33 @@ try_read1msg(
 	ber_int_t msgid,
 	int all,
 	LDAPConn *lc,
-	LDAPMessage **result )
+	LDAPMessage **result,
+	LDAPStream *ls )
+{
+	struct ldap_arena	*la = NULL;
+	ber_tag_t	rc;
+
+	rc = read1msg( ld, msgid, all, lc, result, ls, &la );
+	if ( la != NULL ) {
+		ldap_int_arena_release( la, 1 );
+	}
+	return rc;
+}
+
+/* protected by res_mutex, conn_mutex and req_mutex */
+static ber_tag_t
+read1msg(
+	LDAP *ld,
+	ber_int_t msgid,
+	int all,
+	LDAPConn *lc,
+	LDAPMessage **result,
+	LDAPStream *ls,
+	struct ldap_arena **lap )
 {
+	ArenaArg	aa;
 	BerElement	*ber;
-	LDAPMessage	*newmsg, *l, *prev;
+	LDAPMessage	*newmsg, *l;
 	ber_int_t	id;
 	ber_tag_t	tag;
 	ber_len_t	len;
@@ -480,6 +1298,19 @@ try_read1msg(
 		(void *)ld, msgid, all );
 
 retry:
+	if ( ls != NULL ) {
+		rc = try_stream1msg( ld, lc, ls );
+		if ( rc < 0 ) {
+			return -1;
+		}
+		if ( rc > 0 ) {
+			if ( ber_sockbuf_ctrl( lc->lconn_sb, LBER_SB_OPT_DATA_READY, NULL ) ) {
+				goto retry;
+			}
+			return LDAP_MSG_X_KEEP_LOOKING;
+		}
+	}
+
 	if ( lc->lconn_ber == NULL ) {
 		lc->lconn_ber = ldap_alloc_ber_with_options( ld );
 
@@ -501,8 +1332,27 @@ retry:
 		if ( ld->ld_options.ldo_version == LDAP_VERSION2 ) isv2 = 1;
 	}
 nextresp3:
+	if ( LDAP_IS_UDP(ld) ) {
+		/* the responses in a datagram may share one buffer */
+		tag = ber_get_next( lc->lconn_sb, &len, ber );
+	} else
 #endif
-	tag = ber_get_next( lc->lconn_sb, &len, ber );
+	{
+		aa.aa_ld = ld;
+		aa.aa_lc = lc;
+		ber->ber_bufalloc = arena_bufalloc;
+		ber->ber_bufarg = &aa;
+		tag = ber_get_next( lc->lconn_sb, &len, ber );
+		ber->ber_bufalloc = NULL;
+		ber->ber_bufarg = NULL;
+	}
+	if ( tag != LBER_DEFAULT ) {
+		if ( *lap != NULL ) {
+			ldap_int_arena_release( *lap, 1 );
+		}
+		*lap = lc->lconn_arena;
+		lc->lconn_arena = NULL;
+	}
 	switch ( tag ) {
 	case LDAP_TAG_MESSAGE:
 		/*
@@ -510,6 +1360,8 @@ nextresp3:
 	 	 * The connection should no longer need this ber.
 	 	 */
 		lc->lconn_ber = NULL;
+		/* a finished stream may have left data behind */
+		stream_pop( lc );
 		break;
 
 	default:
@@ -992,15 +1844,34 @@ nextresp2:
 		}
 	}
 
+	/* streamed responses that could not be decoded in place end up here */
+	if ( ls != NULL && id == ls->ls_msgid &&
+		( tag == LDAP_RES_SEARCH_ENTRY ||
+			tag == LDAP_RES_SEARCH_REFERENCE ||
+			tag == LDAP_RES_INTERMEDIATE ) )
+	{
+		rc = stream_deliver( ld, ls, id, tag, ber );
+		ber_free( ber, 1 );
+		if ( rc ) {
+			return -1;
+		}
+		goto exit;
+	}
+
 	/* make a new ldap message */
-	newmsg = (LDAPMessage *) LDAP_CALLOC( 1, sizeof(LDAPMessage) );
-	if ( newmsg == NULL ) {
-		ld->ld_errno = LDAP_NO_MEMORY;
-		return( -1 );
+	if ( ber->ber_options & LBER_BUF_FOREIGN ) {
+		newmsg = arena_msg( ber, lap );
+		ber = newmsg->lm_ber;
+	} else {
+		newmsg = (LDAPMessage *) LDAP_CALLOC( 1, sizeof(LDAPMessage) );
+		if ( newmsg == NULL ) {
+			ld->ld_errno = LDAP_NO_MEMORY;
+			return( -1 );
+		}
+		newmsg->lm_ber = ber;
 	}
 	newmsg->lm_msgid = (int)id;
 	newmsg->lm_msgtype = tag;
-	newmsg->lm_ber = ber;
 	newmsg->lm_chain_tail = newmsg;
 
 #ifdef LDAP_CONNECTIONLESS
@@ -1054,8 +1925,7 @@ nextresp2:
 			}
 			/* set up response chain */
 			if ( tmp == NULL ) {
-				newmsg->lm_next = ld->ld_responses;
-				ld->ld_responses = newmsg;
+				ldap_res_link( ld, newmsg );
 				chain_head = newmsg;
 			} else {
 				tmp->lm_chain = newmsg;
@@ -1116,13 +1986,7 @@ nextresp2:
 	 * search response.
 	 */
 
-	prev = NULL;
-	for ( l = ld->ld_responses; l != NULL; l = l->lm_next ) {
-		if ( l->lm_msgid == newmsg->lm_msgid ) {
-			break;
-		}
-		prev = l;
-	}
+	l = ldap_tavl_find( ld->ld_resindex, newmsg, ldap_res_cmp );
 
 	/* not part of an existing search response */
 	if ( l == NULL ) {
@@ -1131,8 +1995,7 @@ nextresp2:
 			goto exit;
 		}
 
-		newmsg->lm_next = ld->ld_responses;
-		ld->ld_responses = newmsg;
+		ldap_res_link( ld, newmsg );
 		goto exit;
 	}
 
@@ -1145,11 +2008,7 @@ nextresp2:
 
 	/* return the whole chain if that's what we were looking for */
 	if ( foundit ) {
-		if ( prev == NULL ) {
-			ld->ld_responses = l->lm_next;
-		} else {
-			prev->lm_next = l->lm_next;
-		}
+		ldap_res_unlink( ld, l );
 		*result = l;
 	}
 
@@ -1299,16 +2158,32 @@ int
 ldap_msgfree( LDAPMessage *lm )
 {
 	LDAPMessage	*next;
-	int		type = 0;
+	struct ldap_arena	*la = NULL;
+	int		type = 0, n = 0;
 
 	Debug0( LDAP_DEBUG_TRACE, "ldap_msgfree\n" );
 
 	for ( ; lm != NULL; lm = next ) {
 		next = lm->lm_chain;
 		type = lm->lm_msgtype;
+		if ( lm->lm_arena != NULL ) {
+			/* entries in a chain mostly share their block */
+			if ( lm->lm_arena != la ) {
+				if ( la != NULL ) {
+					ldap_int_arena_release( la, n );
+				}
+				la = lm->lm_arena;
+				n = 0;
+			}
+			n++;
+			continue;
+		}
 		ber_free( lm->lm_ber, 1 );
 		LDAP_FREE( (char *) lm );
 	}
+	if ( la != NULL ) {
+		ldap_int_arena_release( la, n );
+	}
 
 	return type;
 }
@@ -1321,7 +2196,7 @@ ldap_msgfree( LDAPMessage *lm )
 int
 ldap_msgdelete( LDAP *ld, int msgid )
 {
-	LDAPMessage	*lm, *prev;
+	LDAPMessage	*lm, needle;
 	int		rc = 0;
 
 	assert( ld != NULL );
@@ -1330,23 +2205,14 @@ ldap_msgdelete( LDAP *ld, int msgid )
 		(void *)ld, msgid );
 
 	LDAP_MUTEX_LOCK( &ld->ld_res_mutex );
-	prev = NULL;
-	for ( lm = ld->ld_responses; lm != NULL; lm = lm->lm_next ) {
-		if ( lm->lm_msgid == msgid ) {
-			break;
-		}
-		prev = lm;
-	}
+	needle.lm_msgid = msgid;
+	lm = ldap_tavl_find( ld->ld_resindex, &needle, ldap_res_cmp );
 
 	if ( lm == NULL ) {
 		rc = -1;
 
 	} else {
-		if ( prev == NULL ) {
-			ld->ld_responses = lm->lm_next;
-		} else {
-			prev->lm_next = lm->lm_next;
-		}
+		ldap_res_unlink( ld, lm );
 	}
 	LDAP_MUTEX_UNLOCK( &ld->ld_res_mutex );
 	if ( lm ) {
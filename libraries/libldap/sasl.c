@@ -774,7 +774,8 @@ sb_sasl_generic_write( Sockbuf_IO_Desc *sbiod, void *buf, ber_len_t len)
 	 */
 	if ( p->flags & LDAP_PVT_SASL_PARTIAL_WRITE ) {
 		p->flags ^= LDAP_PVT_SASL_PARTIAL_WRITE;
-		return len2;
+		/* Coalesced writes may be retried with more data */
+		return p->partial_len;
 	}
 
 	/* now encode the next packet. */
@@ -795,12 +796,15 @@ sb_sasl_generic_write( Sockbuf_IO_Desc *sbiod, void *buf, ber_len_t len)
 		/* error? */
 		int err = sock_errno();
 		/* caller can retry this */
-		if ( err == EAGAIN || err == EWOULDBLOCK || err == EINTR )
+		if ( err == EAGAIN || err == EWOULDBLOCK || err == EINTR ) {
 			p->flags |= LDAP_PVT_SASL_PARTIAL_WRITE;
+			p->partial_len = len2;
+		}
 		return ret;
 	} else if ( p->buf_out.buf_ptr != p->buf_out.buf_end ) {
 		/* partial write? pretend nothing got written */
 		p->flags |= LDAP_PVT_SASL_PARTIAL_WRITE;
+		p->partial_len = len2;
 		sock_errset(EAGAIN);
 		len2 = -1;
 	}
@@ -820,6 +824,9 @@ sb_sasl_generic_ctrl( Sockbuf_IO_Desc *sbiod, int opt, void *arg )
 
 	if ( opt == LBER_SB_OPT_DATA_READY ) {
 		if ( p->buf_in.buf_ptr != p->buf_in.buf_end ) return 1;
+
+	} else if ( opt == LBER_SB_OPT_GET_WRITEV ) {
+		return LBER_SB_WRITEV_REPLY( sbiod, arg, ber_pvt_sb_coalesce_writev );
 	}
 
 	return LBER_SBIOD_CTRL_NEXT( sbiod, opt, arg );
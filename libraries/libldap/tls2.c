@@ -652,6 +652,33 @@ ldap_pvt_tls_config( LDAP *ld, int option, const char *arg )
 			return ldap_pvt_tls_set_option( ld, option, &i );
 		}
 		return -1;
+	case LDAP_OPT_X_TLS_SESSION_CACHE:	/* OpenSSL only */
+	case LDAP_OPT_X_TLS_SESSION_LIFETIME: {
+		char *next;
+		long l;
+		l = strtol( arg, &next, 10 );
+		if ( next == arg || *next != '\0' || l < INT_MIN || l > INT_MAX )
+			return -1;
+		i = l;
+		return ldap_pvt_tls_set_option( ld, option, &i );
+		}
+	case LDAP_OPT_X_TLS_KTLS:	/* OpenSSL only */
+		i = -1;
+		if ( ( strcasecmp( arg, "on" ) == 0 ) ||
+			( strcasecmp( arg, "yes" ) == 0) ||
+			( strcasecmp( arg, "true" ) == 0 ) )
+		{
+			i = 1;
+		} else if ( ( strcasecmp( arg, "off" ) == 0 ) ||
+			( strcasecmp( arg, "no" ) == 0) ||
+			( strcasecmp( arg, "false" ) == 0 ) )
+		{
+			i = 0;
+		}
+		if (i >= 0) {
+			return ldap_pvt_tls_set_option( ld, option, &i );
+		}
+		return -1;
 #endif
 	}
 	return -1;
@@ -732,6 +759,15 @@ ldap_pvt_tls_get_option( LDAP *ld, int option, void *arg )
 	case LDAP_OPT_X_TLS_CRLCHECK:	/* OpenSSL only */
 		*(int *)arg = lo->ldo_tls_crlcheck;
 		break;
+	case LDAP_OPT_X_TLS_SESSION_CACHE:	/* OpenSSL only */
+		*(int *)arg = lo->ldo_tls_session_cache;
+		break;
+	case LDAP_OPT_X_TLS_SESSION_LIFETIME:	/* OpenSSL only */
+		*(int *)arg = lo->ldo_tls_session_lifetime;
+		break;
+	case LDAP_OPT_X_TLS_KTLS:	/* OpenSSL only */
+		*(int *)arg = lo->ldo_tls_ktls;
+		break;
 #endif
 	case LDAP_OPT_X_TLS_CIPHER_SUITE:
 		*(char **)arg = lo->ldo_tls_ciphersuite ?
@@ -960,6 +996,18 @@ ldap_pvt_tls_set_option( LDAP *ld, int option, void *arg )
 			return 0;
 		}
 		return -1;
+	case LDAP_OPT_X_TLS_SESSION_CACHE:	/* OpenSSL only */
+		if ( !arg ) return -1;
+		lo->ldo_tls_session_cache = *(int *)arg;
+		return 0;
+	case LDAP_OPT_X_TLS_SESSION_LIFETIME:	/* OpenSSL only */
+		if ( !arg || *(int *)arg < 0 ) return -1;
+		lo->ldo_tls_session_lifetime = *(int *)arg;
+		return 0;
+	case LDAP_OPT_X_TLS_KTLS:	/* OpenSSL only */
+		if ( !arg ) return -1;
+		lo->ldo_tls_ktls = *(int *)arg ? 1 : 0;
+		return 0;
 #endif
 	case LDAP_OPT_X_TLS_CIPHER_SUITE:
 		if ( lo->ldo_tls_ciphersuite ) LDAP_FREE( lo->ldo_tls_ciphersuite );
@@ -1103,6 +1151,50 @@ ldap_pvt_tls_set_option( LDAP *ld, int option, void *arg )
 	return 0;
 }
 
+static char *
+tls_conn_host( LDAPConn *conn, LDAPURLDesc *srv )
+{
+	char *host;
+
+	if( srv ) {
+		host = srv->lud_host;
+	} else {
+ 		host = conn->lconn_server->lud_host;
+	}
+
+	/* avoid NULL host */
+	if( host == NULL ) {
+		host = "localhost";
+	}
+	return host;
+}
+
+/*
+ * Go on with the handshake as far as it gets without waiting, for
+ * connections driven by ldap_async_process(). Returns LDAP_X_CONNECTING
+ * while the socket has to become readable or writable again, as told by
+ * sb_trans_needs_read and sb_trans_needs_write.
+ */
+int
+ldap_int_tls_step( LDAP *ld, LDAPConn *conn, LDAPURLDesc *srv )
+{
+	int ret;
+
+	(void) tls_init( tls_imp, 0 );
+
+	ld->ld_errno = LDAP_SUCCESS;
+	ret = ldap_int_tls_connect( ld, conn, tls_conn_host( conn, srv ) );
+	if ( ret > 0 ) {
+		return LDAP_X_CONNECTING;
+	}
+	if ( ret < 0 ) {
+		if ( ld->ld_errno == LDAP_SUCCESS )
+			ld->ld_errno = LDAP_CONNECT_ERROR;
+		return ld->ld_errno;
+	}
+	return LDAP_SUCCESS;
+}
+
 int
 ldap_int_tls_start ( LDAP *ld, LDAPConn *conn, LDAPURLDesc *srv )
 {
@@ -1117,16 +1209,7 @@ ldap_int_tls_start ( LDAP *ld, LDAPConn *conn, LDAPURLDesc *srv )
 		return LDAP_PARAM_ERROR;
 
 	sb = conn->lconn_sb;
-	if( srv ) {
-		host = srv->lud_host;
-	} else {
- 		host = conn->lconn_server->lud_host;
-	}
-
-	/* avoid NULL host */
-	if( host == NULL ) {
-		host = "localhost";
-	}
+	host = tls_conn_host( conn, srv );
 
 	(void) tls_init( tls_imp, 0 );
 
@@ -1126,6 +1126,9 @@ tlsg_sb_ctrl( Sockbuf_IO_Desc *sbiod, int opt, void *arg )
 		if( gnutls_record_check_pending( p->session->session ) > 0 ) {
 			return 1;
 		}
+
+	} else if ( opt == LBER_SB_OPT_GET_WRITEV ) {
+		return LBER_SB_WRITEV_REPLY( sbiod, arg, ber_pvt_sb_coalesce_writev );
 	}
 	
 	return LBER_SBIOD_CTRL_NEXT( sbiod, opt, arg );
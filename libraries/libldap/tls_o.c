@@ -53,6 +53,7 @@
 #endif
 
 #if OPENSSL_VERSION_MAJOR >= 3
+#include <openssl/core_names.h>
 #define ERR_get_error_line( a, b )	ERR_get_error_all( a, b, NULL, NULL, NULL )
 #ifndef SSL_get_peer_certificate
 #define SSL_get_peer_certificate( s )	SSL_get1_peer_certificate( s )
@@ -72,6 +73,10 @@ static void tlso_info_cb( const SSL *ssl, int where, int ret );
 static int tlso_verify_cb( int ok, X509_STORE_CTX *ctx );
 static int tlso_verify_ok( int ok, X509_STORE_CTX *ctx );
 static int tlso_seed_PRNG( const char *randfile );
+#if OPENSSL_VERSION_NUMBER >= 0x10101000
+static int tlso_cache_idx = -1;
+static CRYPTO_EX_free tlso_cache_free;
+#endif
 #if OPENSSL_VERSION_NUMBER < 0x10100000
 /*
  * OpenSSL 1.1 API and later has new locking code
@@ -240,6 +245,11 @@ tlso_init( void )
 
 	tlso_bio_method = tlso_bio_setup();
 
+#if OPENSSL_VERSION_NUMBER >= 0x10101000
+	tlso_cache_idx = SSL_CTX_get_ex_new_index( 0, NULL, NULL, NULL,
+		tlso_cache_free );
+#endif
+
 	return 0;
 }
 
@@ -368,6 +378,264 @@ tlso_ctx_cipher13( tlso_ctx *ctx, char *suites, char **oldsuites )
 }
 #endif /* OpenSSL 1.1.1 */
 
+#if OPENSSL_VERSION_NUMBER >= 0x10101000
+/*
+ * Session resumption. Clients remember the last resumable session of
+ * each server name they connected to, up to the configured number of
+ * names. Servers rotate the keys protecting their session tickets once
+ * per session lifetime, tickets sealed with the previous key are still
+ * accepted and renewed.
+ */
+typedef struct tlso_sess {
+	struct tlso_sess	*ts_next;
+	SSL_SESSION		*ts_sess;
+	char			ts_host[1];
+} tlso_sess;
+
+typedef struct tlso_ticket_key {
+	unsigned char	tk_name[16];
+	unsigned char	tk_aes[32];
+	unsigned char	tk_hmac[32];
+} tlso_ticket_key;
+
+typedef struct tlso_cache {
+#ifdef LDAP_R_COMPILE
+	ldap_pvt_thread_mutex_t	tc_mutex;
+#endif
+	int		tc_max;
+	int		tc_num;
+	tlso_sess	*tc_sessions;	/* most recent first */
+
+	int		tc_lifetime;
+	time_t		tc_rotated;
+	int		tc_nkeys;
+	tlso_ticket_key	tc_keys[2];	/* current, previous */
+} tlso_cache;
+
+static void
+tlso_cache_free( void *parent, void *ptr, CRYPTO_EX_DATA *ad,
+	int idx, long argl, void *argp )
+{
+	tlso_cache *tc = ptr;
+	tlso_sess *ts;
+
+	if ( tc == NULL ) return;
+
+	while ( (ts = tc->tc_sessions) != NULL ) {
+		tc->tc_sessions = ts->ts_next;
+		SSL_SESSION_free( ts->ts_sess );
+		LDAP_FREE( ts );
+	}
+	OPENSSL_cleanse( tc->tc_keys, sizeof( tc->tc_keys ) );
+#ifdef LDAP_R_COMPILE
+	ldap_pvt_thread_mutex_destroy( &tc->tc_mutex );
+#endif
+	LDAP_FREE( tc );
+}
+
+static int
+tlso_sess_new_cb( SSL *s, SSL_SESSION *sess )
+{
+	tlso_cache *tc = SSL_CTX_get_ex_data( SSL_get_SSL_CTX( s ), tlso_cache_idx );
+	const char *host = SSL_get_servername( s, TLSEXT_NAMETYPE_host_name );
+	tlso_sess *ts, **prev;
+
+	if ( tc == NULL || host == NULL || !SSL_SESSION_is_resumable( sess ) ) {
+		return 0;
+	}
+
+	LDAP_MUTEX_LOCK( &tc->tc_mutex );
+	/* TLSv1.3 servers hand out several single-use tickets, keep them all */
+	for ( prev = &tc->tc_sessions; (ts = *prev) != NULL; prev = &ts->ts_next ) {
+		if ( SSL_SESSION_get_protocol_version( sess ) < TLS1_3_VERSION &&
+				strcasecmp( ts->ts_host, host ) == 0 ) {
+			*prev = ts->ts_next;
+			SSL_SESSION_free( ts->ts_sess );
+			tc->tc_num--;
+			break;
+		}
+	}
+	if ( ts == NULL ) {
+		ts = LDAP_MALLOC( sizeof( tlso_sess ) + strlen( host ) );
+		if ( ts == NULL ) {
+			LDAP_MUTEX_UNLOCK( &tc->tc_mutex );
+			return 0;
+		}
+		strcpy( ts->ts_host, host );
+	}
+	ts->ts_sess = sess;
+	ts->ts_next = tc->tc_sessions;
+	tc->tc_sessions = ts;
+	if ( ++tc->tc_num > tc->tc_max ) {
+		/* Drop the least recent */
+		for ( prev = &tc->tc_sessions; (*prev)->ts_next; prev = &(*prev)->ts_next )
+			/* EMPTY */ ;
+		ts = *prev;
+		*prev = NULL;
+		SSL_SESSION_free( ts->ts_sess );
+		LDAP_FREE( ts );
+		tc->tc_num--;
+	}
+	LDAP_MUTEX_UNLOCK( &tc->tc_mutex );
+
+	/* We keep the reference */
+	return 1;
+}
+
+static void
+tlso_sess_resume( tlso_session *s, const char *host )
+{
+	tlso_cache *tc = SSL_CTX_get_ex_data( SSL_get_SSL_CTX( s ), tlso_cache_idx );
+	tlso_sess *ts, **prev;
+
+	if ( tc == NULL || tc->tc_max <= 0 ) return;
+
+	LDAP_MUTEX_LOCK( &tc->tc_mutex );
+	for ( prev = &tc->tc_sessions; (ts = *prev) != NULL; prev = &ts->ts_next ) {
+		if ( strcasecmp( ts->ts_host, host ) == 0 ) {
+			SSL_set_session( s, ts->ts_sess );
+			/* TLSv1.3 tickets are only good once */
+			if ( SSL_SESSION_get_protocol_version( ts->ts_sess ) >= TLS1_3_VERSION ) {
+				*prev = ts->ts_next;
+				SSL_SESSION_free( ts->ts_sess );
+				LDAP_FREE( ts );
+				tc->tc_num--;
+			}
+			break;
+		}
+	}
+	LDAP_MUTEX_UNLOCK( &tc->tc_mutex );
+}
+
+#if OPENSSL_VERSION_MAJOR >= 3
+static int
+tlso_ticket_key_cb( SSL *s, unsigned char *name, unsigned char *iv,
+	EVP_CIPHER_CTX *ectx, EVP_MAC_CTX *hctx, int enc )
+{
+	tlso_cache *tc = SSL_CTX_get_ex_data( SSL_get_SSL_CTX( s ), tlso_cache_idx );
+	tlso_ticket_key key;
+	OSSL_PARAM params[3];
+	time_t now = time( NULL );
+	int i, rc = 1;
+
+	if ( tc == NULL ) return -1;
+
+	LDAP_MUTEX_LOCK( &tc->tc_mutex );
+	if ( tc->tc_nkeys && now - tc->tc_rotated >= 2 * tc->tc_lifetime ) {
+		/* Unused for so long the previous key has expired too */
+		tc->tc_nkeys = 0;
+	}
+	if ( tc->tc_nkeys == 0 || now - tc->tc_rotated >= tc->tc_lifetime ) {
+		tc->tc_keys[1] = tc->tc_keys[0];
+		if ( RAND_bytes( (unsigned char *)&tc->tc_keys[0],
+				sizeof( tlso_ticket_key ) ) <= 0 ) {
+			LDAP_MUTEX_UNLOCK( &tc->tc_mutex );
+			return -1;
+		}
+		if ( tc->tc_nkeys < 2 ) tc->tc_nkeys++;
+		tc->tc_rotated = now;
+	}
+	if ( enc ) {
+		key = tc->tc_keys[0];
+	} else {
+		for ( i = 0; i < tc->tc_nkeys; i++ ) {
+			if ( memcmp( name, tc->tc_keys[i].tk_name, sizeof( key.tk_name ) ) == 0 )
+				break;
+		}
+		if ( i < tc->tc_nkeys ) {
+			key = tc->tc_keys[i];
+			/* Have the client get a ticket with the current key */
+			rc = i ? 2 : 1;
+		} else {
+			rc = 0;
+		}
+	}
+	LDAP_MUTEX_UNLOCK( &tc->tc_mutex );
+
+	if ( rc == 0 ) {
+		/* Unknown or expired key, fall back to a full handshake */
+		return 0;
+	}
+	if ( enc ) {
+		memcpy( name, key.tk_name, sizeof( key.tk_name ) );
+		if ( RAND_bytes( iv, EVP_CIPHER_get_iv_length( EVP_aes_256_cbc() ) ) <= 0 ) {
+			rc = -1;
+		}
+	}
+	params[0] = OSSL_PARAM_construct_octet_string( OSSL_MAC_PARAM_KEY,
+		key.tk_hmac, sizeof( key.tk_hmac ) );
+	params[1] = OSSL_PARAM_construct_utf8_string( OSSL_MAC_PARAM_DIGEST,
+		"SHA256", 0 );
+	params[2] = OSSL_PARAM_construct_end();
+	if ( rc > 0 && ( !EVP_CipherInit_ex( ectx, EVP_aes_256_cbc(), NULL,
+				key.tk_aes, iv, enc ) ||
+			!EVP_MAC_CTX_set_params( hctx, params ) ) )
+	{
+		rc = -1;
+	}
+	OPENSSL_cleanse( &key, sizeof( key ) );
+	return rc;
+}
+#endif /* OpenSSL 3.0 */
+
+static int
+tlso_cache_init( tlso_ctx *ctx, struct ldapoptions *lo, int is_server )
+{
+	tlso_cache *tc;
+	int cache = lo->ldo_tls_session_cache,
+		lifetime = lo->ldo_tls_session_lifetime;
+
+	if ( lifetime > 0 ) {
+		SSL_CTX_set_timeout( ctx, lifetime );
+	}
+	if ( is_server ) {
+		if ( cache < 0 ) {
+			SSL_CTX_set_session_cache_mode( ctx, SSL_SESS_CACHE_OFF );
+			SSL_CTX_set_options( ctx, SSL_OP_NO_TICKET );
+			SSL_CTX_set_num_tickets( ctx, 0 );
+			return 0;
+		}
+		if ( cache > 0 ) {
+			SSL_CTX_sess_set_cache_size( ctx, cache );
+		}
+#if OPENSSL_VERSION_MAJOR < 3
+		return 0;
+#else
+		if ( lifetime <= 0 ) {
+			return 0;
+		}
+#endif
+	} else if ( cache <= 0 ) {
+		return 0;
+	}
+
+	tc = LDAP_CALLOC( 1, sizeof( tlso_cache ) );
+	if ( tc == NULL ) {
+		return -1;
+	}
+#ifdef LDAP_R_COMPILE
+	ldap_pvt_thread_mutex_init( &tc->tc_mutex );
+#endif
+	tc->tc_max = cache;
+	tc->tc_lifetime = lifetime;
+	if ( !SSL_CTX_set_ex_data( ctx, tlso_cache_idx, tc ) ) {
+		tlso_cache_free( ctx, tc, NULL, tlso_cache_idx, 0, NULL );
+		return -1;
+	}
+
+	if ( is_server ) {
+#if OPENSSL_VERSION_MAJOR >= 3
+		SSL_CTX_set_tlsext_ticket_key_evp_cb( ctx, tlso_ticket_key_cb );
+#endif
+	} else {
+		SSL_CTX_set_session_cache_mode( ctx,
+			SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE );
+		SSL_CTX_sess_set_new_cb( ctx, tlso_sess_new_cb );
+	}
+	return 0;
+}
+#endif /* OpenSSL 1.1.1 */
+
 /*
  * initialize a new TLS context
  */
@@ -666,6 +934,22 @@ tlso_ctx_init( struct ldapoptions *lo, struct ldaptls *lt, int is_server, char *
 	}
 	/* Explicitly honor the server side cipher suite preference */
 	SSL_CTX_set_options( ctx, SSL_OP_CIPHER_SERVER_PREFERENCE );
+	/* Coalesced writes are retried from a different buffer */
+	SSL_CTX_set_mode( ctx, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER );
+
+#if OPENSSL_VERSION_NUMBER >= 0x10101000
+	if ( tlso_cache_init( ctx, lo, is_server ) < 0 ) {
+		Debug0( LDAP_DEBUG_ANY,
+			"TLS: could not set up session resumption.\n" );
+		tlso_report_error( errmsg );
+		return -1;
+	}
+#endif
+#ifdef SSL_OP_ENABLE_KTLS
+	if ( lo->ldo_tls_ktls ) {
+		SSL_CTX_set_options( ctx, SSL_OP_ENABLE_KTLS );
+	}
+#endif
 	return 0;
 }
 
@@ -688,6 +972,11 @@ tlso_session_connect( LDAP *ld, tls_session *sess, const char *name_in )
 		if ( !rc )		/* can fail to strdup the name */
 			return -1;
 	}
+#endif
+#if OPENSSL_VERSION_NUMBER >= 0x10101000
+	if ( name_in && SSL_in_before( s ) ) {
+		tlso_sess_resume( s, name_in );
+	}
 #endif
 	/* Caller expects 0 = success, OpenSSL returns 1 = success */
 	rc = SSL_connect( s ) - 1;
@@ -1369,6 +1658,34 @@ tlso_sb_setup( Sockbuf_IO_Desc *sbiod, void *arg )
 	
 	p->session = arg;
 	p->sbiod = sbiod;
+#ifdef SSL_OP_ENABLE_KTLS
+	if ( SSL_get_options( p->session ) & SSL_OP_ENABLE_KTLS ) {
+		Sockbuf_IO_Desc *next = sbiod->sbiod_next;
+
+		/*
+		 * The kernel can only take over the record layer if OpenSSL
+		 * talks to the socket itself. That bypasses the layers below,
+		 * so only do it when they are plain TCP.
+		 */
+		while ( next && next->sbiod_io == &ber_sockbuf_io_debug )
+			next = next->sbiod_next;
+		if ( next && next->sbiod_io == &ber_sockbuf_io_tcp ) {
+			do {
+				next = next->sbiod_next;
+			} while ( next && next->sbiod_io == &ber_sockbuf_io_debug );
+		} else {
+			next = sbiod;
+		}
+		if ( next == NULL ) {
+			bio = BIO_new_socket( sbiod->sbiod_sb->sb_fd, BIO_NOCLOSE );
+			if ( bio != NULL ) {
+				SSL_set_bio( p->session, bio, bio );
+				sbiod->sbiod_pvt = p;
+				return 0;
+			}
+		}
+	}
+#endif
 	bio = BIO_new( tlso_bio_method );
 	BIO_set_data( bio, p );
 	SSL_set_bio( p->session, bio, bio );
@@ -1422,6 +1739,9 @@ tlso_sb_ctrl( Sockbuf_IO_Desc *sbiod, int opt, void *arg )
 		if( SSL_pending( p->session ) > 0 ) {
 			return 1;
 		}
+
+	} else if ( opt == LBER_SB_OPT_GET_WRITEV ) {
+		return LBER_SB_WRITEV_REPLY( sbiod, arg, ber_pvt_sb_coalesce_writev );
 	}
 	
 	return LBER_SBIOD_CTRL_NEXT( sbiod, opt, arg );
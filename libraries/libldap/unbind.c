@@ -123,6 +123,9 @@ ldap_ld_free(
 		next = lm->lm_next;
 		ldap_msgfree( lm );
 	}
+	ldap_tavl_free( ld->ld_resindex, NULL );
+	ld->ld_resindex = NULL;
+	ldap_int_async_free( ld );
 
 	if ( ld->ld_abandoned != NULL ) {
 		LDAP_FREE( ld->ld_abandoned );
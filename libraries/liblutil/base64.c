@@ -51,6 +51,42 @@ static const char Base64[] =
 	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 static const char Pad64 = '=';
 
+/* Reverse of Base64[], 0xff for characters outside the alphabet */
+static const unsigned char Base64Rev[256] = {
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0x3e, 0xff, 0xff, 0xff, 0x3f,
+	0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b,
+	0x3c, 0x3d, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06,
+	0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
+	0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16,
+	0x17, 0x18, 0x19, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20,
+	0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+	0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30,
+	0x31, 0x32, 0x33, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+};
+
 /* (From RFC1521 and draft-ietf-dnssec-secext-03.txt)
    The following encoding technique is taken from RFC 1521 by Borenstein
    and Freed.  It is reproduced here in a slightly edited form for
@@ -192,20 +228,44 @@ lutil_b64_pton(
 	size_t targsize)
 {
 	int tarindex, state, ch;
-	char *pos;
+	unsigned char b0, b1, b2, b3, pos;
 
 	state = 0;
 	tarindex = 0;
 
-	while ((ch = *src++) != '\0') {
+	for (;;) {
+		/*
+		 * Convert whole groups of four digits at once, anything
+		 * else (whitespace, padding, errors) is handled one
+		 * character at a time below.
+		 */
+		while (state == 0 &&
+			(b0 = Base64Rev[(unsigned char)src[0]]) < 64 &&
+			(b1 = Base64Rev[(unsigned char)src[1]]) < 64 &&
+			(b2 = Base64Rev[(unsigned char)src[2]]) < 64 &&
+			(b3 = Base64Rev[(unsigned char)src[3]]) < 64) {
+			if (target) {
+				if ((size_t)tarindex + 3 > targsize)
+					break;
+				target[tarindex]   = (b0 << 2) | (b1 >> 4);
+				target[tarindex+1] = (b1 << 4) | (b2 >> 2);
+				target[tarindex+2] = (b2 << 6) | b3;
+			}
+			tarindex += 3;
+			src += 4;
+		}
+
+		if ((ch = *src++) == '\0')
+			break;
+
 		if (isascii(ch) && isspace(ch))	/* Skip whitespace anywhere. */
 			continue;
 
 		if (ch == Pad64)
 			break;
 
-		pos = strchr(Base64, ch);
-		if (pos == 0) 		/* A non-base64 character. */
+		pos = Base64Rev[(unsigned char)ch];
+		if (pos > 63) 		/* A non-base64 character. */
 			return (-1);
 
 		switch (state) {
@@ -213,7 +273,7 @@ lutil_b64_pton(
 			if (target) {
 				if ((size_t)tarindex >= targsize)
 					return (-1);
-				target[tarindex] = (pos - Base64) << 2;
+				target[tarindex] = pos << 2;
 			}
 			state = 1;
 			break;
@@ -221,8 +281,8 @@ lutil_b64_pton(
 			if (target) {
 				if ((size_t)tarindex + 1 >= targsize)
 					return (-1);
-				target[tarindex]   |=  (pos - Base64) >> 4;
-				target[tarindex+1]  = ((pos - Base64) & 0x0f)
+				target[tarindex]   |=  pos >> 4;
+				target[tarindex+1]  = (pos & 0x0f)
 							<< 4 ;
 			}
 			tarindex++;
@@ -232,8 +292,8 @@ lutil_b64_pton(
 			if (target) {
 				if ((size_t)tarindex + 1 >= targsize)
 					return (-1);
-				target[tarindex]   |=  (pos - Base64) >> 2;
-				target[tarindex+1]  = ((pos - Base64) & 0x03)
+				target[tarindex]   |=  pos >> 2;
+				target[tarindex+1]  = (pos & 0x03)
 							<< 6;
 			}
 			tarindex++;
@@ -243,7 +303,7 @@ lutil_b64_pton(
 			if (target) {
 				if ((size_t)tarindex >= targsize)
 					return (-1);
-				target[tarindex] |= (pos - Base64);
+				target[tarindex] |= pos;
 			}
 			tarindex++;
 			state = 0;
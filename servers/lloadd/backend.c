@@ -27,6 +27,68 @@
 #include "lutil.h"
 #include "lload.h"
 
+/*
+ * xorshift - we don't need high quality randomness, and we don't want to
+ * interfere with anyone else's use of srand() but we still want something with
+ * little bias. Callers hold different locks, so the shared state is only ever
+ * updated with a compare-and-swap.
+ *
+ * The PRNG here cycles thru 2^64-1 numbers.
+ */
+static uint64_t lload_seed;
+
+uint64_t
+lload_rand( void )
+{
+    uint64_t old = __atomic_load_n( &lload_seed, __ATOMIC_RELAXED ), val;
+
+    do {
+        val = old;
+        /* Make sure we never run from a zero seed */
+        while ( !val ) {
+            val = rand();
+        }
+        val ^= val << 13;
+        val ^= val >> 7;
+        val ^= val << 17;
+    } while ( !__atomic_compare_exchange_n( &lload_seed, &old, val, 0,
+            __ATOMIC_RELAXED, __ATOMIC_RELAXED ) );
+    return val;
+}
+
+/*
+ * Fold a new sample into a decaying average without taking any locks. Losing
+ * a sample to a concurrent update is harmless.
+ */
+void
+lload_latency_update( uintptr_t *average, uintptr_t sample )
+{
+    uintptr_t old = __atomic_load_n( average, __ATOMIC_RELAXED ), new;
+
+    do {
+        if ( !old ) {
+            new = sample;
+        } else {
+            new = old - old / LLOAD_LATENCY_DECAY +
+                    sample / LLOAD_LATENCY_DECAY;
+        }
+    } while ( !__atomic_compare_exchange_n( average, &old, new, 0,
+            __ATOMIC_RELAXED, __ATOMIC_RELAXED ) );
+}
+
+/*
+ * Expected wait on an upstream: its pending operations times its average
+ * latency. Read without locks, it is only a hint.
+ */
+static uintptr_t
+upstream_score( LloadConnection *c )
+{
+    uintptr_t latency = __atomic_load_n( &c->c_latency, __ATOMIC_RELAXED );
+    long pending = __atomic_load_n( &c->c_n_ops_executing, __ATOMIC_RELAXED );
+
+    return ( pending + 1 ) * ( latency + 1 );
+}
+
 static void
 upstream_connect_cb( evutil_socket_t s, short what, void *arg )
 {
@@ -367,7 +429,8 @@ backend_select(
         char **message )
 {
     lload_c_head *head;
-    LloadConnection *c;
+    LloadConnection *c, *c0 = NULL, *c1 = NULL;
+    int n;
 
     assert_locked( &b->b_mutex );
     if ( b->b_max_pending && b->b_n_ops_executing >= b->b_max_pending ) {
@@ -379,14 +442,28 @@ backend_select(
         return 1;
     }
 
+    /* Keep the rest of the backend's capacity for other traffic */
+    if ( b->b_max_pending && op->o_class && op->o_class->cl_share &&
+            b->b_n_ops_executing * 100 >=
+                    (long)b->b_max_pending * op->o_class->cl_share ) {
+        Debug( LDAP_DEBUG_CONNS, "backend_select: "
+                "backend %s has no capacity left for class %s\n",
+                b->b_uri.bv_val, op->o_class->cl_name.bv_val );
+        *res = LDAP_BUSY;
+        *message = "server busy";
+        return 1;
+    }
+
     if ( op->o_tag == LDAP_REQ_BIND
 #ifdef LDAP_API_FEATURE_VERIFY_CREDENTIALS
             && !(lload_features & LLOAD_FEATURE_VC)
 #endif /* LDAP_API_FEATURE_VERIFY_CREDENTIALS */
             ) {
         head = &b->b_bindconns;
+        n = b->b_bindavail;
     } else {
         head = &b->b_conns;
+        n = b->b_active;
     }
 
     if ( LDAP_CIRCLEQ_EMPTY( head ) ) {
@@ -396,7 +473,65 @@ backend_select(
     *res = LDAP_BUSY;
     *message = "server busy";
 
+    /*
+     * Power of two choices: pick two connections at random and try the one
+     * with the lower expected wait first, so a single slow upstream stops
+     * absorbing requests. Fall back to trying them all in order.
+     */
+    if ( n > 1 && ( b->b_tier->t_flags & LLOAD_TIER_LEAST_LOADED ) ) {
+        int i, i0 = lload_rand() % n, i1 = lload_rand() % ( n - 1 );
+
+        if ( i1 >= i0 ) {
+            i1 += 1;
+        }
+
+        i = 0;
+        LDAP_CIRCLEQ_FOREACH( c, head, c_next ) {
+            if ( i == i0 ) {
+                c0 = c;
+            } else if ( i == i1 ) {
+                c1 = c;
+            }
+            if ( c0 && c1 ) break;
+            i++;
+        }
+    }
+
+    if ( c0 && c1 ) {
+        if ( upstream_score( c1 ) < upstream_score( c0 ) ) {
+            c = c0;
+            c0 = c1;
+            c1 = c;
+        }
+
+        if ( try_upstream( b, head, op, c0, res, message ) ) {
+            *cp = c0;
+            return 1;
+        }
+        if ( try_upstream( b, head, op, c1, res, message ) ) {
+            *cp = c1;
+            return 1;
+        }
+    }
+
+    if ( !c0 && ( lload_features & LLOAD_FEATURE_INLINE ) && op->o_client ) {
+        /*
+         * Prefer an upstream owned by the same I/O thread as the client so the
+         * request and its responses never leave that thread.
+         */
+        struct event_base *base = lload_get_base( op->o_client->c_fd );
+
+        LDAP_CIRCLEQ_FOREACH( c, head, c_next ) {
+            if ( lload_get_base( c->c_fd ) != base ) continue;
+            if ( try_upstream( b, head, op, c, res, message ) ) {
+                *cp = c;
+                return 1;
+            }
+        }
+    }
+
     LDAP_CIRCLEQ_FOREACH( c, head, c_next ) {
+        if ( c == c0 || c == c1 ) continue;
         if ( try_upstream( b, head, op, c, res, message ) ) {
             *cp = c;
             CONNECTION_ASSERT_LOCKED(c);
@@ -405,6 +540,12 @@ backend_select(
         }
     }
 
+    /* Every connection was full, let backend_pool_update know */
+    if ( head == &b->b_bindconns ) {
+        b->b_pool_bindbusy++;
+    } else {
+        b->b_pool_busy++;
+    }
     return 1;
 }
 
@@ -444,12 +585,12 @@ backend_retry( LloadBackend *b )
     }
     assert_locked( &b->b_mutex );
 
-    requested = b->b_numconns;
+    requested = backend_pool_size( b, 0 );
 #ifdef LDAP_API_FEATURE_VERIFY_CREDENTIALS
     if ( !(lload_features & LLOAD_FEATURE_VC) )
 #endif /* LDAP_API_FEATURE_VERIFY_CREDENTIALS */
     {
-        requested += b->b_numbindconns;
+        requested += backend_pool_size( b, 1 );
     }
 
     if ( b->b_active + b->b_bindavail + b->b_opening >= requested ) {
@@ -497,6 +638,150 @@ backend_retry( LloadBackend *b )
     assert_locked( &b->b_mutex );
 }
 
+/*
+ * Number of connections we currently want in the regular or bind connection
+ * pool, somewhere between numconns/bindconns and max-numconns/max-bindconns.
+ */
+int
+backend_pool_size( LloadBackend *b, int bind )
+{
+    int min = bind ? b->b_numbindconns : b->b_numconns,
+        max = bind ? b->b_max_numbindconns : b->b_max_numconns,
+        size = bind ? b->b_pool_bindconns : b->b_pool_conns;
+
+    if ( size > max ) {
+        size = max;
+    }
+    if ( size < min ) {
+        size = min;
+    }
+    return size;
+}
+
+/*
+ * Decide whether the pool should grow or shrink based on how many operations
+ * are pending on its connections and whether backend_select found it full
+ * since we last looked. Returns a referenced connection to close if there are
+ * more ready connections than the pool should have.
+ */
+static LloadConnection *
+backend_pool_evaluate( LloadBackend *b, int bind )
+{
+    lload_c_head *head = bind ? &b->b_bindconns : &b->b_conns;
+    int *pool = bind ? &b->b_pool_bindconns : &b->b_pool_conns,
+        *busy = bind ? &b->b_pool_bindbusy : &b->b_pool_busy,
+        *idle = bind ? &b->b_pool_bindidle : &b->b_pool_idle;
+    int min = bind ? b->b_numbindconns : b->b_numconns,
+        max = bind ? b->b_max_numbindconns : b->b_max_numconns,
+        size, depth, ready = 0, victim_ops = 0;
+    long pending = 0;
+    LloadConnection *c, *victim = NULL;
+
+    assert_locked( &b->b_mutex );
+
+    /* slapd processes the binds on a connection one at a time */
+    if ( bind ) {
+        depth = 1;
+    } else if ( b->b_max_conn_pending ) {
+        depth = b->b_max_conn_pending;
+    } else {
+        depth = LLOAD_POOL_DEPTH;
+    }
+
+    LDAP_CIRCLEQ_FOREACH ( c, head, c_next ) {
+        int ops;
+
+        CONNECTION_LOCK(c);
+        ops = c->c_n_ops_executing;
+        if ( c->c_state == LLOAD_C_READY ) {
+            if ( !victim || ops < victim_ops ) {
+                victim = c;
+                victim_ops = ops;
+            }
+            ready++;
+        }
+        CONNECTION_UNLOCK(c);
+        pending += ops;
+    }
+
+    *pool = size = backend_pool_size( b, bind );
+    if ( max > min ) {
+        if ( *busy || 4 * pending > 3 * (long)size * depth ) {
+            *idle = 0;
+            if ( size < max ) {
+                Debug( LDAP_DEBUG_CONNS, "backend_pool_evaluate: "
+                        "backend uri=%s growing %s pool to %d connections, "
+                        "%ld operations pending, %d selections failed\n",
+                        b->b_uri.bv_val, bind ? "bind" : "regular", size + 1,
+                        pending, *busy );
+                *pool = ++size;
+                b->b_pool_grown++;
+            }
+        } else if ( size > min && 2 * pending <= (long)( size - 1 ) * depth ) {
+            if ( ++*idle >= LLOAD_POOL_IDLE_PERIODS ) {
+                Debug( LDAP_DEBUG_CONNS, "backend_pool_evaluate: "
+                        "backend uri=%s shrinking %s pool to %d connections, "
+                        "%ld operations pending\n",
+                        b->b_uri.bv_val, bind ? "bind" : "regular", size - 1,
+                        pending );
+                *idle = 0;
+                *pool = --size;
+                b->b_pool_shrunk++;
+            }
+        } else {
+            *idle = 0;
+        }
+    }
+    *busy = 0;
+
+    if ( ready <= size || !acquire_ref( &victim->c_refcnt ) ) {
+        return NULL;
+    }
+    return victim;
+}
+
+/*
+ * Called every second to resize the backend's connection pools, connections
+ * are opened through backend_retry and closed gently when the pool shrinks.
+ */
+void
+backend_pool_update( LloadBackend *b )
+{
+    LloadConnection *victims[2] = {};
+    uintptr_t grown;
+    epoch_t epoch;
+    int i;
+
+    epoch = epoch_join();
+    checked_lock( &b->b_mutex );
+    grown = b->b_pool_grown;
+    victims[0] = backend_pool_evaluate( b, 0 );
+#ifdef LDAP_API_FEATURE_VERIFY_CREDENTIALS
+    if ( !(lload_features & LLOAD_FEATURE_VC) )
+#endif /* LDAP_API_FEATURE_VERIFY_CREDENTIALS */
+    {
+        victims[1] = backend_pool_evaluate( b, 1 );
+    }
+    if ( b->b_pool_grown != grown ) {
+        backend_retry( b );
+    }
+    checked_unlock( &b->b_mutex );
+
+    for ( i = 0; i < 2; i++ ) {
+        LloadConnection *c = victims[i];
+        int gentle = 1;
+
+        if ( !c ) continue;
+
+        Debug( LDAP_DEBUG_CONNS, "backend_pool_update: "
+                "closing connid=%lu to shrink the pool\n",
+                c->c_connid );
+        lload_connection_close( c, &gentle );
+        RELEASE_REF( c, c_refcnt, c->c_destroy );
+    }
+    epoch_leave( epoch );
+}
+
 void
 backend_connect( evutil_socket_t s, short what, void *arg )
 {
@@ -759,6 +1044,7 @@ lload_backend_destroy( LloadBackend *b )
     checked_lock( &b->b_mutex );
     b->b_tier->t_type.tier_remove_backend( b->b_tier, b );
     b->b_numconns = b->b_numbindconns = 0;
+    b->b_max_numconns = b->b_max_numbindconns = 0;
     backend_reset( b, 0 );
 
 #ifdef BALANCER_MODULE
@@ -214,7 +214,7 @@ request_bind( LloadConnection *client, LloadOperation *op )
                 client->c_connid, pin );
 
         pinned_op =
-                ldap_tavl_delete( &client->c_ops, &needle, operation_client_cmp );
+                lload_optable_delete( &client->c_ops, &needle );
         if ( pinned_op ) {
             assert( op->o_tag == pinned_op->o_tag );
 
@@ -228,16 +228,16 @@ request_bind( LloadConnection *client, LloadOperation *op )
 
             pinned_op->o_request = op->o_request;
             pinned_op->o_ctrls = op->o_ctrls;
+            pinned_op->o_payload = op->o_payload;
 
             /* No one has seen this operation yet, plant the pin back in its stead */
             client->c_n_ops_executing--;
             op->o_res = LLOAD_OP_COMPLETED;
-            ldap_tavl_delete( &client->c_ops, op, operation_client_cmp );
+            lload_optable_delete( &client->c_ops, op );
             op->o_client = NULL;
             assert( op->o_upstream == NULL );
 
-            rc = ldap_tavl_insert( &client->c_ops, pinned_op, operation_client_cmp,
-                    ldap_avl_dup_error );
+            rc = lload_optable_insert( &client->c_ops, pinned_op );
             assert( rc == LDAP_SUCCESS );
 
             /* No one has seen this operation yet */
@@ -251,7 +251,7 @@ request_bind( LloadConnection *client, LloadOperation *op )
         }
     }
 
-    ldap_tavl_delete( &client->c_ops, op, operation_client_cmp );
+    lload_optable_delete( &client->c_ops, op );
     client->c_n_ops_executing--;
 
     client_reset( client );
@@ -333,13 +333,26 @@ request_bind( LloadConnection *client, LloadOperation *op )
         goto fail;
     }
 
-    rc = ldap_tavl_insert( &client->c_ops, op, operation_client_cmp, ldap_avl_dup_error );
+    rc = lload_optable_insert( &client->c_ops, op );
     assert( rc == LDAP_SUCCESS );
     client->c_n_ops_executing++;
 
     client_restricted = client->c_restricted;
     CONNECTION_UNLOCK(client);
 
+    if ( !pin && tag == LDAP_AUTH_SIMPLE &&
+            client_restricted != LLOAD_OP_RESTRICTED_ISOLATE ) {
+        rc = lload_bind_cache_lookup( client, op, &binddn, &auth );
+        if ( rc > 0 ) {
+            ber_free( copy, 0 );
+            return LDAP_SUCCESS;
+        } else if ( rc < 0 ) {
+            CONNECTION_LOCK(client);
+            goto fail;
+        }
+        rc = LDAP_SUCCESS;
+    }
+
     if ( pin ) {
         checked_lock( &op->o_link_mutex );
         upstream = op->o_upstream;
@@ -422,7 +435,7 @@ request_bind( LloadConnection *client, LloadOperation *op )
     }
 
     if ( pin ) {
-        ldap_tavl_delete( &upstream->c_ops, op, operation_upstream_cmp );
+        lload_optable_delete( &upstream->c_ops, op );
         if ( tag == LDAP_AUTH_SIMPLE ) {
             pin = op->o_pin_id = 0;
         }
@@ -477,8 +490,7 @@ request_bind( LloadConnection *client, LloadOperation *op )
             "added bind from client connid=%lu to upstream connid=%lu "
             "as msgid=%d\n",
             op->o_client_connid, op->o_upstream_connid, op->o_upstream_msgid );
-    if ( ldap_tavl_insert( &upstream->c_ops, op, operation_upstream_cmp,
-                 ldap_avl_dup_error ) ) {
+    if ( lload_optable_insert( &upstream->c_ops, op ) ) {
         assert(0);
     }
     upstream->c_state = LLOAD_C_BINDING;
@@ -536,7 +548,7 @@ finish_sasl_bind(
     int rc;
 
     CONNECTION_ASSERT_LOCKED(upstream);
-    removed = ldap_tavl_delete( &upstream->c_ops, op, operation_upstream_cmp );
+    removed = lload_optable_delete( &upstream->c_ops, op );
     if ( !removed ) {
         assert( upstream->c_state != LLOAD_C_BINDING );
         /* FIXME: has client replaced this bind since? */
@@ -572,8 +584,7 @@ finish_sasl_bind(
     op->o_ber = ber;
 
     /* Could we have been unlinked in the meantime? */
-    rc = ldap_tavl_insert(
-            &upstream->c_ops, op, operation_upstream_cmp, ldap_avl_dup_error );
+    rc = lload_optable_insert( &upstream->c_ops, op );
     assert( rc == LDAP_SUCCESS );
 
     CONNECTION_UNLOCK(upstream);
@@ -632,7 +643,7 @@ handle_bind_response(
     }
 
     CONNECTION_LOCK(upstream);
-    if ( !ldap_tavl_find( upstream->c_ops, op, operation_upstream_cmp ) ) {
+    if ( !lload_optable_find( &upstream->c_ops, op ) ) {
         /*
          * operation might not be found because:
          * - it has timed out (only happens when debugging/hung/...)
@@ -667,10 +678,9 @@ handle_bind_response(
         op->o_pin_id = 0;
 
     } else if ( result == LDAP_SASL_BIND_IN_PROGRESS ) {
-        ldap_tavl_delete( &upstream->c_ops, op, operation_upstream_cmp );
+        lload_optable_delete( &upstream->c_ops, op );
         op->o_upstream_msgid = 0;
-        rc = ldap_tavl_insert(
-                &upstream->c_ops, op, operation_upstream_cmp, ldap_avl_dup_error );
+        rc = lload_optable_insert( &upstream->c_ops, op );
         assert( rc == LDAP_SUCCESS );
     } else {
         int sasl_finished = 0;
@@ -696,7 +706,7 @@ handle_bind_response(
     }
 
     CONNECTION_LOCK(client);
-    removed = ldap_tavl_delete( &client->c_ops, op, operation_client_cmp );
+    removed = lload_optable_delete( &client->c_ops, op );
     assert( !removed || op == removed );
 
     if ( client->c_state == LLOAD_C_BINDING ) {
@@ -705,8 +715,7 @@ handle_bind_response(
             case LDAP_SASL_BIND_IN_PROGRESS:
                 op->o_saved_msgid = op->o_client_msgid;
                 op->o_client_msgid = 0;
-                rc = ldap_tavl_insert( &client->c_ops, op, operation_client_cmp,
-                        ldap_avl_dup_error );
+                rc = lload_optable_insert( &client->c_ops, op );
                 assert( rc == LDAP_SUCCESS );
                 break;
             case LDAP_SUCCESS:
@@ -822,7 +831,7 @@ handle_whoami_response(
         }
     }
 
-    removed = ldap_tavl_delete( &client->c_ops, op, operation_client_cmp );
+    removed = lload_optable_delete( &client->c_ops, op );
     assert( !removed || op == removed );
     op->o_pin_id = 0;
     if ( removed ) {
@@ -967,6 +976,8 @@ handle_vc_bind_response(
     }
     CONNECTION_UNLOCK(client);
 
+    lload_bind_cache_result( op, result, !BER_BVISNULL( &controls ) );
+
     checked_lock( &client->c_io_mutex );
     output = client->c_pendingber;
     if ( output == NULL && (output = ber_alloc()) == NULL ) {
@@ -0,0 +1,475 @@
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1998-2024 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <ac/ctype.h>
+#include <ac/string.h>
+
+#ifdef HAVE_OPENSSL
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#endif /* HAVE_OPENSSL */
+
+#include "lutil.h"
+#include "lload.h"
+
+/*
+ * Verified credential cache.
+ *
+ * When a simple bind without controls succeeds upstream and the response
+ * carries no controls either, we remember a salted scrypt hash of the DN and
+ * password for bind_cache_ttl seconds. A later simple bind with the same DN
+ * and password is answered locally without involving an upstream.
+ *
+ * Entries are keyed on the normalised DN (without a schema when running
+ * standalone, so only the LDAPv3 string form is canonicalised there) compared
+ * case-insensitively. Any other outcome of a bind to a DN (a failure, or a
+ * response with controls such as a password policy warning) removes its
+ * entry so the upstream gets to see the following attempts. A password modify
+ * exop passing through drops the whole cache, modify, delete and modrdn drop
+ * the entry for their target DN. Changes made by other means are only picked
+ * up as the entries expire.
+ *
+ * The scrypt parameters keep a hash under a couple of milliseconds while
+ * still requiring 1MiB of memory to compute one.
+ */
+
+#define BIND_CACHE_SALT_LEN 16
+#define BIND_CACHE_HASH_LEN 32
+#define BIND_CACHE_SCRYPT_N 1024
+#define BIND_CACHE_SCRYPT_R 8
+#define BIND_CACHE_SCRYPT_P 1
+
+typedef struct bind_cache_entry {
+    struct berval bce_dn;
+    unsigned char bce_salt[BIND_CACHE_SALT_LEN];
+    unsigned char bce_hash[BIND_CACHE_HASH_LEN];
+    time_t bce_expires;
+    LDAP_TAILQ_ENTRY(bind_cache_entry) bce_next;
+} bind_cache_entry;
+
+unsigned int lload_bind_cache_ttl = 0;
+
+static struct berval modify_passwd_oid = BER_BVC(LDAP_EXOP_MODIFY_PASSWD);
+
+/* Protects everything below */
+static ldap_pvt_thread_mutex_t lload_bind_cache_mutex;
+static TAvlnode *lload_bind_cache = NULL;
+/* In order of insertion which is also the order they expire in */
+static LDAP_TAILQ_HEAD(BindCacheList, bind_cache_entry)
+        lload_bind_cache_list = LDAP_TAILQ_HEAD_INITIALIZER(lload_bind_cache_list);
+/* Never 0 so operations can use that to mean they are not being tracked */
+static unsigned long lload_bind_cache_generation = 1;
+
+static int
+bind_cache_entry_cmp( const void *left, const void *right )
+{
+    const bind_cache_entry *l = left, *r = right;
+
+    return ber_bvstrcasecmp( &l->bce_dn, &r->bce_dn );
+}
+
+static void
+bind_cache_evict( bind_cache_entry *bce )
+{
+    assert_locked( &lload_bind_cache_mutex );
+
+    ldap_tavl_delete( &lload_bind_cache, bce, bind_cache_entry_cmp );
+    LDAP_TAILQ_REMOVE( &lload_bind_cache_list, bce, bce_next );
+    ch_free( bce );
+}
+
+static void
+bind_cache_expire( time_t now )
+{
+    bind_cache_entry *bce;
+
+    assert_locked( &lload_bind_cache_mutex );
+
+    while ( (bce = LDAP_TAILQ_FIRST( &lload_bind_cache_list )) &&
+            bce->bce_expires <= now ) {
+        bind_cache_evict( bce );
+    }
+}
+
+static void
+bind_cache_flush( void )
+{
+    bind_cache_entry *bce;
+
+    assert_locked( &lload_bind_cache_mutex );
+
+    while ( (bce = LDAP_TAILQ_FIRST( &lload_bind_cache_list )) ) {
+        LDAP_TAILQ_REMOVE( &lload_bind_cache_list, bce, bce_next );
+        ch_free( bce );
+    }
+    ldap_tavl_free( lload_bind_cache, NULL );
+    lload_bind_cache = NULL;
+}
+
+static void
+bind_cache_remove( struct berval *dn )
+{
+    bind_cache_entry *bce, needle = { .bce_dn = *dn };
+
+    assert_locked( &lload_bind_cache_mutex );
+
+    bce = ldap_tavl_find( lload_bind_cache, &needle, bind_cache_entry_cmp );
+    if ( bce ) {
+        bind_cache_evict( bce );
+    }
+}
+
+/*
+ * Normalise dn into ndn, which is allocated. dn need not be terminated.
+ */
+int
+lload_dn_normalize( struct berval *dn, struct berval *ndn )
+{
+#ifdef BALANCER_MODULE
+    struct berval val;
+    int rc;
+
+    /* Taken straight from the PDU, dnNormalize wants it terminated */
+    ber_dupbv( &val, dn );
+    rc = dnNormalize( 0, NULL, NULL, &val, ndn, NULL );
+    ber_memfree( val.bv_val );
+    return rc;
+#else /* ! BALANCER_MODULE */
+    LDAPDN ldn;
+    int rc;
+
+    rc = ldap_bv2dn( dn, &ldn, LDAP_DN_FORMAT_LDAP );
+    if ( rc != LDAP_SUCCESS ) {
+        return rc;
+    }
+    rc = ldap_dn2bv( ldn, ndn, LDAP_DN_FORMAT_LDAPV3 | LDAP_DN_PRETTY );
+    ldap_dnfree( ldn );
+    return rc;
+#endif /* ! BALANCER_MODULE */
+}
+
+static int
+bind_cache_hash(
+        struct berval *dn,
+        struct berval *password,
+        unsigned char *salt,
+        unsigned char *hash )
+{
+#ifdef HAVE_OPENSSL
+    char *buf, *ptr;
+    ber_len_t i, len = dn->bv_len + 1 + password->bv_len;
+    int rc;
+
+    buf = ch_malloc( len );
+    for ( i = 0, ptr = buf; i < dn->bv_len; i++ ) {
+        *ptr++ = TOLOWER( (unsigned char)dn->bv_val[i] );
+    }
+    *ptr++ = '\0';
+    AC_MEMCPY( ptr, password->bv_val, password->bv_len );
+
+    rc = EVP_PBE_scrypt( buf, len, salt, BIND_CACHE_SALT_LEN,
+            BIND_CACHE_SCRYPT_N, BIND_CACHE_SCRYPT_R, BIND_CACHE_SCRYPT_P, 0,
+            hash, BIND_CACHE_HASH_LEN );
+
+    OPENSSL_cleanse( buf, len );
+    ch_free( buf );
+    return rc == 1 ? LDAP_SUCCESS : -1;
+#else /* ! HAVE_OPENSSL */
+    return -1;
+#endif /* ! HAVE_OPENSSL */
+}
+
+static int
+bind_cache_parse(
+        LloadOperation *op,
+        struct berval *dn,
+        struct berval *password )
+{
+    BerElementBuffer berbuf;
+    BerElement *ber = (BerElement *)&berbuf;
+    ber_int_t version;
+
+    ber_init2( ber, &op->o_request, 0 );
+    if ( ber_get_int( ber, &version ) == LBER_ERROR ||
+            ber_get_stringbv( ber, dn, LBER_BV_NOTERM ) == LBER_ERROR ||
+            ber_skip_element( ber, password ) != LDAP_AUTH_SIMPLE ) {
+        return -1;
+    }
+    return LDAP_SUCCESS;
+}
+
+/*
+ * Answer a simple bind from the cache if we have a matching entry. Otherwise
+ * return 0 and, if the bind is eligible, remember that its result can be
+ * cached.
+ */
+int
+lload_bind_cache_lookup(
+        LloadConnection *client,
+        LloadOperation *op,
+        struct berval *binddn,
+        struct berval *password )
+{
+    bind_cache_entry *bce, needle = {};
+    unsigned char salt[BIND_CACHE_SALT_LEN], stored[BIND_CACHE_HASH_LEN],
+            hash[BIND_CACHE_HASH_LEN];
+    LloadOperation *removed;
+    BerElement *output;
+    unsigned char diff;
+    int i, found = 0, rc = -1;
+
+    if ( !lload_bind_cache_ttl || BER_BVISEMPTY( binddn ) ||
+            BER_BVISEMPTY( password ) || !BER_BVISNULL( &op->o_ctrls ) ||
+            lload_dn_normalize( binddn, &needle.bce_dn ) ) {
+        return 0;
+    }
+
+    checked_lock( &lload_bind_cache_mutex );
+    bind_cache_expire( slap_get_time() );
+    bce = ldap_tavl_find( lload_bind_cache, &needle, bind_cache_entry_cmp );
+    if ( bce ) {
+        AC_MEMCPY( salt, bce->bce_salt, sizeof(salt) );
+        AC_MEMCPY( stored, bce->bce_hash, sizeof(stored) );
+        found = 1;
+    }
+    op->o_bind_cache_gen = lload_bind_cache_generation;
+    checked_unlock( &lload_bind_cache_mutex );
+
+    if ( found ) {
+        found = bind_cache_hash( &needle.bce_dn, password, salt, hash ) ==
+                LDAP_SUCCESS;
+    }
+    ber_memfree( needle.bce_dn.bv_val );
+    if ( !found ) {
+        return 0;
+    }
+    /* Do not leak how much of the hash matched */
+    for ( i = 0, diff = 0; i < BIND_CACHE_HASH_LEN; i++ ) {
+        diff |= hash[i] ^ stored[i];
+    }
+    if ( diff ) {
+        return 0;
+    }
+
+    Debug( LDAP_DEBUG_STATS, "lload_bind_cache_lookup: "
+            "connid=%lu msgid=%d bind answered from cache\n",
+            op->o_client_connid, op->o_client_msgid );
+    op->o_bind_cache_gen = 0;
+
+    /* Same as a successful response in handle_bind_response */
+    CONNECTION_LOCK(client);
+    removed = lload_optable_delete( &client->c_ops, op );
+    if ( removed ) {
+        assert( op == removed );
+        client->c_n_ops_executing--;
+    }
+    if ( client->c_state == LLOAD_C_BINDING ) {
+        client->c_state = LLOAD_C_READY;
+        client->c_type = LLOAD_C_OPEN;
+        client->c_pin_id = 0;
+        if ( !ber_bvstrcasecmp( &client->c_auth, &lloadd_identity ) ) {
+            client->c_type = LLOAD_C_PRIVILEGED;
+        }
+    }
+    CONNECTION_UNLOCK(client);
+
+    checked_lock( &client->c_io_mutex );
+    output = client->c_pendingber;
+    if ( output != NULL || (output = ber_alloc()) != NULL ) {
+        client->c_pendingber = output;
+        rc = ber_printf( output, "t{tit{ess}}", LDAP_TAG_MESSAGE,
+                LDAP_TAG_MSGID, op->o_client_msgid,
+                LDAP_RES_BIND, LDAP_SUCCESS, "", "" );
+    }
+    checked_unlock( &client->c_io_mutex );
+
+    op->o_res = LLOAD_OP_COMPLETED;
+    OPERATION_UNLINK(op);
+
+    if ( rc < 0 ) {
+        return -1;
+    }
+    connection_write_cb( -1, 0, client );
+    return 1;
+}
+
+/*
+ * Record the outcome of a bind that went upstream, cache it if it succeeded
+ * without anything else to say to the client, forget the DN otherwise.
+ */
+void
+lload_bind_cache_result(
+        LloadOperation *op,
+        ber_int_t result,
+        int has_controls )
+{
+    bind_cache_entry *bce;
+    struct berval dn, ndn, password;
+    unsigned long generation = op->o_bind_cache_gen;
+
+    if ( !generation || result == LDAP_SASL_BIND_IN_PROGRESS ) {
+        return;
+    }
+    op->o_bind_cache_gen = 0;
+
+    if ( bind_cache_parse( op, &dn, &password ) ||
+            lload_dn_normalize( &dn, &ndn ) ) {
+        return;
+    }
+
+    if ( result != LDAP_SUCCESS || has_controls || !lload_bind_cache_ttl ) {
+        checked_lock( &lload_bind_cache_mutex );
+        bind_cache_remove( &ndn );
+        checked_unlock( &lload_bind_cache_mutex );
+        ber_memfree( ndn.bv_val );
+        return;
+    }
+
+    bce = ch_calloc( 1, sizeof(bind_cache_entry) + ndn.bv_len + 1 );
+    bce->bce_dn.bv_val = (char *)(bce + 1);
+    bce->bce_dn.bv_len = ndn.bv_len;
+    AC_MEMCPY( bce->bce_dn.bv_val, ndn.bv_val, ndn.bv_len );
+    ber_memfree( ndn.bv_val );
+
+    if ( lutil_entropy( bce->bce_salt, sizeof(bce->bce_salt) ) ||
+            bind_cache_hash( &bce->bce_dn, &password, bce->bce_salt,
+                    bce->bce_hash ) ) {
+        ch_free( bce );
+        return;
+    }
+
+    checked_lock( &lload_bind_cache_mutex );
+    bind_cache_remove( &bce->bce_dn );
+    if ( generation != lload_bind_cache_generation ) {
+        /* Something might have changed the password in the meantime */
+        checked_unlock( &lload_bind_cache_mutex );
+        ch_free( bce );
+        return;
+    }
+    bce->bce_expires = slap_get_time() + lload_bind_cache_ttl;
+    ldap_tavl_insert( &lload_bind_cache, bce, bind_cache_entry_cmp,
+            ldap_avl_dup_error );
+    LDAP_TAILQ_INSERT_TAIL( &lload_bind_cache_list, bce, bce_next );
+    checked_unlock( &lload_bind_cache_mutex );
+
+    Debug( LDAP_DEBUG_TRACE, "lload_bind_cache_result: "
+            "connid=%lu msgid=%d credentials for \"%s\" cached\n",
+            op->o_client_connid, op->o_client_msgid, bce->bce_dn.bv_val );
+}
+
+/*
+ * Called with a bind response on its way to the client, it has already been
+ * stripped of the LDAPMessage envelope.
+ */
+void
+lload_bind_cache_response(
+        LloadOperation *op,
+        ber_tag_t tag,
+        struct berval *response )
+{
+    BerElementBuffer berbuf;
+    BerElement *ber = (BerElement *)&berbuf;
+    struct berval protocolop;
+    ber_int_t result;
+    ber_len_t len;
+
+    if ( !op->o_bind_cache_gen || tag != LDAP_RES_BIND ) {
+        return;
+    }
+
+    ber_init2( ber, response, 0 );
+    if ( ber_skip_element( ber, &protocolop ) == LBER_ERROR ) {
+        return;
+    }
+    tag = ber_peek_tag( ber, &len );
+
+    ber_init2( ber, &protocolop, 0 );
+    if ( ber_get_enum( ber, &result ) == LBER_ERROR ) {
+        return;
+    }
+
+    lload_bind_cache_result( op, result, tag == LDAP_TAG_CONTROLS );
+}
+
+/*
+ * Forget credentials that op might be about to change.
+ */
+void
+lload_bind_cache_invalidate( LloadOperation *op )
+{
+    BerElementBuffer berbuf;
+    BerElement *ber = (BerElement *)&berbuf;
+    struct berval dn = BER_BVNULL, ndn = BER_BVNULL, oid;
+
+    if ( !lload_bind_cache_ttl ) {
+        return;
+    }
+
+    switch ( op->o_tag ) {
+        case LDAP_REQ_DELETE:
+            dn = op->o_request;
+            break;
+        case LDAP_REQ_MODIFY:
+        case LDAP_REQ_MODDN:
+            ber_init2( ber, &op->o_request, 0 );
+            if ( ber_get_stringbv( ber, &dn, LBER_BV_NOTERM ) == LBER_ERROR ) {
+                return;
+            }
+            break;
+        case LDAP_REQ_EXTENDED:
+            ber_init2( ber, &op->o_request, 0 );
+            if ( ber_get_stringbv( ber, &oid, LBER_BV_NOTERM ) == LBER_ERROR ||
+                    ber_bvcmp( &oid, &modify_passwd_oid ) ) {
+                return;
+            }
+            break;
+        default:
+            return;
+    }
+
+    if ( !BER_BVISNULL( &dn ) && lload_dn_normalize( &dn, &ndn ) ) {
+        /* Not a valid DN, the upstream will refuse it */
+        return;
+    }
+
+    checked_lock( &lload_bind_cache_mutex );
+    lload_bind_cache_generation++;
+    if ( BER_BVISNULL( &ndn ) ) {
+        bind_cache_flush();
+    } else {
+        bind_cache_remove( &ndn );
+    }
+    checked_unlock( &lload_bind_cache_mutex );
+
+    ber_memfree( ndn.bv_val );
+}
+
+void
+lload_bind_cache_init( void )
+{
+    ldap_pvt_thread_mutex_init( &lload_bind_cache_mutex );
+}
+
+void
+lload_bind_cache_destroy( void )
+{
+    checked_lock( &lload_bind_cache_mutex );
+    bind_cache_flush();
+    checked_unlock( &lload_bind_cache_mutex );
+
+    ldap_pvt_thread_mutex_destroy( &lload_bind_cache_mutex );
+}
@@ -0,0 +1,601 @@
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1998-2024 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <ac/string.h>
+
+#include "lutil.h"
+#include "lload.h"
+
+/*
+ * Search result cache and request coalescing.
+ *
+ * Searches without controls are keyed on the bound identity and the raw
+ * SearchRequest as received, so no filter or attribute list normalisation
+ * takes place, a hit needs the client to send byte-identical requests. All
+ * response PDUs of a search are stored and replayed with the client's msgid
+ * substituted.
+ *
+ * lloadd does not see changes made to the directory by other means, so
+ * entries expire after cache_ttl (cache_negative_ttl for an empty result or
+ * noSuchObject) and the whole cache is dropped whenever an operation that
+ * modifies the directory passes through. The generation counter makes
+ * sure a search that was in progress while such an operation was running is
+ * not cached.
+ *
+ * With the coalesce feature enabled, a search that is being recorded is also
+ * registered as a flight. Identical searches arriving while it is running
+ * are not forwarded, they get the responses recorded so far and wait for the
+ * rest to be fanned out to them as they arrive. Should the client of the
+ * forwarded operation abandon it or go away, the operation keeps running
+ * without a client until it completes, see lload_cache_orphan(). If it fails
+ * to complete, the waiting ones are failed too.
+ */
+
+unsigned int lload_cache_ttl = 0;
+unsigned int lload_cache_negative_ttl = 0;
+ber_len_t lload_cache_size = 0;
+
+/* Extended operations that change the directory */
+static struct berval cache_write_exops[] = {
+    BER_BVC(LDAP_EXOP_MODIFY_PASSWD),
+    BER_BVC(LDAP_EXOP_TXN_END),
+    BER_BVNULL
+};
+
+/*
+ * Protects everything below as well as o_cache, o_flight and o_waiting.
+ * Lock order: lload_cache_mutex is taken before an operation's o_link_mutex
+ * and a client's c_io_mutex (flight_fan_out), it is never acquired while
+ * holding any connection or operation mutex.
+ */
+static ldap_pvt_thread_mutex_t lload_cache_mutex;
+static TAvlnode *lload_cache = NULL;
+static TAvlnode *lload_flights = NULL;
+static LDAP_TAILQ_HEAD(CacheLRU, LloadCacheEntry)
+        lload_cache_lru = LDAP_TAILQ_HEAD_INITIALIZER(lload_cache_lru);
+static ber_len_t lload_cache_used = 0;
+static unsigned long lload_cache_generation = 0;
+
+static int
+cache_entry_cmp( const void *left, const void *right )
+{
+    const LloadCacheEntry *l = left, *r = right;
+    int rc;
+
+    rc = ber_bvcmp( &l->ce_auth, &r->ce_auth );
+    if ( rc ) return rc;
+    return ber_bvcmp( &l->ce_request, &r->ce_request );
+}
+
+static LloadCacheEntry *
+cache_entry_new( struct berval *auth, struct berval *request )
+{
+    LloadCacheEntry *ce;
+    ber_len_t len = sizeof(LloadCacheEntry) + auth->bv_len + request->bv_len;
+
+    ce = ch_calloc( 1, len );
+    ce->ce_size = len;
+    LDAP_TAILQ_INIT( &ce->ce_waiters );
+
+    ce->ce_auth.bv_val = (char *)(ce + 1);
+    ce->ce_auth.bv_len = auth->bv_len;
+    if ( auth->bv_len ) {
+        AC_MEMCPY( ce->ce_auth.bv_val, auth->bv_val, auth->bv_len );
+    }
+
+    ce->ce_request.bv_val = ce->ce_auth.bv_val + auth->bv_len;
+    ce->ce_request.bv_len = request->bv_len;
+    AC_MEMCPY( ce->ce_request.bv_val, request->bv_val, request->bv_len );
+
+    return ce;
+}
+
+static void
+cache_entry_clear( LloadCacheEntry *ce )
+{
+    int i;
+
+    for ( i = 0; i < ce->ce_nresponses; i++ ) {
+        ch_free( ce->ce_responses[i].bv_val );
+    }
+    ch_free( ce->ce_responses );
+    ce->ce_responses = NULL;
+    ce->ce_nresponses = 0;
+    ce->ce_size = sizeof(LloadCacheEntry) + ce->ce_auth.bv_len +
+            ce->ce_request.bv_len;
+}
+
+static void
+cache_entry_free( LloadCacheEntry *ce )
+{
+    assert( LDAP_TAILQ_EMPTY( &ce->ce_waiters ) );
+    cache_entry_clear( ce );
+    ch_free( ce );
+}
+
+static void
+cache_entry_append( LloadCacheEntry *ce, struct berval *response )
+{
+    int n = ce->ce_nresponses;
+
+    /* Grow the array whenever we hit a power of two */
+    if ( !( n & ( n - 1 ) ) ) {
+        ce->ce_responses = ch_realloc(
+                ce->ce_responses, ( n ? 2 * n : 1 ) * sizeof(struct berval) );
+    }
+    ber_dupbv( &ce->ce_responses[n], response );
+    ce->ce_nresponses++;
+    ce->ce_size += response->bv_len;
+}
+
+static void
+cache_evict( LloadCacheEntry *ce )
+{
+    assert_locked( &lload_cache_mutex );
+
+    ldap_tavl_delete( &lload_cache, ce, cache_entry_cmp );
+    LDAP_TAILQ_REMOVE( &lload_cache_lru, ce, ce_next );
+    lload_cache_used -= ce->ce_size;
+    cache_entry_free( ce );
+}
+
+static void
+cache_flush( void )
+{
+    LloadCacheEntry *ce;
+
+    assert_locked( &lload_cache_mutex );
+
+    while ( (ce = LDAP_TAILQ_FIRST( &lload_cache_lru )) ) {
+        LDAP_TAILQ_REMOVE( &lload_cache_lru, ce, ce_next );
+        cache_entry_free( ce );
+    }
+    ldap_tavl_free( lload_cache, NULL );
+    lload_cache = NULL;
+    lload_cache_used = 0;
+}
+
+static void
+flight_land( void *arg )
+{
+    LloadCacheEntry *ce = arg;
+
+    ce->ce_flags &= ~LLOAD_CACHE_IN_FLIGHT;
+}
+
+static void
+flight_remove( LloadCacheEntry *ce )
+{
+    assert_locked( &lload_cache_mutex );
+
+    if ( ce->ce_flags & LLOAD_CACHE_IN_FLIGHT ) {
+        ldap_tavl_delete( &lload_flights, ce, cache_entry_cmp );
+        flight_land( ce );
+    }
+}
+
+/*
+ * Queue responses to be sent to the client with the provided msgid, the
+ * caller is responsible for flushing them.
+ */
+static int
+cache_write(
+        LloadConnection *client,
+        ber_int_t msgid,
+        struct berval *responses,
+        int n )
+{
+    BerElement *output;
+    int i;
+
+    if ( !n ) {
+        return LDAP_SUCCESS;
+    }
+
+    checked_lock( &client->c_io_mutex );
+    output = client->c_pendingber;
+    if ( output == NULL && (output = ber_alloc()) == NULL ) {
+        checked_unlock( &client->c_io_mutex );
+        return -1;
+    }
+    client->c_pendingber = output;
+
+    for ( i = 0; i < n; i++ ) {
+        ber_printf( output, "t{ti" /* "}" */, LDAP_TAG_MESSAGE,
+                LDAP_TAG_MSGID, msgid );
+        ber_write( output, responses[i].bv_val, responses[i].bv_len, 0 );
+        ber_printf( output, /* "{" */ "}" );
+    }
+    checked_unlock( &client->c_io_mutex );
+
+    return LDAP_SUCCESS;
+}
+
+/*
+ * Pass a response onto each operation waiting on ce. We cannot call
+ * connection_write_cb with lload_cache_mutex held, the write event is
+ * scheduled instead.
+ */
+static void
+flight_fan_out( LloadCacheEntry *ce, struct berval *response )
+{
+    LloadOperation *op;
+
+    assert_locked( &lload_cache_mutex );
+
+    LDAP_TAILQ_FOREACH ( op, &ce->ce_waiters, o_waiting ) {
+        LloadConnection *client;
+
+        if ( !IS_ALIVE( op, o_refcnt ) ) {
+            continue;
+        }
+        checked_lock( &op->o_link_mutex );
+        client = op->o_client;
+        checked_unlock( &op->o_link_mutex );
+        if ( !client || !IS_ALIVE( client, c_live ) ) {
+            continue;
+        }
+
+        if ( cache_write( client, op->o_client_msgid, response, 1 ) ) {
+            Debug( LDAP_DEBUG_ANY, "flight_fan_out: "
+                    "ber_alloc failed for client connid=%lu\n",
+                    op->o_client_connid );
+            continue;
+        }
+        event_add( client->c_write_event, lload_write_timeout );
+    }
+}
+
+/*
+ * Try to answer op from the cache or attach it to an identical operation in
+ * progress. Returns 1 if that has happened, otherwise 0 and op might have
+ * been set up so its responses are recorded as they are forwarded.
+ */
+int
+lload_cache_lookup( LloadConnection *client, LloadOperation *op )
+{
+    LloadCacheEntry *ce, *found = NULL;
+    int coalesce = lload_features & LLOAD_FEATURE_COALESCE;
+    int rc = 0;
+
+    if ( ( !lload_cache_ttl && !coalesce ) || op->o_tag != LDAP_REQ_SEARCH ||
+            !BER_BVISNULL( &op->o_ctrls ) ) {
+        return 0;
+    }
+
+    CONNECTION_LOCK(client);
+    ce = cache_entry_new( &client->c_auth, &op->o_request );
+    CONNECTION_UNLOCK(client);
+
+    checked_lock( &lload_cache_mutex );
+    if ( lload_cache_ttl ) {
+        found = ldap_tavl_find( lload_cache, ce, cache_entry_cmp );
+        if ( found && found->ce_expires <= slap_get_time() ) {
+            cache_evict( found );
+            found = NULL;
+        }
+    }
+    if ( found ) {
+        /* Keep it at the end of the LRU list */
+        LDAP_TAILQ_REMOVE( &lload_cache_lru, found, ce_next );
+        LDAP_TAILQ_INSERT_TAIL( &lload_cache_lru, found, ce_next );
+
+        if ( cache_write( client, op->o_client_msgid, found->ce_responses,
+                     found->ce_nresponses ) == LDAP_SUCCESS ) {
+            Debug( LDAP_DEBUG_STATS, "lload_cache_lookup: "
+                    "connid=%lu msgid=%d answered from cache with %d "
+                    "responses\n",
+                    op->o_client_connid, op->o_client_msgid,
+                    found->ce_nresponses );
+            rc = 1;
+        }
+        checked_unlock( &lload_cache_mutex );
+        cache_entry_free( ce );
+
+        if ( rc ) {
+            op->o_res = LLOAD_OP_COMPLETED;
+            OPERATION_UNLINK(op);
+            connection_write_cb( -1, 0, client );
+        }
+        return rc;
+    }
+
+    if ( coalesce ) {
+        found = ldap_tavl_find( lload_flights, ce, cache_entry_cmp );
+    }
+    if ( found ) {
+        int replayed = found->ce_nresponses;
+
+        if ( cache_write( client, op->o_client_msgid, found->ce_responses,
+                     replayed ) == LDAP_SUCCESS ) {
+            Debug( LDAP_DEBUG_STATS, "lload_cache_lookup: "
+                    "connid=%lu msgid=%d waiting on an identical search in "
+                    "progress, %d responses replayed\n",
+                    op->o_client_connid, op->o_client_msgid, replayed );
+            LDAP_TAILQ_INSERT_TAIL( &found->ce_waiters, op, o_waiting );
+            op->o_flight = found;
+            rc = 1;
+        }
+        checked_unlock( &lload_cache_mutex );
+        cache_entry_free( ce );
+
+        if ( rc && replayed ) {
+            connection_write_cb( -1, 0, client );
+        }
+        return rc;
+    }
+
+    ce->ce_generation = lload_cache_generation;
+    if ( coalesce ) {
+        ldap_tavl_insert(
+                &lload_flights, ce, cache_entry_cmp, ldap_avl_dup_error );
+        ce->ce_flags |= LLOAD_CACHE_IN_FLIGHT;
+    }
+    op->o_cache = ce;
+    checked_unlock( &lload_cache_mutex );
+
+    return 0;
+}
+
+/*
+ * Record a response being forwarded to the client and pass it onto anyone
+ * waiting. Once the final one is seen, the search result is added to the
+ * cache if still eligible.
+ */
+void
+lload_cache_response(
+        LloadOperation *op,
+        ber_tag_t tag,
+        struct berval *response )
+{
+    LloadCacheEntry *ce, *old;
+    LloadOperation *waiter, *next;
+    BerElementBuffer berbuf;
+    BerElement *ber = (BerElement *)&berbuf;
+    ber_int_t result;
+    ber_len_t len;
+    unsigned int ttl = 0;
+
+    if ( !__atomic_load_n( &op->o_cache, __ATOMIC_ACQUIRE ) ) return;
+
+    checked_lock( &lload_cache_mutex );
+    ce = op->o_cache;
+    if ( !ce ) {
+        checked_unlock( &lload_cache_mutex );
+        return;
+    }
+
+    flight_fan_out( ce, response );
+
+    if ( !( ce->ce_flags & LLOAD_CACHE_TRUNCATED ) ) {
+        if ( lload_cache_size &&
+                ce->ce_size + response->bv_len > lload_cache_size ) {
+            /* Would never fit, late comers can't be served either */
+            flight_remove( ce );
+            cache_entry_clear( ce );
+            ce->ce_flags |= LLOAD_CACHE_TRUNCATED;
+        } else {
+            cache_entry_append( ce, response );
+        }
+    }
+
+    if ( tag == LDAP_RES_SEARCH_ENTRY ) {
+        ce->ce_nentries++;
+    }
+    if ( tag != LDAP_RES_SEARCH_RESULT ) {
+        checked_unlock( &lload_cache_mutex );
+        return;
+    }
+
+    op->o_cache = NULL;
+    flight_remove( ce );
+
+    waiter = LDAP_TAILQ_FIRST( &ce->ce_waiters );
+    LDAP_TAILQ_INIT( &ce->ce_waiters );
+    for ( next = waiter; next; next = LDAP_TAILQ_NEXT( next, o_waiting ) ) {
+        next->o_flight = NULL;
+    }
+
+    ber_init2( ber, response, 0 );
+    if ( lload_cache_ttl && !( ce->ce_flags & LLOAD_CACHE_TRUNCATED ) &&
+            ce->ce_generation == lload_cache_generation &&
+            ber_skip_tag( ber, &len ) != LBER_ERROR &&
+            ber_get_enum( ber, &result ) != LBER_ERROR ) {
+        if ( result == LDAP_NO_SUCH_OBJECT ||
+                ( result == LDAP_SUCCESS && !ce->ce_nentries ) ) {
+            ttl = lload_cache_negative_ttl;
+        } else if ( result == LDAP_SUCCESS ) {
+            ttl = lload_cache_ttl;
+        }
+    }
+
+    if ( ttl ) {
+        ce->ce_expires = slap_get_time() + ttl;
+
+        old = ldap_tavl_find( lload_cache, ce, cache_entry_cmp );
+        if ( old ) {
+            cache_evict( old );
+        }
+        ldap_tavl_insert(
+                &lload_cache, ce, cache_entry_cmp, ldap_avl_dup_error );
+        LDAP_TAILQ_INSERT_TAIL( &lload_cache_lru, ce, ce_next );
+        lload_cache_used += ce->ce_size;
+
+        while ( lload_cache_size && lload_cache_used > lload_cache_size ) {
+            cache_evict( LDAP_TAILQ_FIRST( &lload_cache_lru ) );
+        }
+        ce = NULL;
+    }
+    checked_unlock( &lload_cache_mutex );
+
+    if ( ce ) {
+        cache_entry_free( ce );
+    }
+
+    /* Their final response has been queued by flight_fan_out already */
+    for ( ; waiter; waiter = next ) {
+        next = LDAP_TAILQ_NEXT( waiter, o_waiting );
+
+        waiter->o_res = LLOAD_OP_COMPLETED;
+        OPERATION_UNLINK(waiter);
+    }
+}
+
+/*
+ * Called as op is being unlinked, if it was waiting on another operation,
+ * stop doing so. If responses to it were being recorded and it hasn't
+ * completed, it won't anymore, so neither will the operations waiting on it.
+ */
+void
+lload_cache_unlink( LloadOperation *op )
+{
+    LloadCacheEntry *ce;
+    LloadOperation *waiter, *next;
+
+    if ( !__atomic_load_n( &op->o_cache, __ATOMIC_ACQUIRE ) &&
+            !__atomic_load_n( &op->o_flight, __ATOMIC_ACQUIRE ) ) {
+        return;
+    }
+
+    checked_lock( &lload_cache_mutex );
+    if ( op->o_flight ) {
+        LDAP_TAILQ_REMOVE( &op->o_flight->ce_waiters, op, o_waiting );
+        op->o_flight = NULL;
+    }
+
+    ce = op->o_cache;
+    if ( !ce ) {
+        checked_unlock( &lload_cache_mutex );
+        return;
+    }
+    op->o_cache = NULL;
+    flight_remove( ce );
+
+    waiter = LDAP_TAILQ_FIRST( &ce->ce_waiters );
+    LDAP_TAILQ_INIT( &ce->ce_waiters );
+    for ( next = waiter; next; next = LDAP_TAILQ_NEXT( next, o_waiting ) ) {
+        next->o_flight = NULL;
+    }
+    checked_unlock( &lload_cache_mutex );
+
+    cache_entry_free( ce );
+
+    for ( ; waiter; waiter = next ) {
+        next = LDAP_TAILQ_NEXT( waiter, o_waiting );
+
+        operation_send_reject(
+                waiter, LDAP_UNAVAILABLE, "coalesced search failed", 1 );
+    }
+}
+
+/*
+ * Called as op's client abandons it or disconnects. If other operations are
+ * waiting on op's results, returns 1 and op is to be left running upstream
+ * with no client, its responses are still recorded and fanned out to them.
+ * Otherwise returns 0 and op should be abandoned as usual.
+ */
+int
+lload_cache_orphan( LloadOperation *op )
+{
+    LloadCacheEntry *ce;
+    int rc = 0;
+
+    if ( !__atomic_load_n( &op->o_cache, __ATOMIC_ACQUIRE ) ) {
+        return rc;
+    }
+
+    checked_lock( &lload_cache_mutex );
+    ce = op->o_cache;
+    if ( ce && !LDAP_TAILQ_EMPTY( &ce->ce_waiters ) ) {
+        Debug( LDAP_DEBUG_STATS, "lload_cache_orphan: "
+                "connid=%lu msgid=%d has other searches waiting on it, "
+                "keeping it running upstream\n",
+                op->o_client_connid, op->o_client_msgid );
+        rc = 1;
+    }
+    checked_unlock( &lload_cache_mutex );
+
+    return rc;
+}
+
+/*
+ * Drop all cached results if op is an add, delete, modify or modrdn, or one
+ * of cache_write_exops. Called both when the operation is forwarded and when
+ * it completes. Searches in progress can still finish but nobody else can
+ * join them from now on.
+ */
+void
+lload_cache_invalidate( LloadOperation *op )
+{
+    BerElementBuffer berbuf;
+    BerElement *ber = (BerElement *)&berbuf;
+    struct berval oid;
+    int i;
+
+    if ( !lload_cache_ttl && !( lload_features & LLOAD_FEATURE_COALESCE ) ) {
+        return;
+    }
+
+    switch ( op->o_tag ) {
+        case LDAP_REQ_ADD:
+        case LDAP_REQ_DELETE:
+        case LDAP_REQ_MODIFY:
+        case LDAP_REQ_MODDN:
+            break;
+        case LDAP_REQ_EXTENDED:
+            ber_init2( ber, &op->o_request, 0 );
+            if ( ber_get_stringbv( ber, &oid, LBER_BV_NOTERM ) == LBER_ERROR ) {
+                return;
+            }
+            for ( i = 0; !BER_BVISNULL( &cache_write_exops[i] ); i++ ) {
+                if ( !ber_bvcmp( &oid, &cache_write_exops[i] ) ) {
+                    break;
+                }
+            }
+            if ( BER_BVISNULL( &cache_write_exops[i] ) ) {
+                return;
+            }
+            break;
+        default:
+            return;
+    }
+
+    checked_lock( &lload_cache_mutex );
+    lload_cache_generation++;
+    cache_flush();
+    ldap_tavl_free( lload_flights, flight_land );
+    lload_flights = NULL;
+    checked_unlock( &lload_cache_mutex );
+}
+
+void
+lload_cache_init( void )
+{
+    ldap_pvt_thread_mutex_init( &lload_cache_mutex );
+}
+
+void
+lload_cache_destroy( void )
+{
+    checked_lock( &lload_cache_mutex );
+    cache_flush();
+    ldap_tavl_free( lload_flights, flight_land );
+    lload_flights = NULL;
+    checked_unlock( &lload_cache_mutex );
+
+    ldap_pvt_thread_mutex_destroy( &lload_cache_mutex );
+}
@@ -0,0 +1,456 @@
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1998-2024 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <ac/socket.h>
+#include <ac/string.h>
+
+#include "lutil.h"
+#include "lload.h"
+
+/*
+ * Traffic classes.
+ *
+ * Each operation received from a client is matched against the configured
+ * classes in order and belongs to the first one that matches, if any. A class
+ * can restrict:
+ * - how many of its operations can be in progress at the same time, anything
+ *   over that is rejected with LDAP_BUSY straight away
+ * - what share of each backend's max-pending-ops its operations can occupy,
+ *   keeping the remainder available to other traffic
+ *
+ * lloadd does not queue operations waiting for an upstream slot, it turns
+ * them away, so this is how bulk traffic is kept from crowding out
+ * interactive clients.
+ *
+ * The list is only modified while the server is paused. Operations hold a
+ * reference on their class so a class removed from the configuration stays
+ * around until the last one has finished.
+ */
+
+struct ClassList lload_classes = LDAP_STAILQ_HEAD_INITIALIZER(lload_classes);
+
+static slap_verbmasks class_ops[] = {
+    { BER_BVC("add"), LLOAD_CLASS_OP_ADD },
+    { BER_BVC("bind"), LLOAD_CLASS_OP_BIND },
+    { BER_BVC("compare"), LLOAD_CLASS_OP_COMPARE },
+    { BER_BVC("delete"), LLOAD_CLASS_OP_DELETE },
+    { BER_BVC("extended"), LLOAD_CLASS_OP_EXTENDED },
+    { BER_BVC("modify"), LLOAD_CLASS_OP_MODIFY },
+    { BER_BVC("modrdn"), LLOAD_CLASS_OP_MODRDN },
+    { BER_BVC("search"), LLOAD_CLASS_OP_SEARCH },
+    { BER_BVNULL, 0 }
+};
+
+static unsigned int
+class_op_mask( ber_tag_t tag )
+{
+    switch ( tag ) {
+        case LDAP_REQ_ADD:
+            return LLOAD_CLASS_OP_ADD;
+        case LDAP_REQ_BIND:
+            return LLOAD_CLASS_OP_BIND;
+        case LDAP_REQ_COMPARE:
+            return LLOAD_CLASS_OP_COMPARE;
+        case LDAP_REQ_DELETE:
+            return LLOAD_CLASS_OP_DELETE;
+        case LDAP_REQ_EXTENDED:
+            return LLOAD_CLASS_OP_EXTENDED;
+        case LDAP_REQ_MODIFY:
+            return LLOAD_CLASS_OP_MODIFY;
+        case LDAP_REQ_MODRDN:
+            return LLOAD_CLASS_OP_MODRDN;
+        case LDAP_REQ_SEARCH:
+            return LLOAD_CLASS_OP_SEARCH;
+    }
+    return 0;
+}
+
+/*
+ * Extract the address from "IP=addr:port" or "IP=[addr]:port" as produced by
+ * ldap_pvt_sockaddrstr.
+ */
+static int
+class_peer_parse( struct berval *peer, int *family, unsigned char *addr )
+{
+    char buf[LDAP_IPADDRLEN], *start, *end;
+    ber_len_t len;
+
+    if ( peer->bv_len <= STRLENOF("IP=") ||
+            strncmp( peer->bv_val, "IP=", STRLENOF("IP=") ) ) {
+        return -1;
+    }
+    start = peer->bv_val + STRLENOF("IP=");
+
+    if ( *start == '[' ) {
+        start++;
+        end = strchr( start, ']' );
+    } else {
+        end = strrchr( start, ':' );
+    }
+    if ( !end ) {
+        return -1;
+    }
+    len = end - start;
+    if ( len >= sizeof(buf) ) {
+        return -1;
+    }
+    AC_MEMCPY( buf, start, len );
+    buf[len] = '\0';
+
+#ifdef LDAP_PF_INET6
+    if ( inet_pton( AF_INET6, buf, addr ) == 1 ) {
+        *family = AF_INET6;
+        return LDAP_SUCCESS;
+    }
+#endif /* LDAP_PF_INET6 */
+    if ( inet_pton( AF_INET, buf, addr ) == 1 ) {
+        *family = AF_INET;
+        return LDAP_SUCCESS;
+    }
+    return -1;
+}
+
+static int
+class_match_peer( LloadClass *cl, struct berval *peer )
+{
+    unsigned char addr[16];
+    int family, bytes = cl->cl_peer_bits / 8, bits = cl->cl_peer_bits % 8;
+
+    if ( class_peer_parse( peer, &family, addr ) ||
+            family != cl->cl_peer_family ) {
+        return 0;
+    }
+    if ( memcmp( addr, cl->cl_peer_addr, bytes ) ) {
+        return 0;
+    }
+    if ( bits ) {
+        unsigned char mask = 0xff << ( 8 - bits );
+
+        if ( ( addr[bytes] ^ cl->cl_peer_addr[bytes] ) & mask ) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Normalise the DN of a "dn:" identity into ndn, left empty for any other.
+ */
+static void
+class_auth_normalize( struct berval *auth, struct berval *ndn )
+{
+    struct berval dn;
+
+    BER_BVZERO( ndn );
+    if ( auth->bv_len <= STRLENOF("dn:") ||
+            strncasecmp( auth->bv_val, "dn:", STRLENOF("dn:") ) ) {
+        return;
+    }
+    dn.bv_val = auth->bv_val + STRLENOF("dn:");
+    dn.bv_len = auth->bv_len - STRLENOF("dn:");
+
+    if ( lload_dn_normalize( &dn, ndn ) ) {
+        BER_BVZERO( ndn );
+    }
+}
+
+/*
+ * The normalised DN ndn matches if it is the class DN or any entry below it,
+ * the class DN has to start right after an RDN separator.
+ */
+static int
+class_match_dn( LloadClass *cl, struct berval *ndn )
+{
+    ber_len_t d;
+
+    if ( ndn->bv_len < cl->cl_binddn.bv_len ) {
+        return 0;
+    }
+    d = ndn->bv_len - cl->cl_binddn.bv_len;
+    if ( d ) {
+        ber_len_t i;
+
+        if ( ndn->bv_val[d - 1] != ',' ) {
+            return 0;
+        }
+        /* An escaped comma is part of the value, not a separator */
+        for ( i = d - 1; i > 0 && ndn->bv_val[i - 1] == '\\'; i-- )
+            ;
+        if ( ( d - 1 - i ) % 2 ) {
+            return 0;
+        }
+    }
+    return !strncasecmp(
+            ndn->bv_val + d, cl->cl_binddn.bv_val, cl->cl_binddn.bv_len );
+}
+
+/*
+ * Find the class op belongs to and count it against that class. Returns
+ * LDAP_BUSY if the class has too many operations in progress already.
+ */
+int
+lload_class_acquire( LloadConnection *c, LloadOperation *op )
+{
+    LloadClass *cl;
+    struct berval ndn = BER_BVNULL;
+    unsigned int mask = class_op_mask( op->o_tag );
+    int rc = LDAP_SUCCESS, normalized = 0;
+
+    CONNECTION_LOCK(c);
+    LDAP_STAILQ_FOREACH( cl, &lload_classes, cl_next ) {
+        if ( cl->cl_ops && !( cl->cl_ops & mask ) ) continue;
+        if ( !BER_BVISNULL( &cl->cl_binddn ) ) {
+            /* Only once, and only if some class cares */
+            if ( !normalized ) {
+                class_auth_normalize( &c->c_auth, &ndn );
+                normalized = 1;
+            }
+            if ( BER_BVISNULL( &ndn ) || !class_match_dn( cl, &ndn ) )
+                continue;
+        }
+        if ( cl->cl_peer_family != AF_UNSPEC &&
+                !class_match_peer( cl, &c->c_peer_name ) )
+            continue;
+        break;
+    }
+    CONNECTION_UNLOCK(c);
+    ber_memfree( ndn.bv_val );
+
+    if ( !cl ) {
+        return LDAP_SUCCESS;
+    }
+
+    if ( cl->cl_max_pending ) {
+        uintptr_t pending = __atomic_load_n( &cl->cl_pending, __ATOMIC_RELAXED );
+
+        do {
+            if ( pending >= cl->cl_max_pending ) {
+                rc = LDAP_BUSY;
+                break;
+            }
+        } while ( !__atomic_compare_exchange_n( &cl->cl_pending, &pending,
+                pending + 1, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) );
+    } else {
+        __atomic_add_fetch( &cl->cl_pending, 1, __ATOMIC_RELAXED );
+    }
+
+    if ( rc == LDAP_SUCCESS ) {
+        __atomic_add_fetch( &cl->cl_refcnt, 1, __ATOMIC_ACQUIRE );
+        op->o_class = cl;
+    } else {
+        Debug( LDAP_DEBUG_STATS, "lload_class_acquire: "
+                "connid=%lu msgid=%d class %s has %u operations pending, "
+                "rejecting\n",
+                op->o_client_connid, op->o_client_msgid, cl->cl_name.bv_val,
+                cl->cl_max_pending );
+    }
+    return rc;
+}
+
+/*
+ * The operation has completed, let another one of its class in. The class
+ * itself stays referenced until the operation is destroyed.
+ */
+void
+lload_class_complete( LloadOperation *op )
+{
+    if ( op->o_class ) {
+        __atomic_sub_fetch( &op->o_class->cl_pending, 1, __ATOMIC_RELAXED );
+    }
+}
+
+void
+lload_class_release( LloadClass *cl )
+{
+    if ( !__atomic_sub_fetch( &cl->cl_refcnt, 1, __ATOMIC_ACQ_REL ) ) {
+        lload_class_free( cl );
+    }
+}
+
+void
+lload_class_free( LloadClass *cl )
+{
+    ch_free( cl->cl_name.bv_val );
+    ch_free( cl->cl_binddn.bv_val );
+    ch_free( cl );
+}
+
+/*
+ * Parse "<name> [binddn=<dn>] [peer=<address>[/<bits>]] [op=<op>[,...]]
+ * [max-pending=<n>] [share=<percent>]"
+ */
+LloadClass *
+lload_class_parse( int argc, char **argv, char *msg, size_t msglen )
+{
+    LloadClass *cl;
+    struct berval bv;
+    int i;
+
+    cl = ch_calloc( 1, sizeof(LloadClass) );
+    ber_str2bv( argv[0], 0, 1, &cl->cl_name );
+    cl->cl_peer_family = AF_UNSPEC;
+    cl->cl_refcnt = 1;
+
+    for ( i = 1; i < argc; i++ ) {
+        char *arg = argv[i], *value = strchr( arg, '=' );
+
+        if ( !value ) {
+            snprintf( msg, msglen, "malformed class option \"%s\"", arg );
+            goto fail;
+        }
+        value++;
+
+        if ( !strncasecmp( arg, "binddn=", STRLENOF("binddn=") ) ) {
+            if ( !*value ) {
+                snprintf( msg, msglen, "empty binddn" );
+                goto fail;
+            }
+            ch_free( cl->cl_binddn.bv_val );
+            BER_BVZERO( &cl->cl_binddn );
+            ber_str2bv( value, 0, 0, &bv );
+            if ( lload_dn_normalize( &bv, &cl->cl_binddn ) ) {
+                snprintf( msg, msglen, "invalid binddn \"%s\"", value );
+                goto fail;
+            }
+
+        } else if ( !strncasecmp( arg, "peer=", STRLENOF("peer=") ) ) {
+            char *bits = strchr( value, '/' ), addr[LDAP_IPADDRLEN];
+            int max = 32;
+            ber_len_t len = bits ? bits - value : strlen( value );
+
+            if ( len >= sizeof(addr) ) {
+                snprintf( msg, msglen, "invalid peer address \"%s\"", value );
+                goto fail;
+            }
+            AC_MEMCPY( addr, value, len );
+            addr[len] = '\0';
+
+            if ( inet_pton( AF_INET, addr, cl->cl_peer_addr ) == 1 ) {
+                cl->cl_peer_family = AF_INET;
+#ifdef LDAP_PF_INET6
+            } else if ( inet_pton( AF_INET6, addr, cl->cl_peer_addr ) == 1 ) {
+                cl->cl_peer_family = AF_INET6;
+                max = 128;
+#endif /* LDAP_PF_INET6 */
+            } else {
+                snprintf( msg, msglen, "invalid peer address \"%s\"", value );
+                goto fail;
+            }
+
+            cl->cl_peer_bits = max;
+            if ( bits && ( lutil_atoi( &cl->cl_peer_bits, bits + 1 ) ||
+                                 cl->cl_peer_bits < 0 ||
+                                 cl->cl_peer_bits > max ) ) {
+                snprintf( msg, msglen, "invalid prefix length \"%s\"", bits );
+                goto fail;
+            }
+
+        } else if ( !strncasecmp( arg, "op=", STRLENOF("op=") ) ) {
+            char **ops = ldap_str2charray( value, "," );
+            int j;
+
+            cl->cl_ops = 0;
+            for ( j = 0; ops && ops[j]; j++ ) {
+                int k = verb_to_mask( ops[j], class_ops );
+
+                if ( BER_BVISNULL( &class_ops[k].word ) ) {
+                    snprintf( msg, msglen, "unknown operation \"%s\"", ops[j] );
+                    ldap_charray_free( ops );
+                    goto fail;
+                }
+                cl->cl_ops |= class_ops[k].mask;
+            }
+            ldap_charray_free( ops );
+            if ( !cl->cl_ops ) {
+                snprintf( msg, msglen, "no operations listed" );
+                goto fail;
+            }
+
+        } else if ( !strncasecmp( arg, "max-pending=", STRLENOF("max-pending=") ) ) {
+            if ( lutil_atou( &cl->cl_max_pending, value ) ) {
+                snprintf( msg, msglen, "invalid max-pending \"%s\"", value );
+                goto fail;
+            }
+
+        } else if ( !strncasecmp( arg, "share=", STRLENOF("share=") ) ) {
+            if ( lutil_atou( &cl->cl_share, value ) || cl->cl_share > 100 ) {
+                snprintf( msg, msglen, "invalid share \"%s\"", value );
+                goto fail;
+            }
+
+        } else {
+            snprintf( msg, msglen, "unknown class option \"%s\"", arg );
+            goto fail;
+        }
+    }
+
+    return cl;
+
+fail:
+    lload_class_free( cl );
+    return NULL;
+}
+
+void
+lload_class_unparse( LloadClass *cl, struct berval *out, size_t size )
+{
+    char *ptr = out->bv_val, *end = out->bv_val + size;
+    int i;
+
+    ptr += snprintf( ptr, end - ptr, "%s", cl->cl_name.bv_val );
+    if ( ptr < end && !BER_BVISNULL( &cl->cl_binddn ) ) {
+        ptr += snprintf( ptr, end - ptr, " \"binddn=%s\"", cl->cl_binddn.bv_val );
+    }
+    if ( ptr < end && cl->cl_peer_family != AF_UNSPEC ) {
+        char addr[LDAP_IPADDRLEN];
+
+        inet_ntop( cl->cl_peer_family, cl->cl_peer_addr, addr, sizeof(addr) );
+        ptr += snprintf(
+                ptr, end - ptr, " peer=%s/%d", addr, cl->cl_peer_bits );
+    }
+    if ( ptr < end && cl->cl_ops ) {
+        char sep = '=';
+
+        ptr += snprintf( ptr, end - ptr, " op" );
+        for ( i = 0; ptr < end && !BER_BVISNULL( &class_ops[i].word ); i++ ) {
+            if ( cl->cl_ops & class_ops[i].mask ) {
+                ptr += snprintf( ptr, end - ptr, "%c%s", sep,
+                        class_ops[i].word.bv_val );
+                sep = ',';
+            }
+        }
+    }
+    if ( ptr < end && cl->cl_max_pending ) {
+        ptr += snprintf(
+                ptr, end - ptr, " max-pending=%u", cl->cl_max_pending );
+    }
+    if ( ptr < end && cl->cl_share ) {
+        ptr += snprintf( ptr, end - ptr, " share=%u", cl->cl_share );
+    }
+    out->bv_len = ptr < end ? ptr - out->bv_val : size - 1;
+}
+
+void
+lload_classes_destroy( void )
+{
+    LloadClass *cl;
+
+    while ( (cl = LDAP_STAILQ_FIRST( &lload_classes )) ) {
+        LDAP_STAILQ_REMOVE_HEAD( &lload_classes, cl_next );
+        lload_class_release( cl );
+    }
+}
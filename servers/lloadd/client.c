@@ -51,7 +51,7 @@ request_abandon( LloadConnection *c, LloadOperation *op )
     }
 
     CONNECTION_LOCK(c);
-    request = ldap_tavl_find( c->c_ops, &needle, operation_client_cmp );
+    request = lload_optable_find( &c->c_ops, &needle );
     if ( !request ) {
         Debug( LDAP_DEBUG_STATS, "request_abandon: "
                 "connid=%lu msgid=%d requests abandon of an operation "
@@ -177,6 +177,13 @@ request_process( LloadConnection *client, LloadOperation *op )
     }
     CONNECTION_UNLOCK(client);
 
+    if ( client_restricted == LLOAD_OP_NOT_RESTRICTED &&
+            lload_cache_lookup( client, op ) ) {
+        return LDAP_SUCCESS;
+    }
+    lload_cache_invalidate( op );
+    lload_bind_cache_invalidate( op );
+
     if ( upstream ) {
         b = upstream->c_backend;
         checked_lock( &b->b_mutex );
@@ -256,8 +263,7 @@ request_process( LloadConnection *client, LloadOperation *op )
     }
 
     op->o_upstream_msgid = msgid = upstream->c_next_msgid++;
-    rc = ldap_tavl_insert(
-            &upstream->c_ops, op, operation_upstream_cmp, ldap_avl_dup_error );
+    rc = lload_optable_insert( &upstream->c_ops, op );
 
     CONNECTION_UNLOCK(upstream);
 
@@ -313,10 +319,11 @@ request_process( LloadConnection *client, LloadOperation *op )
 
         ber_printf( output, /* "{{" */ "}}" );
     } else {
-        ber_printf( output, "t{titOtO}", LDAP_TAG_MESSAGE,
-                LDAP_TAG_MSGID, msgid,
-                op->o_tag, &op->o_request,
-                LDAP_TAG_CONTROLS, BER_BV_OPTIONAL( &op->o_ctrls ) );
+        /* Nothing to change past the msgid, pass the rest through as-is */
+        ber_printf( output, "t{ti" /* "}" */, LDAP_TAG_MESSAGE,
+                LDAP_TAG_MSGID, msgid );
+        ber_write( output, op->o_payload.bv_val, op->o_payload.bv_len, 0 );
+        ber_printf( output, /* "{" */ "}" );
     }
     checked_unlock( &upstream->c_io_mutex );
 
@@ -432,6 +439,15 @@ handle_one_request( LloadConnection *c )
         return LDAP_SUCCESS;
     }
 
+    /* Rejecting a step of a multi-stage SASL bind would leave it hanging */
+    if ( !LDAP_STAILQ_EMPTY( &lload_classes ) &&
+            lload_class_acquire( c, op ) != LDAP_SUCCESS &&
+            state != LLOAD_C_BINDING ) {
+        operation_send_reject(
+                op, LDAP_BUSY, "traffic class operation limit reached", 0 );
+        return LDAP_SUCCESS;
+    }
+
     return handler( c, op );
 }
 
@@ -528,7 +544,7 @@ fail:
             "connid=%lu failed rc=%d\n",
             c->c_connid, rc );
 
-    assert( c->c_ops == NULL );
+    assert( LLOAD_OPTABLE_EMPTY( &c->c_ops ) );
     epoch = epoch_join();
     CONNECTION_LOCK_DESTROY(c);
     epoch_leave( epoch );
@@ -659,14 +675,14 @@ fail:
 void
 client_reset( LloadConnection *c )
 {
-    TAvlnode *root;
+    LloadOpTable ops;
     long freed = 0, executing;
     LloadConnection *linked_upstream = NULL;
     enum op_restriction restricted = c->c_restricted;
 
     CONNECTION_ASSERT_LOCKED(c);
-    root = c->c_ops;
-    c->c_ops = NULL;
+    ops = c->c_ops;
+    lload_optable_init( &c->c_ops, 0 );
     executing = c->c_n_ops_executing;
     c->c_n_ops_executing = 0;
 
@@ -694,12 +710,13 @@ client_reset( LloadConnection *c )
     }
     CONNECTION_UNLOCK(c);
 
-    if ( root ) {
-        freed = ldap_tavl_free( root, (AVL_FREE)operation_abandon );
+    if ( !LLOAD_OPTABLE_EMPTY( &ops ) ) {
+        freed = lload_optable_free( &ops, operation_abandon );
         Debug( LDAP_DEBUG_TRACE, "client_reset: "
                 "dropped %ld operations\n",
                 freed );
     }
+    lload_optable_destroy( &ops );
     assert( freed == executing );
 
     if ( linked_upstream && restricted == LLOAD_OP_RESTRICTED_UPSTREAM ) {
@@ -779,7 +796,7 @@ client_destroy( LloadConnection *c )
 
     c->c_state = LLOAD_C_INVALID;
 
-    assert( c->c_ops == NULL );
+    assert( LLOAD_OPTABLE_EMPTY( &c->c_ops ) );
 
     if ( c->c_read_event ) {
         event_free( c->c_read_event );
@@ -113,6 +113,7 @@ static ConfigDriver config_tier;
 static ConfigDriver config_backend;
 static ConfigDriver config_bindconf;
 static ConfigDriver config_restrict_oid;
+static ConfigDriver config_class;
 #ifdef LDAP_TCP_BUFFER
 static ConfigDriver config_tcp_buffer;
 #endif /* LDAP_TCP_BUFFER */
@@ -166,6 +167,8 @@ enum {
     CFG_URI,
     CFG_NUMCONNS,
     CFG_BINDCONNS,
+    CFG_MAX_NUMCONNS,
+    CFG_MAX_BINDCONNS,
     CFG_RETRY,
     CFG_MAX_PENDING_OPS,
     CFG_MAX_PENDING_CONNS,
@@ -676,6 +679,17 @@ static ConfigTable config_back_cf_table[] = {
             "SYNTAX OMsDirectoryString )",
         NULL, NULL
     },
+    { "class", "name> <options", 2, 0, 0,
+        ARG_MAGIC,
+        &config_class,
+        "( OLcfgBkAt:13.47 "
+            "NAME 'olcBkLloadClass' "
+            "DESC 'Traffic class and its limits' "
+            "EQUALITY caseIgnoreMatch "
+            "SYNTAX OMsDirectoryString "
+            "X-ORDERED 'VALUES' )",
+        NULL, NULL
+    },
     { "restrict_control", "OID> <action", 3, 3, 0,
         ARG_MAGIC|CFG_RESTRICT_CONTROL,
         &config_restrict_oid,
@@ -686,6 +700,59 @@ static ConfigTable config_back_cf_table[] = {
             "SYNTAX OMsDirectoryString )",
         NULL, NULL
     },
+    { "cache_ttl", "seconds", 2, 2, 0,
+        ARG_UINT,
+        &lload_cache_ttl,
+        "( OLcfgBkAt:13.41 "
+            "NAME 'olcBkLloadCacheTTL' "
+            "DESC 'How long search results are cached for, 0 disables the cache' "
+            "EQUALITY integerMatch "
+            "SYNTAX OMsInteger "
+            "SINGLE-VALUE )",
+        NULL,
+        { .v_uint = 0 }
+    },
+    { "cache_negative_ttl", "seconds", 2, 2, 0,
+        ARG_UINT,
+        &lload_cache_negative_ttl,
+        "( OLcfgBkAt:13.42 "
+            "NAME 'olcBkLloadCacheNegativeTTL' "
+            "DESC 'How long empty search results are cached for' "
+            "EQUALITY integerMatch "
+            "SYNTAX OMsInteger "
+            "SINGLE-VALUE )",
+        NULL,
+        { .v_uint = 0 }
+    },
+    { "cache_size", "bytes", 2, 2, 0,
+        ARG_BER_LEN_T,
+        &lload_cache_size,
+        "( OLcfgBkAt:13.43 "
+            "NAME 'olcBkLloadCacheSize' "
+            "DESC 'Maximum amount of memory used by the search result cache' "
+            "EQUALITY integerMatch "
+            "SYNTAX OMsInteger "
+            "SINGLE-VALUE )",
+        NULL,
+        { .v_ber_t = 0 }
+    },
+    { "bind_cache_ttl", "seconds", 2, 2, 0,
+#ifdef HAVE_OPENSSL
+        ARG_UINT,
+        &lload_bind_cache_ttl,
+#else
+        ARG_IGNORED,
+        NULL,
+#endif
+        "( OLcfgBkAt:13.46 "
+            "NAME 'olcBkLloadBindCacheTTL' "
+            "DESC 'How long verified simple bind credentials are cached for, 0 disables the cache' "
+            "EQUALITY integerMatch "
+            "SYNTAX OMsInteger "
+            "SINGLE-VALUE )",
+        NULL,
+        { .v_uint = 0 }
+    },
 
     /* cn=config only options */
 #ifdef BALANCER_MODULE
@@ -777,6 +844,28 @@ static ConfigTable config_back_cf_table[] = {
         NULL,
         { .v_uint = 0 },
     },
+    { "", NULL, 2, 2, 0,
+        ARG_UINT|ARG_MAGIC|CFG_MAX_NUMCONNS,
+        &backend_cf_gen,
+        "( OLcfgBkAt:13.44 "
+            "NAME 'olcBkLloadMaxNumconns' "
+            "DESC 'Number of regular connections the pool can grow to' "
+            "EQUALITY integerMatch "
+            "SYNTAX OMsInteger "
+            "SINGLE-VALUE )",
+        NULL, NULL
+    },
+    { "", NULL, 2, 2, 0,
+        ARG_UINT|ARG_MAGIC|CFG_MAX_BINDCONNS,
+        &backend_cf_gen,
+        "( OLcfgBkAt:13.45 "
+            "NAME 'olcBkLloadMaxBindconns' "
+            "DESC 'Number of bind connections the pool can grow to' "
+            "EQUALITY integerMatch "
+            "SYNTAX OMsInteger "
+            "SINGLE-VALUE )",
+        NULL, NULL
+    },
 #endif /* BALANCER_MODULE */
 
     { NULL, NULL, 0, 0, 0, ARG_IGNORED, NULL }
@@ -824,6 +913,11 @@ static ConfigOCs lloadocs[] = {
             "$ olcBkLloadWriteCoherence "
             "$ olcBkLloadRestrictExop "
             "$ olcBkLloadRestrictControl "
+            "$ olcBkLloadCacheTTL "
+            "$ olcBkLloadCacheNegativeTTL "
+            "$ olcBkLloadCacheSize "
+            "$ olcBkLloadBindCacheTTL "
+            "$ olcBkLloadClass "
         ") )",
         Cft_Backend, config_back_cf_table,
         NULL,
@@ -841,7 +935,9 @@ static ConfigOCs lloadocs[] = {
             "$ olcBkLloadMaxPendingOps "
             "$ olcBkLloadMaxPendingConns ) "
         "MAY ( olcBkLloadStartTLS "
-            "$ olcBkLloadWeight ) "
+            "$ olcBkLloadWeight "
+            "$ olcBkLloadMaxNumconns "
+            "$ olcBkLloadMaxBindconns ) "
         ") )",
         Cft_Misc, config_back_cf_table,
         lload_backend_ldadd,
@@ -1517,6 +1613,82 @@ done:
     return rc;
 }
 
+static int
+config_class( ConfigArgs *c )
+{
+    LloadClass *cl, *prev = NULL;
+    int i;
+
+    if ( c->op == SLAP_CONFIG_EMIT ) {
+        char buf[SLAP_TEXT_BUFLEN];
+        struct berval bv;
+
+        i = 0;
+        LDAP_STAILQ_FOREACH( cl, &lload_classes, cl_next ) {
+            bv.bv_len = snprintf( buf, sizeof(buf), SLAP_X_ORDERED_FMT, i++ );
+            bv.bv_val = buf + bv.bv_len;
+            lload_class_unparse( cl, &bv, sizeof(buf) - bv.bv_len );
+            bv.bv_len += bv.bv_val - buf;
+            bv.bv_val = buf;
+            value_add_one( &c->rvalue_vals, &bv );
+        }
+        return LDAP_SUCCESS;
+
+    } else if ( c->op == LDAP_MOD_DELETE ) {
+        if ( c->valx < 0 ) {
+            while ( (cl = LDAP_STAILQ_FIRST( &lload_classes )) ) {
+                LDAP_STAILQ_REMOVE_HEAD( &lload_classes, cl_next );
+                lload_class_release( cl );
+            }
+            return LDAP_SUCCESS;
+        }
+
+        i = 0;
+        LDAP_STAILQ_FOREACH( cl, &lload_classes, cl_next ) {
+            if ( i++ == c->valx ) break;
+        }
+        if ( !cl ) {
+            return 1;
+        }
+        LDAP_STAILQ_REMOVE( &lload_classes, cl, LloadClass, cl_next );
+        /* Operations in progress might still hold a reference */
+        lload_class_release( cl );
+        return LDAP_SUCCESS;
+    }
+
+    cl = lload_class_parse(
+            c->argc - 1, c->argv + 1, c->cr_msg, sizeof(c->cr_msg) );
+    if ( !cl ) {
+        Debug( LDAP_DEBUG_ANY, "%s: %s\n", c->log, c->cr_msg );
+        return 1;
+    }
+
+    LDAP_STAILQ_FOREACH( prev, &lload_classes, cl_next ) {
+        if ( !ber_bvstrcasecmp( &prev->cl_name, &cl->cl_name ) ) {
+            snprintf( c->cr_msg, sizeof(c->cr_msg),
+                    "class %s already defined", cl->cl_name.bv_val );
+            Debug( LDAP_DEBUG_ANY, "%s: %s\n", c->log, c->cr_msg );
+            lload_class_free( cl );
+            return 1;
+        }
+    }
+
+    /* Insert at the requested position, classes are matched in order */
+    if ( c->valx == 0 || LDAP_STAILQ_EMPTY( &lload_classes ) ) {
+        LDAP_STAILQ_INSERT_HEAD( &lload_classes, cl, cl_next );
+    } else if ( c->valx < 0 ) {
+        LDAP_STAILQ_INSERT_TAIL( &lload_classes, cl, cl_next );
+    } else {
+        prev = LDAP_STAILQ_FIRST( &lload_classes );
+        for ( i = 1; i < c->valx && LDAP_STAILQ_NEXT( prev, cl_next ); i++ ) {
+            prev = LDAP_STAILQ_NEXT( prev, cl_next );
+        }
+        LDAP_STAILQ_INSERT_AFTER( &lload_classes, prev, cl, cl_next );
+    }
+
+    return LDAP_SUCCESS;
+}
+
 static int
 config_tier( ConfigArgs *c )
 {
@@ -2025,6 +2197,8 @@ config_feature( ConfigArgs *c )
 #endif /* LDAP_API_FEATURE_VERIFY_CREDENTIALS */
         { BER_BVC("proxyauthz"), LLOAD_FEATURE_PROXYAUTHZ },
         { BER_BVC("read_pause"), LLOAD_FEATURE_PAUSE },
+        { BER_BVC("coalesce"), LLOAD_FEATURE_COALESCE },
+        { BER_BVC("run_to_completion"), LLOAD_FEATURE_INLINE },
         { BER_BVNULL, 0 }
     };
     slap_mask_t mask = 0;
@@ -2830,6 +3004,8 @@ static slap_cf_aux_table backendkey[] = {
 
     { BER_BVC("numconns="), offsetof(LloadBackend, b_numconns), 'i', 0, NULL },
     { BER_BVC("bindconns="), offsetof(LloadBackend, b_numbindconns), 'i', 0, NULL },
+    { BER_BVC("max-numconns="), offsetof(LloadBackend, b_max_numconns), 'i', 0, NULL },
+    { BER_BVC("max-bindconns="), offsetof(LloadBackend, b_max_numbindconns), 'i', 0, NULL },
     { BER_BVC("retry="), offsetof(LloadBackend, b_retry_timeout), 'i', 0, NULL },
 
     { BER_BVC("max-pending-ops="), offsetof(LloadBackend, b_max_pending), 'i', 0, NULL },
@@ -3672,6 +3848,12 @@ backend_cf_gen( ConfigArgs *c )
             case CFG_BINDCONNS:
                 c->value_uint = b->b_numbindconns;
                 break;
+            case CFG_MAX_NUMCONNS:
+                c->value_uint = b->b_max_numconns;
+                break;
+            case CFG_MAX_BINDCONNS:
+                c->value_uint = b->b_max_numbindconns;
+                break;
             case CFG_RETRY:
                 c->value_uint = b->b_retry_timeout;
                 break;
@@ -3700,6 +3882,12 @@ backend_cf_gen( ConfigArgs *c )
             case CFG_STARTTLS:
                 b->b_tls_conf = LLOAD_CLEARTEXT;
                 break;
+            case CFG_MAX_NUMCONNS:
+                b->b_max_numconns = 0;
+                break;
+            case CFG_MAX_BINDCONNS:
+                b->b_max_numbindconns = 0;
+                break;
             default:
                 break;
         }
@@ -3737,6 +3925,14 @@ backend_cf_gen( ConfigArgs *c )
             b->b_numbindconns = c->value_uint;
             flag = LLOAD_BACKEND_MOD_CONNS;
             break;
+        case CFG_MAX_NUMCONNS:
+            b->b_max_numconns = c->value_uint;
+            flag = LLOAD_BACKEND_MOD_CONNS;
+            break;
+        case CFG_MAX_BINDCONNS:
+            b->b_max_numbindconns = c->value_uint;
+            flag = LLOAD_BACKEND_MOD_CONNS;
+            break;
         case CFG_RETRY:
             b->b_retry_timeout = c->value_uint;
             break;
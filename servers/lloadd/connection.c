@@ -49,6 +49,36 @@ lload_connection_assign_nextid( LloadConnection *conn )
     conn->c_connid = __atomic_fetch_add( &conn_nextid, 1, __ATOMIC_RELAXED );
 }
 
+/*
+ * With run_to_completion, requests that might need a password verified
+ * against the bind cache are still left to a worker thread, the key
+ * derivation is far too slow to run on an I/O thread.
+ */
+static int
+pdu_needs_worker( BerElement *ber )
+{
+    BerElement *copy;
+    ber_len_t len;
+    ber_int_t msgid;
+    ber_tag_t tag = LBER_DEFAULT;
+
+    if ( !lload_bind_cache_ttl ) {
+        return 0;
+    }
+
+    /* Peek at the protocolOp through a copy sharing the buffer, the pdu
+     * handler expects to find ber where it is now */
+    if ( (copy = ber_dup( ber )) == NULL ) {
+        return 0;
+    }
+    if ( ber_get_int( copy, &msgid ) == LDAP_TAG_MSGID ) {
+        tag = ber_peek_tag( copy, &len );
+    }
+    ber_free( copy, 0 );
+
+    return tag == LDAP_REQ_BIND;
+}
+
 /*
  * We start off with the connection muted and c_currentber holding the pdu we
  * received.
@@ -137,6 +167,17 @@ handle_pdus( void *ctx, void *arg )
             break;
         }
 
+        if ( !ctx && pdu_needs_worker( ber ) &&
+                !ldap_pvt_thread_pool_submit(
+                        &connection_pool, handle_pdus, c ) ) {
+            /* Running on the I/O thread, the task owns our reference now */
+            Debug( LDAP_DEBUG_CONNS, "handle_pdus: "
+                    "handing a bind on connid=%lu over to a worker\n",
+                    c->c_connid );
+            epoch_leave( epoch );
+            return NULL;
+        }
+
         assert( IS_ALIVE( c, c_refcnt ) );
         epoch_leave( epoch );
         epoch = epoch_join();
@@ -167,6 +208,9 @@ done:
  *
  * If we can't submit it to the queue (overload), process this one and return
  * to the event loop immediately after.
+ *
+ * With run_to_completion enabled, the I/O thread that owns the connection
+ * handles the PDUs itself, saving the hand-off to a worker thread.
  */
 void
 connection_read_cb( evutil_socket_t s, short what, void *arg )
@@ -262,6 +306,14 @@ connection_read_cb( evutil_socket_t s, short what, void *arg )
     checked_unlock( &c->c_io_mutex );
     event_del( c->c_read_event );
 
+    if ( (lload_features & LLOAD_FEATURE_INLINE) &&
+            lload_conn_max_pdus_per_cycle && !pdu_needs_worker( ber ) ) {
+        /* handle_pdus takes over our reference */
+        epoch_leave( epoch );
+        handle_pdus( NULL, c );
+        return;
+    }
+
     if ( !lload_conn_max_pdus_per_cycle ||
             ldap_pvt_thread_pool_submit( &connection_pool, handle_pdus, c ) ) {
         /* If we're overloaded or configured as such, process one and resume in
@@ -395,6 +447,7 @@ connection_destroy( LloadConnection *c )
     assert( c->c_state == LLOAD_C_INVALID );
 
     ber_sockbuf_free( c->c_sb );
+    lload_optable_destroy( &c->c_ops );
 
     if ( c->c_currentber ) {
         ber_free( c->c_currentber, 1 );
@@ -558,7 +611,7 @@ lload_connection_close( LloadConnection *c, void *arg )
     if ( unlock )
         checked_unlock( &c->c_io_mutex );
 
-    if ( !gentle || !c->c_ops ) {
+    if ( !gentle || LLOAD_OPTABLE_EMPTY( &c->c_ops ) ) {
         CONNECTION_DESTROY(c);
         return LDAP_SUCCESS;
     }
@@ -567,19 +620,21 @@ lload_connection_close( LloadConnection *c, void *arg )
     c->c_state = LLOAD_C_CLOSING;
 
     do {
-        TAvlnode *node = ldap_tavl_end( c->c_ops, TAVL_DIR_LEFT );
-        op = node->avl_data;
+        unsigned int cursor = 0;
 
         /* Close operations that would need client action to resolve,
          * only SASL binds in progress do that right now */
-        if ( op->o_client_msgid || op->o_upstream_msgid ) {
+        while ( (op = lload_optable_next( &c->c_ops, &cursor )) &&
+                ( op->o_client_msgid || op->o_upstream_msgid ) )
+            /* Skip operations with a response pending */;
+        if ( !op ) {
             break;
         }
 
         CONNECTION_UNLOCK(c);
         OPERATION_UNLINK(op);
         CONNECTION_LOCK(c);
-    } while ( c->c_ops );
+    } while ( !LLOAD_OPTABLE_EMPTY( &c->c_ops ) );
 
     CONNECTION_UNLOCK(c);
     return LDAP_SUCCESS;
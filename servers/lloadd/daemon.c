@@ -1524,14 +1524,15 @@ lload_handle_backend_invalidation( LloadChange *change )
      *     that at some point
      */
     if ( change->flags.backend & LLOAD_BACKEND_MOD_CONNS ) {
-        int bind_requested = 0, need_close = 0, need_open = 0;
+        int bind_requested = 0, requested, need_close = 0, need_open = 0;
         LloadConnection *c;
 
         bind_requested =
 #ifdef LDAP_API_FEATURE_VERIFY_CREDENTIALS
                 (lload_features & LLOAD_FEATURE_VC) ? 0 :
 #endif /* LDAP_API_FEATURE_VERIFY_CREDENTIALS */
-                b->b_numbindconns;
+                backend_pool_size( b, 1 );
+        requested = backend_pool_size( b, 0 );
 
         if ( b->b_bindavail > bind_requested ) {
             need_close += b->b_bindavail - bind_requested;
@@ -1539,9 +1540,9 @@ lload_handle_backend_invalidation( LloadChange *change )
             need_open = 1;
         }
 
-        if ( b->b_active > b->b_numconns ) {
-            need_close += b->b_active - b->b_numconns;
-        } else if ( b->b_active < b->b_numconns ) {
+        if ( b->b_active > requested ) {
+            need_close += b->b_active - requested;
+        } else if ( b->b_active < requested ) {
             need_open = 1;
         }
 
@@ -1597,8 +1598,8 @@ lload_handle_backend_invalidation( LloadChange *change )
             assert( diff == 0 );
         }
 
-        if ( b->b_active > b->b_numconns ) {
-            int diff = b->b_active - b->b_numconns;
+        if ( b->b_active > requested ) {
+            int diff = b->b_active - requested;
 
             assert( need_close >= diff );
 
@@ -1692,6 +1693,9 @@ lload_handle_global_invalidation( LloadChange *change )
          *   - off: clear c_auth/privileged on each client
          * - read pause (WIP):
          *   - nothing needed?
+         * - coalesce:
+         *   - on: nothing needed
+         *   - off: nothing needed, searches in progress finish as usual
          */
 
         assert( change->target );
@@ -1702,6 +1706,12 @@ lload_handle_global_invalidation( LloadChange *change )
         if ( feature_diff & LLOAD_FEATURE_PAUSE ) {
             feature_diff &= ~LLOAD_FEATURE_PAUSE;
         }
+        if ( feature_diff & LLOAD_FEATURE_COALESCE ) {
+            feature_diff &= ~LLOAD_FEATURE_COALESCE;
+        }
+        if ( feature_diff & LLOAD_FEATURE_INLINE ) {
+            feature_diff &= ~LLOAD_FEATURE_INLINE;
+        }
         if ( feature_diff & LLOAD_FEATURE_PROXYAUTHZ ) {
             if ( !(lload_features & LLOAD_FEATURE_PROXYAUTHZ) ) {
                 LloadConnection *c;
@@ -40,7 +40,7 @@ handle_starttls( LloadConnection *c, LloadOperation *op )
     int rc = LDAP_SUCCESS;
 
     CONNECTION_LOCK(c);
-    found = ldap_tavl_delete( &c->c_ops, op, operation_client_cmp );
+    found = lload_optable_delete( &c->c_ops, op );
     assert( op == found );
     c->c_n_ops_executing--;
 
@@ -51,7 +51,7 @@ handle_starttls( LloadConnection *c, LloadOperation *op )
     } else if ( c->c_state == LLOAD_C_BINDING ) {
         rc = LDAP_OPERATIONS_ERROR;
         msg = "bind in progress";
-    } else if ( c->c_ops ) {
+    } else if ( !LLOAD_OPTABLE_EMPTY( &c->c_ops ) ) {
         rc = LDAP_OPERATIONS_ERROR;
         msg = "cannot start TLS when operations are outstanding";
     } else if ( !LLOAD_TLS_CTX ) {
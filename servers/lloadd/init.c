@@ -98,6 +98,8 @@ lload_global_init( void )
 
     ldap_pvt_thread_mutex_init( &clients_mutex );
     ldap_pvt_thread_mutex_init( &lload_pin_mutex );
+    lload_cache_init();
+    lload_bind_cache_init();
 
     if ( lload_exop_init() ) {
         return -1;
@@ -116,6 +118,7 @@ lload_global_destroy( void )
     lload_exop_destroy();
     ldap_tavl_free( lload_control_actions, (AVL_FREE)lload_restriction_free );
     ldap_tavl_free( lload_exop_actions, (AVL_FREE)lload_restriction_free );
+    lload_classes_destroy();
 
 #ifdef HAVE_TLS
     if ( lload_tls_backend_ld ) {
@@ -135,6 +138,8 @@ lload_global_destroy( void )
 
     ldap_pvt_thread_mutex_destroy( &clients_mutex );
     ldap_pvt_thread_mutex_destroy( &lload_pin_mutex );
+    lload_cache_destroy();
+    lload_bind_cache_destroy();
 
     lload_libevent_destroy();
 
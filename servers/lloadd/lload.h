@@ -82,6 +82,14 @@ LDAP_BEGIN_DECL
 
 #define LLOAD_CONN_MAX_PDUS_PER_CYCLE_DEFAULT 10
 
+/* Each new latency sample contributes 1/LLOAD_LATENCY_DECAY to the average */
+#define LLOAD_LATENCY_DECAY 8
+
+/* Pending operations an upstream is expected to handle without conn-max-pending */
+#define LLOAD_POOL_DEPTH 16
+/* Seconds a connection pool has to be underused before it is shrunk */
+#define LLOAD_POOL_IDLE_PERIODS 10
+
 #define BER_BV_OPTIONAL( bv ) ( BER_BVISNULL( bv ) ? NULL : ( bv ) )
 
 #include <epoch.h>
@@ -104,6 +112,8 @@ typedef struct LloadPendingConnection LloadPendingConnection;
 typedef struct LloadConnection LloadConnection;
 typedef struct LloadOperation LloadOperation;
 typedef struct LloadChange LloadChange;
+typedef struct LloadCacheEntry LloadCacheEntry;
+typedef struct LloadClass LloadClass;
 /* end of forward declarations */
 
 typedef LDAP_STAILQ_HEAD(TierSt, LloadTier) lload_t_head;
@@ -181,10 +191,14 @@ typedef enum {
 #endif /* LDAP_API_FEATURE_VERIFY_CREDENTIALS */
     LLOAD_FEATURE_PROXYAUTHZ = 1 << 1,
     LLOAD_FEATURE_PAUSE = 1 << 2,
+    LLOAD_FEATURE_COALESCE = 1 << 3,
+    LLOAD_FEATURE_INLINE = 1 << 4,
 } lload_features_t;
 
 #define LLOAD_FEATURE_SUPPORTED_MASK ( \
     LLOAD_FEATURE_PROXYAUTHZ | \
+    LLOAD_FEATURE_COALESCE | \
+    LLOAD_FEATURE_INLINE | \
     0 )
 
 #ifdef BALANCER_MODULE
@@ -274,6 +288,7 @@ struct LloadTier {
 
     enum {
         LLOAD_TIER_EXCLUSIVE = 1 << 0, /* Reject if busy */
+        LLOAD_TIER_LEAST_LOADED = 1 << 1, /* Prefer upstreams by expected wait */
     } t_flags;
 
     struct berval t_name;
@@ -300,6 +315,13 @@ struct LloadBackend {
 
     int b_numconns, b_numbindconns;
     int b_bindavail, b_active, b_opening;
+
+    /* Pools are resized between b_num*conns and these, see backend_pool_update */
+    int b_max_numconns, b_max_numbindconns;
+    int b_pool_conns, b_pool_bindconns;
+    int b_pool_busy, b_pool_bindbusy; /* selections that found the pool full */
+    int b_pool_idle, b_pool_bindidle; /* consecutive quiet periods */
+    uintptr_t b_pool_grown, b_pool_shrunk;
     lload_c_head b_conns, b_bindconns, b_preparing;
     LDAP_LIST_HEAD(ConnectingSt, LloadPendingConnection) b_connecting;
     LloadConnection *b_last_conn, *b_last_bindconn;
@@ -312,11 +334,10 @@ struct LloadBackend {
     LloadTier *b_tier;
 
     time_t b_last_update;
-    uintptr_t b_fitness;
     int b_weight;
 
-    uintptr_t b_operation_count;
-    uintptr_t b_operation_time;
+    uintptr_t b_operation_count; /* responses since last tier update */
+    uintptr_t b_latency; /* decaying average of response latency (us) */
 
 #ifdef BALANCER_MODULE
     monitor_subsys_t *b_monitor;
@@ -382,6 +403,26 @@ enum op_restriction {
                                  * or rejected */
 };
 
+/*
+ * Operations pending on a connection, keyed on the client or upstream msgid
+ * (pin id for operations that only hold a pin), protected by c_mutex. An open
+ * addressing hash table, the msgid is kept in the slot so probing doesn't
+ * have to touch the operations themselves.
+ */
+typedef struct LloadOpSlot {
+    ber_int_t s_msgid;
+    LloadOperation *s_op;
+} LloadOpSlot;
+
+typedef struct LloadOpTable {
+    LloadOpSlot *ot_slots;
+    unsigned int ot_size; /* always a power of two */
+    unsigned int ot_count;
+    int ot_upstream; /* keyed on o_upstream_msgid rather than o_client_msgid */
+} LloadOpTable;
+
+#define LLOAD_OPTABLE_EMPTY(t) ( (t)->ot_count == 0 )
+
 /*
  * represents a connection from an ldap client/to ldap server
  */
@@ -480,7 +521,7 @@ struct LloadConnection {
     BerElement *c_currentber; /* ber we're attempting to read */
     BerElement *c_pendingber; /* ber we're attempting to write */
 
-    TAvlnode *c_ops; /* Operations pending on the connection */
+    LloadOpTable c_ops; /* Operations pending on the connection */
 
 #ifdef HAVE_TLS
     enum lload_tls_type c_is_tls; /* true if this LDAP over raw TLS */
@@ -488,6 +529,7 @@ struct LloadConnection {
 
     long c_n_ops_executing;      /* num of ops currently executing */
     long c_n_ops_completed;      /* num of ops completed */
+    uintptr_t c_latency;         /* decaying average of response latency */
     lload_counters_t c_counters; /* per connection operation counters */
 
     enum op_restriction c_restricted;
@@ -560,8 +602,75 @@ struct LloadOperation {
     enum op_result o_res;
     BerElement *o_ber;
     BerValue o_request, o_ctrls;
+    BerValue o_payload; /* protocolOp and controls as received */
+
+    /* Search result being recorded for the cache, if any */
+    LloadCacheEntry *o_cache;
+    /* Identical search we're waiting on and our place in its list */
+    LloadCacheEntry *o_flight;
+    LDAP_TAILQ_ENTRY(LloadOperation) o_waiting;
+
+    /* Bind cache generation if the bind result can be cached, see bindcache.c */
+    unsigned long o_bind_cache_gen;
+
+    /* Traffic class this operation is counted against, if any */
+    LloadClass *o_class;
 };
 
+/*
+ * All responses to a search request made under a given identity, see cache.c
+ */
+struct LloadCacheEntry {
+    struct berval ce_auth, ce_request;
+
+    struct berval *ce_responses; /* protocolOp and controls of each one */
+    int ce_nresponses, ce_nentries;
+    ber_len_t ce_size;
+
+#define LLOAD_CACHE_IN_FLIGHT 0x1
+#define LLOAD_CACHE_TRUNCATED 0x2
+    int ce_flags;
+    LDAP_TAILQ_HEAD(CacheWaiters, LloadOperation) ce_waiters;
+
+    time_t ce_expires;
+    unsigned long ce_generation;
+    LDAP_TAILQ_ENTRY(LloadCacheEntry) ce_next;
+};
+
+/*
+ * A traffic class, see class.c
+ */
+#define LLOAD_CLASS_OP_ADD 0x01
+#define LLOAD_CLASS_OP_BIND 0x02
+#define LLOAD_CLASS_OP_COMPARE 0x04
+#define LLOAD_CLASS_OP_DELETE 0x08
+#define LLOAD_CLASS_OP_EXTENDED 0x10
+#define LLOAD_CLASS_OP_MODIFY 0x20
+#define LLOAD_CLASS_OP_MODRDN 0x40
+#define LLOAD_CLASS_OP_SEARCH 0x80
+
+struct LloadClass {
+    struct berval cl_name;
+
+    /* What to match, unset fields match anything */
+    struct berval cl_binddn;
+    int cl_peer_family, cl_peer_bits;
+    unsigned char cl_peer_addr[16];
+    unsigned int cl_ops;
+
+    unsigned int cl_max_pending; /* 0 means no limit */
+    unsigned int cl_share; /* percentage of a backend's max-pending-ops */
+
+    /* Operations admitted that have not completed yet */
+    uintptr_t cl_pending;
+    /* One held by the configuration and one for each operation referring to
+     * it, even after it has completed */
+    uintptr_t cl_refcnt;
+    LDAP_STAILQ_ENTRY(LloadClass) cl_next;
+};
+
+LDAP_STAILQ_HEAD(ClassList, LloadClass);
+
 struct restriction_entry {
     struct berval oid;
     enum op_restriction action;
@@ -96,6 +96,10 @@ static AttributeDescription *ad_olmPendingConnections;
 static AttributeDescription *ad_olmActiveConnections;
 static AttributeDescription *ad_olmIncomingConnections;
 static AttributeDescription *ad_olmOutgoingConnections;
+static AttributeDescription *ad_olmPoolConnections;
+static AttributeDescription *ad_olmPoolBindConnections;
+static AttributeDescription *ad_olmPoolGrown;
+static AttributeDescription *ad_olmPoolShrunk;
 
 monitor_subsys_t *lload_monitor_client_subsys;
 
@@ -233,6 +237,36 @@ static struct {
       "SYNTAX 1.3.6.1.4.1.1466.115.121.1.12 "
       "USAGE dSAOperation )",
         &ad_olmConnectionAuthzDN },
+    { "( olmBalancerAttributes:17 "
+      "NAME ( 'olmPoolConnections' ) "
+      "DESC 'monitor regular connection pool size' "
+      "EQUALITY integerMatch "
+      "SYNTAX 1.3.6.1.4.1.1466.115.121.1.27 "
+      "NO-USER-MODIFICATION "
+      "USAGE dSAOperation )",
+        &ad_olmPoolConnections },
+    { "( olmBalancerAttributes:18 "
+      "NAME ( 'olmPoolBindConnections' ) "
+      "DESC 'monitor bind connection pool size' "
+      "EQUALITY integerMatch "
+      "SYNTAX 1.3.6.1.4.1.1466.115.121.1.27 "
+      "NO-USER-MODIFICATION "
+      "USAGE dSAOperation )",
+        &ad_olmPoolBindConnections },
+    { "( olmBalancerAttributes:19 "
+      "NAME ( 'olmPoolGrown' ) "
+      "DESC 'monitor times a connection pool was grown' "
+      "SUP monitorCounter "
+      "NO-USER-MODIFICATION "
+      "USAGE dSAOperation )",
+        &ad_olmPoolGrown },
+    { "( olmBalancerAttributes:20 "
+      "NAME ( 'olmPoolShrunk' ) "
+      "DESC 'monitor times a connection pool was shrunk' "
+      "SUP monitorCounter "
+      "NO-USER-MODIFICATION "
+      "USAGE dSAOperation )",
+        &ad_olmPoolShrunk },
 
     { NULL }
 };
@@ -270,6 +304,10 @@ static struct {
       "$ olmReceivedOps "
       "$ olmCompletedOps "
       "$ olmFailedOps "
+      "$ olmPoolConnections "
+      "$ olmPoolBindConnections "
+      "$ olmPoolGrown "
+      "$ olmPoolShrunk "
       ") )",
         &oc_olmBalancerServer },
 
@@ -889,11 +927,15 @@ lload_monitor_server_update(
     LloadConnection *c;
     LloadPendingConnection *pc;
     ldap_pvt_mp_t active = 0, pending = 0, received = 0, completed = 0,
-                  failed = 0;
+                  failed = 0, pool, bindpool, grown, shrunk;
     int i;
 
     checked_lock( &b->b_mutex );
     active = b->b_active + b->b_bindavail;
+    pool = backend_pool_size( b, 0 );
+    bindpool = backend_pool_size( b, 1 );
+    grown = b->b_pool_grown;
+    shrunk = b->b_pool_shrunk;
 
     LDAP_CIRCLEQ_FOREACH ( c, &b->b_preparing, c_next ) {
         pending++;
@@ -941,6 +983,22 @@ lload_monitor_server_update(
     assert( a != NULL );
     UI2BV( &a->a_vals[0], failed );
 
+    a = attr_find( e->e_attrs, ad_olmPoolConnections );
+    assert( a != NULL );
+    UI2BV( &a->a_vals[0], pool );
+
+    a = attr_find( e->e_attrs, ad_olmPoolBindConnections );
+    assert( a != NULL );
+    UI2BV( &a->a_vals[0], bindpool );
+
+    a = attr_find( e->e_attrs, ad_olmPoolGrown );
+    assert( a != NULL );
+    UI2BV( &a->a_vals[0], grown );
+
+    a = attr_find( e->e_attrs, ad_olmPoolShrunk );
+    assert( a != NULL );
+    UI2BV( &a->a_vals[0], shrunk );
+
     return SLAP_CB_CONTINUE;
 }
 
@@ -983,6 +1041,10 @@ lload_monitor_backend_open( BackendDB *be, monitor_subsys_t *ms )
     attr_merge_normalize_one( e, ad_olmReceivedOps, &value, NULL );
     attr_merge_normalize_one( e, ad_olmCompletedOps, &value, NULL );
     attr_merge_normalize_one( e, ad_olmFailedOps, &value, NULL );
+    attr_merge_normalize_one( e, ad_olmPoolConnections, &value, NULL );
+    attr_merge_normalize_one( e, ad_olmPoolBindConnections, &value, NULL );
+    attr_merge_normalize_one( e, ad_olmPoolGrown, &value, NULL );
+    attr_merge_normalize_one( e, ad_olmPoolShrunk, &value, NULL );
 
     rc = mbe->register_entry( e, cb, ms, 0 );
 
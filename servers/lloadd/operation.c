@@ -95,36 +95,181 @@ lload_restriction_cmp( const void *left, const void *right )
     return ber_bvcmp( &l->oid, &r->oid );
 }
 
-int
-operation_client_cmp( const void *left, const void *right )
+/*
+ * Operation tables, see LloadOpTable in lload.h. The msgid is used as the
+ * hash, both clients and our own upstream connections allocate them
+ * sequentially so there is little clustering. Removal shifts the following
+ * entries back instead of leaving tombstones around.
+ */
+#define LLOAD_OPTABLE_MIN 16
+
+static ber_int_t
+optable_msgid( LloadOpTable *t, LloadOperation *op )
 {
-    const LloadOperation *l = left, *r = right;
+    return t->ot_upstream ? op->o_upstream_msgid : op->o_client_msgid;
+}
 
-    assert( l->o_client_connid == r->o_client_connid );
-    if ( l->o_client_msgid || r->o_client_msgid ) {
-        return ( l->o_client_msgid < r->o_client_msgid ) ?
-                -1 :
-                ( l->o_client_msgid > r->o_client_msgid );
-    } else {
-        return ( l->o_pin_id < r->o_pin_id ) ? -1 :
-                ( l->o_pin_id > r->o_pin_id );
+static unsigned int
+optable_home( LloadOpTable *t, ber_int_t msgid, LloadOperation *op )
+{
+    /* Operations that only hold a pin are keyed on the pin id */
+    return ( msgid ? (unsigned int)msgid : (unsigned int)op->o_pin_id ) &
+            ( t->ot_size - 1 );
+}
+
+static unsigned int
+optable_lookup( LloadOpTable *t, LloadOperation *needle )
+{
+    ber_int_t msgid = optable_msgid( t, needle );
+    unsigned int i, mask = t->ot_size - 1;
+
+    for ( i = optable_home( t, msgid, needle ); t->ot_slots[i].s_op;
+            i = ( i + 1 ) & mask ) {
+        if ( t->ot_slots[i].s_msgid == msgid &&
+                ( msgid || t->ot_slots[i].s_op->o_pin_id ==
+                                needle->o_pin_id ) ) {
+            break;
+        }
     }
+    return i;
+}
+
+static void
+optable_resize( LloadOpTable *t, unsigned int size )
+{
+    LloadOpSlot *old = t->ot_slots;
+    unsigned int i, j, oldsize = t->ot_size;
+
+    t->ot_slots = ch_calloc( size, sizeof(LloadOpSlot) );
+    t->ot_size = size;
+
+    for ( i = 0; i < oldsize; i++ ) {
+        if ( !old[i].s_op ) continue;
+
+        for ( j = optable_home( t, old[i].s_msgid, old[i].s_op );
+                t->ot_slots[j].s_op; j = ( j + 1 ) & ( size - 1 ) )
+            /* Find an empty slot */;
+        t->ot_slots[j] = old[i];
+    }
+    ch_free( old );
+}
+
+void
+lload_optable_init( LloadOpTable *t, int upstream )
+{
+    t->ot_slots = NULL;
+    t->ot_size = t->ot_count = 0;
+    t->ot_upstream = upstream;
+}
+
+void
+lload_optable_destroy( LloadOpTable *t )
+{
+    assert( t->ot_count == 0 );
+    ch_free( t->ot_slots );
+    t->ot_slots = NULL;
+    t->ot_size = 0;
 }
 
 int
-operation_upstream_cmp( const void *left, const void *right )
+lload_optable_insert( LloadOpTable *t, LloadOperation *op )
 {
-    const LloadOperation *l = left, *r = right;
+    unsigned int i;
 
-    assert( l->o_upstream_connid == r->o_upstream_connid );
-    if ( l->o_upstream_msgid || r->o_upstream_msgid ) {
-        return ( l->o_upstream_msgid < r->o_upstream_msgid ) ?
-                -1 :
-                ( l->o_upstream_msgid > r->o_upstream_msgid );
-    } else {
-        return ( l->o_pin_id < r->o_pin_id ) ? -1 :
-                ( l->o_pin_id > r->o_pin_id );
+    /* Keep the load factor at or below a half */
+    if ( 2 * ( t->ot_count + 1 ) > t->ot_size ) {
+        optable_resize(
+                t, t->ot_size ? 2 * t->ot_size : LLOAD_OPTABLE_MIN );
+    }
+
+    i = optable_lookup( t, op );
+    if ( t->ot_slots[i].s_op ) {
+        return -1;
     }
+    t->ot_slots[i].s_msgid = optable_msgid( t, op );
+    t->ot_slots[i].s_op = op;
+    t->ot_count++;
+    return LDAP_SUCCESS;
+}
+
+LloadOperation *
+lload_optable_find( LloadOpTable *t, LloadOperation *needle )
+{
+    if ( !t->ot_count ) {
+        return NULL;
+    }
+    return t->ot_slots[optable_lookup( t, needle )].s_op;
+}
+
+LloadOperation *
+lload_optable_delete( LloadOpTable *t, LloadOperation *needle )
+{
+    LloadOperation *op;
+    unsigned int i, j, home, mask = t->ot_size - 1;
+
+    if ( !t->ot_count ) {
+        return NULL;
+    }
+
+    i = optable_lookup( t, needle );
+    if ( !(op = t->ot_slots[i].s_op) ) {
+        return NULL;
+    }
+
+    /* Shift back any entries that would become unreachable */
+    for ( j = ( i + 1 ) & mask; t->ot_slots[j].s_op; j = ( j + 1 ) & mask ) {
+        home = optable_home(
+                t, t->ot_slots[j].s_msgid, t->ot_slots[j].s_op );
+        if ( ( ( j - home ) & mask ) >= ( ( j - i ) & mask ) ) {
+            t->ot_slots[i] = t->ot_slots[j];
+            i = j;
+        }
+    }
+    t->ot_slots[i].s_op = NULL;
+    t->ot_count--;
+
+    if ( t->ot_size > LLOAD_OPTABLE_MIN && 8 * t->ot_count < t->ot_size ) {
+        optable_resize( t, t->ot_size / 2 );
+    }
+    return op;
+}
+
+/*
+ * Iterate over the table, *cursor should start at 0. The table must not be
+ * modified until done.
+ */
+LloadOperation *
+lload_optable_next( LloadOpTable *t, unsigned int *cursor )
+{
+    while ( *cursor < t->ot_size ) {
+        LloadOperation *op = t->ot_slots[( *cursor )++].s_op;
+        if ( op ) return op;
+    }
+    return NULL;
+}
+
+/*
+ * Empty the table, calling cb on every operation that was in it. Returns the
+ * number of operations processed.
+ */
+long
+lload_optable_free( LloadOpTable *t, void (*cb)( LloadOperation *op ) )
+{
+    LloadOpSlot *slots = t->ot_slots;
+    unsigned int i, size = t->ot_size;
+    long count = 0;
+
+    lload_optable_init( t, t->ot_upstream );
+
+    for ( i = 0; i < size; i++ ) {
+        if ( !slots[i].s_op ) continue;
+        if ( cb ) {
+            cb( slots[i].s_op );
+        }
+        count++;
+    }
+    ch_free( slots );
+    return count;
 }
 
 /*
@@ -135,7 +280,7 @@ operation_init( LloadConnection *c, BerElement *ber )
 {
     LloadOperation *op;
     ber_tag_t tag;
-    ber_len_t len;
+    ber_len_t len, remaining;
     int rc;
 
     if ( !IS_ALIVE( c, c_live ) ) {
@@ -162,7 +307,7 @@ operation_init( LloadConnection *c, BerElement *ber )
     }
 
     CONNECTION_ASSERT_LOCKED(c);
-    rc = ldap_tavl_insert( &c->c_ops, op, operation_client_cmp, ldap_avl_dup_error );
+    rc = lload_optable_insert( &c->c_ops, op );
     if ( rc ) {
         Debug( LDAP_DEBUG_PACKETS, "operation_init: "
                 "several operations with same msgid=%d in-flight "
@@ -171,6 +316,7 @@ operation_init( LloadConnection *c, BerElement *ber )
         goto fail;
     }
 
+    ber_get_option( ber, LBER_OPT_BER_REMAINING_BYTES, &remaining );
     tag = op->o_tag = ber_skip_element( ber, &op->o_request );
     switch ( tag ) {
         case LBER_ERROR:
@@ -178,10 +324,19 @@ operation_init( LloadConnection *c, BerElement *ber )
             break;
     }
     if ( rc ) {
-        ldap_tavl_delete( &c->c_ops, op, operation_client_cmp );
+        lload_optable_delete( &c->c_ops, op );
         goto fail;
     }
 
+    /*
+     * The protocolOp (with its header) and any controls run to the end of the
+     * PDU, remember them so they can be forwarded without re-encoding
+     */
+    ber_get_option( ber, LBER_OPT_BER_REMAINING_BYTES, &len );
+    op->o_payload.bv_val = op->o_request.bv_val + op->o_request.bv_len -
+            ( remaining - len );
+    op->o_payload.bv_len = remaining;
+
     tag = ber_peek_tag( ber, &len );
     if ( tag == LDAP_TAG_CONTROLS ) {
         ber_skip_element( ber, &op->o_ctrls );
@@ -222,6 +377,9 @@ operation_destroy( LloadOperation *op )
     assert( op->o_client == NULL );
     assert( op->o_upstream == NULL );
 
+    if ( op->o_class ) {
+        lload_class_release( op->o_class );
+    }
     ber_free( op->o_ber, 1 );
     ldap_pvt_thread_mutex_destroy( &op->o_link_mutex );
     ch_free( op );
@@ -242,6 +400,9 @@ operation_unlink( LloadOperation *op )
             "client msgid=%d\n",
             op->o_client_connid, op->o_upstream_connid, op->o_client_msgid );
 
+    lload_cache_unlink( op );
+    lload_class_complete( op );
+
     checked_lock( &op->o_link_mutex );
     client = op->o_client;
     upstream = op->o_upstream;
@@ -275,8 +436,7 @@ operation_unlink_client( LloadOperation *op, LloadConnection *client )
             op, op->o_client_msgid, op->o_client_connid );
 
     CONNECTION_LOCK(client);
-    if ( (removed = ldap_tavl_delete(
-                   &client->c_ops, op, operation_client_cmp )) ) {
+    if ( (removed = lload_optable_delete( &client->c_ops, op )) ) {
         result = LLOAD_OP_DETACHING_CLIENT;
 
         assert( op == removed );
@@ -313,7 +473,7 @@ operation_unlink_client( LloadOperation *op, LloadConnection *client )
             }
         }
     }
-    if ( client->c_state == LLOAD_C_CLOSING && !client->c_ops ) {
+    if ( client->c_state == LLOAD_C_CLOSING && LLOAD_OPTABLE_EMPTY( &client->c_ops ) ) {
         CONNECTION_DESTROY(client);
     } else {
         CONNECTION_UNLOCK(client);
@@ -334,15 +494,15 @@ operation_unlink_upstream( LloadOperation *op, LloadConnection *upstream )
             op, op->o_upstream_msgid, op->o_upstream_connid );
 
     CONNECTION_LOCK(upstream);
-    if ( (removed = ldap_tavl_delete(
-                   &upstream->c_ops, op, operation_upstream_cmp )) ) {
+    if ( (removed = lload_optable_delete( &upstream->c_ops, op )) ) {
         result |= LLOAD_OP_DETACHING_UPSTREAM;
 
         assert( op == removed );
         upstream->c_n_ops_executing--;
 
         if ( upstream->c_state == LLOAD_C_BINDING ) {
-            assert( op->o_tag == LDAP_REQ_BIND && upstream->c_ops == NULL );
+            assert( op->o_tag == LDAP_REQ_BIND &&
+                    LLOAD_OPTABLE_EMPTY( &upstream->c_ops ) );
             upstream->c_state = LLOAD_C_READY;
             if ( !BER_BVISNULL( &upstream->c_sasl_bind_mech ) ) {
                 ber_memfree( upstream->c_sasl_bind_mech.bv_val );
@@ -352,7 +512,7 @@ operation_unlink_upstream( LloadOperation *op, LloadConnection *upstream )
         operation_update_conn_counters( op, upstream );
         b = upstream->c_backend;
     }
-    if ( upstream->c_state == LLOAD_C_CLOSING && !upstream->c_ops ) {
+    if ( upstream->c_state == LLOAD_C_CLOSING && LLOAD_OPTABLE_EMPTY( &upstream->c_ops ) ) {
         CONNECTION_DESTROY(upstream);
     } else {
         CONNECTION_UNLOCK(upstream);
@@ -416,7 +576,8 @@ done:
 
 /*
  * Will remove the operation from its upstream and if it was still there,
- * sends an abandon request.
+ * sends an abandon request. A search with others coalesced onto it is only
+ * detached from its client instead.
  *
  * Being called from client_reset or request_abandon, the following hold:
  * - noone else is processing the read part of the client connection (no new
@@ -426,7 +587,7 @@ done:
 void
 operation_abandon( LloadOperation *op )
 {
-    LloadConnection *c;
+    LloadConnection *c, *client;
 
     checked_lock( &op->o_link_mutex );
     c = op->o_upstream;
@@ -435,6 +596,20 @@ operation_abandon( LloadOperation *op )
         goto done;
     }
 
+    if ( lload_cache_orphan( op ) ) {
+        /* Searches from other clients are coalesced onto this one, only
+         * detach the client and let it complete */
+        checked_lock( &op->o_link_mutex );
+        client = op->o_client;
+        op->o_client = NULL;
+        checked_unlock( &op->o_link_mutex );
+
+        if ( client ) {
+            operation_unlink_client( op, client );
+        }
+        return;
+    }
+
     /* for now consider all abandoned operations completed,
      * perhaps add a separate counter later */
     op->o_res = LLOAD_OP_COMPLETED;
@@ -541,20 +716,19 @@ int
 connection_timeout( LloadConnection *upstream, void *arg )
 {
     LloadOperation *op;
-    TAvlnode *ops = NULL, *node, *next;
+    LloadOpTable ops;
     LloadBackend *b = upstream->c_backend;
     struct timeval *threshold = arg;
+    unsigned int cursor = 0;
     int rc, nops = 0;
 
-    CONNECTION_LOCK(upstream);
-    for ( node = ldap_tavl_end( upstream->c_ops, TAVL_DIR_LEFT );
-            node && timercmp( &((LloadOperation *)node->avl_data)->o_start,
-                    threshold, < ); /* shortcut */
-            node = next ) {
-        LloadOperation *found_op;
+    lload_optable_init( &ops, 1 );
 
-        next = ldap_tavl_next( node, TAVL_DIR_RIGHT );
-        op = node->avl_data;
+    CONNECTION_LOCK(upstream);
+    while ( (op = lload_optable_next( &upstream->c_ops, &cursor )) ) {
+        if ( !timercmp( &op->o_start, threshold, < ) ) {
+            continue;
+        }
 
         /* Have we received another response since? */
         if ( timerisset( &op->o_last_response ) &&
@@ -562,12 +736,22 @@ connection_timeout( LloadConnection *upstream, void *arg )
             continue;
         }
 
+        rc = lload_optable_insert( &ops, op );
+        assert( rc == LDAP_SUCCESS );
+    }
+
+    /* Can't modify c_ops while walking it */
+    cursor = 0;
+    while ( (op = lload_optable_next( &ops, &cursor )) ) {
+        LloadOperation *found_op;
+
         op->o_res = LLOAD_OP_FAILED;
-        found_op = ldap_tavl_delete( &upstream->c_ops, op, operation_upstream_cmp );
+        found_op = lload_optable_delete( &upstream->c_ops, op );
         assert( op == found_op );
 
         if ( upstream->c_state == LLOAD_C_BINDING ) {
-            assert( op->o_tag == LDAP_REQ_BIND && upstream->c_ops == NULL );
+            assert( op->o_tag == LDAP_REQ_BIND &&
+                    LLOAD_OPTABLE_EMPTY( &upstream->c_ops ) );
             upstream->c_state = LLOAD_C_READY;
             if ( !BER_BVISNULL( &upstream->c_sasl_bind_mech ) ) {
                 ber_memfree( upstream->c_sasl_bind_mech.bv_val );
@@ -575,9 +759,6 @@ connection_timeout( LloadConnection *upstream, void *arg )
             }
         }
 
-        rc = ldap_tavl_insert( &ops, op, operation_upstream_cmp, ldap_avl_dup_error );
-        assert( rc == LDAP_SUCCESS );
-
         Debug( LDAP_DEBUG_STATS2, "connection_timeout: "
                 "timing out %s from connid=%lu msgid=%d sent to connid=%lu as "
                 "msgid=%d\n",
@@ -589,6 +770,7 @@ connection_timeout( LloadConnection *upstream, void *arg )
 
     if ( nops == 0 ) {
         CONNECTION_UNLOCK(upstream);
+        lload_optable_destroy( &ops );
         return LDAP_SUCCESS;
     }
     upstream->c_n_ops_executing -= nops;
@@ -602,10 +784,9 @@ connection_timeout( LloadConnection *upstream, void *arg )
     b->b_n_ops_executing -= nops;
     checked_unlock( &b->b_mutex );
 
-    for ( node = ldap_tavl_end( ops, TAVL_DIR_LEFT ); node;
-            node = ldap_tavl_next( node, TAVL_DIR_RIGHT ) ) {
-        op = node->avl_data;
-
+    rc = LDAP_SUCCESS;
+    cursor = 0;
+    while ( (op = lload_optable_next( &ops, &cursor )) ) {
         operation_send_reject( op,
                 op->o_tag == LDAP_REQ_SEARCH ? LDAP_TIMELIMIT_EXCEEDED :
                                                LDAP_ADMINLIMIT_EXCEEDED,
@@ -624,14 +805,15 @@ connection_timeout( LloadConnection *upstream, void *arg )
     CONNECTION_LOCK(upstream);
     /* ITS#9799: If a Bind timed out, connection is in an unknown state */
     if ( upstream->c_type == LLOAD_C_BIND || rc != LDAP_SUCCESS ||
-            ( upstream->c_state == LLOAD_C_CLOSING && !upstream->c_ops ) ) {
+            ( upstream->c_state == LLOAD_C_CLOSING &&
+                    LLOAD_OPTABLE_EMPTY( &upstream->c_ops ) ) ) {
         CONNECTION_DESTROY(upstream);
     } else {
         CONNECTION_UNLOCK(upstream);
     }
 
-    /* just dispose of the AVL, most operations should already be gone */
-    ldap_tavl_free( ops, NULL );
+    /* just dispose of the table, most operations should already be gone */
+    lload_optable_free( &ops, NULL );
     return LDAP_SUCCESS;
 }
 
@@ -40,8 +40,12 @@ LDAP_BEGIN_DECL
 LDAP_SLAPD_F (void) backend_connect( evutil_socket_t s, short what, void *arg );
 LDAP_SLAPD_F (void *) backend_connect_task( void *ctx, void *arg );
 LDAP_SLAPD_F (void) backend_retry( LloadBackend *b );
+LDAP_SLAPD_F (int) backend_pool_size( LloadBackend *b, int bind );
+LDAP_SLAPD_F (void) backend_pool_update( LloadBackend *b );
 LDAP_SLAPD_F (int) upstream_select( LloadOperation *op, LloadConnection **c, int *res, char **message );
 LDAP_SLAPD_F (int) backend_select( LloadBackend *b, LloadOperation *op, LloadConnection **c, int *res, char **message );
+LDAP_SLAPD_F (uint64_t) lload_rand( void );
+LDAP_SLAPD_F (void) lload_latency_update( uintptr_t *average, uintptr_t sample );
 LDAP_SLAPD_F (int) try_upstream( LloadBackend *b, lload_c_head *head, LloadOperation *op, LloadConnection *c, int *res, char **message );
 LDAP_SLAPD_F (void) backend_reset( LloadBackend *b, int gentle );
 LDAP_SLAPD_F (LloadBackend *) lload_backend_new( void );
@@ -55,6 +59,44 @@ LDAP_SLAPD_F (int) handle_bind_response( LloadConnection *client, LloadOperation
 LDAP_SLAPD_F (int) handle_whoami_response( LloadConnection *client, LloadOperation *op, BerElement *ber );
 LDAP_SLAPD_F (int) handle_vc_bind_response( LloadConnection *client, LloadOperation *op, BerElement *ber );
 
+/*
+ * bindcache.c
+ */
+LDAP_SLAPD_F (int) lload_bind_cache_lookup( LloadConnection *client, LloadOperation *op, struct berval *binddn, struct berval *password );
+LDAP_SLAPD_F (void) lload_bind_cache_result( LloadOperation *op, ber_int_t result, int has_controls );
+LDAP_SLAPD_F (void) lload_bind_cache_response( LloadOperation *op, ber_tag_t tag, struct berval *response );
+LDAP_SLAPD_F (void) lload_bind_cache_invalidate( LloadOperation *op );
+LDAP_SLAPD_F (void) lload_bind_cache_init( void );
+LDAP_SLAPD_F (void) lload_bind_cache_destroy( void );
+LDAP_SLAPD_F (int) lload_dn_normalize( struct berval *dn, struct berval *ndn );
+LDAP_SLAPD_V (unsigned int) lload_bind_cache_ttl;
+
+/*
+ * cache.c
+ */
+LDAP_SLAPD_F (int) lload_cache_lookup( LloadConnection *client, LloadOperation *op );
+LDAP_SLAPD_F (void) lload_cache_response( LloadOperation *op, ber_tag_t tag, struct berval *response );
+LDAP_SLAPD_F (void) lload_cache_unlink( LloadOperation *op );
+LDAP_SLAPD_F (int) lload_cache_orphan( LloadOperation *op );
+LDAP_SLAPD_F (void) lload_cache_invalidate( LloadOperation *op );
+LDAP_SLAPD_F (void) lload_cache_init( void );
+LDAP_SLAPD_F (void) lload_cache_destroy( void );
+LDAP_SLAPD_V (unsigned int) lload_cache_ttl;
+LDAP_SLAPD_V (unsigned int) lload_cache_negative_ttl;
+LDAP_SLAPD_V (ber_len_t) lload_cache_size;
+
+/*
+ * class.c
+ */
+LDAP_SLAPD_F (int) lload_class_acquire( LloadConnection *c, LloadOperation *op );
+LDAP_SLAPD_F (void) lload_class_complete( LloadOperation *op );
+LDAP_SLAPD_F (void) lload_class_release( LloadClass *cl );
+LDAP_SLAPD_F (void) lload_class_free( LloadClass *cl );
+LDAP_SLAPD_F (LloadClass *) lload_class_parse( int argc, char **argv, char *msg, size_t msglen );
+LDAP_SLAPD_F (void) lload_class_unparse( LloadClass *cl, struct berval *out, size_t size );
+LDAP_SLAPD_F (void) lload_classes_destroy( void );
+LDAP_SLAPD_V (struct ClassList) lload_classes;
+
 /*
  * client.c
  */
@@ -191,8 +233,13 @@ LDAP_SLAPD_V (TAvlnode *) lload_exop_actions;
 LDAP_SLAPD_V (enum op_restriction) lload_default_exop_action;
 LDAP_SLAPD_F (int) lload_restriction_cmp( const void *left, const void *right );
 LDAP_SLAPD_F (const char *) lload_msgtype2str( ber_tag_t tag );
-LDAP_SLAPD_F (int) operation_upstream_cmp( const void *l, const void *r );
-LDAP_SLAPD_F (int) operation_client_cmp( const void *l, const void *r );
+LDAP_SLAPD_F (void) lload_optable_init( LloadOpTable *t, int upstream );
+LDAP_SLAPD_F (void) lload_optable_destroy( LloadOpTable *t );
+LDAP_SLAPD_F (int) lload_optable_insert( LloadOpTable *t, LloadOperation *op );
+LDAP_SLAPD_F (LloadOperation *) lload_optable_find( LloadOpTable *t, LloadOperation *needle );
+LDAP_SLAPD_F (LloadOperation *) lload_optable_delete( LloadOpTable *t, LloadOperation *needle );
+LDAP_SLAPD_F (LloadOperation *) lload_optable_next( LloadOpTable *t, unsigned int *cursor );
+LDAP_SLAPD_F (long) lload_optable_free( LloadOpTable *t, void (*cb)( LloadOperation *op ) );
 LDAP_SLAPD_F (LloadOperation *) operation_init( LloadConnection *c, BerElement *ber );
 LDAP_SLAPD_F (int) operation_send_abandon( LloadOperation *op, LloadConnection *c );
 LDAP_SLAPD_F (void) operation_abandon( LloadOperation *op );
@@ -52,6 +52,7 @@ tier_reset( LloadTier *tier, int shutdown )
         checked_lock( &b->b_mutex );
         if ( shutdown ) {
             b->b_numconns = b->b_numbindconns = 0;
+            b->b_max_numconns = b->b_max_numbindconns = 0;
         }
         backend_reset( b, 1 );
         backend_retry( b );
@@ -133,9 +134,15 @@ lload_tiers_update( evutil_socket_t s, short what, void *arg )
     LloadTier *tier;
 
     LDAP_STAILQ_FOREACH ( tier, &tiers, t_next ) {
+        LloadBackend *b;
+
         if ( tier->t_type.tier_update ) {
             tier->t_type.tier_update( tier );
         }
+
+        LDAP_CIRCLEQ_FOREACH ( b, &tier->t_backends, b_next ) {
+            backend_pool_update( b );
+        }
     }
 }
 
@@ -16,7 +16,6 @@
 #include "portable.h"
 
 #include <ac/string.h>
-#include <math.h>
 
 #include "lload.h"
 #include "lutil.h"
@@ -30,55 +29,25 @@ static LloadTierSelect bestof_select;
 struct lload_tier_type bestof_tier;
 
 /*
- * xorshift - we don't need high quality randomness, and we don't want to
- * interfere with anyone else's use of srand() but we still want something with
- * little bias.
- *
- * The PRNG here cycles thru 2^64−1 numbers.
+ * Weighted expected wait: the backend's average latency scaled by the number
+ * of operations it has pending. Latency is counted from 1us, as in
+ * upstream_score(), so that backends not measured yet still compare on what
+ * they have pending. Uses lock-free reads only, the values might be slightly
+ * stale but this is just a heuristic.
  */
-static uint64_t bestof_seed;
-
-static void
-bestof_srand( int seed )
+static float
+bestof_score( const LloadBackend *b )
 {
-    bestof_seed = seed;
-}
+    uintptr_t latency = __atomic_load_n( &b->b_latency, __ATOMIC_RELAXED );
+    long pending = __atomic_load_n( &b->b_n_ops_executing, __ATOMIC_RELAXED );
 
-static uint64_t
-bestof_rand()
-{
-    uint64_t val = bestof_seed;
-    val ^= val << 13;
-    val ^= val >> 7;
-    val ^= val << 17;
-    bestof_seed = val;
-    return val;
+    return (float)( latency + 1 ) * b->b_weight * ( pending + 1 );
 }
 
 static int
 bestof_cmp( const void *left, const void *right )
 {
-    const LloadBackend *l = left;
-    const LloadBackend *r = right;
-    struct timeval now;
-    uintptr_t count, diff;
-    float a = l->b_fitness, b = r->b_fitness, factor = 1;
-
-    gettimeofday( &now, NULL );
-    /* We assume this is less than a second after the last update */
-    factor = 1 / ( pow( ( 1 / factor ) + 1, now.tv_usec / 1000000.0 ) - 1 );
-
-    count = __atomic_load_n( &l->b_operation_count, __ATOMIC_RELAXED );
-    diff = __atomic_load_n( &l->b_operation_time, __ATOMIC_RELAXED );
-    if ( count ) {
-        a = ( a * factor + (float)diff * l->b_weight / count ) / ( factor + 1 );
-    }
-
-    count = __atomic_load_n( &r->b_operation_count, __ATOMIC_RELAXED );
-    diff = __atomic_load_n( &r->b_operation_time, __ATOMIC_RELAXED );
-    if ( count ) {
-        b = ( b * factor + (float)diff * r->b_weight / count ) / ( factor + 1 );
-    }
+    float a = bestof_score( left ), b = bestof_score( right );
 
     return (a - b < 0) ? -1 : (a - b == 0) ? 0 : 1;
 }
@@ -87,20 +56,14 @@ LloadTier *
 bestof_init( void )
 {
     LloadTier *tier;
-    int seed;
 
     tier = ch_calloc( 1, sizeof(LloadTier) );
 
     tier->t_type = bestof_tier;
+    tier->t_flags |= LLOAD_TIER_LEAST_LOADED;
     ldap_pvt_thread_mutex_init( &tier->t_mutex );
     LDAP_CIRCLEQ_INIT( &tier->t_backends );
 
-    /* Make sure we don't pass 0 as a seed */
-    do {
-        seed = rand();
-    } while ( !seed );
-    bestof_srand( seed );
-
     return tier;
 }
 
@@ -161,6 +124,10 @@ bestof_backend_options( LloadTier *tier, LloadBackend *b, char *arg )
     return 1;
 }
 
+/*
+ * A backend that has not been answering anything keeps the average it had when
+ * it last did, halve it every second so that it eventually gets tried again.
+ */
 static int
 bestof_update( LloadTier *tier )
 {
@@ -178,30 +145,17 @@ bestof_update( LloadTier *tier )
         checked_lock( &b->b_mutex );
 
         steps = now - b->b_last_update;
-        if ( b->b_weight && steps > 0 ) {
-            uintptr_t count, diff;
-            float factor = 1;
+        if ( steps > 0 ) {
+            uintptr_t count, latency;
 
             count = __atomic_exchange_n(
                     &b->b_operation_count, 0, __ATOMIC_RELAXED );
-            diff = __atomic_exchange_n(
-                    &b->b_operation_time, 0, __ATOMIC_RELAXED );
-
-            /* Smear values over time - rolling average */
-            if ( count ) {
-                float fitness = b->b_weight * diff;
-
-                /* Stretch factor accordingly favouring the latest value */
-                if ( steps > 10 ) {
-                    factor = 0; /* No recent data */
-                } else if ( steps > 1 ) {
-                    factor = 1 / ( pow( ( 1 / factor ) + 1, steps ) - 1 );
-                }
-
-                b->b_fitness = ( factor * b->b_fitness + fitness / count ) /
-                        ( factor + 1 );
-                b->b_last_update = now;
+            if ( !count ) {
+                latency = __atomic_load_n( &b->b_latency, __ATOMIC_RELAXED );
+                latency = steps < 8 * sizeof(latency) ? latency >> steps : 0;
+                __atomic_store_n( &b->b_latency, latency, __ATOMIC_RELAXED );
             }
+            b->b_last_update = now;
         }
 
         next = LDAP_CIRCLEQ_LOOP_NEXT( &tier->t_backends, b, b_next );
@@ -235,8 +189,8 @@ bestof_select(
     }
 
     /* Pick two backend indices at random */
-    i0 = bestof_rand() % n;
-    i1 = bestof_rand() % ( n - 1 );
+    i0 = lload_rand() % n;
+    i1 = lload_rand() % ( n - 1 );
     if ( i1 >= i0 ) {
         i1 += 1;
     } else {
@@ -65,26 +65,42 @@ int
 forward_response( LloadConnection *client, LloadOperation *op, BerElement *ber )
 {
     BerElement *output;
-    BerValue response, controls = BER_BVNULL;
-    ber_int_t msgid;
-    ber_tag_t tag, response_tag;
+    BerValue response;
+    ber_int_t msgid = 0;
+    ber_tag_t response_tag;
     ber_len_t len;
 
-    CONNECTION_LOCK(client);
-    if ( op->o_client_msgid ) {
-        msgid = op->o_client_msgid;
-    } else {
-        assert( op->o_pin_id );
-        msgid = op->o_saved_msgid;
-        op->o_saved_msgid = 0;
+    if ( client ) {
+        CONNECTION_LOCK(client);
+        if ( op->o_client_msgid ) {
+            msgid = op->o_client_msgid;
+        } else {
+            assert( op->o_pin_id );
+            msgid = op->o_saved_msgid;
+            op->o_saved_msgid = 0;
+        }
+        CONNECTION_UNLOCK(client);
     }
-    CONNECTION_UNLOCK(client);
 
-    response_tag = ber_skip_element( ber, &response );
+    /*
+     * Only the msgid needs replacing, the protocolOp and any controls that
+     * follow it are passed through verbatim without being parsed
+     */
+    response_tag = ber_skip_raw( ber, &response );
+    if ( response_tag == LBER_ERROR ) {
+        ber_free( ber, 1 );
+        return -1;
+    }
+    ber_get_option( ber, LBER_OPT_BER_REMAINING_BYTES, &len );
+    response.bv_len += len;
+
+    lload_cache_response( op, response_tag, &response );
+    lload_bind_cache_response( op, response_tag, &response );
 
-    tag = ber_peek_tag( ber, &len );
-    if ( tag == LDAP_TAG_CONTROLS ) {
-        ber_skip_element( ber, &controls );
+    if ( !client ) {
+        /* Only still running for those waiting on it, see lload_cache_orphan */
+        ber_free( ber, 1 );
+        return 0;
     }
 
     Debug( LDAP_DEBUG_TRACE, "forward_response: "
@@ -100,10 +116,10 @@ forward_response( LloadConnection *client, LloadOperation *op, BerElement *ber )
     }
     client->c_pendingber = output;
 
-    ber_printf( output, "t{titOtO}", LDAP_TAG_MESSAGE,
-            LDAP_TAG_MSGID, msgid,
-            response_tag, &response,
-            LDAP_TAG_CONTROLS, BER_BV_OPTIONAL( &controls ) );
+    ber_printf( output, "t{ti" /* "}" */, LDAP_TAG_MESSAGE,
+            LDAP_TAG_MSGID, msgid );
+    ber_write( output, response.bv_val, response.bv_len, 0 );
+    ber_printf( output, /* "{" */ "}" );
 
     checked_unlock( &client->c_io_mutex );
 
@@ -126,6 +142,8 @@ forward_final_response(
             op->o_upstream_connid, op->o_upstream_msgid, op->o_client_connid );
 
     rc = forward_response( client, op, ber );
+    lload_cache_invalidate( op );
+    lload_bind_cache_invalidate( op );
 
     op->o_res = LLOAD_OP_COMPLETED;
     if ( !op->o_pin_id ) {
@@ -209,8 +227,7 @@ handle_one_response( LloadConnection *c )
     CONNECTION_LOCK(c);
     if ( needle.o_upstream_msgid == 0 ) {
         return handle_unsolicited( c, ber );
-    } else if ( !( op = ldap_tavl_find(
-                           c->c_ops, &needle, operation_upstream_cmp ) ) ) {
+    } else if ( !( op = lload_optable_find( &c->c_ops, &needle ) ) ) {
         /* Already abandoned, do nothing */
         CONNECTION_UNLOCK(c);
         ber_free( ber, 1 );
@@ -265,7 +282,8 @@ handle_one_response( LloadConnection *c )
             diff = 1000000 * tvdiff.tv_sec + tvdiff.tv_usec;
 
             __atomic_add_fetch( &b->b_operation_count, 1, __ATOMIC_RELAXED );
-            __atomic_add_fetch( &b->b_operation_time, diff, __ATOMIC_RELAXED );
+            lload_latency_update( &b->b_latency, diff );
+            lload_latency_update( &c->c_latency, diff );
         }
         op->o_last_response = tv;
 
@@ -290,6 +308,10 @@ handle_one_response( LloadConnection *c )
         checked_unlock( &op->o_link_mutex );
         if ( client && IS_ALIVE( client, c_live ) ) {
             rc = handler( client, op, ber );
+        } else if ( op->o_tag == LDAP_REQ_SEARCH ) {
+            /* The responses might still be needed by searches coalesced onto
+             * this one */
+            rc = handler( NULL, op, ber );
         } else {
             ber_free( ber, 1 );
         }
@@ -668,11 +690,11 @@ upstream_finish( LloadConnection *c )
 #ifdef LDAP_API_FEATURE_VERIFY_CREDENTIALS
             !(lload_features & LLOAD_FEATURE_VC) &&
 #endif /* LDAP_API_FEATURE_VERIFY_CREDENTIALS */
-            b->b_active && b->b_numbindconns ) {
+            b->b_active && backend_pool_size( b, 1 ) ) {
         if ( !b->b_bindavail ) {
             is_bindconn = 1;
-        } else if ( b->b_active >= b->b_numconns &&
-                b->b_bindavail < b->b_numbindconns ) {
+        } else if ( b->b_active >= backend_pool_size( b, 0 ) &&
+                b->b_bindavail < backend_pool_size( b, 1 ) ) {
             is_bindconn = 1;
         }
     }
@@ -800,7 +822,7 @@ fail:
             "connid=%lu failed rc=%d\n",
             c->c_connid, rc );
 
-    assert( c->c_ops == NULL );
+    assert( LLOAD_OPTABLE_EMPTY( &c->c_ops ) );
     epoch = epoch_join();
     CONNECTION_DESTROY(c);
     epoch_leave( epoch );
@@ -946,6 +968,7 @@ upstream_init(
     c->c_is_tls = b->b_tls;
 #endif
     c->c_pdu_cb = handle_one_response;
+    lload_optable_init( &c->c_ops, 1 );
 
     LDAP_CIRCLEQ_INSERT_HEAD( &b->b_preparing, c, c_next );
     c->c_type = LLOAD_C_PREPARING;
@@ -1065,7 +1088,8 @@ upstream_unlink( LloadConnection *c )
 {
     LloadBackend *b = c->c_backend;
     struct event *read_event, *write_event;
-    TAvlnode *root, *linked_root;
+    LloadOpTable ops;
+    TAvlnode *linked_root;
     long freed, executing;
 
     Debug( LDAP_DEBUG_CONNS, "upstream_unlink: "
@@ -1081,8 +1105,8 @@ upstream_unlink( LloadConnection *c )
     read_event = c->c_read_event;
     write_event = c->c_write_event;
 
-    root = c->c_ops;
-    c->c_ops = NULL;
+    ops = c->c_ops;
+    lload_optable_init( &c->c_ops, 1 );
     executing = c->c_n_ops_executing;
     c->c_n_ops_executing = 0;
 
@@ -1091,7 +1115,8 @@ upstream_unlink( LloadConnection *c )
 
     CONNECTION_UNLOCK(c);
 
-    freed = ldap_tavl_free( root, (AVL_FREE)operation_lost_upstream );
+    freed = lload_optable_free( &ops, operation_lost_upstream );
+    lload_optable_destroy( &ops );
     assert( freed == executing );
 
     ldap_tavl_free( linked_root, (AVL_FREE)linked_upstream_lost );
@@ -1169,7 +1194,7 @@ upstream_destroy( LloadConnection *c )
 
     c->c_state = LLOAD_C_INVALID;
 
-    assert( c->c_ops == NULL );
+    assert( LLOAD_OPTABLE_EMPTY( &c->c_ops ) );
 
     if ( c->c_read_event ) {
         event_free( c->c_read_event );
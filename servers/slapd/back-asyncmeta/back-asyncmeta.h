@@ -337,9 +337,33 @@ typedef struct a_metatarget_t {
 	int			mt_timeout_ops;
 } a_metatarget_t;
 
-typedef struct a_metadncache_t {
-	ldap_pvt_thread_mutex_t mutex;
+/*
+ * The dn cache is split in shards by a hash of the dn, each with its
+ * own lock, taken for writing only to add, move or drop entries.
+ * Entries are kept in the bucket of the time they were last updated,
+ * and expire with it when the timeout loop gets past the ttl.
+ */
+#define META_DNCACHE_SHARDS	16
+#define META_DNCACHE_BUCKETS	8
+
+struct metadncacheentry_t;
+
+typedef struct a_metadncache_shard_t {
+	ldap_pvt_thread_rdwr_t	rwlock;
 	Avlnode			*tree;
+	LDAP_LIST_HEAD(metadncachebucket, metadncacheentry_t)
+				buckets[ META_DNCACHE_BUCKETS ];
+	time_t			epoch;		/* bucket of the current time */
+	time_t			width;		/* seconds per bucket */
+	int			nentries;
+
+	/* updated without the write lock, see dncache.c */
+	unsigned long		hits;
+	unsigned long		misses;
+} a_metadncache_shard_t;
+
+typedef struct a_metadncache_t {
+	a_metadncache_shard_t	shards[ META_DNCACHE_SHARDS ];
 
 #define META_DNCACHE_DISABLED   (0)
 #define META_DNCACHE_FOREVER    ((time_t)(-1))
@@ -428,6 +452,10 @@ typedef struct a_metainfo_t {
 
 	struct berval		mi_suffix;
 	volatile int          mi_disabled;
+
+	/* cn=monitor entry of the database, see monitor.c */
+	struct berval		mi_monitor_ndn;
+	void			*mi_monitor_cb;
 } a_metainfo_t;
 
 typedef enum meta_op_type {
@@ -570,6 +598,24 @@ asyncmeta_dncache_delete_entry(
 extern void
 asyncmeta_dncache_free( void *entry );
 
+extern void
+asyncmeta_dncache_init( a_metadncache_t *cache );
+
+extern void
+asyncmeta_dncache_destroy( a_metadncache_t *cache );
+
+extern void
+asyncmeta_dncache_expire(
+	a_metadncache_t		*cache,
+	time_t			now );
+
+extern void
+asyncmeta_dncache_stats(
+	a_metadncache_t		*cache,
+	unsigned long		*hits,
+	unsigned long		*misses,
+	int			*nentries );
+
 extern int
 asyncmeta_subtree_destroy( a_metasubtree_t *ms );
 
@@ -26,26 +26,45 @@
 #include <ac/string.h>
 
 #include "slap.h"
+#include "lutil_hash.h"
 #include "../back-ldap/back-ldap.h"
 #include "back-asyncmeta.h"
 
 /*
  * The dncache, at present, maps an entry to the target that holds it.
+ *
+ * Lookups only take the read lock of a shard, and do not check the
+ * time: expired entries are dropped a bucket at a time by
+ * asyncmeta_dncache_expire(), called from the timeout loop once a
+ * second. Entries go in the bucket of sh->epoch, which only that loop
+ * advances: an entry updated early in a bucket is dropped up to two
+ * bucket widths after its ttl, one updated while sh->epoch is behind
+ * may go up to a run of the loop early. With a ttl of 10 the width is
+ * 2, six buckets are kept, and an entry lives 9 to 13 seconds.
  */
 
 typedef struct metadncacheentry_t {
 	struct berval	dn;
 	int 		target;
 
-	time_t 		lastupdated;
+	time_t		epoch;		/* bucket the entry is in */
+	LDAP_LIST_ENTRY(metadncacheentry_t)	next;
 } metadncacheentry_t;
 
+/* hits and misses are counted under the read lock; they are only
+ * statistics, so without atomics a few may get lost */
+#ifdef __ATOMIC_RELAXED
+#define	DNCACHE_COUNT(c)	((void)__atomic_add_fetch( &(c), 1, __ATOMIC_RELAXED ))
+#define	DNCACHE_READ(c)		__atomic_load_n( &(c), __ATOMIC_RELAXED )
+#else /* ! __ATOMIC_RELAXED */
+#define	DNCACHE_COUNT(c)	((void)(c)++)
+#define	DNCACHE_READ(c)		(c)
+#endif /* ! __ATOMIC_RELAXED */
+
 /*
  * asyncmeta_dncache_cmp
  *
  * compares two struct metadncacheentry; used by avl stuff
- * FIXME: modify avl stuff to delete an entry based on cmp
- * (e.g. when ttl expired?)
  */
 int
 asyncmeta_dncache_cmp(
@@ -81,6 +100,79 @@ asyncmeta_dncache_dup(
 	return ( ber_bvcmp( &cc1->dn, &cc2->dn ) == 0 ) ? -1 : 0;
 }
 
+static a_metadncache_shard_t *
+asyncmeta_dncache_shard(
+	a_metadncache_t	*cache,
+	struct berval	*ndn )
+{
+	lutil_HASH_CTX	ctx;
+	unsigned char	digest[ LUTIL_HASH_BYTES ];
+	unsigned	h;
+
+	lutil_HASHInit( &ctx );
+	lutil_HASHUpdate( &ctx, (unsigned char *)ndn->bv_val, ndn->bv_len );
+	lutil_HASHFinal( digest, &ctx );
+	h = digest[ 0 ] | digest[ 1 ] << 8 | digest[ 2 ] << 16 | (unsigned)digest[ 3 ] << 24;
+
+	return &cache->shards[ h % META_DNCACHE_SHARDS ];
+}
+
+/*
+ * the width of a bucket, and how many buckets an entry lives:
+ * enough to cover the ttl, with one bucket of slack; 0 if the
+ * cache never expires
+ */
+static time_t
+asyncmeta_dncache_width( time_t ttl, int *live )
+{
+	time_t	width;
+
+	if ( ttl < 0 ) {
+		*live = 0;
+		return 0;
+	}
+
+	width = ( ttl + META_DNCACHE_BUCKETS - 2 ) / ( META_DNCACHE_BUCKETS - 1 );
+	if ( width < 1 ) {
+		width = 1;
+	}
+	*live = ( ttl + width - 1 ) / width + 1;
+
+	return width;
+}
+
+/* drop the entries of a bucket; write lock held */
+static void
+asyncmeta_dncache_drop_bucket(
+	a_metadncache_shard_t	*sh,
+	int			bucket )
+{
+	metadncacheentry_t	*entry;
+
+	while ( ( entry = LDAP_LIST_FIRST( &sh->buckets[ bucket ] ) ) != NULL ) {
+		LDAP_LIST_REMOVE( entry, next );
+		ldap_avl_delete( &sh->tree, ( caddr_t )entry, asyncmeta_dncache_cmp );
+		asyncmeta_dncache_free( ( void * )entry );
+		sh->nentries--;
+	}
+}
+
+/* start over with buckets of a different width; write lock held */
+static void
+asyncmeta_dncache_reset(
+	a_metadncache_shard_t	*sh,
+	time_t			width,
+	time_t			now )
+{
+	int	i;
+
+	for ( i = 0; i < META_DNCACHE_BUCKETS; i++ ) {
+		asyncmeta_dncache_drop_bucket( sh, i );
+	}
+	sh->width = width;
+	sh->epoch = width ? now / width : 0;
+}
+
 /*
  * asyncmeta_dncache_get_target
  *
@@ -92,6 +184,7 @@ asyncmeta_dncache_get_target(
 	a_metadncache_t	*cache,
 	struct berval	*ndn )
 {
+	a_metadncache_shard_t	*sh;
 	metadncacheentry_t	tmp_entry,
 				*entry;
 	int			target = META_TARGET_NONE;
@@ -99,28 +192,21 @@ asyncmeta_dncache_get_target(
 	assert( cache != NULL );
 	assert( ndn != NULL );
 
+	sh = asyncmeta_dncache_shard( cache, ndn );
 	tmp_entry.dn = *ndn;
-	ldap_pvt_thread_mutex_lock( &cache->mutex );
-	entry = ( metadncacheentry_t * )ldap_avl_find( cache->tree,
+	ldap_pvt_thread_rdwr_rlock( &sh->rwlock );
+	entry = ( metadncacheentry_t * )ldap_avl_find( sh->tree,
 			( caddr_t )&tmp_entry, asyncmeta_dncache_cmp );
-
 	if ( entry != NULL ) {
+		target = entry->target;
+	}
+	ldap_pvt_thread_rdwr_runlock( &sh->rwlock );
 
-		/*
-		 * if cache->ttl < 0, cache never expires;
-		 * if cache->ttl = 0 no cache is used; shouldn't get here
-		 * else, cache is used with ttl
-		 */
-		if ( cache->ttl < 0 ) {
-			target = entry->target;
-
-		} else {
-			if ( entry->lastupdated+cache->ttl > slap_get_time() ) {
-				target = entry->target;
-			}
-		}
+	if ( target != META_TARGET_NONE ) {
+		DNCACHE_COUNT( sh->hits );
+	} else {
+		DNCACHE_COUNT( sh->misses );
 	}
-	ldap_pvt_thread_mutex_unlock( &cache->mutex );
 
 	return target;
 }
@@ -128,7 +214,7 @@ asyncmeta_dncache_get_target(
 /*
  * asyncmeta_dncache_update_entry
  *
- * updates target and lastupdated of a struct metadncacheentry if exists,
+ * updates target and bucket of a struct metadncacheentry if exists,
  * otherwise it gets created; returns -1 in case of error
  */
 int
@@ -137,32 +223,47 @@ asyncmeta_dncache_update_entry(
 	struct berval	*ndn,
 	int 		target )
 {
+	a_metadncache_shard_t	*sh;
 	metadncacheentry_t	*entry,
 				tmp_entry;
-	time_t			curr_time = 0L;
-	int			err = 0;
+	time_t			width;
+	int			live, err = 0;
 
 	assert( cache != NULL );
 	assert( ndn != NULL );
 
-	/*
-	 * if cache->ttl < 0, cache never expires;
-	 * if cache->ttl = 0 no cache is used; shouldn't get here
-	 * else, cache is used with ttl
-	 */
-	if ( cache->ttl > 0 ) {
-		curr_time = slap_get_time();
+	sh = asyncmeta_dncache_shard( cache, ndn );
+	width = asyncmeta_dncache_width( cache->ttl, &live );
+	tmp_entry.dn = *ndn;
+
+	/* most updates find the entry as it is */
+	ldap_pvt_thread_rdwr_rlock( &sh->rwlock );
+	entry = ( metadncacheentry_t * )ldap_avl_find( sh->tree,
+			( caddr_t )&tmp_entry, asyncmeta_dncache_cmp );
+	if ( entry != NULL && entry->target == target
+		&& entry->epoch == sh->epoch && sh->width == width )
+	{
+		ldap_pvt_thread_rdwr_runlock( &sh->rwlock );
+		return 0;
 	}
+	ldap_pvt_thread_rdwr_runlock( &sh->rwlock );
 
-	tmp_entry.dn = *ndn;
+	ldap_pvt_thread_rdwr_wlock( &sh->rwlock );
+	if ( sh->width != width ) {
+		asyncmeta_dncache_reset( sh, width, slap_get_time() );
+	}
 
-	ldap_pvt_thread_mutex_lock( &cache->mutex );
-	entry = ( metadncacheentry_t * )ldap_avl_find( cache->tree,
+	entry = ( metadncacheentry_t * )ldap_avl_find( sh->tree,
 			( caddr_t )&tmp_entry, asyncmeta_dncache_cmp );
 
 	if ( entry != NULL ) {
 		entry->target = target;
-		entry->lastupdated = curr_time;
+		if ( entry->epoch != sh->epoch ) {
+			LDAP_LIST_REMOVE( entry, next );
+			entry->epoch = sh->epoch;
+			LDAP_LIST_INSERT_HEAD( &sh->buckets[ sh->epoch % META_DNCACHE_BUCKETS ],
+				entry, next );
+		}
 
 	} else {
 		entry = ch_malloc( sizeof( metadncacheentry_t ) + ndn->bv_len + 1 );
@@ -177,14 +278,22 @@ asyncmeta_dncache_update_entry(
 		entry->dn.bv_val[ ndn->bv_len ] = '\0';
 
 		entry->target = target;
-		entry->lastupdated = curr_time;
+		entry->epoch = sh->epoch;
 
-		err = ldap_avl_insert( &cache->tree, ( caddr_t )entry,
+		err = ldap_avl_insert( &sh->tree, ( caddr_t )entry,
 				asyncmeta_dncache_cmp, asyncmeta_dncache_dup );
+		if ( err == 0 ) {
+			LDAP_LIST_INSERT_HEAD( &sh->buckets[ sh->epoch % META_DNCACHE_BUCKETS ],
+				entry, next );
+			sh->nentries++;
+
+		} else {
+			asyncmeta_dncache_free( ( void * )entry );
+		}
 	}
 
 error_return:;
-	ldap_pvt_thread_mutex_unlock( &cache->mutex );
+	ldap_pvt_thread_rdwr_wunlock( &sh->rwlock );
 
 	return err;
 }
@@ -194,18 +303,24 @@ asyncmeta_dncache_delete_entry(
 	a_metadncache_t	*cache,
 	struct berval	*ndn )
 {
+	a_metadncache_shard_t	*sh;
 	metadncacheentry_t	*entry,
 				tmp_entry;
 
 	assert( cache != NULL );
 	assert( ndn != NULL );
 
+	sh = asyncmeta_dncache_shard( cache, ndn );
 	tmp_entry.dn = *ndn;
 
-	ldap_pvt_thread_mutex_lock( &cache->mutex );
-	entry = ldap_avl_delete( &cache->tree, ( caddr_t )&tmp_entry,
+	ldap_pvt_thread_rdwr_wlock( &sh->rwlock );
+	entry = ldap_avl_delete( &sh->tree, ( caddr_t )&tmp_entry,
 			asyncmeta_dncache_cmp );
-	ldap_pvt_thread_mutex_unlock( &cache->mutex );
+	if ( entry != NULL ) {
+		LDAP_LIST_REMOVE( entry, next );
+		sh->nentries--;
+	}
+	ldap_pvt_thread_rdwr_wunlock( &sh->rwlock );
 
 	if ( entry != NULL ) {
 		asyncmeta_dncache_free( ( void * )entry );
@@ -214,6 +329,122 @@ asyncmeta_dncache_delete_entry(
 	return 0;
 }
 
+/*
+ * asyncmeta_dncache_expire
+ *
+ * drops the buckets that got older than the ttl since the last call
+ */
+void
+asyncmeta_dncache_expire(
+	a_metadncache_t	*cache,
+	time_t		now )
+{
+	a_metadncache_shard_t	*sh;
+	time_t			width, epoch, e;
+	int			i, live, uptodate;
+
+	if ( cache->ttl <= 0 ) {
+		return;
+	}
+
+	width = asyncmeta_dncache_width( cache->ttl, &live );
+	epoch = now / width;
+
+	for ( i = 0; i < META_DNCACHE_SHARDS; i++ ) {
+		sh = &cache->shards[ i ];
+
+		ldap_pvt_thread_rdwr_rlock( &sh->rwlock );
+		uptodate = ( sh->width == width && sh->epoch == epoch );
+		ldap_pvt_thread_rdwr_runlock( &sh->rwlock );
+		if ( uptodate ) {
+			continue;
+		}
+
+		ldap_pvt_thread_rdwr_wlock( &sh->rwlock );
+		if ( sh->width != width || epoch < sh->epoch
+			|| epoch - sh->epoch >= META_DNCACHE_BUCKETS )
+		{
+			asyncmeta_dncache_reset( sh, width, now );
+
+		} else {
+			for ( e = sh->epoch - live + 1; e <= epoch - live; e++ ) {
+				asyncmeta_dncache_drop_bucket( sh, e % META_DNCACHE_BUCKETS );
+			}
+			sh->epoch = epoch;
+		}
+		ldap_pvt_thread_rdwr_wunlock( &sh->rwlock );
+	}
+}
+
+/*
+ * asyncmeta_dncache_stats
+ *
+ * sums the counters of the shards, for cn=monitor
+ */
+void
+asyncmeta_dncache_stats(
+	a_metadncache_t	*cache,
+	unsigned long	*hits,
+	unsigned long	*misses,
+	int		*nentries )
+{
+	a_metadncache_shard_t	*sh;
+	int			i;
+
+	*hits = *misses = 0;
+	*nentries = 0;
+	for ( i = 0; i < META_DNCACHE_SHARDS; i++ ) {
+		sh = &cache->shards[ i ];
+
+		*hits += DNCACHE_READ( sh->hits );
+		*misses += DNCACHE_READ( sh->misses );
+
+		ldap_pvt_thread_rdwr_rlock( &sh->rwlock );
+		*nentries += sh->nentries;
+		ldap_pvt_thread_rdwr_runlock( &sh->rwlock );
+	}
+}
+
+void
+asyncmeta_dncache_init(
+	a_metadncache_t	*cache )
+{
+	a_metadncache_shard_t	*sh;
+	int			i, j;
+
+	for ( i = 0; i < META_DNCACHE_SHARDS; i++ ) {
+		sh = &cache->shards[ i ];
+
+		ldap_pvt_thread_rdwr_init( &sh->rwlock );
+		sh->tree = NULL;
+		for ( j = 0; j < META_DNCACHE_BUCKETS; j++ ) {
+			LDAP_LIST_INIT( &sh->buckets[ j ] );
+		}
+		sh->epoch = 0;
+		sh->width = 0;
+		sh->nentries = 0;
+		sh->hits = sh->misses = 0;
+	}
+}
+
+void
+asyncmeta_dncache_destroy(
+	a_metadncache_t	*cache )
+{
+	a_metadncache_shard_t	*sh;
+	int			i;
+
+	for ( i = 0; i < META_DNCACHE_SHARDS; i++ ) {
+		sh = &cache->shards[ i ];
+
+		if ( sh->tree ) {
+			ldap_avl_free( sh->tree, asyncmeta_dncache_free );
+			sh->tree = NULL;
+		}
+		ldap_pvt_thread_rdwr_destroy( &sh->rwlock );
+	}
+}
+
 /*
  * meta_dncache_free
  *
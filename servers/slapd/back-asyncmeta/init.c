@@ -143,7 +143,7 @@ asyncmeta_back_db_init(
 	mi->mi_rebind_f = asyncmeta_back_default_rebind;
 	mi->mi_urllist_f = asyncmeta_back_default_urllist;
 
-	ldap_pvt_thread_mutex_init( &mi->mi_cache.mutex );
+	asyncmeta_dncache_init( &mi->mi_cache );
 
 	/* safe default */
 	mi->mi_nretries = META_RETRY_DEFAULT;
@@ -165,6 +165,8 @@ asyncmeta_back_db_init(
 	be->be_private = mi;
 	be->be_cf_ocs = be->bd_info->bi_cf_ocs;
 
+	asyncmeta_monitor_db_init( be );
+
 	return 0;
 }
 
@@ -284,6 +286,11 @@ asyncmeta_back_db_open(
 			ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
 		}
 	}
+
+	if ( asyncmeta_monitor_db_open( be ) ) {
+		return 1;
+	}
+
 	return 0;
 }
 
@@ -394,6 +401,7 @@ asyncmeta_back_db_close(
 	if ( be->be_private ) {
 		mi = ( a_metainfo_t * )be->be_private;
 		mi->mi_disabled = 1;
+		asyncmeta_monitor_db_close( be );
 		/* there are no pending ops so we can free up the connections and stop the timeout loop
 		 * else timeout_loop will clear up the ops and connections and not reschedule */
 		if ( asyncmeta_db_has_pending_ops( mi ) == 0 ) {
@@ -447,13 +455,7 @@ asyncmeta_back_db_destroy(
 			free( mi->mi_targets );
 		}
 
-		ldap_pvt_thread_mutex_lock( &mi->mi_cache.mutex );
-		if ( mi->mi_cache.tree ) {
-			ldap_avl_free( mi->mi_cache.tree, asyncmeta_dncache_free );
-		}
-
-		ldap_pvt_thread_mutex_unlock( &mi->mi_cache.mutex );
-		ldap_pvt_thread_mutex_destroy( &mi->mi_cache.mutex );
+		asyncmeta_dncache_destroy( &mi->mi_cache );
 
 		if ( mi->mi_candidates != NULL ) {
 			ber_memfree_x( mi->mi_candidates, NULL );
@@ -1674,6 +1674,11 @@ void* asyncmeta_timeout_loop(void *ctx, void *arg)
 		ldap_pvt_thread_mutex_unlock( &mi->mi_mc_mutex );
 		return NULL;
 	}
+
+	if ( mi->mi_cache.ttl > 0 ) {
+		asyncmeta_dncache_expire( &mi->mi_cache, current_time );
+	}
+
 	void *oldctx = slap_sl_mem_create(SLAP_SLAB_SIZE, SLAP_SLAB_STACK, ctx, 0);
 	for (i=0; i<mi->mi_num_conns; i++) {
 		a_metaconn_t * mc= &mi->mi_conns[i];
@@ -0,0 +1,387 @@
+/* monitor.c - monitor asyncmeta backend */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2016-2024 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/string.h>
+
+#include "slap.h"
+#include "../back-ldap/back-ldap.h"
+#include "back-asyncmeta.h"
+#include "../back-monitor/back-monitor.h"
+#include "slap-config.h"
+
+static ObjectClass		*oc_olmAsyncMetaDatabase;
+
+static AttributeDescription	*ad_olmAsyncMetaDNCacheHits,
+	*ad_olmAsyncMetaDNCacheMisses, *ad_olmAsyncMetaDNCacheEntries;
+
+/*
+ * AsyncMeta database monitor attributes	1.3.6.1.4.1.4203.666.1.55.0.1.3
+ * AsyncMeta database monitor objectclasses	1.3.6.1.4.1.4203.666.3.16.0.1.3
+ */
+
+static struct {
+	char			*name;
+	char			*oid;
+}		s_oid[] = {
+	{ "olmAsyncMetaAttributes",		"olmDatabaseAttributes:3" },
+	{ "olmAsyncMetaObjectClasses",		"olmDatabaseObjectClasses:3" },
+
+	{ NULL }
+};
+
+static struct {
+	char			*desc;
+	AttributeDescription	**ad;
+}		s_at[] = {
+	{ "( olmAsyncMetaAttributes:1 "
+		"NAME ( 'olmAsyncMetaDNCacheHits' ) "
+		"DESC 'Number of lookups that found the target of a DN in the cache' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmAsyncMetaDNCacheHits },
+
+	{ "( olmAsyncMetaAttributes:2 "
+		"NAME ( 'olmAsyncMetaDNCacheMisses' ) "
+		"DESC 'Number of lookups that did not find a DN in the cache' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmAsyncMetaDNCacheMisses },
+
+	{ "( olmAsyncMetaAttributes:3 "
+		"NAME ( 'olmAsyncMetaDNCacheEntries' ) "
+		"DESC 'Number of DNs in the cache' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmAsyncMetaDNCacheEntries },
+
+	{ NULL }
+};
+
+static struct {
+	char		*desc;
+	ObjectClass	**oc;
+}		s_oc[] = {
+	/* augments an existing object, so it must be AUXILIARY */
+	{ "( olmAsyncMetaObjectClasses:1 "
+		"NAME ( 'olmAsyncMetaDatabase' ) "
+		"SUP top AUXILIARY "
+		"MAY ( "
+			"olmAsyncMetaDNCacheHits "
+			"$ olmAsyncMetaDNCacheMisses "
+			"$ olmAsyncMetaDNCacheEntries "
+			") )",
+		&oc_olmAsyncMetaDatabase },
+
+	{ NULL }
+};
+
+static int
+asyncmeta_monitor_update(
+	Operation	*op,
+	SlapReply	*rs,
+	Entry		*e,
+	void		*priv )
+{
+	a_metainfo_t	*mi = (a_metainfo_t *) priv;
+	Attribute	*a;
+	char		buf[ BUFSIZ ];
+	struct berval	bv;
+	unsigned long	hits, misses;
+	int		nentries;
+
+	asyncmeta_dncache_stats( &mi->mi_cache, &hits, &misses, &nentries );
+
+	a = attr_find( e->e_attrs, ad_olmAsyncMetaDNCacheHits );
+	assert( a != NULL );
+	bv.bv_val = buf;
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", hits );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+	a = attr_find( e->e_attrs, ad_olmAsyncMetaDNCacheMisses );
+	assert( a != NULL );
+	bv.bv_val = buf;
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", misses );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+	a = attr_find( e->e_attrs, ad_olmAsyncMetaDNCacheEntries );
+	assert( a != NULL );
+	bv.bv_val = buf;
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%d", nentries );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+	return SLAP_CB_CONTINUE;
+}
+
+static int
+asyncmeta_monitor_free(
+	Entry		*e,
+	void		**priv )
+{
+	struct berval	values[ 2 ];
+	Modification	mod = { 0 };
+
+	const char	*text;
+	char		textbuf[ SLAP_TEXT_BUFLEN ];
+
+	int		i;
+
+	/* NOTE: if slap_shutdown != 0, priv might have already been freed */
+	*priv = NULL;
+
+	/* Remove objectClass */
+	mod.sm_op = LDAP_MOD_DELETE;
+	mod.sm_desc = slap_schema.si_ad_objectClass;
+	mod.sm_values = values;
+	mod.sm_numvals = 1;
+	values[ 0 ] = oc_olmAsyncMetaDatabase->soc_cname;
+	BER_BVZERO( &values[ 1 ] );
+
+	/* don't care too much about return code... */
+	(void)modify_delete_values( e, &mod, 1, &text,
+		textbuf, sizeof( textbuf ) );
+
+	/* remove attrs */
+	mod.sm_values = NULL;
+	mod.sm_numvals = 0;
+	for ( i = 0; s_at[ i ].desc != NULL; i++ ) {
+		mod.sm_desc = *s_at[ i ].ad;
+		(void)modify_delete_values( e, &mod, 1, &text,
+			textbuf, sizeof( textbuf ) );
+	}
+
+	return SLAP_CB_CONTINUE;
+}
+
+/*
+ * call from within asyncmeta_back_db_init()
+ */
+static int
+asyncmeta_monitor_initialize( void )
+{
+	int		i, code;
+	ConfigArgs c;
+	char	*argv[ 3 ];
+
+	static int	asyncmeta_monitor_initialized = 0;
+
+	/* set to 0 when successfully initialized; otherwise, remember failure */
+	static int	asyncmeta_monitor_initialized_failure = 1;
+
+	if ( asyncmeta_monitor_initialized++ ) {
+		return asyncmeta_monitor_initialized_failure;
+	}
+
+	if ( backend_info( "monitor" ) == NULL ) {
+		return -1;
+	}
+
+	/* register schema here */
+
+	argv[ 0 ] = "back-asyncmeta monitor";
+	c.argv = argv;
+	c.argc = 3;
+	c.fname = argv[0];
+
+	for ( i = 0; s_oid[ i ].name; i++ ) {
+		c.lineno = i;
+		argv[ 1 ] = s_oid[ i ].name;
+		argv[ 2 ] = s_oid[ i ].oid;
+
+		if ( parse_oidm( &c, 0, NULL ) != 0 ) {
+			Debug( LDAP_DEBUG_ANY, LDAP_XSTRING(asyncmeta_monitor_initialize)
+				": unable to add "
+				"objectIdentifier \"%s=%s\"\n",
+				s_oid[ i ].name, s_oid[ i ].oid );
+			return 2;
+		}
+	}
+
+	for ( i = 0; s_at[ i ].desc != NULL; i++ ) {
+		code = register_at( s_at[ i ].desc, s_at[ i ].ad, 1 );
+		if ( code != LDAP_SUCCESS ) {
+			Debug( LDAP_DEBUG_ANY, LDAP_XSTRING(asyncmeta_monitor_initialize)
+				": register_at failed for attributeType (%s)\n",
+				s_at[ i ].desc );
+			return 3;
+
+		} else {
+			(*s_at[ i ].ad)->ad_type->sat_flags |= SLAP_AT_HIDE;
+		}
+	}
+
+	for ( i = 0; s_oc[ i ].desc != NULL; i++ ) {
+		code = register_oc( s_oc[ i ].desc, s_oc[ i ].oc, 1 );
+		if ( code != LDAP_SUCCESS ) {
+			Debug( LDAP_DEBUG_ANY, LDAP_XSTRING(asyncmeta_monitor_initialize)
+				": register_oc failed for objectClass (%s)\n",
+				s_oc[ i ].desc );
+			return 4;
+
+		} else {
+			(*s_oc[ i ].oc)->soc_flags |= SLAP_OC_HIDE;
+		}
+	}
+
+	return ( asyncmeta_monitor_initialized_failure = LDAP_SUCCESS );
+}
+
+/*
+ * call from within asyncmeta_back_db_init()
+ */
+int
+asyncmeta_monitor_db_init( BackendDB *be )
+{
+	if ( asyncmeta_monitor_initialize() == LDAP_SUCCESS ) {
+		/* monitoring in back-asyncmeta is on by default */
+		SLAP_DBFLAGS( be ) |= SLAP_DBFLAG_MONITORING;
+	}
+
+	return 0;
+}
+
+/*
+ * call from within asyncmeta_back_db_open()
+ */
+int
+asyncmeta_monitor_db_open( BackendDB *be )
+{
+	a_metainfo_t		*mi = (a_metainfo_t *) be->be_private;
+	Attribute		*a, *next;
+	monitor_callback_t	*cb = NULL;
+	int			rc = 0;
+	BackendInfo		*bi;
+	monitor_extra_t		*mbe;
+
+	if ( !SLAP_DBMONITORING( be ) ) {
+		return 0;
+	}
+
+	bi = backend_info( "monitor" );
+	if ( !bi || !bi->bi_extra ) {
+		SLAP_DBFLAGS( be ) ^= SLAP_DBFLAG_MONITORING;
+		return 0;
+	}
+	mbe = bi->bi_extra;
+
+	/* don't bother if monitor is not configured */
+	if ( !mbe->is_configured() ) {
+		static int warning = 0;
+
+		if ( warning++ == 0 ) {
+			Debug( LDAP_DEBUG_CONFIG, LDAP_XSTRING(asyncmeta_monitor_db_open)
+				": monitoring disabled; "
+				"configure monitor database to enable\n" );
+		}
+
+		return 0;
+	}
+
+	/* alloc as many as required (plus 1 for objectClass) */
+	a = attrs_alloc( 1 + 3 );
+	if ( a == NULL ) {
+		rc = 1;
+		goto cleanup;
+	}
+
+	a->a_desc = slap_schema.si_ad_objectClass;
+	attr_valadd( a, &oc_olmAsyncMetaDatabase->soc_cname, NULL, 1 );
+	next = a->a_next;
+
+	{
+		struct berval bv = BER_BVC( "0" );
+
+		next->a_desc = ad_olmAsyncMetaDNCacheHits;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
+
+		next->a_desc = ad_olmAsyncMetaDNCacheMisses;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
+
+		next->a_desc = ad_olmAsyncMetaDNCacheEntries;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
+	}
+
+	cb = ch_calloc( sizeof( monitor_callback_t ), 1 );
+	cb->mc_update = asyncmeta_monitor_update;
+	cb->mc_free = asyncmeta_monitor_free;
+	cb->mc_private = (void *)mi;
+
+	/* make sure the database is registered; then add monitor attributes */
+	rc = mbe->register_database( be, &mi->mi_monitor_ndn );
+	if ( rc == 0 ) {
+		rc = mbe->register_entry_attrs( &mi->mi_monitor_ndn, a, cb,
+			NULL, -1, NULL );
+	}
+
+cleanup:;
+	if ( rc != 0 ) {
+		if ( cb != NULL ) {
+			ch_free( cb );
+			cb = NULL;
+		}
+
+		if ( a != NULL ) {
+			attrs_free( a );
+			a = NULL;
+		}
+	}
+
+	/* store for cleanup */
+	mi->mi_monitor_cb = (void *)cb;
+
+	/* we don't need to keep track of the attributes, because
+	 * asyncmeta_monitor_free() takes care of everything */
+	if ( a != NULL ) {
+		attrs_free( a );
+	}
+
+	return rc;
+}
+
+/*
+ * call from within asyncmeta_back_db_close()
+ */
+int
+asyncmeta_monitor_db_close( BackendDB *be )
+{
+	a_metainfo_t		*mi = (a_metainfo_t *) be->be_private;
+
+	if ( !BER_BVISNULL( &mi->mi_monitor_ndn ) ) {
+		BackendInfo		*bi = backend_info( "monitor" );
+		monitor_extra_t		*mbe;
+
+		if ( bi && bi->bi_extra ) {
+			struct berval dummy = BER_BVNULL;
+			mbe = bi->bi_extra;
+			mbe->unregister_entry_callback( &mi->mi_monitor_ndn,
+				(monitor_callback_t *)mi->mi_monitor_cb,
+				&dummy, 0, &dummy );
+		}
+
+		BER_BVZERO( &mi->mi_monitor_ndn );
+		mi->mi_monitor_cb = NULL;
+	}
+
+	return 0;
+}
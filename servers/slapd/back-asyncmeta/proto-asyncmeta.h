@@ -48,6 +48,10 @@ extern BI_connection_destroy	asyncmeta_back_conn_destroy;
 
 int asyncmeta_back_init_cf( BackendInfo *bi );
 
+int asyncmeta_monitor_db_init( BackendDB *be );
+int asyncmeta_monitor_db_open( BackendDB *be );
+int asyncmeta_monitor_db_close( BackendDB *be );
+
 LDAP_END_DECL
 
 #endif /* PROTO_ASYNCMETA_H */
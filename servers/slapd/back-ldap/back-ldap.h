@@ -29,6 +29,10 @@
 LDAP_BEGIN_DECL
 
 struct ldapinfo_t;
+struct ldap_back_mux_t;
+
+/* called with the responses of an operation, see ldap_back_mux_async() */
+typedef int (ldap_back_mux_func)( void *ctx, LDAPMessage *msg, int err, void *arg );
 
 /* stuff required for monitoring */
 typedef struct ldap_monitor_info_t {
@@ -176,6 +180,9 @@ typedef struct ldapconn_t {
 	struct berval		lc_cred;
 	struct berval 		lc_bound_ndn;
 	unsigned		lc_flags;
+
+	/* demultiplexer of a shared connection, see mux.c */
+	struct ldap_back_mux_t	*lc_mux;
 } ldapconn_t;
 
 typedef struct ldap_avl_info_t {
@@ -398,6 +405,19 @@ typedef struct ldapinfo_t {
 	 * and LDAP_BACK_CONN_PRIV_MAX ! */
 #define	LDAP_BACK_CONN_PRIV_DEFAULT	(16)
 
+	/* operations in progress on a shared connection
+	 * before another one is opened; 0 disables sharing */
+	int			li_multiplex;
+	ldap_pvt_thread_mutex_t	li_mux_mutex;
+	struct ldap_back_mux_t	*li_mux;
+	/* demultiplexer thread, woken through li_mux_wake */
+	ldap_pvt_thread_t	li_mux_thread;
+	ber_socket_t		li_mux_wake[ 2 ];
+	int			li_mux_state;
+#define	LDAP_BACK_MUX_IDLE	(0)
+#define	LDAP_BACK_MUX_RUNNING	(1)
+#define	LDAP_BACK_MUX_SHUTDOWN	(2)
+
 	ldap_monitor_info_t	li_monitor_info;
 
 	sig_atomic_t		li_isquarantined;
@@ -900,6 +900,31 @@ retry_lock:
 				}
 			}
 
+			/* shared conns take up to li_multiplex ops each
+			 * before another one is opened */
+			if ( lc == NULL && li->li_multiplex
+				&& !LDAP_BACK_PCONN_ISBIND( &lc_curr ) )
+			{
+				ldapconn_t	*tmplc;
+
+				LDAP_TAILQ_FOREACH( tmplc,
+					&li->li_conn_priv[ LDAP_BACK_CONN2PRIV( &lc_curr ) ].lic_priv,
+					lc_q )
+				{
+					if ( tmplc->lc_mux != NULL && !LDAP_BACK_CONN_BINDING( tmplc )
+						&& ( lc == NULL || tmplc->lc_refcnt < lc->lc_refcnt ) )
+					{
+						lc = tmplc;
+					}
+				}
+
+				if ( lc != NULL && lc->lc_refcnt >= li->li_multiplex
+					&& li->li_conn_priv[ LDAP_BACK_CONN2PRIV( &lc_curr ) ].lic_num < li->li_conn_priv_max )
+				{
+					lc = NULL;
+				}
+			}
+
 			if ( lc != NULL ) {
 				if ( lc != LDAP_TAILQ_LAST( &li->li_conn_priv[ LDAP_BACK_CONN2PRIV( lc ) ].lic_priv,
 					lc_conn_priv_q ) )
@@ -1515,6 +1540,7 @@ retry:;
 
 			assert( lc->lc_refcnt > 0 );
 			if ( lc->lc_refcnt == 1 ) {
+				ldap_back_mux_stop( lc );
 				ldap_unbind_ext( lc->lc_ld, NULL, NULL );
 				lc->lc_ld = NULL;
 
@@ -1575,6 +1601,9 @@ retry:;
 	}
 
 done:;
+	if ( li->li_multiplex && LDAP_BACK_CONN_ISBOUND( lc ) ) {
+		(void)ldap_back_mux_start( li, lc );
+	}
 	LDAP_BACK_CONN_BINDING_CLEAR( lc );
 	rc = LDAP_BACK_CONN_ISBOUND( lc );
 	if ( !rc ) {
@@ -1694,19 +1723,52 @@ ldap_back_cancel(
 		ldap_back_send_t	sendok )
 {
 	ldapinfo_t	*li = (ldapinfo_t *)op->o_bd->be_private;
+	int		rc;
+
+	/*
+	 * On a shared connection, what was received for msgid is only
+	 * forgotten once nothing more can come for it.
+	 */
 
 	/* default behavior */
 	if ( LDAP_BACK_ABANDON( li ) ) {
-		return ldap_abandon_ext( lc->lc_ld, msgid, NULL, NULL );
+		rc = ldap_abandon_ext( lc->lc_ld, msgid, NULL, NULL );
+		ldap_back_mux_discard( lc, msgid );
+		return rc;
 	}
 
 	if ( LDAP_BACK_IGNORE( li ) ) {
-		return ldap_pvt_discard( lc->lc_ld, msgid );
+		rc = ldap_pvt_discard( lc->lc_ld, msgid );
+		ldap_back_mux_discard( lc, msgid );
+		return rc;
 	}
 
 	if ( LDAP_BACK_CANCEL( li ) ) {
-		/* FIXME: asynchronous? */
-		return ldap_cancel_s( lc->lc_ld, msgid, NULL, NULL );
+		ber_int_t	cmsgid;
+		LDAPMessage	*res = NULL;
+
+		if ( lc->lc_mux == NULL ) {
+			/* FIXME: asynchronous? */
+			return ldap_cancel_s( lc->lc_ld, msgid, NULL, NULL );
+		}
+
+		/* the response is passed on by the reader of a shared conn */
+		rc = ldap_cancel( lc->lc_ld, msgid, NULL, NULL, &cmsgid );
+		if ( rc != LDAP_SUCCESS ) {
+			ldap_back_mux_discard( lc, msgid );
+			return rc;
+		}
+		if ( ldap_back_result( lc, cmsgid, LDAP_MSG_ALL, NULL, &res ) == -1 ) {
+			ldap_get_option( lc->lc_ld, LDAP_OPT_RESULT_CODE, &rc );
+
+		} else if ( ldap_parse_result( lc->lc_ld, res, &rc,
+			NULL, NULL, NULL, NULL, 1 ) != LDAP_SUCCESS )
+		{
+			ldap_get_option( lc->lc_ld, LDAP_OPT_RESULT_CODE, &rc );
+		}
+		/* the server answers the operation before the cancel */
+		ldap_back_mux_discard( lc, msgid );
+		return rc;
 	}
 
 	assert( 0 );
@@ -1785,11 +1847,12 @@ ldap_back_op_result(
 
 retry:;
 		/* if result parsing fails, note the failure reason */
-		rc = ldap_result( lc->lc_ld, msgid, LDAP_MSG_ALL, &tv, &res );
+		rc = ldap_back_result( lc, msgid, LDAP_MSG_ALL, &tv, &res );
 		switch ( rc ) {
 		case 0:
 			if ( timeout && slap_get_time() > stoptime ) {
 				if ( sendok & LDAP_BACK_BINDING ) {
+					ldap_back_mux_stop( lc );
 					ldap_unbind_ext( lc->lc_ld, NULL, NULL );
 					lc->lc_ld = NULL;
 
@@ -2010,6 +2073,7 @@ ldap_back_retry( ldapconn_t **lcp, Operation *op, SlapReply *rs, ldap_back_send_
 				"" : (*lcp)->lc_bound_ndn.bv_val );
 		ldap_pvt_thread_mutex_unlock( &li->li_uri_mutex );
 
+		ldap_back_mux_stop( *lcp );
 		ldap_unbind_ext( (*lcp)->lc_ld, NULL, NULL );
 		(*lcp)->lc_ld = NULL;
 		LDAP_BACK_CONN_ISBOUND_CLEAR( (*lcp) );
@@ -2330,7 +2394,7 @@ ldap_back_proxy_authz_bind(
 
 			ldap_msgfree( result );
 
-			if ( ldap_result( lc->lc_ld, msgid, LDAP_MSG_ALL, NULL, &result ) == -1 || !result ) {
+			if ( ldap_back_result( lc, msgid, LDAP_MSG_ALL, NULL, &result ) == -1 || !result ) {
 				ldap_get_option( lc->lc_ld, LDAP_OPT_RESULT_CODE, (void*)&rs->sr_err );
 				ldap_get_option( lc->lc_ld, LDAP_OPT_DIAGNOSTIC_MESSAGE, (void*)&rs->sr_text );
 				break;
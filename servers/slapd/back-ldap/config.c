@@ -59,6 +59,7 @@ enum {
 	LDAP_BACK_CFG_SINGLECONN,
 	LDAP_BACK_CFG_USETEMP,
 	LDAP_BACK_CFG_CONNPOOLMAX,
+	LDAP_BACK_CFG_MULTIPLEX,
 	LDAP_BACK_CFG_CANCEL,
 	LDAP_BACK_CFG_QUARANTINE,
 	LDAP_BACK_CFG_ST_REQUEST,
@@ -246,6 +247,15 @@ static ConfigTable ldapcfg[] = {
 			"SYNTAX OMsInteger "
 			"SINGLE-VALUE )",
 		NULL, NULL },
+	{ "conn-multiplex", "<n>", 2, 2, 0,
+		ARG_MAGIC|ARG_INT|LDAP_BACK_CFG_MULTIPLEX,
+		ldap_back_cf_gen, "( OLcfgDbAt:3.31 "
+			"NAME 'olcDbConnMultiplex' "
+			"DESC 'Operations in progress on a shared connection before another is opened' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger "
+			"SINGLE-VALUE )",
+		NULL, NULL },
 #ifdef SLAP_CONTROL_X_SESSION_TRACKING
 	{ "session-tracking-request", "true|FALSE", 2, 2, 0,
 		ARG_MAGIC|ARG_ON_OFF|LDAP_BACK_CFG_ST_REQUEST,
@@ -348,6 +358,7 @@ static ConfigOCs ldapocs[] = {
 			"$ olcDbQuarantine "
 			"$ olcDbUseTemporaryConn "
 			"$ olcDbConnectionPoolMax "
+			"$ olcDbConnMultiplex "
 #ifdef SLAP_CONTROL_X_SESSION_TRACKING
 			"$ olcDbSessionTrackingRequest "
 #endif /* SLAP_CONTROL_X_SESSION_TRACKING */
@@ -1307,6 +1318,13 @@ ldap_back_cf_gen( ConfigArgs *c )
 			c->value_int = li->li_conn_priv_max;
 			break;
 
+		case LDAP_BACK_CFG_MULTIPLEX:
+			if ( li->li_multiplex == 0 ) {
+				return 1;
+			}
+			c->value_int = li->li_multiplex;
+			break;
+
 		case LDAP_BACK_CFG_CANCEL: {
 			slap_mask_t	mask = LDAP_BACK_F_CANCEL_MASK2;
 
@@ -1500,6 +1518,10 @@ ldap_back_cf_gen( ConfigArgs *c )
 			li->li_conn_priv_max = LDAP_BACK_CONN_PRIV_MIN;
 			break;
 
+		case LDAP_BACK_CFG_MULTIPLEX:
+			li->li_multiplex = 0;
+			break;
+
 		case LDAP_BACK_CFG_QUARANTINE:
 			if ( !LDAP_BACK_QUARANTINE( li ) ) {
 				break;
@@ -1936,6 +1958,18 @@ done_url:;
 		li->li_conn_priv_max = c->value_int;
 		break;
 
+	case LDAP_BACK_CFG_MULTIPLEX:
+		if ( c->value_int < 0 ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"invalid number of operations "
+				"\"%s\" in \"conn-multiplex <n>\"",
+				c->argv[ 1 ] );
+			Debug( LDAP_DEBUG_ANY, "%s: %s.\n", c->log, c->cr_msg );
+			return 1;
+		}
+		li->li_multiplex = c->value_int;
+		break;
+
 	case LDAP_BACK_CFG_CANCEL: {
 		slap_mask_t		mask;
 
@@ -2164,7 +2198,7 @@ retry:
 		if ( rs->sr_err == LDAP_SUCCESS ) {
 			/* by now, make sure no timeout is used (ITS#6282) */
 			struct timeval tv = { -1, 0 };
-			if ( ldap_result( lc->lc_ld, msgid, LDAP_MSG_ALL, &tv, &res ) == -1 ) {
+			if ( ldap_back_result( lc, msgid, LDAP_MSG_ALL, &tv, &res ) == -1 ) {
 				ldap_get_option( lc->lc_ld, LDAP_OPT_ERROR_NUMBER,
 					&rs->sr_err );
 				if ( rs->sr_err == LDAP_SERVER_DOWN && doretry ) {
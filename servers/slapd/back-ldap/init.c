@@ -174,6 +174,7 @@ ldap_back_db_init( Backend *be, ConfigReply *cr )
 	li->li_version = LDAP_VERSION3;
 
 	ldap_pvt_thread_mutex_init( &li->li_conninfo.lai_mutex );
+	ldap_pvt_thread_mutex_init( &li->li_mux_mutex );
 
 	for ( i = LDAP_BACK_PCONN_FIRST; i < LDAP_BACK_PCONN_LAST; i++ ) {
 		li->li_conn_priv[ i ].lic_num = 0;
@@ -273,6 +274,7 @@ ldap_back_conn_free( void *v_lc )
 	ldapconn_t	*lc = v_lc;
 
 	if ( lc->lc_ld != NULL ) {	
+		ldap_back_mux_stop( lc );
 		ldap_unbind_ext( lc->lc_ld, NULL, NULL );
 	}
 	if ( !BER_BVISNULL( &lc->lc_bound_ndn ) ) {
@@ -358,6 +360,8 @@ ldap_back_db_destroy( Backend *be, ConfigReply *cr )
 
 		ldap_pvt_thread_mutex_unlock( &li->li_conninfo.lai_mutex );
 		ldap_pvt_thread_mutex_destroy( &li->li_conninfo.lai_mutex );
+		ldap_back_mux_destroy( li );
+		ldap_pvt_thread_mutex_destroy( &li->li_mux_mutex );
 		ldap_pvt_thread_mutex_destroy( &li->li_uri_mutex );
 
 		for ( i = 0; i < SLAP_OP_LAST; i++ ) {
@@ -0,0 +1,775 @@
+/* mux.c - ldap backend shared connections */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1998-2024 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/*
+ * With "conn-multiplex", operations of many clients are sent over the
+ * same privileged connections, with identity assertion by proxyAuthz
+ * control, and must not each poll the connection for their results:
+ * ldap_result() holds the session locked while it waits, so waiters
+ * would only take turns. Instead, a thread of the database watches the
+ * sockets and hands whatever has arrived, by message id, to the thread
+ * waiting for it in ldap_back_result(). Responses read before their
+ * operation started waiting are kept aside until it claims them, gives
+ * up on them in ldap_back_mux_discard() or the connection is closed.
+ *
+ * Operations may also leave a function to be called, from the thread
+ * pool, with their responses instead of waiting for them; see
+ * ldap_back_mux_async().
+ *
+ * The reader is not run by the thread pool, which may well be taken
+ * up entirely by operations waiting for their responses. The
+ * structures are only freed with the database, and are recycled in
+ * the meantime.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+
+#include <ac/string.h>
+#include <ac/socket.h>
+#include <ac/time.h>
+
+#include "slap.h"
+#include "../../../libraries/libldap/ldap-int.h"
+#include "back-ldap.h"
+#include "lutil.h"
+
+/* seconds between rounds of the reader over all the connections */
+#define	LDAP_BACK_MUX_TICK		(1)
+
+typedef struct ldap_back_waiter_t {
+	ber_int_t		lw_msgid;
+	LDAPMessage		*lw_msgs;	/* linked by lm_next */
+	LDAPMessage		**lw_tail;
+	int			lw_done;	/* final response queued */
+	int			lw_poked;
+	ldap_pvt_thread_cond_t	lw_cond;
+
+	/* asynchronous waiters */
+	struct ldap_back_mux_t	*lw_mux;
+	ldap_back_mux_func	*lw_func;
+	void			*lw_arg;
+	int			lw_running;
+	int			lw_stopped;	/* freed by the runner */
+} ldap_back_waiter_t;
+
+typedef struct ldap_back_mux_t {
+	struct ldap_back_mux_t	*lm_next;
+	ldap_pvt_thread_mutex_t	lm_mutex;
+	ldap_pvt_thread_cond_t	lm_cond;	/* the reader is done */
+	LDAP			*lm_ld;		/* NULL when not in use */
+	ber_socket_t		lm_sd;
+	TAvlnode		*lm_waiters;
+	LDAPMessage		*lm_orphans;
+	LDAPMessage		**lm_otail;
+	int			lm_reading;
+	int			lm_err;
+} ldap_back_mux_t;
+
+static int
+ldap_back_waiter_cmp( const void *l, const void *r )
+{
+	const ldap_back_waiter_t *left = l, *right = r;
+
+	return left->lw_msgid < right->lw_msgid ? -1 :
+		left->lw_msgid > right->lw_msgid;
+}
+
+static int
+ldap_back_msg_final( LDAPMessage *msg )
+{
+	switch ( msg->lm_msgtype ) {
+	case LDAP_RES_SEARCH_ENTRY:
+	case LDAP_RES_SEARCH_REFERENCE:
+	case LDAP_RES_INTERMEDIATE:
+		return 0;
+	}
+	return 1;
+}
+
+static void
+ldap_back_msgs_free( LDAPMessage *msg )
+{
+	LDAPMessage	*next;
+
+	for ( ; msg != NULL; msg = next ) {
+		next = msg->lm_next;
+		msg->lm_next = NULL;
+		ldap_msgfree( msg );
+	}
+}
+
+static void
+ldap_back_waiter_free( void *v_lw )
+{
+	ldap_back_waiter_t	*lw = v_lw;
+
+	ldap_back_msgs_free( lw->lw_msgs );
+	ldap_pvt_thread_cond_destroy( &lw->lw_cond );
+	ch_free( lw );
+}
+
+/* a running waiter is freed by ldap_back_waiter_run() */
+static void
+ldap_back_waiter_release( void *v_lw )
+{
+	ldap_back_waiter_t	*lw = v_lw;
+
+	if ( lw->lw_running ) {
+		lw->lw_stopped = 1;
+		return;
+	}
+	ldap_back_waiter_free( lw );
+}
+
+/* find the waiter for msgid, or start waiting and claim what already
+ * arrived for it; lm_mutex held */
+static ldap_back_waiter_t *
+ldap_back_waiter_get( ldap_back_mux_t *lm, ber_int_t msgid )
+{
+	ldap_back_waiter_t	*lw, needle;
+	LDAPMessage		**mp, *msg;
+
+	needle.lw_msgid = msgid;
+	lw = ldap_tavl_find( lm->lm_waiters, &needle, ldap_back_waiter_cmp );
+	if ( lw != NULL ) {
+		return lw;
+	}
+
+	lw = ch_calloc( 1, sizeof( ldap_back_waiter_t ) );
+	lw->lw_msgid = msgid;
+	lw->lw_tail = &lw->lw_msgs;
+	ldap_pvt_thread_cond_init( &lw->lw_cond );
+
+	for ( mp = &lm->lm_orphans; *mp != NULL; ) {
+		msg = *mp;
+		if ( msg->lm_msgid != msgid ) {
+			mp = &msg->lm_next;
+			continue;
+		}
+		*mp = msg->lm_next;
+		msg->lm_next = NULL;
+		*lw->lw_tail = msg;
+		lw->lw_tail = &msg->lm_next;
+		if ( ldap_back_msg_final( msg ) ) {
+			lw->lw_done = 1;
+		}
+	}
+	lm->lm_otail = mp;
+
+	ldap_tavl_insert( &lm->lm_waiters, lw, ldap_back_waiter_cmp,
+		ldap_avl_dup_error );
+	return lw;
+}
+
+static void
+ldap_back_waiter_drop( ldap_back_mux_t *lm, ldap_back_waiter_t *lw )
+{
+	ldap_tavl_delete( &lm->lm_waiters, lw, ldap_back_waiter_cmp );
+	ldap_back_waiter_free( lw );
+}
+
+static void *ldap_back_waiter_run( void *ctx, void *arg );
+
+/* let the waiter know there is something for it; lm_mutex held */
+static void
+ldap_back_waiter_kick( ldap_back_mux_t *lm, ldap_back_waiter_t *lw )
+{
+	if ( lw->lw_func == NULL ) {
+		ldap_pvt_thread_cond_signal( &lw->lw_cond );
+		return;
+	}
+
+	/* if the pool refuses the task, the next tick tries again */
+	if ( !lw->lw_running && ldap_pvt_thread_pool_submit( &connection_pool,
+		ldap_back_waiter_run, lw ) == 0 )
+	{
+		lw->lw_running = 1;
+	}
+}
+
+/*
+ * Pass what was received to an asynchronous waiter, one call at a time:
+ * each response, then a failure of the connection or a tick, with
+ * a NULL message. The waiter is dropped once the function returns
+ * non-zero, which it must after a failure.
+ */
+static void *
+ldap_back_waiter_run( void *ctx, void *arg )
+{
+	ldap_back_waiter_t	*lw = arg;
+	ldap_back_mux_t		*lm = lw->lw_mux;
+	LDAPMessage		*msg;
+	int			err, done = 0;
+
+	ldap_pvt_thread_mutex_lock( &lm->lm_mutex );
+	while ( !done && !lw->lw_stopped ) {
+		err = LDAP_SUCCESS;
+		msg = lw->lw_msgs;
+		if ( msg != NULL ) {
+			lw->lw_msgs = msg->lm_next;
+			if ( lw->lw_msgs == NULL ) {
+				lw->lw_tail = &lw->lw_msgs;
+			}
+			msg->lm_next = NULL;
+
+		} else if ( lm->lm_err != LDAP_SUCCESS ) {
+			err = lm->lm_err;
+
+		} else if ( lw->lw_poked ) {
+			lw->lw_poked = 0;
+
+		} else {
+			break;
+		}
+		ldap_pvt_thread_mutex_unlock( &lm->lm_mutex );
+
+		done = lw->lw_func( ctx, msg, err, lw->lw_arg )
+			|| err != LDAP_SUCCESS;
+
+		ldap_pvt_thread_mutex_lock( &lm->lm_mutex );
+	}
+	/* the connection may have gone with the last response */
+	if ( lw->lw_stopped ) {
+		ldap_back_waiter_free( lw );
+
+	} else {
+		lw->lw_running = 0;
+		if ( done ) {
+			ldap_back_waiter_drop( lm, lw );
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &lm->lm_mutex );
+
+	return NULL;
+}
+
+/* lm_mutex held */
+static void
+ldap_back_mux_dispatch( ldap_back_mux_t *lm, LDAPMessage *msg )
+{
+	ldap_back_waiter_t	*lw, needle;
+
+	if ( msg->lm_msgid == LDAP_RES_UNSOLICITED ) {
+		/* a notice of disconnection, the next read fails */
+		ldap_msgfree( msg );
+		return;
+	}
+
+	needle.lw_msgid = msg->lm_msgid;
+	lw = ldap_tavl_find( lm->lm_waiters, &needle, ldap_back_waiter_cmp );
+	if ( lw == NULL ) {
+		*lm->lm_otail = msg;
+		lm->lm_otail = &msg->lm_next;
+		return;
+	}
+
+	*lw->lw_tail = msg;
+	lw->lw_tail = &msg->lm_next;
+	if ( ldap_back_msg_final( msg ) ) {
+		lw->lw_done = 1;
+	}
+	ldap_back_waiter_kick( lm, lw );
+}
+
+/* wake all waiters, to notice a failure or check their time limits;
+ * lm_mutex held */
+static void
+ldap_back_mux_poke( ldap_back_mux_t *lm )
+{
+	TAvlnode	*edge;
+
+	for ( edge = ldap_tavl_end( lm->lm_waiters, TAVL_DIR_LEFT );
+		edge != NULL;
+		edge = ldap_tavl_next( edge, TAVL_DIR_RIGHT ) )
+	{
+		ldap_back_waiter_t	*lw = edge->avl_data;
+
+		lw->lw_poked = 1;
+		ldap_back_waiter_kick( lm, lw );
+	}
+}
+
+/*
+ * Read all responses that arrived on the connection without waiting.
+ */
+static void
+ldap_back_mux_read( ldap_back_mux_t *lm )
+{
+	struct timeval	tv;
+	LDAPMessage	*msg;
+	int		rc;
+
+	ldap_pvt_thread_mutex_lock( &lm->lm_mutex );
+	if ( lm->lm_ld == NULL || lm->lm_err != LDAP_SUCCESS ) {
+		ldap_pvt_thread_mutex_unlock( &lm->lm_mutex );
+		return;
+	}
+	lm->lm_reading = 1;
+	ldap_pvt_thread_mutex_unlock( &lm->lm_mutex );
+
+	for ( ;; ) {
+		tv.tv_sec = 0;
+		tv.tv_usec = 0;
+		rc = ldap_result( lm->lm_ld, LDAP_RES_ANY, LDAP_MSG_ONE, &tv, &msg );
+		if ( rc <= 0 ) {
+			break;
+		}
+		ldap_pvt_thread_mutex_lock( &lm->lm_mutex );
+		ldap_back_mux_dispatch( lm, msg );
+		ldap_pvt_thread_mutex_unlock( &lm->lm_mutex );
+	}
+
+	ldap_pvt_thread_mutex_lock( &lm->lm_mutex );
+	if ( rc < 0 ) {
+		ldap_get_option( lm->lm_ld, LDAP_OPT_RESULT_CODE, &lm->lm_err );
+		if ( lm->lm_err == LDAP_SUCCESS ) {
+			lm->lm_err = LDAP_SERVER_DOWN;
+		}
+		Debug( LDAP_DEBUG_TRACE,
+			"ldap_back_mux_read: ld=%p failed err=%d\n",
+			(void *)lm->lm_ld, lm->lm_err );
+		ldap_back_mux_poke( lm );
+	}
+	lm->lm_reading = 0;
+	ldap_pvt_thread_cond_broadcast( &lm->lm_cond );
+	ldap_pvt_thread_mutex_unlock( &lm->lm_mutex );
+}
+
+/*
+ * Once in a while, also read what the sockets did not show, such as
+ * the responses on connections opened to chase referrals, and let the
+ * waiters check their time limits.
+ */
+static void
+ldap_back_mux_tick( ldap_back_mux_t *lm )
+{
+	ldap_back_mux_read( lm );
+
+	ldap_pvt_thread_mutex_lock( &lm->lm_mutex );
+	ldap_back_mux_poke( lm );
+	ldap_pvt_thread_mutex_unlock( &lm->lm_mutex );
+}
+
+static void
+ldap_back_mux_wake( ldapinfo_t *li )
+{
+	char	c = 0;
+
+	(void)tcp_write( li->li_mux_wake[ 1 ], &c, 1 );
+}
+
+static void *
+ldap_back_mux_thread( void *arg )
+{
+	ldapinfo_t	*li = arg;
+	ldap_back_mux_t	*lm, **lms = NULL;
+#ifdef HAVE_POLL
+	struct pollfd	*fds = NULL;
+#else /* ! HAVE_POLL */
+	fd_set		rfds;
+	ber_socket_t	maxfd;
+	struct timeval	tv;
+#endif /* ! HAVE_POLL */
+	int		i, n, nalloc = 0, rc;
+	time_t		now, last = slap_get_time();
+	char		buf[ 32 ];
+
+	for ( ;; ) {
+		ldap_pvt_thread_mutex_lock( &li->li_mux_mutex );
+		if ( li->li_mux_state == LDAP_BACK_MUX_SHUTDOWN ) {
+			ldap_pvt_thread_mutex_unlock( &li->li_mux_mutex );
+			break;
+		}
+		n = 0;
+		for ( lm = li->li_mux; lm != NULL; lm = lm->lm_next ) {
+			int	watch;
+
+			/* once failed, wait for the connection to be closed */
+			ldap_pvt_thread_mutex_lock( &lm->lm_mutex );
+			watch = lm->lm_ld != NULL && lm->lm_err == LDAP_SUCCESS;
+			ldap_pvt_thread_mutex_unlock( &lm->lm_mutex );
+			if ( watch ) {
+				if ( n == nalloc ) {
+					nalloc = nalloc ? 2 * nalloc : 8;
+					lms = ch_realloc( lms, nalloc * sizeof( ldap_back_mux_t * ) );
+#ifdef HAVE_POLL
+					fds = ch_realloc( fds, ( nalloc + 1 ) * sizeof( struct pollfd ) );
+#endif /* HAVE_POLL */
+				}
+				lms[ n++ ] = lm;
+			}
+		}
+		ldap_pvt_thread_mutex_unlock( &li->li_mux_mutex );
+
+		/* the descriptor of a mux is only touched here, and a mux
+		 * stopped meanwhile is ignored by ldap_back_mux_read() */
+#ifdef HAVE_POLL
+		if ( fds == NULL ) {
+			fds = ch_malloc( sizeof( struct pollfd ) );
+		}
+		fds[ 0 ].fd = li->li_mux_wake[ 0 ];
+		fds[ 0 ].events = POLL_READ;
+		for ( i = 0; i < n; i++ ) {
+			fds[ i + 1 ].fd = lms[ i ]->lm_sd;
+			fds[ i + 1 ].events = POLL_READ;
+		}
+		rc = poll( fds, n + 1, LDAP_BACK_MUX_TICK * 1000 );
+		if ( rc > 0 && fds[ 0 ].revents ) {
+			(void)tcp_read( li->li_mux_wake[ 0 ], buf, sizeof( buf ) );
+		}
+		for ( i = 0; rc > 0 && i < n; i++ ) {
+			if ( fds[ i + 1 ].revents ) {
+				ldap_back_mux_read( lms[ i ] );
+			}
+		}
+#else /* ! HAVE_POLL */
+		FD_ZERO( &rfds );
+		FD_SET( li->li_mux_wake[ 0 ], &rfds );
+		maxfd = li->li_mux_wake[ 0 ];
+		for ( i = 0; i < n; i++ ) {
+			FD_SET( lms[ i ]->lm_sd, &rfds );
+			if ( lms[ i ]->lm_sd > maxfd ) {
+				maxfd = lms[ i ]->lm_sd;
+			}
+		}
+		tv.tv_sec = LDAP_BACK_MUX_TICK;
+		tv.tv_usec = 0;
+		rc = select( maxfd + 1, &rfds, NULL, NULL, &tv );
+		if ( rc > 0 && FD_ISSET( li->li_mux_wake[ 0 ], &rfds ) ) {
+			(void)tcp_read( li->li_mux_wake[ 0 ], buf, sizeof( buf ) );
+		}
+		for ( i = 0; rc > 0 && i < n; i++ ) {
+			if ( FD_ISSET( lms[ i ]->lm_sd, &rfds ) ) {
+				ldap_back_mux_read( lms[ i ] );
+			}
+		}
+#endif /* ! HAVE_POLL */
+
+		now = slap_get_time();
+		if ( now >= last + LDAP_BACK_MUX_TICK ) {
+			last = now;
+			for ( i = 0; i < n; i++ ) {
+				ldap_back_mux_tick( lms[ i ] );
+			}
+		}
+	}
+
+	ch_free( lms );
+#ifdef HAVE_POLL
+	ch_free( fds );
+#endif /* HAVE_POLL */
+
+	return NULL;
+}
+
+/*
+ * Have the demultiplexer read the responses on a connection of the
+ * shared pools once it is bound. Connections of explicit binds are not
+ * shared.
+ */
+int
+ldap_back_mux_start( ldapinfo_t *li, ldapconn_t *lc )
+{
+	ldap_back_mux_t	*lm;
+	ber_socket_t	s = AC_SOCKET_INVALID;
+
+	if ( li->li_multiplex == 0 || lc->lc_mux != NULL
+		|| !LDAP_BACK_PCONN_ISPRIV( lc ) || LDAP_BACK_PCONN_ISBIND( lc )
+		|| !LDAP_BACK_CONN_CACHED( lc ) )
+	{
+		return 0;
+	}
+
+	ldap_get_option( lc->lc_ld, LDAP_OPT_DESC, &s );
+	if ( s == AC_SOCKET_INVALID ) {
+		return -1;
+	}
+
+	ldap_pvt_thread_mutex_lock( &li->li_mux_mutex );
+	if ( li->li_mux_state == LDAP_BACK_MUX_IDLE ) {
+		if ( lutil_pair( li->li_mux_wake ) < 0 ) {
+			ldap_pvt_thread_mutex_unlock( &li->li_mux_mutex );
+			Debug( LDAP_DEBUG_ANY,
+				"ldap_back_mux_start: lutil_pair() failed\n" );
+			return -1;
+		}
+		if ( ldap_pvt_thread_create( &li->li_mux_thread, 0,
+			ldap_back_mux_thread, li ) != 0 )
+		{
+			tcp_close( li->li_mux_wake[ 0 ] );
+			tcp_close( li->li_mux_wake[ 1 ] );
+			ldap_pvt_thread_mutex_unlock( &li->li_mux_mutex );
+			Debug( LDAP_DEBUG_ANY,
+				"ldap_back_mux_start: unable to start the "
+				"demultiplexer thread\n" );
+			return -1;
+		}
+		li->li_mux_state = LDAP_BACK_MUX_RUNNING;
+	}
+
+	for ( lm = li->li_mux; lm != NULL; lm = lm->lm_next ) {
+		if ( lm->lm_ld == NULL ) {
+			break;
+		}
+	}
+	if ( lm == NULL ) {
+		lm = ch_calloc( 1, sizeof( ldap_back_mux_t ) );
+		ldap_pvt_thread_mutex_init( &lm->lm_mutex );
+		ldap_pvt_thread_cond_init( &lm->lm_cond );
+		lm->lm_otail = &lm->lm_orphans;
+		lm->lm_next = li->li_mux;
+		li->li_mux = lm;
+	}
+
+	ldap_pvt_thread_mutex_lock( &lm->lm_mutex );
+	lm->lm_ld = lc->lc_ld;
+	lm->lm_sd = s;
+	lm->lm_err = LDAP_SUCCESS;
+	ldap_pvt_thread_mutex_unlock( &lm->lm_mutex );
+	lc->lc_mux = lm;
+
+	ldap_back_mux_wake( li );
+	ldap_pvt_thread_mutex_unlock( &li->li_mux_mutex );
+
+	Debug( LDAP_DEBUG_TRACE,
+		"ldap_back_mux_start: conn %p ld=%p fd=%ld shared\n",
+		(void *)lc, (void *)lc->lc_ld, (long)s );
+
+	return 0;
+}
+
+/*
+ * Stop watching the connection, before it is closed. Nobody else
+ * may be using it.
+ */
+void
+ldap_back_mux_stop( ldapconn_t *lc )
+{
+	ldap_back_mux_t	*lm = lc->lc_mux;
+
+	if ( lm == NULL ) {
+		return;
+	}
+
+	ldap_pvt_thread_mutex_lock( &lm->lm_mutex );
+	while ( lm->lm_reading ) {
+		ldap_pvt_thread_cond_wait( &lm->lm_cond, &lm->lm_mutex );
+	}
+	ldap_tavl_free( lm->lm_waiters, ldap_back_waiter_release );
+	lm->lm_waiters = NULL;
+	ldap_back_msgs_free( lm->lm_orphans );
+	lm->lm_orphans = NULL;
+	lm->lm_otail = &lm->lm_orphans;
+	lm->lm_err = LDAP_SUCCESS;
+	lm->lm_ld = NULL;
+	ldap_pvt_thread_mutex_unlock( &lm->lm_mutex );
+
+	lc->lc_mux = NULL;
+}
+
+/*
+ * Like ldap_result(), for a single message id. On a shared connection
+ * the responses are passed by the reader; a timeout other than zero
+ * is only checked when the tick comes by, which is precise enough for
+ * the callers to check their limits.
+ */
+int
+ldap_back_result(
+	ldapconn_t	*lc,
+	ber_int_t	msgid,
+	int		all,
+	struct timeval	*tv,
+	LDAPMessage	**res )
+{
+	ldap_back_mux_t		*lm = lc->lc_mux;
+	ldap_back_waiter_t	*lw;
+	LDAPMessage		*msg;
+	time_t			stoptime = (time_t)(-1);
+	int			rc, err = LDAP_SUCCESS;
+
+	if ( lm == NULL ) {
+		return ldap_result( lc->lc_ld, msgid, all, tv, res );
+	}
+
+	assert( msgid > 0 );
+
+	if ( tv != NULL && tv->tv_sec >= 0 ) {
+		stoptime = slap_get_time() + tv->tv_sec;
+	}
+
+	*res = NULL;
+	ldap_pvt_thread_mutex_lock( &lm->lm_mutex );
+	lw = ldap_back_waiter_get( lm, msgid );
+	for ( ;; ) {
+		if ( lw->lw_msgs != NULL && ( all == LDAP_MSG_ONE || lw->lw_done ) ) {
+			msg = lw->lw_msgs;
+			if ( all == LDAP_MSG_ONE ) {
+				lw->lw_msgs = msg->lm_next;
+				msg->lm_next = NULL;
+				msg->lm_chain_tail = msg;
+
+			} else {
+				/* chain them as ldap_result() does */
+				LDAPMessage	*m;
+
+				for ( m = msg; m->lm_next != NULL; m = m->lm_next ) {
+					m->lm_chain = m->lm_next;
+					m->lm_next = NULL;
+				}
+				msg->lm_chain_tail = m;
+				lw->lw_msgs = NULL;
+			}
+			if ( lw->lw_msgs == NULL ) {
+				lw->lw_tail = &lw->lw_msgs;
+			}
+
+			*res = msg;
+			rc = msg->lm_msgtype;
+			if ( lw->lw_msgs == NULL && lw->lw_done ) {
+				ldap_back_waiter_drop( lm, lw );
+			}
+			break;
+		}
+
+		if ( lm->lm_err != LDAP_SUCCESS ) {
+			err = lm->lm_err;
+			ldap_back_waiter_drop( lm, lw );
+			rc = -1;
+			break;
+		}
+
+		if ( stoptime != (time_t)(-1) &&
+			( ( tv->tv_sec == 0 && tv->tv_usec == 0 ) ||
+				( lw->lw_poked && slap_get_time() >= stoptime ) ) )
+		{
+			lw->lw_poked = 0;
+			rc = 0;
+			break;
+		}
+		lw->lw_poked = 0;
+
+		ldap_pvt_thread_cond_wait( &lw->lw_cond, &lm->lm_mutex );
+	}
+	ldap_pvt_thread_mutex_unlock( &lm->lm_mutex );
+
+	if ( err != LDAP_SUCCESS ) {
+		ldap_set_option( lc->lc_ld, LDAP_OPT_RESULT_CODE, &err );
+	}
+
+	return rc;
+}
+
+/*
+ * Have func called from the thread pool with each response to msgid,
+ * instead of waiting for them in ldap_back_result(). Returns -1 if
+ * the connection is not shared.
+ */
+int
+ldap_back_mux_async(
+	ldapconn_t		*lc,
+	ber_int_t		msgid,
+	ldap_back_mux_func	*func,
+	void			*arg )
+{
+	ldap_back_mux_t		*lm = lc->lc_mux;
+	ldap_back_waiter_t	*lw;
+
+	if ( lm == NULL ) {
+		return -1;
+	}
+
+	ldap_pvt_thread_mutex_lock( &lm->lm_mutex );
+	lw = ldap_back_waiter_get( lm, msgid );
+	lw->lw_mux = lm;
+	lw->lw_func = func;
+	lw->lw_arg = arg;
+	if ( lw->lw_msgs != NULL || lm->lm_err != LDAP_SUCCESS ) {
+		ldap_back_waiter_kick( lm, lw );
+	}
+	ldap_pvt_thread_mutex_unlock( &lm->lm_mutex );
+
+	return 0;
+}
+
+/*
+ * Forget what was received for msgid, once nothing more can come for
+ * it: after it was abandoned, or its final response arrived. Unclaimed
+ * responses are only freed here and when the connection is closed.
+ * Asynchronous waiters go away when their function is done.
+ */
+void
+ldap_back_mux_discard( ldapconn_t *lc, ber_int_t msgid )
+{
+	ldap_back_mux_t		*lm = lc->lc_mux;
+	ldap_back_waiter_t	*lw, needle;
+	LDAPMessage		**mp, *msg;
+
+	if ( lm == NULL ) {
+		return;
+	}
+
+	needle.lw_msgid = msgid;
+	ldap_pvt_thread_mutex_lock( &lm->lm_mutex );
+	/* a response taken by the reader may not be dispatched yet */
+	while ( lm->lm_reading ) {
+		ldap_pvt_thread_cond_wait( &lm->lm_cond, &lm->lm_mutex );
+	}
+	lw = ldap_tavl_find( lm->lm_waiters, &needle, ldap_back_waiter_cmp );
+	if ( lw != NULL && lw->lw_func == NULL ) {
+		ldap_back_waiter_drop( lm, lw );
+	}
+
+	for ( mp = &lm->lm_orphans; *mp != NULL; ) {
+		msg = *mp;
+		if ( msg->lm_msgid != msgid ) {
+			mp = &msg->lm_next;
+			continue;
+		}
+		*mp = msg->lm_next;
+		msg->lm_next = NULL;
+		ldap_msgfree( msg );
+	}
+	lm->lm_otail = mp;
+	ldap_pvt_thread_mutex_unlock( &lm->lm_mutex );
+}
+
+void
+ldap_back_mux_destroy( ldapinfo_t *li )
+{
+	ldap_back_mux_t	*lm;
+
+	if ( li->li_mux_state == LDAP_BACK_MUX_RUNNING ) {
+		ldap_pvt_thread_mutex_lock( &li->li_mux_mutex );
+		li->li_mux_state = LDAP_BACK_MUX_SHUTDOWN;
+		ldap_back_mux_wake( li );
+		ldap_pvt_thread_mutex_unlock( &li->li_mux_mutex );
+
+		ldap_pvt_thread_join( li->li_mux_thread, (void *)NULL );
+		tcp_close( li->li_mux_wake[ 0 ] );
+		tcp_close( li->li_mux_wake[ 1 ] );
+		li->li_mux_state = LDAP_BACK_MUX_IDLE;
+	}
+
+	while ( ( lm = li->li_mux ) != NULL ) {
+		li->li_mux = lm->lm_next;
+		assert( lm->lm_ld == NULL );
+		ldap_pvt_thread_cond_destroy( &lm->lm_cond );
+		ldap_pvt_thread_mutex_destroy( &lm->lm_mutex );
+		ch_free( lm );
+	}
+}
@@ -54,6 +54,15 @@ int ldap_back_op_result( ldapconn_t *lc, Operation *op, SlapReply *rs,
 	ber_int_t msgid, time_t timeout, ldap_back_send_t sendok );
 int ldap_back_cancel( ldapconn_t *lc, Operation *op, SlapReply *rs, ber_int_t msgid, ldap_back_send_t sendok );
 
+int ldap_back_result( ldapconn_t *lc, ber_int_t msgid, int all,
+	struct timeval *tv, LDAPMessage **res );
+int ldap_back_mux_start( ldapinfo_t *li, ldapconn_t *lc );
+void ldap_back_mux_stop( ldapconn_t *lc );
+void ldap_back_mux_discard( ldapconn_t *lc, ber_int_t msgid );
+int ldap_back_mux_async( ldapconn_t *lc, ber_int_t msgid,
+	ldap_back_mux_func *func, void *arg );
+void ldap_back_mux_destroy( ldapinfo_t *li );
+
 int ldap_back_init_cf( BackendInfo *bi );
 int ldap_pbind_init_cf( BackendInfo *bi );
 
@@ -140,6 +140,470 @@ ldap_back_munge_filter(
 	return gotit;
 }
 
+/* what a search keeps between its responses */
+typedef struct ldap_back_search_t {
+	ldapconn_t	*ls_lc;
+	int		ls_msgid;
+	time_t		ls_stoptime;
+	struct berval	ls_match;
+	struct berval	ls_filter;
+	char		**ls_attrs;
+	LDAPControl	**ls_ctrls;
+	LDAPControl	**ls_res_ctrls;
+	char		**ls_references;
+	int		ls_freetext;
+} ldap_back_search_t;
+
+/* a search that no longer holds the thread that started it */
+typedef struct ldap_back_asearch_t {
+	Operation		las_op;		/* o_bd is the database */
+	Operation		*las_orig;
+	SlapReply		las_rs;
+	ldap_back_search_t	las_ls;
+	time_t			las_last;	/* last response */
+	int			las_started;
+} ldap_back_asearch_t;
+
+/*
+ * Handle a response to the search; returns 1 when the search is over,
+ * either because the result arrived or because of an error.
+ */
+static int
+ldap_back_search_msg(
+		Operation		*op,
+		SlapReply		*rs,
+		ldap_back_search_t	*ls,
+		LDAPMessage		*res )
+{
+	ldapinfo_t	*li = (ldapinfo_t *) op->o_bd->be_private;
+	ldapconn_t	*lc = ls->ls_lc;
+	LDAPMessage	*e;
+	int		rc = ldap_msgtype( res );
+
+	/* only touch when activity actually took place... */
+	if ( li->li_idle_timeout ) {
+		lc->lc_time = op->o_time;
+	}
+
+	if ( rc == LDAP_RES_SEARCH_ENTRY ) {
+		Entry		ent = { 0 };
+		struct berval	bdn = BER_BVNULL;
+
+		e = ldap_first_entry( lc->lc_ld, res );
+		rc = ldap_build_entry( op, e, &ent, &bdn,
+					LDAP_BACK_OMIT_UNKNOWN_SCHEMA( li ) );
+		if ( rc == LDAP_SUCCESS ) {
+			ldap_get_entry_controls( lc->lc_ld, res, &rs->sr_ctrls );
+			ls->ls_res_ctrls = rs->sr_ctrls;
+
+			rs->sr_entry = &ent;
+			rs->sr_attrs = op->ors_attrs;
+			rs->sr_operational_attrs = NULL;
+			rs->sr_flags = 0;
+			rs->sr_err = LDAP_SUCCESS;
+			rc = rs->sr_err = send_search_entry( op, rs );
+			if ( ls->ls_res_ctrls ) {
+				ldap_controls_free( ls->ls_res_ctrls );
+				ls->ls_res_ctrls = NULL;
+				rs->sr_ctrls = NULL;
+			}
+			rs->sr_entry = NULL;
+			rs->sr_flags = 0;
+			if ( !BER_BVISNULL( &ent.e_name ) ) {
+				assert( ent.e_name.bv_val != bdn.bv_val );
+				op->o_tmpfree( ent.e_name.bv_val, op->o_tmpmemctx );
+				BER_BVZERO( &ent.e_name );
+			}
+			if ( !BER_BVISNULL( &ent.e_nname ) ) {
+				op->o_tmpfree( ent.e_nname.bv_val, op->o_tmpmemctx );
+				BER_BVZERO( &ent.e_nname );
+			}
+			entry_clean( &ent );
+		}
+		ldap_msgfree( res );
+		switch ( rc ) {
+		case LDAP_SUCCESS:
+		case LDAP_INSUFFICIENT_ACCESS:
+			return 0;
+
+		default:
+			if ( rc == LDAP_UNAVAILABLE ) {
+				rs->sr_err = LDAP_OTHER;
+			} else {
+				(void)ldap_back_cancel( lc, op, rs, ls->ls_msgid, LDAP_BACK_DONTSEND );
+			}
+			return 1;
+		}
+
+	} else if ( rc == LDAP_RES_SEARCH_REFERENCE ) {
+		char		**references = NULL;
+
+		if ( LDAP_BACK_NOREFS( li ) ) {
+			ldap_msgfree( res );
+			return 0;
+		}
+
+		rc = ldap_parse_reference( lc->lc_ld, res,
+				&references, &rs->sr_ctrls, 1 );
+
+		if ( rc != LDAP_SUCCESS ) {
+			return 0;
+		}
+		ls->ls_res_ctrls = rs->sr_ctrls;
+
+		/* FIXME: there MUST be at least one */
+		if ( references && references[ 0 ] && references[ 0 ][ 0 ] ) {
+			int		cnt;
+
+			for ( cnt = 0; references[ cnt ]; cnt++ )
+				/* NO OP */ ;
+
+			/* FIXME: there MUST be at least one */
+			rs->sr_ref = op->o_tmpalloc( ( cnt + 1 ) * sizeof( struct berval ),
+				op->o_tmpmemctx );
+
+			for ( cnt = 0; references[ cnt ]; cnt++ ) {
+				ber_str2bv( references[ cnt ], 0, 0, &rs->sr_ref[ cnt ] );
+			}
+			BER_BVZERO( &rs->sr_ref[ cnt ] );
+
+			/* ignore return value by now */
+			RS_ASSERT( !(rs->sr_flags & REP_ENTRY_MASK) );
+			rs->sr_entry = NULL;
+			( void )send_search_reference( op, rs );
+
+		} else {
+			Debug( LDAP_DEBUG_ANY,
+				"%s ldap_back_search: "
+				"got SEARCH_REFERENCE "
+				"with no referrals\n",
+				op->o_log_prefix );
+		}
+
+		/* cleanup */
+		if ( references ) {
+			ber_memvfree( (void **)references );
+			op->o_tmpfree( rs->sr_ref, op->o_tmpmemctx );
+			rs->sr_ref = NULL;
+		}
+
+		if ( ls->ls_res_ctrls ) {
+			ldap_controls_free( ls->ls_res_ctrls );
+			ls->ls_res_ctrls = NULL;
+			rs->sr_ctrls = NULL;
+		}
+
+	} else if ( rc == LDAP_RES_INTERMEDIATE ) {
+		/* FIXME: response controls
+		 * are passed without checks */
+		rc = ldap_parse_intermediate( lc->lc_ld,
+			res,
+			(char **)&rs->sr_rspoid,
+			&rs->sr_rspdata,
+			&rs->sr_ctrls,
+			1 );
+		if ( rc != LDAP_SUCCESS ) {
+			return 0;
+		}
+		ls->ls_res_ctrls = rs->sr_ctrls;
+
+		slap_send_ldap_intermediate( op, rs );
+
+		if ( rs->sr_rspoid != NULL ) {
+			ber_memfree( (char *)rs->sr_rspoid );
+			rs->sr_rspoid = NULL;
+		}
+
+		if ( rs->sr_rspdata != NULL ) {
+			ber_bvfree( rs->sr_rspdata );
+			rs->sr_rspdata = NULL;
+		}
+
+		if ( ls->ls_res_ctrls ) {
+			ldap_controls_free( ls->ls_res_ctrls );
+			ls->ls_res_ctrls = NULL;
+			rs->sr_ctrls = NULL;
+		}
+
+	} else {
+		char		*err = NULL;
+
+		rc = ldap_parse_result( lc->lc_ld, res, &rs->sr_err,
+				&ls->ls_match.bv_val, &err,
+				&ls->ls_references, &rs->sr_ctrls, 1 );
+		if ( rc == LDAP_SUCCESS ) {
+			if ( err ) {
+				rs->sr_text = err;
+				ls->ls_freetext = 1;
+			}
+		} else {
+			rs->sr_err = rc;
+		}
+		rs->sr_err = slap_map_api2result( rs );
+		ls->ls_res_ctrls = rs->sr_ctrls;
+
+		/* RFC 4511: referrals can only appear
+		 * if result code is LDAP_REFERRAL */
+		if ( ls->ls_references
+			&& ls->ls_references[ 0 ]
+			&& ls->ls_references[ 0 ][ 0 ] )
+		{
+			if ( rs->sr_err != LDAP_REFERRAL ) {
+				Debug( LDAP_DEBUG_ANY,
+					"%s ldap_back_search: "
+					"got referrals with err=%d\n",
+					op->o_log_prefix,
+					rs->sr_err );
+
+			} else {
+				int	cnt;
+
+				for ( cnt = 0; ls->ls_references[ cnt ]; cnt++ )
+					/* NO OP */ ;
+			
+				rs->sr_ref = op->o_tmpalloc( ( cnt + 1 ) * sizeof( struct berval ),
+					op->o_tmpmemctx );
+
+				for ( cnt = 0; ls->ls_references[ cnt ]; cnt++ ) {
+					/* duplicating ...*/
+					ber_str2bv( ls->ls_references[ cnt ], 0, 0, &rs->sr_ref[ cnt ] );
+				}
+				BER_BVZERO( &rs->sr_ref[ cnt ] );
+			}
+
+		} else if ( rs->sr_err == LDAP_REFERRAL ) {
+			Debug( LDAP_DEBUG_ANY,
+				"%s ldap_back_search: "
+				"got err=%d with null "
+				"or empty referrals\n",
+				op->o_log_prefix,
+				rs->sr_err );
+
+			rs->sr_err = LDAP_NO_SUCH_OBJECT;
+		}
+
+		if ( ls->ls_match.bv_val != NULL ) {
+			ls->ls_match.bv_len = strlen( ls->ls_match.bv_val );
+		}
+
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Send the result of the search and release what it used.
+ */
+static int
+ldap_back_search_finish(
+		Operation		*op,
+		SlapReply		*rs,
+		ldap_back_search_t	*ls )
+{
+	ldapinfo_t	*li = (ldapinfo_t *) op->o_bd->be_private;
+
+	/*
+	 * Rewrite the matched portion of the search base, if required
+	 */
+	if ( !BER_BVISNULL( &ls->ls_match ) && !BER_BVISEMPTY( &ls->ls_match ) ) {
+		struct berval	pmatch;
+
+		if ( dnPretty( NULL, &ls->ls_match, &pmatch, op->o_tmpmemctx ) != LDAP_SUCCESS ) {
+			pmatch.bv_val = ls->ls_match.bv_val;
+			ls->ls_match.bv_val = NULL;
+		}
+		rs->sr_matched = pmatch.bv_val;
+		rs->sr_flags |= REP_MATCHED_MUSTBEFREED;
+	}
+
+	if ( !BER_BVISNULL( &ls->ls_match ) ) {
+		ber_memfree( ls->ls_match.bv_val );
+	}
+
+	if ( rs->sr_v2ref ) {
+		rs->sr_err = LDAP_REFERRAL;
+	}
+
+	if ( LDAP_BACK_QUARANTINE( li ) ) {
+		ldap_back_quarantine( op, rs );
+	}
+
+	if ( ls->ls_filter.bv_val != op->ors_filterstr.bv_val ) {
+		op->o_tmpfree( ls->ls_filter.bv_val, op->o_tmpmemctx );
+	}
+
+#if 0
+	/* let send_ldap_result play cleanup handlers (ITS#4645) */
+	if ( rc != SLAPD_ABANDON )
+#endif
+	{
+		send_ldap_result( op, rs );
+	}
+
+	(void)ldap_back_controls_free( op, rs, &ls->ls_ctrls );
+
+	if ( ls->ls_res_ctrls ) {
+		ldap_controls_free( ls->ls_res_ctrls );
+		rs->sr_ctrls = NULL;
+		ls->ls_res_ctrls = NULL;
+	}
+
+	if ( rs->sr_text ) {
+		if ( ls->ls_freetext ) {
+			ber_memfree( (char *)rs->sr_text );
+		}
+		rs->sr_text = NULL;
+	}
+
+	if ( rs->sr_ref ) {
+		op->o_tmpfree( rs->sr_ref, op->o_tmpmemctx );
+		rs->sr_ref = NULL;
+	}
+
+	if ( ls->ls_references ) {
+		ber_memvfree( (void **)ls->ls_references );
+	}
+
+	if ( ls->ls_attrs ) {
+		op->o_tmpfree( ls->ls_attrs, op->o_tmpmemctx );
+	}
+
+	if ( ls->ls_lc != NULL ) {
+		ldap_back_release_conn( li, ls->ls_lc );
+	}
+
+	if ( rs->sr_err == LDAP_UNAVAILABLE &&
+		/* if we originally bound and wanted rebind-as-user, must drop
+		 * the connection now because we just discarded the credentials.
+		 * ITS#7464, #8142
+		 */
+		LDAP_BACK_SAVECRED( li ) && SLAP_IS_AUTHZ_BACKEND( op ) )
+		rs->sr_err = SLAPD_DISCONNECT;
+	return rs->sr_err;
+}
+
+/*
+ * Called from the thread pool with the responses to a detached
+ * search, and once a second to check its limits.
+ */
+static int
+ldap_back_search_cb( void *ctx, LDAPMessage *res, int err, void *arg )
+{
+	ldap_back_asearch_t	*las = arg;
+	Operation		*op = &las->las_op;
+	SlapReply		*rs = &las->las_rs;
+	ldap_back_search_t	*ls = &las->las_ls;
+	ldapinfo_t		*li = (ldapinfo_t *) op->o_bd->be_private;
+	void			*oldctx, *memctx;
+	time_t			now;
+	int			done = 0;
+
+	if ( !las->las_started ) {
+		/* wait for the frontend to let go of the operation */
+		while ( las->las_orig->o_bd == op->o_bd ) {
+			ldap_pvt_thread_yield();
+		}
+		las->las_started = 1;
+	}
+
+	/* the operation uses its own memory context */
+	oldctx = slap_sl_mem_create( SLAP_SLAB_SIZE, SLAP_SLAB_STACK, ctx, 0 );
+	op->o_threadctx = ctx;
+	op->o_tid = ldap_pvt_thread_pool_tid( ctx );
+	slap_sl_mem_setctx( ctx, op->o_tmpmemctx );
+	operation_counter_init( op, ctx );
+
+	/* abandon flags the operation of the connection, not the copy */
+	op->o_abandon = las->las_orig->o_abandon;
+
+	now = slap_get_time();
+	if ( op->o_abandon || LDAP_BACK_CONN_ABANDON( ls->ls_lc ) ) {
+		if ( res != NULL ) {
+			ldap_msgfree( res );
+		}
+		(void)ldap_back_cancel( ls->ls_lc, op, rs, ls->ls_msgid, LDAP_BACK_DONTSEND );
+		done = 1;
+
+	} else if ( res != NULL ) {
+		las->las_last = now;
+		done = ldap_back_search_msg( op, rs, ls, res );
+
+	} else if ( err != LDAP_SUCCESS ) {
+		rs->sr_err = err;
+		rs->sr_err = slap_map_api2result( rs );
+		done = 1;
+
+	} else if ( op->ors_tlimit != SLAP_NO_LIMIT && now > ls->ls_stoptime ) {
+		(void)ldap_back_cancel( ls->ls_lc, op, rs, ls->ls_msgid, LDAP_BACK_DONTSEND );
+		rs->sr_err = LDAP_TIMELIMIT_EXCEEDED;
+		done = 1;
+
+	} else if ( li->li_timeout[ SLAP_OP_SEARCH ]
+		&& now > las->las_last + li->li_timeout[ SLAP_OP_SEARCH ] )
+	{
+		(void)ldap_back_cancel( ls->ls_lc, op, rs, ls->ls_msgid, LDAP_BACK_DONTSEND );
+		rs->sr_text = "Operation timed out";
+		rs->sr_err = op->o_protocol >= LDAP_VERSION3 ?
+			LDAP_ADMINLIMIT_EXCEEDED : LDAP_OTHER;
+		done = 1;
+	}
+
+	if ( done ) {
+		Operation	*orig = las->las_orig;
+
+		memctx = op->o_tmpmemctx;
+		(void)ldap_back_search_finish( op, rs, ls );
+		connection_op_finish( orig, 1 );
+		slap_op_free( orig, ctx );
+		slap_sl_mem_setctx( ctx, NULL );
+		slap_sl_mem_destroy( (void *)1, memctx );
+	}
+	slap_sl_mem_setctx( ctx, oldctx );
+
+	return done;
+}
+
+/*
+ * On a shared connection, let the responses to a search of a client
+ * be handled as they arrive rather than holding this thread.
+ * Operations of internal or intercepted searches, which their callers
+ * expect to be over on return, are not detached.
+ */
+static int
+ldap_back_search_detach(
+		Operation		*op,
+		ldap_back_search_t	*ls )
+{
+	ldap_back_asearch_t	*las;
+
+	if ( ls->ls_lc->lc_mux == NULL || op->o_callback != NULL
+		|| op->o_conn->c_conn_idx == -1 || op->o_abandon )
+	{
+		return 0;
+	}
+
+	las = op->o_tmpcalloc( 1, sizeof( ldap_back_asearch_t ), op->o_tmpmemctx );
+	las->las_op = *op;
+	las->las_orig = op;
+	las->las_rs.sr_type = REP_RESULT;
+	las->las_ls = *ls;
+	las->las_last = slap_get_time();
+
+	if ( ldap_back_mux_async( ls->ls_lc, ls->ls_msgid,
+		ldap_back_search_cb, las ) != 0 )
+	{
+		op->o_tmpfree( las, op->o_tmpmemctx );
+		return 0;
+	}
+
+	Debug( LDAP_DEBUG_TRACE,
+		"%s ldap_back_search: msgid=%d detached\n",
+		op->o_log_prefix, ls->ls_msgid );
+
+	return 1;
+}
+
 int
 ldap_back_search(
 		Operation	*op,
@@ -147,28 +611,18 @@ ldap_back_search(
 {
 	ldapinfo_t	*li = (ldapinfo_t *) op->o_bd->be_private;
 
-	ldapconn_t	*lc = NULL;
+	ldap_back_search_t	ls = { 0 };
 	struct timeval	tv;
-	time_t		stoptime = (time_t)(-1);
-	LDAPMessage	*res,
-			*e;
-	int		rc = 0,
-			msgid; 
-	struct berval	match = BER_BVNULL,
-			filter = BER_BVNULL;
+	LDAPMessage	*res;
+	int		rc = 0;
 	int		i, x;
-	char		**attrs = NULL;
-	int		freetext = 0, filter_undef = 0;
+	int		filter_undef = 0;
 	int		do_retry = 1, dont_retry = 0;
-	LDAPControl	**ctrls = NULL, **res_ctrls = NULL;
-	char		**references = NULL;
-	int		remove_unknown_schema =
-				 LDAP_BACK_OMIT_UNKNOWN_SCHEMA (li);
 
 	rs_assert_ready( rs );
 	rs->sr_flags &= ~REP_ENTRY_MASK; /* paranoia, we can set rs = non-entry */
 
-	if ( !ldap_back_dobind( &lc, op, rs, LDAP_BACK_SENDERR ) ) {
+	if ( !ldap_back_dobind( &ls.ls_lc, op, rs, LDAP_BACK_SENDERR ) ) {
 		return rs->sr_err;
 	}
 
@@ -180,10 +634,11 @@ ldap_back_search(
 	if ( op->ors_tlimit != SLAP_NO_LIMIT ) {
 		tv.tv_sec = op->ors_tlimit;
 		tv.tv_usec = 0;
-		stoptime = op->o_time + op->ors_tlimit;
+		ls.ls_stoptime = op->o_time + op->ors_tlimit;
 
 	} else {
 		LDAP_BACK_TV_SET( &tv );
+		ls.ls_stoptime = (time_t)(-1);
 	}
 
 	i = 0;
@@ -201,9 +656,9 @@ ldap_back_search(
 	if ( i > 0 || x > 0 ) {
 		int j = 0;
 
-		attrs = op->o_tmpalloc( ( i + x + 1 )*sizeof( char * ),
+		ls.ls_attrs = op->o_tmpalloc( ( i + x + 1 )*sizeof( char * ),
 			op->o_tmpmemctx );
-		if ( attrs == NULL ) {
+		if ( ls.ls_attrs == NULL ) {
 			rs->sr_err = LDAP_NO_MEMORY;
 			rc = -1;
 			goto finish;
@@ -211,7 +666,7 @@ ldap_back_search(
 
 		if ( i > 0 ) {	
 			for ( i = 0; !BER_BVISNULL( &op->ors_attrs[i].an_name ); i++, j++ ) {
-				attrs[ j ] = op->ors_attrs[i].an_name.bv_val;
+				ls.ls_attrs[ j ] = op->ors_attrs[i].an_name.bv_val;
 			}
 		}
 
@@ -223,35 +678,35 @@ ldap_back_search(
 					continue;
 				}
 
-				attrs[ j ] = op->o_bd->be_extra_anlist[x].an_name.bv_val;
+				ls.ls_attrs[ j ] = op->o_bd->be_extra_anlist[x].an_name.bv_val;
 			}
 		}
 
-		attrs[ j ] = NULL;
+		ls.ls_attrs[ j ] = NULL;
 	}
 
-	ctrls = op->o_ctrls;
-	rc = ldap_back_controls_add( op, rs, lc, &ctrls );
+	ls.ls_ctrls = op->o_ctrls;
+	rc = ldap_back_controls_add( op, rs, ls.ls_lc, &ls.ls_ctrls );
 	if ( rc != LDAP_SUCCESS ) {
 		goto finish;
 	}
 
 	/* deal with <draft-zeilenga-ldap-t-f> filters */
-	filter = op->ors_filterstr;
+	ls.ls_filter = op->ors_filterstr;
 retry:
 	/* this goes after retry because ldap_back_munge_filter()
 	 * optionally replaces RFC 4526 T-F filters (&) (|)
 	 * if already computed, they will be re-installed
 	 * by filter2bv_undef_x() later */
 	if ( !LDAP_BACK_T_F( li ) ) {
-		ldap_back_munge_filter( op, &filter );
+		ldap_back_munge_filter( op, &ls.ls_filter );
 	}
 
-	rs->sr_err = ldap_pvt_search( lc->lc_ld, op->o_req_dn.bv_val,
-			op->ors_scope, filter.bv_val,
-			attrs, op->ors_attrsonly, ctrls, NULL,
+	rs->sr_err = ldap_pvt_search( ls.ls_lc->lc_ld, op->o_req_dn.bv_val,
+			op->ors_scope, ls.ls_filter.bv_val,
+			ls.ls_attrs, op->ors_attrsonly, ls.ls_ctrls, NULL,
 			tv.tv_sec ? &tv : NULL,
-			op->ors_slimit, op->ors_deref, &msgid );
+			op->ors_slimit, op->ors_deref, &ls.ls_msgid );
 
 	ldap_pvt_thread_mutex_lock( &li->li_counter_mutex );
 	ldap_pvt_mp_add( li->li_ops_completed[ SLAP_OP_SEARCH ], 1 );
@@ -262,17 +717,17 @@ retry:
 		case LDAP_SERVER_DOWN:
 			if ( do_retry ) {
 				do_retry = 0;
-				if ( ldap_back_retry( &lc, op, rs, LDAP_BACK_DONTSEND ) ) {
+				if ( ldap_back_retry( &ls.ls_lc, op, rs, LDAP_BACK_DONTSEND ) ) {
 					goto retry;
 				}
 			}
 
-			if ( lc == NULL ) {
+			if ( ls.ls_lc == NULL ) {
 				/* reset by ldap_back_retry ... */
 				rs->sr_err = slap_map_api2result( rs );
 
 			} else {
-				rc = ldap_back_op_result( lc, op, rs, msgid, 0, LDAP_BACK_DONTSEND );
+				rc = ldap_back_op_result( ls.ls_lc, op, rs, ls.ls_msgid, 0, LDAP_BACK_DONTSEND );
 			}
 				
 			goto finish;
@@ -280,11 +735,11 @@ retry:
 		case LDAP_FILTER_ERROR:
 			/* first try? */
 			if ( !filter_undef &&
-				strstr( filter.bv_val, "(?" ) &&
+				strstr( ls.ls_filter.bv_val, "(?" ) &&
 				!LDAP_BACK_NOUNDEFFILTER( li ) )
 			{
-				BER_BVZERO( &filter );
-				filter2bv_undef_x( op, op->ors_filter, 1, &filter );
+				BER_BVZERO( &ls.ls_filter );
+				filter2bv_undef_x( op, op->ors_filter, 1, &ls.ls_filter );
 				filter_undef = 1;
 				goto retry;
 			}
@@ -301,6 +756,11 @@ retry:
 		}
 	}
 
+	if ( ldap_back_search_detach( op, &ls ) ) {
+		/* the operation is completed by ldap_back_search_cb() */
+		return ( rs->sr_err = SLAPD_ASYNCOP );
+	}
+
 	/* if needed, initialize timeout */
 	if ( li->li_timeout[ SLAP_OP_SEARCH ] ) {
 		if ( tv.tv_sec == 0 || tv.tv_sec > li->li_timeout[ SLAP_OP_SEARCH ] ) {
@@ -314,14 +774,14 @@ retry:
 	 * but this is necessary for version matching, and for ACL processing.
 	 */
 
-	for ( rc = -2; rc != -1; rc = ldap_result( lc->lc_ld, msgid, LDAP_MSG_ONE, &tv, &res ) )
+	for ( rc = -2; rc != -1; rc = ldap_back_result( ls.ls_lc, ls.ls_msgid, LDAP_MSG_ONE, &tv, &res ) )
 	{
 		/* check for abandon */
-		if ( op->o_abandon || LDAP_BACK_CONN_ABANDON( lc ) ) {
+		if ( op->o_abandon || LDAP_BACK_CONN_ABANDON( ls.ls_lc ) ) {
 			if ( rc > 0 ) {
 				ldap_msgfree( res );
 			}
-			(void)ldap_back_cancel( lc, op, rs, msgid, LDAP_BACK_DONTSEND );
+			(void)ldap_back_cancel( ls.ls_lc, op, rs, ls.ls_msgid, LDAP_BACK_DONTSEND );
 			rc = SLAPD_ABANDON;
 			goto finish;
 		}
@@ -332,7 +792,7 @@ retry:
 			/* check timeout */
 			if ( li->li_timeout[ SLAP_OP_SEARCH ] ) {
 				if ( rc == 0 ) {
-					(void)ldap_back_cancel( lc, op, rs, msgid, LDAP_BACK_DONTSEND );
+					(void)ldap_back_cancel( ls.ls_lc, op, rs, ls.ls_msgid, LDAP_BACK_DONTSEND );
 					rs->sr_text = "Operation timed out";
 					rc = rs->sr_err = op->o_protocol >= LDAP_VERSION3 ?
 						LDAP_ADMINLIMIT_EXCEEDED : LDAP_OTHER;
@@ -345,226 +805,19 @@ retry:
 
 			/* check time limit */
 			if ( op->ors_tlimit != SLAP_NO_LIMIT
-					&& slap_get_time() > stoptime )
+					&& slap_get_time() > ls.ls_stoptime )
 			{
-				(void)ldap_back_cancel( lc, op, rs, msgid, LDAP_BACK_DONTSEND );
+				(void)ldap_back_cancel( ls.ls_lc, op, rs, ls.ls_msgid, LDAP_BACK_DONTSEND );
 				rc = rs->sr_err = LDAP_TIMELIMIT_EXCEEDED;
 				goto finish;
 			}
 			continue;
-
-		} else {
-			/* only touch when activity actually took place... */
-			if ( li->li_idle_timeout ) {
-				lc->lc_time = op->o_time;
-			}
-
-			/* don't retry any more */
-			dont_retry = 1;
 		}
 
+		/* don't retry any more */
+		dont_retry = 1;
 
-		if ( rc == LDAP_RES_SEARCH_ENTRY ) {
-			Entry		ent = { 0 };
-			struct berval	bdn = BER_BVNULL;
-
-			do_retry = 0;
-
-			e = ldap_first_entry( lc->lc_ld, res );
-			rc = ldap_build_entry( op, e, &ent, &bdn,
-						remove_unknown_schema);
-			if ( rc == LDAP_SUCCESS ) {
-
-				ldap_get_entry_controls( lc->lc_ld, res, &rs->sr_ctrls );
-				res_ctrls = rs->sr_ctrls;
-
-				rs->sr_entry = &ent;
-				rs->sr_attrs = op->ors_attrs;
-				rs->sr_operational_attrs = NULL;
-				rs->sr_flags = 0;
-				rs->sr_err = LDAP_SUCCESS;
-				rc = rs->sr_err = send_search_entry( op, rs );
-				if ( res_ctrls ) {
-					ldap_controls_free( res_ctrls );
-					rs->sr_ctrls = NULL;
-				}
-				rs->sr_entry = NULL;
-				rs->sr_flags = 0;
-				if ( !BER_BVISNULL( &ent.e_name ) ) {
-					assert( ent.e_name.bv_val != bdn.bv_val );
-					op->o_tmpfree( ent.e_name.bv_val, op->o_tmpmemctx );
-					BER_BVZERO( &ent.e_name );
-				}
-				if ( !BER_BVISNULL( &ent.e_nname ) ) {
-					op->o_tmpfree( ent.e_nname.bv_val, op->o_tmpmemctx );
-					BER_BVZERO( &ent.e_nname );
-				}
-				entry_clean( &ent );
-			}
-			ldap_msgfree( res );
-			switch ( rc ) {
-			case LDAP_SUCCESS:
-			case LDAP_INSUFFICIENT_ACCESS:
-				break;
-
-			default:
-				if ( rc == LDAP_UNAVAILABLE ) {
-					rc = rs->sr_err = LDAP_OTHER;
-				} else {
-					(void)ldap_back_cancel( lc, op, rs, msgid, LDAP_BACK_DONTSEND );
-				}
-				goto finish;
-			}
-
-		} else if ( rc == LDAP_RES_SEARCH_REFERENCE ) {
-			if ( LDAP_BACK_NOREFS( li ) ) {
-				ldap_msgfree( res );
-				continue;
-			}
-
-			do_retry = 0;
-			rc = ldap_parse_reference( lc->lc_ld, res,
-					&references, &rs->sr_ctrls, 1 );
-
-			if ( rc != LDAP_SUCCESS ) {
-				continue;
-			}
-			res_ctrls = rs->sr_ctrls;
-
-			/* FIXME: there MUST be at least one */
-			if ( references && references[ 0 ] && references[ 0 ][ 0 ] ) {
-				int		cnt;
-
-				for ( cnt = 0; references[ cnt ]; cnt++ )
-					/* NO OP */ ;
-
-				/* FIXME: there MUST be at least one */
-				rs->sr_ref = op->o_tmpalloc( ( cnt + 1 ) * sizeof( struct berval ),
-					op->o_tmpmemctx );
-
-				for ( cnt = 0; references[ cnt ]; cnt++ ) {
-					ber_str2bv( references[ cnt ], 0, 0, &rs->sr_ref[ cnt ] );
-				}
-				BER_BVZERO( &rs->sr_ref[ cnt ] );
-
-				/* ignore return value by now */
-				RS_ASSERT( !(rs->sr_flags & REP_ENTRY_MASK) );
-				rs->sr_entry = NULL;
-				( void )send_search_reference( op, rs );
-
-			} else {
-				Debug( LDAP_DEBUG_ANY,
-					"%s ldap_back_search: "
-					"got SEARCH_REFERENCE "
-					"with no referrals\n",
-					op->o_log_prefix );
-			}
-
-			/* cleanup */
-			if ( references ) {
-				ber_memvfree( (void **)references );
-				op->o_tmpfree( rs->sr_ref, op->o_tmpmemctx );
-				rs->sr_ref = NULL;
-				references = NULL;
-			}
-
-			if ( res_ctrls ) {
-				ldap_controls_free( res_ctrls );
-				rs->sr_ctrls = NULL;
-			}
-
-		} else if ( rc == LDAP_RES_INTERMEDIATE ) {
-			/* FIXME: response controls
-			 * are passed without checks */
-			rc = ldap_parse_intermediate( lc->lc_ld,
-				res,
-				(char **)&rs->sr_rspoid,
-				&rs->sr_rspdata,
-				&rs->sr_ctrls,
-				0 );
-			if ( rc != LDAP_SUCCESS ) {
-				continue;
-			}
-			res_ctrls = rs->sr_ctrls;
-
-			slap_send_ldap_intermediate( op, rs );
-
-			if ( rs->sr_rspoid != NULL ) {
-				ber_memfree( (char *)rs->sr_rspoid );
-				rs->sr_rspoid = NULL;
-			}
-
-			if ( rs->sr_rspdata != NULL ) {
-				ber_bvfree( rs->sr_rspdata );
-				rs->sr_rspdata = NULL;
-			}
-
-			if ( res_ctrls ) {
-				ldap_controls_free( res_ctrls );
-				rs->sr_ctrls = NULL;
-			}
-
-		} else {
-			char		*err = NULL;
-
-			rc = ldap_parse_result( lc->lc_ld, res, &rs->sr_err,
-					&match.bv_val, &err,
-					&references, &rs->sr_ctrls, 1 );
-			if ( rc == LDAP_SUCCESS ) {
-				if ( err ) {
-					rs->sr_text = err;
-					freetext = 1;
-				}
-			} else {
-				rs->sr_err = rc;
-			}
-			rs->sr_err = slap_map_api2result( rs );
-			res_ctrls = rs->sr_ctrls;
-
-			/* RFC 4511: referrals can only appear
-			 * if result code is LDAP_REFERRAL */
-			if ( references 
-				&& references[ 0 ]
-				&& references[ 0 ][ 0 ] )
-			{
-				if ( rs->sr_err != LDAP_REFERRAL ) {
-					Debug( LDAP_DEBUG_ANY,
-						"%s ldap_back_search: "
-						"got referrals with err=%d\n",
-						op->o_log_prefix,
-						rs->sr_err );
-
-				} else {
-					int	cnt;
-
-					for ( cnt = 0; references[ cnt ]; cnt++ )
-						/* NO OP */ ;
-				
-					rs->sr_ref = op->o_tmpalloc( ( cnt + 1 ) * sizeof( struct berval ),
-						op->o_tmpmemctx );
-
-					for ( cnt = 0; references[ cnt ]; cnt++ ) {
-						/* duplicating ...*/
-						ber_str2bv( references[ cnt ], 0, 0, &rs->sr_ref[ cnt ] );
-					}
-					BER_BVZERO( &rs->sr_ref[ cnt ] );
-				}
-
-			} else if ( rs->sr_err == LDAP_REFERRAL ) {
-				Debug( LDAP_DEBUG_ANY,
-					"%s ldap_back_search: "
-					"got err=%d with null "
-					"or empty referrals\n",
-					op->o_log_prefix,
-					rs->sr_err );
-
-				rs->sr_err = LDAP_NO_SUCH_OBJECT;
-			}
-
-			if ( match.bv_val != NULL ) {
-				match.bv_len = strlen( match.bv_val );
-			}
-
+		if ( ldap_back_search_msg( op, rs, &ls, res ) ) {
 			rc = 0;
 			break;
 		}
@@ -582,7 +835,7 @@ retry:
 		if ( dont_retry == 0 ) {
 			if ( do_retry ) {
 				do_retry = 0;
-				if ( ldap_back_retry( &lc, op, rs, LDAP_BACK_DONTSEND ) ) {
+				if ( ldap_back_retry( &ls.ls_lc, op, rs, LDAP_BACK_DONTSEND ) ) {
 					goto retry;
 				}
 			}
@@ -599,85 +852,8 @@ retry:
 		}
 	}
 
-	/*
-	 * Rewrite the matched portion of the search base, if required
-	 */
-	if ( !BER_BVISNULL( &match ) && !BER_BVISEMPTY( &match ) ) {
-		struct berval	pmatch;
-
-		if ( dnPretty( NULL, &match, &pmatch, op->o_tmpmemctx ) != LDAP_SUCCESS ) {
-			pmatch.bv_val = match.bv_val;
-			match.bv_val = NULL;
-		}
-		rs->sr_matched = pmatch.bv_val;
-		rs->sr_flags |= REP_MATCHED_MUSTBEFREED;
-	}
-
 finish:;
-	if ( !BER_BVISNULL( &match ) ) {
-		ber_memfree( match.bv_val );
-	}
-
-	if ( rs->sr_v2ref ) {
-		rs->sr_err = LDAP_REFERRAL;
-	}
-
-	if ( LDAP_BACK_QUARANTINE( li ) ) {
-		ldap_back_quarantine( op, rs );
-	}
-
-	if ( filter.bv_val != op->ors_filterstr.bv_val ) {
-		op->o_tmpfree( filter.bv_val, op->o_tmpmemctx );
-	}
-
-#if 0
-	/* let send_ldap_result play cleanup handlers (ITS#4645) */
-	if ( rc != SLAPD_ABANDON )
-#endif
-	{
-		send_ldap_result( op, rs );
-	}
-
-	(void)ldap_back_controls_free( op, rs, &ctrls );
-
-	if ( res_ctrls ) {
-		ldap_controls_free( res_ctrls );
-		rs->sr_ctrls = NULL;
-		res_ctrls = NULL;
-	}
-
-	if ( rs->sr_text ) {
-		if ( freetext ) {
-			ber_memfree( (char *)rs->sr_text );
-		}
-		rs->sr_text = NULL;
-	}
-
-	if ( rs->sr_ref ) {
-		op->o_tmpfree( rs->sr_ref, op->o_tmpmemctx );
-		rs->sr_ref = NULL;
-	}
-
-	if ( references ) {
-		ber_memvfree( (void **)references );
-	}
-
-	if ( attrs ) {
-		op->o_tmpfree( attrs, op->o_tmpmemctx );
-	}
-
-	if ( lc != NULL ) {
-		ldap_back_release_conn( li, lc );
-	}
-
-	if ( rs->sr_err == LDAP_UNAVAILABLE &&
-		/* if we originally bound and wanted rebind-as-user, must drop
-		 * the connection now because we just discarded the credentials.
-		 * ITS#7464, #8142
-		 */
-		LDAP_BACK_SAVECRED( li ) && SLAP_IS_AUTHZ_BACKEND( op ) )
-		rs->sr_err = SLAPD_DISCONNECT;
-	return rs->sr_err;
+	return ldap_back_search_finish( op, rs, &ls );
 }
 
 static int
@@ -942,6 +1118,7 @@ ldap_back_entry_get(
 	char		*filter = NULL;
 	SlapReply	rs;
 	int		do_retry = 1;
+	int		msgid;
 	LDAPControl	**ctrls = NULL, **res_ctrls = NULL;
 	Operation op2 = *op;
 
@@ -995,9 +1172,19 @@ retry:
 	}
 
 	/* TODO: timeout? */
-	rc = ldap_pvt_search_s( lc->lc_ld, ndn->bv_val, LDAP_SCOPE_BASE, filter,
+	rc = ldap_pvt_search( lc->lc_ld, ndn->bv_val, LDAP_SCOPE_BASE, filter,
 				attrp, LDAP_DEREF_NEVER, ctrls, NULL,
-				NULL, LDAP_NO_LIMIT, 0, &result );
+				NULL, LDAP_NO_LIMIT, 0, &msgid );
+	if ( rc == LDAP_SUCCESS ) {
+		if ( ldap_back_result( lc, msgid, LDAP_MSG_ALL, NULL, &result ) == -1 ) {
+			ldap_get_option( lc->lc_ld, LDAP_OPT_RESULT_CODE, &rc );
+
+		} else if ( ldap_parse_result( lc->lc_ld, result, &rc,
+			NULL, NULL, NULL, NULL, 0 ) != LDAP_SUCCESS )
+		{
+			ldap_get_option( lc->lc_ld, LDAP_OPT_RESULT_CODE, &rc );
+		}
+	}
 	if ( rc != LDAP_SUCCESS ) {
 		if ( rc == LDAP_SERVER_DOWN && do_retry ) {
 			do_retry = 0;
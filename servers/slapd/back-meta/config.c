@@ -64,6 +64,7 @@ enum {
 	LDAP_BACK_CFG_SINGLECONN,
 	LDAP_BACK_CFG_USETEMP,
 	LDAP_BACK_CFG_CONNPOOLMAX,
+	LDAP_BACK_CFG_BASE_FIRST,
 	LDAP_BACK_CFG_LAST_BASE
 };
 
@@ -428,6 +429,15 @@ static ConfigTable metacfg[] = {
                        "SINGLE-VALUE )",
                NULL, NULL },
 
+	{ "base-first-responder", "true|FALSE", 2, 2, 0,
+		ARG_MAGIC|ARG_ON_OFF|LDAP_BACK_CFG_BASE_FIRST,
+		meta_back_cf_gen, "( OLcfgDbAt:3.118 "
+			"NAME 'olcDbBaseFirstResponder' "
+			"DESC 'end base searches with the first target returning the entry' "
+			"EQUALITY booleanMatch "
+			"SYNTAX OMsBoolean "
+			"SINGLE-VALUE )",
+		NULL, NULL },
 	{ "filter", "pattern", 2, 2, 0,
 		ARG_MAGIC|LDAP_BACK_CFG_FILTER,
 		meta_back_cf_gen, "( OLcfgDbAt:3.112 "
@@ -477,6 +487,7 @@ static ConfigOCs metaocs[] = {
 			"$ olcDbSingleConn "
 			"$ olcDbUseTemporaryConn "
 			"$ olcDbConnectionPoolMax "
+			"$ olcDbBaseFirstResponder "
 
 			/* defaults, may be overridden per-target */
 			COMMON_ATTRS
@@ -1169,6 +1180,10 @@ meta_back_cf_gen( ConfigArgs *c )
 			c->value_int = LDAP_BACK_SINGLECONN( mi );
 			break;
 
+		case LDAP_BACK_CFG_BASE_FIRST:
+			c->value_int = META_BACK_BASE_FIRST( mi );
+			break;
+
 		case LDAP_BACK_CFG_USETEMP:
 			c->value_int = LDAP_BACK_USE_TEMPORARIES( mi );
 			break;
@@ -1644,6 +1659,10 @@ meta_back_cf_gen( ConfigArgs *c )
 			mi->mi_flags &= ~LDAP_BACK_F_SINGLECONN;
 			break;
 
+		case LDAP_BACK_CFG_BASE_FIRST:
+			mi->mi_flags &= ~META_BACK_F_BASE_FIRST;
+			break;
+
 		case LDAP_BACK_CFG_USETEMP:
 			mi->mi_flags &= ~LDAP_BACK_F_USE_TEMPORARIES;
 			break;
@@ -2372,6 +2391,14 @@ meta_back_cf_gen( ConfigArgs *c )
 		}
 		break;
 
+	case LDAP_BACK_CFG_BASE_FIRST:
+		if ( c->value_int ) {
+			mi->mi_flags |= META_BACK_F_BASE_FIRST;
+		} else {
+			mi->mi_flags &= ~META_BACK_F_BASE_FIRST;
+		}
+		break;
+
 	case LDAP_BACK_CFG_SINGLECONN:
 	/* single-conn? */
 		if ( mi->mi_ntargets > 0 ) {
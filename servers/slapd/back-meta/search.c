@@ -766,6 +766,119 @@ doreturn:;
 	return retcode;
 }
 
+/*
+ * Stop the searches still in progress on the candidates: targets still
+ * binding are dropped, the others are sent a cancel.
+ */
+static void
+meta_search_drop_candidates(
+	Operation		*op,
+	SlapReply		*rs,
+	metaconn_t		*mc,
+	SlapReply		*candidates,
+	int			*ncandidates )
+{
+	metainfo_t	*mi = ( metainfo_t * )op->o_bd->be_private;
+	long		i;
+
+	for ( i = 0; i < mi->mi_ntargets; i++ ) {
+		if ( candidates[ i ].sr_msgid >= 0
+			|| candidates[ i ].sr_msgid == META_MSGID_CONNECTING )
+		{
+			if ( META_IS_BINDING( &candidates[ i ] )
+				|| candidates[ i ].sr_msgid == META_MSGID_CONNECTING )
+			{
+				ldap_pvt_thread_mutex_lock( &mi->mi_conninfo.lai_mutex );
+				if ( LDAP_BACK_CONN_BINDING( &mc->mc_conns[ i ] )
+					|| candidates[ i ].sr_msgid == META_MSGID_CONNECTING )
+				{
+					/* if still binding, destroy */
+
+#ifdef DEBUG_205
+					Debug(LDAP_DEBUG_ANY,
+					      "### %s meta_back_search(abandon) " "ldap_unbind_ext[%ld] mc=%p ld=%p\n",
+					      op->o_log_prefix,
+					      i, (void *)mc,
+					      (void *)mc->mc_conns[i].msc_ld );
+#endif /* DEBUG_205 */
+
+					meta_clear_one_candidate( op, mc, i );
+				}
+				ldap_pvt_thread_mutex_unlock( &mi->mi_conninfo.lai_mutex );
+				META_BINDING_CLEAR( &candidates[ i ] );
+				
+			} else {
+				(void)meta_back_cancel( mc, op, rs,
+					candidates[ i ].sr_msgid, i,
+					LDAP_BACK_DONTSEND );
+			}
+
+			candidates[ i ].sr_msgid = META_MSGID_IGNORE;
+			assert( *ncandidates > 0 );
+			--*ncandidates;
+		}
+	}
+}
+
+/*
+ * Wait at most tvp for a response on the connection of any of the
+ * candidates with a request in progress, rather than polling each
+ * of them in turn. Responses read meanwhile by another operation
+ * sharing a connection are only noticed when the wait is over.
+ */
+static void
+meta_search_wait(
+	Operation		*op,
+	metaconn_t		*mc,
+	SlapReply		*candidates,
+	struct timeval		*tvp )
+{
+	metainfo_t	*mi = ( metainfo_t * )op->o_bd->be_private;
+	ber_socket_t	s;
+	long		i;
+	int		n = 0;
+#ifdef HAVE_POLL
+	struct pollfd	*fds;
+
+	fds = op->o_tmpalloc( mi->mi_ntargets * sizeof( struct pollfd ),
+		op->o_tmpmemctx );
+#else /* ! HAVE_POLL */
+	fd_set		rfds;
+	ber_socket_t	maxfd = 0;
+
+	FD_ZERO( &rfds );
+#endif /* ! HAVE_POLL */
+
+	for ( i = 0; i < mi->mi_ntargets; i++ ) {
+		if ( candidates[ i ].sr_msgid < 0
+			|| mc->mc_conns[ i ].msc_ld == NULL
+			|| ldap_get_option( mc->mc_conns[ i ].msc_ld,
+				LDAP_OPT_DESC, &s ) != LDAP_OPT_SUCCESS
+			|| s == AC_SOCKET_INVALID )
+		{
+			continue;
+		}
+#ifdef HAVE_POLL
+		fds[ n ].fd = s;
+		fds[ n ].events = POLL_READ;
+		fds[ n ].revents = 0;
+#else /* ! HAVE_POLL */
+		FD_SET( s, &rfds );
+		if ( s > maxfd ) {
+			maxfd = s;
+		}
+#endif /* ! HAVE_POLL */
+		n++;
+	}
+
+#ifdef HAVE_POLL
+	(void)poll( fds, n, tvp->tv_sec * 1000 + tvp->tv_usec / 1000 );
+	op->o_tmpfree( fds, op->o_tmpmemctx );
+#else /* ! HAVE_POLL */
+	(void)select( n ? maxfd + 1 : 0, n ? &rfds : NULL, NULL, NULL, tvp );
+#endif /* ! HAVE_POLL */
+}
+
 int
 meta_back_search( Operation *op, SlapReply *rs )
 {
@@ -1130,8 +1243,12 @@ getconn:;
 			 * to handle it, so at some time we'll
 			 * get a LDAP_TIMELIMIT_EXCEEDED from
 			 * one of them ...
+			 *
+			 * Only take what already arrived; the wait
+			 * for more is in meta_search_wait()
 			 */
-			tv = save_tv;
+			tv.tv_sec = 0;
+			tv.tv_usec = 0;
 			rc = ldap_result( msc->msc_ld, candidates[ i ].sr_msgid,
 					LDAP_MSG_RECEIVED, &tv, &res );
 			switch ( rc ) {
@@ -1658,6 +1775,18 @@ got_err:
 					assert( ncandidates > 0 );
 					--ncandidates;
 
+					/* a base entry comes from a single
+					 * target: the first that returns it
+					 * ends the search */
+					if ( ncandidates > 0
+						&& op->ors_scope == LDAP_SCOPE_BASE
+						&& META_BACK_BASE_FIRST( mi )
+						&& candidates[ i ].sr_nentries > 0
+						&& sres == LDAP_SUCCESS )
+					{
+						meta_search_drop_candidates( op, rs, mc, candidates, &ncandidates );
+					}
+
 				} else if ( rc == LDAP_RES_BIND ) {
 					meta_search_candidate_t	retcode;
 	
@@ -1715,43 +1844,7 @@ free_message:;
 
 		/* check for abandon */
 		if ( op->o_abandon || LDAP_BACK_CONN_ABANDON( mc ) ) {
-			for ( i = 0; i < mi->mi_ntargets; i++ ) {
-				if ( candidates[ i ].sr_msgid >= 0
-					|| candidates[ i ].sr_msgid == META_MSGID_CONNECTING )
-				{
-					if ( META_IS_BINDING( &candidates[ i ] )
-						|| candidates[ i ].sr_msgid == META_MSGID_CONNECTING )
-					{
-						ldap_pvt_thread_mutex_lock( &mi->mi_conninfo.lai_mutex );
-						if ( LDAP_BACK_CONN_BINDING( &mc->mc_conns[ i ] )
-							|| candidates[ i ].sr_msgid == META_MSGID_CONNECTING )
-						{
-							/* if still binding, destroy */
-
-#ifdef DEBUG_205
-							Debug(LDAP_DEBUG_ANY,
-							      "### %s meta_back_search(abandon) " "ldap_unbind_ext[%ld] mc=%p ld=%p\n",
-							      op->o_log_prefix,
-							      i, (void *)mc,
-							      (void *)mc->mc_conns[i].msc_ld );
-#endif /* DEBUG_205 */
-
-							meta_clear_one_candidate( op, mc, i );
-						}
-						ldap_pvt_thread_mutex_unlock( &mi->mi_conninfo.lai_mutex );
-						META_BINDING_CLEAR( &candidates[ i ] );
-						
-					} else {
-						(void)meta_back_cancel( mc, op, rs,
-							candidates[ i ].sr_msgid, i,
-							LDAP_BACK_DONTSEND );
-					}
-
-					candidates[ i ].sr_msgid = META_MSGID_IGNORE;
-					assert( ncandidates > 0 );
-					--ncandidates;
-				}
-			}
+			meta_search_drop_candidates( op, rs, mc, candidates, &ncandidates );
 
 			if ( op->o_abandon ) {
 				rc = SLAPD_ABANDON;
@@ -1775,12 +1868,19 @@ free_message:;
 				lutil_timermul( &save_tv, 2, &save_tv );
 			}
 
+			/* wake up at least once a second, to notice abandon
+			 * and the responses read by other operations */
+			tv = save_tv;
+			if ( tv.tv_sec >= 1 ) {
+				tv.tv_sec = 1;
+				tv.tv_usec = 0;
+			}
+
 			if ( alreadybound == 0 ) {
-				tv = save_tv;
 				(void)select( 0, NULL, NULL, NULL, &tv );
 
 			} else {
-				ldap_pvt_thread_yield();
+				meta_search_wait( op, mc, candidates, &tv );
 			}
 		}
 	}
@@ -239,6 +239,12 @@ typedef unsigned long backsql_key_t;
 #define BACKSQL_STR2ID lutil_atoulx
 #endif /* ! HAVE_LONG_LONG */
 
+/*
+ * default number of candidates whose attribute values are fetched
+ * by a single query during searches; 0 or 1 means one query per entry
+ */
+#define BACKSQL_FETCH_BATCH	0
+
 /*
  * define to enable support for syncprov overlay
  */
@@ -342,6 +348,10 @@ typedef struct backsql_at_map_rec {
 #ifdef BACKSQL_COUNTQUERY
 	char		*bam_countquery;
 #endif /* BACKSQL_COUNTQUERY */
+	/* the same query for a batch of entries, split where the list
+	 * of their keys goes; see backsql_batch_prepare() */
+	char		*bam_batch_query;
+	char		*bam_batch_tail;
 	/* following flags are bitmasks (first bit used for add_proc, 
 	 * second - for delete_proc) */
 	/* order of parameters for procedures above; 
@@ -429,6 +439,30 @@ typedef struct backsql_entryID {
 	( ( (f) & BACKSQL_ISF_GET_OC ) == BACKSQL_ISF_GET_OC )
 #define BACKSQL_IS_MATCHED(f) \
 	( ( (f) & BACKSQL_ISF_MATCHED ) == BACKSQL_ISF_MATCHED )
+
+/*
+ * Batch of candidates whose attribute values are fetched together,
+ * with one "... WHERE key IN (?,...)" query per attribute
+ */
+typedef struct backsql_fetch_batch {
+	int			bfb_max;
+	int			bfb_n;
+	int			bfb_cur;
+	unsigned		bfb_gen;
+
+	/* only bfb_eids[ bfb_cur ] and the following may be dereferenced;
+	 * the keys are copied since the queries may run later on */
+	backsql_entryID		**bfb_eids;
+#ifdef BACKSQL_ARBITRARY_KEY
+	struct berval		*bfb_keys;
+#else /* ! BACKSQL_ARBITRARY_KEY */
+	backsql_key_t		*bfb_keys;
+#endif /* ! BACKSQL_ARBITRARY_KEY */
+
+	/* a backsql_batch_at for each attribute mapping used so far */
+	Avlnode			*bfb_attrs;
+} backsql_fetch_batch;
+
 typedef struct backsql_srch_info {
 	Operation		*bsi_op;
 	SlapReply		*bsi_rs;
@@ -476,6 +510,8 @@ typedef struct backsql_srch_info {
 	AttributeName		*bsi_attrs;
 
 	Entry			*bsi_e;
+
+	backsql_fetch_batch	*bsi_batch;
 } backsql_srch_info;
 
 /*
@@ -522,6 +558,8 @@ typedef struct backsql_info {
 
 	AttributeName	*sql_anlist;
 
+	int		sql_fetch_batch;
+
 	unsigned int	sql_flags;
 #define	BSQLF_SCHEMA_LOADED		0x0001
 #define	BSQLF_UPPER_NEEDS_CAST		0x0002
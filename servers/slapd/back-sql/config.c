@@ -249,6 +249,12 @@ static ConfigTable sqlcfg[] = {
 			"DESC 'Query used to collect entryID mapping data' "
 			"EQUALITY caseExactMatch "
 			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
+	{ "fetch_batch_size", "size", 2, 2, 0, ARG_INT|ARG_OFFSET,
+		(void *)offsetof(struct backsql_info, sql_fetch_batch),
+		"( OLcfgDbAt:6.47 NAME 'olcSqlFetchBatchSize' "
+			"DESC 'Number of entries whose attributes are fetched at once' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ NULL, NULL, 0, 0, 0, ARG_IGNORED,
 		NULL, NULL, NULL, NULL }
 };
@@ -269,7 +275,8 @@ static ConfigOCs sqlocs[] = {
 		"olcSqlFailIfNoMapping $ olcSqlAllowOrphans $ olcSqlBaseObject $ "
 		"olcSqlLayer $ olcSqlUseSubtreeShortcut $ olcSqlFetchAllAttrs $ "
 		"olcSqlFetchAttrs $ olcSqlCheckSchema $ olcSqlAliasingKeyword $ "
-		"olcSqlAliasingQuote $ olcSqlAutocommit $ olcSqlIdQuery ) )",
+		"olcSqlAliasingQuote $ olcSqlAutocommit $ olcSqlIdQuery $ "
+		"olcSqlFetchBatchSize ) )",
 			Cft_Database, sqlcfg },
 	{ NULL, Cft_Abstract, NULL }
 };
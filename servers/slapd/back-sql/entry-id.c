@@ -497,6 +497,481 @@ backsql_has_children(
 	return rc;
 }
 
+/*
+ * Batched fetch of the attribute values of search candidates.
+ *
+ * backsql_search() calls backsql_batch_next() for each candidate;
+ * when it is not in the current batch, a new batch is made of it
+ * and of the candidates of the same objectClass that follow it.
+ * The first time an attribute mapping is needed within a batch,
+ * its values are fetched for all the entries of the batch with a
+ * single query, prepared once per search with a full batch of
+ * parameters; a short batch repeats its last key.
+ */
+typedef struct backsql_batch_at {
+	backsql_at_map_rec	*bba_at;
+	SQLHSTMT		bba_sth;
+	unsigned		bba_gen;
+	int			bba_err;
+	BerVarray		*bba_vals;
+} backsql_batch_at;
+
+static int
+backsql_batch_at_cmp( const void *v1, const void *v2 )
+{
+	const backsql_batch_at	*ba1 = v1,
+				*ba2 = v2;
+
+	return SLAP_PTRCMP( ba1->bba_at, ba2->bba_at );
+}
+
+static void
+backsql_batch_free_vals( Operation *op, backsql_fetch_batch *bb,
+	backsql_batch_at *ba )
+{
+	int	i;
+
+	for ( i = 0; i < bb->bfb_max; i++ ) {
+		if ( ba->bba_vals[ i ] != NULL ) {
+			ber_bvarray_free_x( ba->bba_vals[ i ], op->o_tmpmemctx );
+			ba->bba_vals[ i ] = NULL;
+		}
+	}
+}
+
+static int
+backsql_batch_at_free( void *v_ba, void *v_bsi )
+{
+	backsql_batch_at	*ba = v_ba;
+	backsql_srch_info	*bsi = v_bsi;
+	Operation		*op = bsi->bsi_op;
+
+	backsql_batch_free_vals( op, bsi->bsi_batch, ba );
+	if ( ba->bba_sth != SQL_NULL_HSTMT ) {
+		SQLFreeStmt( ba->bba_sth, SQL_DROP );
+	}
+	op->o_tmpfree( ba, op->o_tmpmemctx );
+
+	return 0;
+}
+
+static void
+backsql_batch_clear( Operation *op, backsql_fetch_batch *bb )
+{
+#ifdef BACKSQL_ARBITRARY_KEY
+	int	i;
+
+	for ( i = 0; i < bb->bfb_n; i++ ) {
+		op->o_tmpfree( bb->bfb_keys[ i ].bv_val, op->o_tmpmemctx );
+		BER_BVZERO( &bb->bfb_keys[ i ] );
+	}
+#endif /* BACKSQL_ARBITRARY_KEY */
+
+	bb->bfb_n = 0;
+	bb->bfb_cur = 0;
+}
+
+void
+backsql_batch_init( backsql_srch_info *bsi )
+{
+	Operation		*op = bsi->bsi_op;
+	backsql_info		*bi = (backsql_info *)op->o_bd->be_private;
+	backsql_fetch_batch	*bb;
+
+	bsi->bsi_batch = NULL;
+	if ( bi->sql_fetch_batch < 2 ) {
+		return;
+	}
+
+	bb = op->o_tmpcalloc( 1, sizeof( backsql_fetch_batch ),
+			op->o_tmpmemctx );
+	bb->bfb_max = bi->sql_fetch_batch;
+	bb->bfb_eids = op->o_tmpcalloc( bb->bfb_max,
+			sizeof( backsql_entryID * ), op->o_tmpmemctx );
+	bb->bfb_keys = op->o_tmpcalloc( bb->bfb_max,
+			sizeof( bb->bfb_keys[ 0 ] ), op->o_tmpmemctx );
+
+	bsi->bsi_batch = bb;
+}
+
+void
+backsql_batch_next( backsql_srch_info *bsi, backsql_entryID *eid )
+{
+	Operation		*op = bsi->bsi_op;
+	backsql_fetch_batch	*bb = bsi->bsi_batch;
+	backsql_entryID		*e;
+
+	if ( bb == NULL ) {
+		return;
+	}
+
+	if ( bb->bfb_cur + 1 < bb->bfb_n
+			&& bb->bfb_eids[ bb->bfb_cur + 1 ] == eid )
+	{
+		bb->bfb_cur++;
+		return;
+	}
+
+	backsql_batch_clear( op, bb );
+	bb->bfb_gen++;
+
+	for ( e = eid; e != NULL && bb->bfb_n < bb->bfb_max; e = e->eid_next ) {
+		/* the searchBase and the baseObject are not collected
+		 * by backsql_id2entry() */
+		if ( e == &bsi->bsi_base_id
+				|| BACKSQL_IS_BASEOBJECT_ID( &e->eid_id )
+				|| e->eid_oc == NULL
+				|| e->eid_oc != eid->eid_oc )
+		{
+			break;
+		}
+
+		bb->bfb_eids[ bb->bfb_n ] = e;
+#ifdef BACKSQL_ARBITRARY_KEY
+		ber_dupbv_x( &bb->bfb_keys[ bb->bfb_n ], &e->eid_keyval,
+				op->o_tmpmemctx );
+#else /* ! BACKSQL_ARBITRARY_KEY */
+		bb->bfb_keys[ bb->bfb_n ] = e->eid_keyval;
+#endif /* ! BACKSQL_ARBITRARY_KEY */
+		bb->bfb_n++;
+	}
+
+	Debug( LDAP_DEBUG_TRACE, "backsql_batch_next(): "
+		"%d entries in batch\n", bb->bfb_n );
+}
+
+void
+backsql_batch_destroy( backsql_srch_info *bsi )
+{
+	Operation		*op = bsi->bsi_op;
+	backsql_fetch_batch	*bb = bsi->bsi_batch;
+
+	if ( bb == NULL ) {
+		return;
+	}
+
+	ldap_avl_apply( bb->bfb_attrs, backsql_batch_at_free, bsi,
+			-1, AVL_INORDER );
+	ldap_avl_free( bb->bfb_attrs, NULL );
+
+	backsql_batch_clear( op, bb );
+	op->o_tmpfree( bb->bfb_keys, op->o_tmpmemctx );
+	op->o_tmpfree( bb->bfb_eids, op->o_tmpmemctx );
+	op->o_tmpfree( bb, op->o_tmpmemctx );
+
+	bsi->bsi_batch = NULL;
+}
+
+/*
+ * the bam_batch_query of the attribute, a "?" for each entry of a full
+ * batch, then its bam_batch_tail; both are built with bam_query, from
+ * the same join_where
+ */
+static int
+backsql_batch_prepare( backsql_srch_info *bsi, backsql_batch_at *ba )
+{
+	Operation		*op = bsi->bsi_op;
+	backsql_info		*bi = (backsql_info *)op->o_bd->be_private;
+	backsql_at_map_rec	*at = ba->bba_at;
+	struct berbuf		query = BB_NULL;
+	RETCODE			rc;
+	int			i;
+
+	if ( at->bam_batch_query == NULL ) {
+		return LDAP_OTHER;
+	}
+
+	backsql_strfcat_x( &query, op->o_tmpmemctx, "sc",
+			at->bam_batch_query, '?' );
+
+	for ( i = 1; i < bsi->bsi_batch->bfb_max; i++ ) {
+		backsql_strfcat_x( &query, op->o_tmpmemctx, "l",
+				(ber_len_t)STRLENOF( ",?" ), ",?" );
+	}
+
+	backsql_strfcat_x( &query, op->o_tmpmemctx, "s", at->bam_batch_tail );
+
+	Debug( LDAP_DEBUG_TRACE, "backsql_batch_prepare(): "
+		"query=\"%s\"\n", query.bb_val.bv_val );
+
+	rc = backsql_Prepare( bsi->bsi_dbh, &ba->bba_sth,
+			query.bb_val.bv_val, 0 );
+	op->o_tmpfree( query.bb_val.bv_val, op->o_tmpmemctx );
+	if ( rc != SQL_SUCCESS ) {
+		Debug( LDAP_DEBUG_TRACE, "backsql_batch_prepare(): "
+			"error preparing batched query for attribute \"%s\"\n",
+			at->bam_ad->ad_cname.bv_val );
+		backsql_PrintErrors( bi->sql_db_env, bsi->bsi_dbh,
+				ba->bba_sth, rc );
+		if ( ba->bba_sth != SQL_NULL_HSTMT ) {
+			SQLFreeStmt( ba->bba_sth, SQL_DROP );
+			ba->bba_sth = SQL_NULL_HSTMT;
+		}
+		return LDAP_OTHER;
+	}
+
+	return LDAP_SUCCESS;
+}
+
+static int
+backsql_batch_fetch( backsql_srch_info *bsi, backsql_batch_at *ba )
+{
+	Operation		*op = bsi->bsi_op;
+	backsql_info		*bi = (backsql_info *)op->o_bd->be_private;
+	backsql_fetch_batch	*bb = bsi->bsi_batch;
+	BACKSQL_ROW_NTS		row;
+	RETCODE			rc;
+	int			i;
+
+	backsql_batch_free_vals( op, bb, ba );
+
+	if ( ba->bba_sth == SQL_NULL_HSTMT
+			&& backsql_batch_prepare( bsi, ba ) != LDAP_SUCCESS )
+	{
+		return LDAP_OTHER;
+	}
+
+	for ( i = 0; i < bb->bfb_max; i++ ) {
+		rc = backsql_BindParamID( ba->bba_sth, i + 1, SQL_PARAM_INPUT,
+				&bb->bfb_keys[ i < bb->bfb_n ? i : bb->bfb_n - 1 ] );
+		if ( rc != SQL_SUCCESS ) {
+			Debug( LDAP_DEBUG_TRACE, "backsql_batch_fetch(): "
+				"error binding key value parameter #%d\n", i + 1 );
+			return LDAP_OTHER;
+		}
+	}
+
+	rc = SQLExecute( ba->bba_sth );
+	if ( !BACKSQL_SUCCESS( rc ) ) {
+		Debug( LDAP_DEBUG_TRACE, "backsql_batch_fetch(): "
+			"error executing batched query for attribute \"%s\"\n",
+			ba->bba_at->bam_ad->ad_cname.bv_val );
+		backsql_PrintErrors( bi->sql_db_env, bsi->bsi_dbh,
+				ba->bba_sth, rc );
+		SQLFreeStmt( ba->bba_sth, SQL_CLOSE );
+		return LDAP_OTHER;
+	}
+
+	backsql_BindRowAsStrings_x( ba->bba_sth, &row, op->o_tmpmemctx );
+	for ( rc = SQLFetch( ba->bba_sth );
+			BACKSQL_SUCCESS( rc );
+			rc = SQLFetch( ba->bba_sth ) )
+	{
+		struct berval	bv;
+#ifdef BACKSQL_ARBITRARY_KEY
+		struct berval	key;
+#else /* ! BACKSQL_ARBITRARY_KEY */
+		backsql_key_t	key;
+#endif /* ! BACKSQL_ARBITRARY_KEY */
+
+		if ( row.ncols < 2 || row.value_len[ 0 ] <= 0
+				|| row.value_len[ 1 ] <= 0 )
+		{
+			continue;
+		}
+
+#ifdef BACKSQL_ARBITRARY_KEY
+		ber_str2bv( row.cols[ 0 ], 0, 0, &key );
+#else /* ! BACKSQL_ARBITRARY_KEY */
+		if ( BACKSQL_STR2ID( &key, row.cols[ 0 ], 0 ) != 0 ) {
+			continue;
+		}
+#endif /* ! BACKSQL_ARBITRARY_KEY */
+
+		/* binary data: use the size read from the database,
+		 * see backsql_get_attr_vals() */
+		if ( BACKSQL_IS_BINARY( row.col_type[ 1 ] ) ) {
+			bv.bv_val = row.cols[ 1 ];
+			bv.bv_len = row.value_len[ 1 ];
+
+		} else {
+			ber_str2bv( row.cols[ 1 ], 0, 0, &bv );
+		}
+
+		for ( i = 0; i < bb->bfb_n; i++ ) {
+			struct berval	dup;
+
+#ifdef BACKSQL_ARBITRARY_KEY
+			if ( !bvmatch( &key, &bb->bfb_keys[ i ] ) )
+#else /* ! BACKSQL_ARBITRARY_KEY */
+			if ( key != bb->bfb_keys[ i ] )
+#endif /* ! BACKSQL_ARBITRARY_KEY */
+			{
+				continue;
+			}
+
+			ber_dupbv_x( &dup, &bv, op->o_tmpmemctx );
+			ber_bvarray_add_x( &ba->bba_vals[ i ], &dup,
+					op->o_tmpmemctx );
+		}
+	}
+	backsql_FreeRow_x( &row, op->o_tmpmemctx );
+	SQLFreeStmt( ba->bba_sth, SQL_CLOSE );
+	SQLFreeStmt( ba->bba_sth, SQL_UNBIND );
+
+	return LDAP_SUCCESS;
+}
+
+/*
+ * returns 0 and the values of the current entry if the attribute
+ * was fetched for its batch, 1 if it must be fetched by itself
+ */
+static int
+backsql_batch_get( backsql_srch_info *bsi, backsql_at_map_rec *at,
+	BerVarray *valsp )
+{
+	Operation		*op = bsi->bsi_op;
+	backsql_fetch_batch	*bb = bsi->bsi_batch;
+	backsql_batch_at	tmp,
+				*ba;
+
+	if ( bb == NULL || bb->bfb_n < 2
+			|| bb->bfb_eids[ bb->bfb_cur ] != bsi->bsi_c_eid )
+	{
+		return 1;
+	}
+
+	tmp.bba_at = at;
+	ba = ldap_avl_find( bb->bfb_attrs, &tmp, backsql_batch_at_cmp );
+	if ( ba == NULL ) {
+		ba = op->o_tmpcalloc( 1, sizeof( backsql_batch_at )
+				+ bb->bfb_max * sizeof( BerVarray ),
+				op->o_tmpmemctx );
+		ba->bba_at = at;
+		ba->bba_sth = SQL_NULL_HSTMT;
+		ba->bba_vals = (BerVarray *)&ba[ 1 ];
+		(void)ldap_avl_insert( &bb->bfb_attrs, ba,
+				backsql_batch_at_cmp, ldap_avl_dup_error );
+	}
+
+	if ( ba->bba_gen != bb->bfb_gen ) {
+		ba->bba_gen = bb->bfb_gen;
+		ba->bba_err = backsql_batch_fetch( bsi, ba );
+	}
+
+	if ( ba->bba_err != LDAP_SUCCESS ) {
+		return 1;
+	}
+
+	*valsp = ba->bba_vals[ bb->bfb_cur ];
+
+	return 0;
+}
+
+/*
+ * adds a value fetched for an attribute mapping to the entry being built
+ */
+static void
+backsql_get_attr_val(
+	backsql_srch_info	*bsi,
+	backsql_at_map_rec	*at,
+	struct berval		*val,
+	unsigned long		k
+#ifdef BACKSQL_COUNTQUERY
+	, Attribute		*attr,
+	unsigned		*jp
+#endif /* BACKSQL_COUNTQUERY */
+	)
+{
+	struct berval			bv = *val;
+#if defined(BACKSQL_PRETTY_VALIDATE) || defined(BACKSQL_COUNTQUERY)
+	int				retval;
+#endif
+#ifdef BACKSQL_COUNTQUERY
+	slap_mr_normalize_func		*normfunc = NULL;
+#endif /* BACKSQL_COUNTQUERY */
+#ifdef BACKSQL_PRETTY_VALIDATE
+	slap_syntax_validate_func	*validate;
+	slap_syntax_transform_func	*pretty;
+
+	validate = at->bam_true_ad->ad_type->sat_syntax->ssyn_validate;
+	pretty =  at->bam_true_ad->ad_type->sat_syntax->ssyn_pretty;
+
+	if ( pretty ) {
+		struct berval	pbv;
+
+		retval = pretty( at->bam_true_ad->ad_type->sat_syntax,
+			&bv, &pbv, bsi->bsi_op->o_tmpmemctx );
+		bv = pbv;
+
+	} else {
+		retval = validate( at->bam_true_ad->ad_type->sat_syntax,
+			&bv );
+	}
+
+	if ( retval != LDAP_SUCCESS ) {
+		/* FIXME: we're ignoring invalid values,
+		 * but we're accepting the attributes;
+		 * should we fail at all? */
+		Debug(LDAP_DEBUG_TRACE,
+		      "==>backsql_get_attr_vals(\"%s\"): " "unable to %s value #%lu " "of AttributeDescription %s (%d)\n",
+		      bsi->bsi_e->e_name.bv_val,
+		      pretty ? "prettify" : "validate",
+		      k,
+		      at->bam_ad->ad_cname.bv_val,
+		      retval );
+		return;
+	}
+#endif /* BACKSQL_PRETTY_VALIDATE */
+
+#ifndef BACKSQL_COUNTQUERY
+	(void)backsql_entry_addattr( bsi->bsi_e, 
+			at->bam_true_ad, &bv,
+			bsi->bsi_op->o_tmpmemctx );
+
+#else /* BACKSQL_COUNTQUERY */
+	if ( at->bam_true_ad->ad_type->sat_equality ) {
+		normfunc = at->bam_true_ad->ad_type->sat_equality->smr_normalize;
+	}
+
+	if ( normfunc ) {
+		struct berval	nbv;
+
+		retval = (*normfunc)( SLAP_MR_VALUE_OF_ATTRIBUTE_SYNTAX,
+			at->bam_true_ad->ad_type->sat_syntax,
+			at->bam_true_ad->ad_type->sat_equality,
+			&bv, &nbv,
+			bsi->bsi_op->o_tmpmemctx );
+
+		if ( retval != LDAP_SUCCESS ) {
+			/* FIXME: we're ignoring invalid values,
+			 * but we're accepting the attributes;
+			 * should we fail at all? */
+			Debug(LDAP_DEBUG_TRACE,
+			      "==>backsql_get_attr_vals(\"%s\"): " "unable to normalize value #%lu " "of AttributeDescription %s (%d)\n",
+			      bsi->bsi_e->e_name.bv_val,
+			      k,
+			      at->bam_ad->ad_cname.bv_val,
+			      retval );
+
+#ifdef BACKSQL_PRETTY_VALIDATE
+			if ( pretty ) {
+				bsi->bsi_op->o_tmpfree( bv.bv_val,
+						bsi->bsi_op->o_tmpmemctx );
+			}
+#endif /* BACKSQL_PRETTY_VALIDATE */
+
+			return;
+		}
+		ber_dupbv( &attr->a_nvals[ *jp ], &nbv );
+		bsi->bsi_op->o_tmpfree( nbv.bv_val,
+				bsi->bsi_op->o_tmpmemctx );
+	}
+
+	ber_dupbv( &attr->a_vals[ *jp ], &bv );
+
+	assert( *jp < attr->a_numvals );
+	(*jp)++;
+#endif /* BACKSQL_COUNTQUERY */
+
+#ifdef BACKSQL_PRETTY_VALIDATE
+	if ( pretty ) {
+		bsi->bsi_op->o_tmpfree( bv.bv_val,
+				bsi->bsi_op->o_tmpmemctx );
+	}
+#endif /* BACKSQL_PRETTY_VALIDATE */
+}
+
 static int
 backsql_get_attr_vals( void *v_at, void *v_bsi )
 {
@@ -506,6 +981,8 @@ backsql_get_attr_vals( void *v_at, void *v_bsi )
 	RETCODE			rc;
 	SQLHSTMT		sth = SQL_NULL_HSTMT;
 	BACKSQL_ROW_NTS		row;
+	BerVarray		vals = NULL;
+	int			batched;
 	unsigned long		i,
 				k = 0,
 				oldcount = 0,
@@ -542,6 +1019,9 @@ backsql_get_attr_vals( void *v_at, void *v_bsi )
 	}
 #endif /* BACKSQL_PRETTY_VALIDATE */
 
+	/* values already fetched along with the rest of the batch? */
+	batched = ( backsql_batch_get( bsi, at, &vals ) == 0 );
+
 #ifdef BACKSQL_COUNTQUERY
 	if ( at->bam_true_ad->ad_type->sat_equality ) {
 		normfunc = at->bam_true_ad->ad_type->sat_equality->smr_normalize;
@@ -551,6 +1031,12 @@ backsql_get_attr_vals( void *v_at, void *v_bsi )
 	 * fragmentation that can result from loading the values in 
 	 * one by one and using realloc() 
 	 */
+	if ( batched ) {
+		for ( count = 0; vals != NULL && !BER_BVISNULL( &vals[ count ] ); count++ )
+			/* count */ ;
+		goto got_count;
+	}
+
 	rc = backsql_Prepare( bsi->bsi_dbh, &sth, at->bam_countquery, 0 );
 	if ( rc != SQL_SUCCESS ) {
 		Debug( LDAP_DEBUG_TRACE, "backsql_get_attr_vals(): "
@@ -597,6 +1083,9 @@ backsql_get_attr_vals( void *v_at, void *v_bsi )
 	Debug( LDAP_DEBUG_TRACE, "backsql_get_attr_vals(): "
 		"number of values in query: %u\n", count );
 	SQLFreeStmt( sth, SQL_DROP );
+	sth = SQL_NULL_HSTMT;
+
+got_count:;
 	if ( count == 0 ) {
 		return 1;
 	}
@@ -656,6 +1145,20 @@ backsql_get_attr_vals( void *v_at, void *v_bsi )
 	}
 #endif /* BACKSQL_COUNTQUERY */
 
+	if ( batched ) {
+#ifdef BACKSQL_COUNTQUERY
+		j = oldcount;
+#endif /* BACKSQL_COUNTQUERY */
+		for ( k = 0; vals != NULL && !BER_BVISNULL( &vals[ k ] ); k++ ) {
+			backsql_get_attr_val( bsi, at, &vals[ k ], k
+#ifdef BACKSQL_COUNTQUERY
+					, attr, &j
+#endif /* BACKSQL_COUNTQUERY */
+					);
+		}
+		goto got_vals;
+	}
+
 	rc = backsql_Prepare( bsi->bsi_dbh, &sth, at->bam_query, 0 );
 	if ( rc != SQL_SUCCESS ) {
 		Debug( LDAP_DEBUG_TRACE, "backsql_get_attr_vals(): "
@@ -715,8 +1218,8 @@ backsql_get_attr_vals( void *v_at, void *v_bsi )
 
 			if ( row.value_len[ i ] > 0 ) {
 				struct berval		bv;
-				int			retval;
 #ifdef BACKSQL_TRACE
+				int			retval;
 				AttributeDescription	*ad = NULL;
 				const char		*text;
 
@@ -767,86 +1270,11 @@ backsql_get_attr_vals( void *v_at, void *v_bsi )
 					ber_str2bv( row.cols[ i ], 0, 0, &bv );
 				}
 
-#ifdef BACKSQL_PRETTY_VALIDATE
-				if ( pretty ) {
-					struct berval	pbv;
-
-					retval = pretty( at->bam_true_ad->ad_type->sat_syntax,
-						&bv, &pbv, bsi->bsi_op->o_tmpmemctx );
-					bv = pbv;
-
-				} else {
-					retval = validate( at->bam_true_ad->ad_type->sat_syntax,
-						&bv );
-				}
-
-				if ( retval != LDAP_SUCCESS ) {
-					/* FIXME: we're ignoring invalid values,
-					 * but we're accepting the attributes;
-					 * should we fail at all? */
-					Debug(LDAP_DEBUG_TRACE,
-					      "==>backsql_get_attr_vals(\"%s\"): " "unable to %s value #%lu " "of AttributeDescription %s (%d)\n",
-					      bsi->bsi_e->e_name.bv_val,
-					      pretty ? "prettify" : "validate",
-					      k - oldcount,
-					      at->bam_ad->ad_cname.bv_val,
-					      retval );
-					continue;
-				}
-#endif /* BACKSQL_PRETTY_VALIDATE */
-
-#ifndef BACKSQL_COUNTQUERY
-				(void)backsql_entry_addattr( bsi->bsi_e, 
-						at->bam_true_ad, &bv,
-						bsi->bsi_op->o_tmpmemctx );
-
-#else /* BACKSQL_COUNTQUERY */
-				if ( normfunc ) {
-					struct berval	nbv;
-
-					retval = (*normfunc)( SLAP_MR_VALUE_OF_ATTRIBUTE_SYNTAX,
-						at->bam_true_ad->ad_type->sat_syntax,
-						at->bam_true_ad->ad_type->sat_equality,
-						&bv, &nbv,
-						bsi->bsi_op->o_tmpmemctx );
-
-					if ( retval != LDAP_SUCCESS ) {
-						/* FIXME: we're ignoring invalid values,
-						 * but we're accepting the attributes;
-						 * should we fail at all? */
-						Debug(LDAP_DEBUG_TRACE,
-						      "==>backsql_get_attr_vals(\"%s\"): " "unable to normalize value #%lu " "of AttributeDescription %s (%d)\n",
-						      bsi->bsi_e->e_name.bv_val,
-						      k - oldcount,
-						      at->bam_ad->ad_cname.bv_val,
-						      retval );
-
-#ifdef BACKSQL_PRETTY_VALIDATE
-						if ( pretty ) {
-							bsi->bsi_op->o_tmpfree( bv.bv_val,
-									bsi->bsi_op->o_tmpmemctx );
-						}
-#endif /* BACKSQL_PRETTY_VALIDATE */
-
-						continue;
-					}
-					ber_dupbv( &attr->a_nvals[ j ], &nbv );
-					bsi->bsi_op->o_tmpfree( nbv.bv_val,
-							bsi->bsi_op->o_tmpmemctx );
-				}
-
-				ber_dupbv( &attr->a_vals[ j ], &bv );
-
-				assert( j < oldcount + count );
-				j++;
+				backsql_get_attr_val( bsi, at, &bv, k - oldcount
+#ifdef BACKSQL_COUNTQUERY
+						, attr, &j
 #endif /* BACKSQL_COUNTQUERY */
-
-#ifdef BACKSQL_PRETTY_VALIDATE
-				if ( pretty ) {
-					bsi->bsi_op->o_tmpfree( bv.bv_val,
-							bsi->bsi_op->o_tmpmemctx );
-				}
-#endif /* BACKSQL_PRETTY_VALIDATE */
+						);
 
 #ifdef BACKSQL_TRACE
 				Debug( LDAP_DEBUG_TRACE, "prec=%d\n",
@@ -861,6 +1289,7 @@ backsql_get_attr_vals( void *v_at, void *v_bsi )
 		}
 	}
 
+got_vals:;
 #ifdef BACKSQL_COUNTQUERY
 	if ( BER_BVISNULL( &attr->a_vals[ 0 ] ) ) {
 		/* don't leave around attributes with no values */
@@ -875,7 +1304,9 @@ backsql_get_attr_vals( void *v_at, void *v_bsi )
 	}
 #endif /* BACKSQL_COUNTQUERY */
 
-	SQLFreeStmt( sth, SQL_DROP );
+	if ( sth != SQL_NULL_HSTMT ) {
+		SQLFreeStmt( sth, SQL_DROP );
+	}
 	Debug( LDAP_DEBUG_TRACE, "<==backsql_get_attr_vals()\n" );
 
 	if ( at->bam_next ) {
@@ -887,7 +1318,9 @@ backsql_get_attr_vals( void *v_at, void *v_bsi )
 #ifdef BACKSQL_TRACE
 done:;
 #endif /* BACKSQL_TRACE */
-	backsql_FreeRow_x( &row, bsi->bsi_op->o_tmpmemctx );
+	if ( !batched ) {
+		backsql_FreeRow_x( &row, bsi->bsi_op->o_tmpmemctx );
+	}
 
 	return res;
 }
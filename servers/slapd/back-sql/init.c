@@ -108,6 +108,7 @@ backsql_db_init(
 	bi = (backsql_info *)ch_calloc( 1, sizeof( backsql_info ) );
 	ldap_pvt_thread_mutex_init( &bi->sql_dbconn_mutex );
 	ldap_pvt_thread_mutex_init( &bi->sql_schema_mutex );
+	bi->sql_fetch_batch = BACKSQL_FETCH_BATCH;
 
 	if ( backsql_init_db_env( bi ) != SQL_SUCCESS ) {
 		rc = -1;
@@ -135,6 +135,16 @@ backsql_free_entryID( backsql_entryID *id, int freeit, void *ctx );
 extern int
 backsql_id2entry( backsql_srch_info *bsi, backsql_entryID *id );
 
+/* batched fetch of the attribute values of the candidates */
+extern void
+backsql_batch_init( backsql_srch_info *bsi );
+
+extern void
+backsql_batch_next( backsql_srch_info *bsi, backsql_entryID *eid );
+
+extern void
+backsql_batch_destroy( backsql_srch_info *bsi );
+
 /* duplicate an entryID */
 extern backsql_entryID *
 backsql_entryID_dup( backsql_entryID *eid, void *ctx );
@@ -187,6 +187,55 @@ backsql_make_attr_query(
 	at_map->bam_countquery = bb.bb_val.bv_val;
 #endif /* BACKSQL_COUNTQUERY */
 
+	/* Query for a batch of entries, the key list goes in between.
+
+	SELECT <keytbl>.<keycol>,<sel_expr> AS <ad_name>
+		FROM <from_tbls> WHERE <keytbl>.<keycol> IN (
+	) [ AND <join_where> ] ORDER BY <ad_name>
+
+	 */
+	BER_BVZERO( &bb.bb_val );
+	bb.bb_len = 0;
+	backsql_strfcat_x( &bb, NULL, "lbcblblbbbblblbcbl",
+			(ber_len_t)STRLENOF( "SELECT " ), "SELECT ",
+			&oc_map->bom_keytbl,
+			'.',
+			&oc_map->bom_keycol,
+			(ber_len_t)STRLENOF( "," ), ",",
+			&at_map->bam_sel_expr,
+			(ber_len_t)STRLENOF( " " ), " ",
+			&bi->sql_aliasing,
+			&bi->sql_aliasing_quote,
+			&at_map->bam_ad->ad_cname,
+			&bi->sql_aliasing_quote,
+			(ber_len_t)STRLENOF( " FROM " ), " FROM ",
+			&at_map->bam_from_tbls,
+			(ber_len_t)STRLENOF( " WHERE " ), " WHERE ",
+			&oc_map->bom_keytbl,
+			'.',
+			&oc_map->bom_keycol,
+			(ber_len_t)STRLENOF( " IN (" ), " IN (" );
+
+	at_map->bam_batch_query = bb.bb_val.bv_val;
+
+	BER_BVZERO( &bb.bb_val );
+	bb.bb_len = 0;
+	backsql_strfcat_x( &bb, NULL, "c", ')' );
+
+	if ( !BER_BVISNULL( &at_map->bam_join_where ) ) {
+		backsql_strfcat_x( &bb, NULL, "lb",
+				(ber_len_t)STRLENOF( " AND " ), " AND ", 
+				&at_map->bam_join_where );
+	}
+
+	backsql_strfcat_x( &bb, NULL, "lbbb", 
+			(ber_len_t)STRLENOF( " ORDER BY " ), " ORDER BY ",
+			&bi->sql_aliasing_quote,
+			&at_map->bam_ad->ad_cname,
+			&bi->sql_aliasing_quote );
+
+	at_map->bam_batch_tail = bb.bb_val.bv_val;
+
 	return 0;
 }
 
@@ -276,6 +325,10 @@ backsql_add_sysmaps( backsql_info *bi, backsql_oc_map_rec *oc_map )
 
 	/* FIXME: we need to correct the objectClass join_where 
 	 * after the attribute query is built */
+	/* NOTE: all the queries that load the attribute, including
+	 * the batched one, must be built above: the join_where below
+	 * does not restrict ldap_entry_objclasses to the entry, and
+	 * would make it a cross join */
 	ch_free( at_map->bam_join_where.bv_val );
 	BER_BVZERO( &bb.bb_val );
 	bb.bb_len = 0;
@@ -955,6 +1008,12 @@ backsql_free_attr( void *v_at )
 	if ( at->bam_query != NULL ) {
 		ch_free( at->bam_query );
 	}
+	if ( at->bam_batch_query != NULL ) {
+		ch_free( at->bam_batch_query );
+	}
+	if ( at->bam_batch_tail != NULL ) {
+		ch_free( at->bam_batch_tail );
+	}
 
 #ifdef BACKSQL_COUNTQUERY
 	if ( at->bam_countquery != NULL ) {
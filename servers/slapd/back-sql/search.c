@@ -189,6 +189,7 @@ backsql_init_search(
 	bsi->bsi_op = op;
 	bsi->bsi_rs = rs;
 	bsi->bsi_flags = BSQL_SF_NONE;
+	bsi->bsi_batch = NULL;
 
 	bsi->bsi_attrs = NULL;
 
@@ -2292,7 +2293,9 @@ backsql_search( Operation *op, SlapReply *rs )
 	 * now we load candidate entries (only those attributes 
 	 * mentioned in attrs and filter), test it against full filter 
 	 * and then send to client; don't free entry_id if baseObject...
+	 * attribute values are fetched for a batch of entries at once
 	 */
+	backsql_batch_init( &bsi );
 	for ( eid = bsi.bsi_id_list;
 		eid != NULL; 
 		eid = backsql_free_entryID( 
@@ -2327,6 +2330,8 @@ backsql_search( Operation *op, SlapReply *rs )
 			eid->eid_oc_id,
 			BACKSQL_IDARG(eid->eid_keyval) );
 
+		backsql_batch_next( &bsi, eid );
+
 		/* check scope */
 		switch ( op->ors_scope ) {
 		case LDAP_SCOPE_BASE:
@@ -2620,6 +2625,7 @@ send_results:;
 #endif /* BACKSQL_SYNCPROV */
 
 done:;
+	backsql_batch_destroy( &bsi );
 	(void)backsql_free_entryID( &bsi.bsi_base_id, 0, op->o_tmpmemctx );
 
 	if ( bsi.bsi_attrs != NULL ) {
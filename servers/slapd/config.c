@@ -1553,6 +1553,24 @@ slap_tls_get_config( LDAP *ld, int opt, char **val )
 		*val = ch_strdup( buf );
 		return 0;
 		}
+#ifdef HAVE_OPENSSL
+	case LDAP_OPT_X_TLS_SESSION_CACHE:
+	case LDAP_OPT_X_TLS_SESSION_LIFETIME: {
+		char buf[16];
+		ldap_pvt_tls_get_option( ld, opt, &ival );
+		if ( ival ) {
+			snprintf( buf, sizeof( buf ), "%d", ival );
+			*val = ch_strdup( buf );
+		}
+		return 0;
+		}
+	case LDAP_OPT_X_TLS_KTLS:
+		ldap_pvt_tls_get_option( ld, opt, &ival );
+		if ( ival ) {
+			*val = ch_strdup( "TRUE" );
+		}
+		return 0;
+#endif
 	default:
 		return -1;
 	}
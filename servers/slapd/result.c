@@ -1025,18 +1025,32 @@ slap_send_ldap_intermediate( Operation *op, SlapReply *rs )
  * LDAP_SIZELIMIT_EXCEEDED	entry not sent (caller must send sizelimitExceeded)
  */
 
+typedef struct EntryAttr {
+	Attribute	*ea_attr;
+	char		*ea_flags;	/* values to send, NULL for none */
+	ber_len_t	ea_len;		/* length of the encoded values */
+} EntryAttr;
+
 int
 slap_send_search_entry( Operation *op, SlapReply *rs )
 {
-	BerElementBuffer berbuf;
+	BerElementBuffer berbuf, cberbuf;
 	BerElement	*ber = (BerElement *) &berbuf;
+	BerElement	*cber = (BerElement *) &cberbuf;
 	Attribute	*a;
-	int		i, j, rc = LDAP_UNAVAILABLE, bytes;
+	int		i, j, k, rc = LDAP_UNAVAILABLE, bytes;
 	int		userattrs;
 	AccessControlState acl_state = ACL_STATE_INIT;
 	int			 attrsonly;
 	AttributeDescription *ad_entry = slap_schema.si_ad_entry;
 
+	/* attributes to send, with the values selected in ea_flags */
+	EntryAttr	*eattrs = NULL;
+	char		*vflags = NULL;
+	int		nattrs = 0, nvals = 0, neattrs = 0, envelope;
+	ber_len_t	attrs_len, entry_len, msg_len;
+	struct berval	ctrls;
+
 	/* a_flags: array of flags telling if the i-th element will be
 	 *          returned or filtered out
 	 * e_flags: array of a_flags
@@ -1096,54 +1110,28 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 		goto error_return;
 	}
 
-	if ( op->o_res_ber ) {
-		/* read back control or LDAP_CONNECTIONLESS */
-	    ber = op->o_res_ber;
-	} else {
-		struct berval	bv;
-
-		bv.bv_len = entry_flatsize( rs->sr_entry, 0 );
-		bv.bv_val = op->o_tmpalloc( bv.bv_len, op->o_tmpmemctx );
+	/* check for special all user attributes ("*") type */
+	userattrs = SLAP_USERATTRS( rs->sr_attr_flags );
 
-		ber_init2( ber, &bv, LBER_USE_DER );
-		ber_set_option( ber, LBER_OPT_BER_MEMCTX, &op->o_tmpmemctx );
+	/* Decide what gets sent first, the entry is then encoded in a
+	 * single pass once all the lengths are known
+	 */
+	for ( a = rs->sr_entry->e_attrs; a != NULL; a = a->a_next ) {
+		for ( i = 0; a->a_vals[i].bv_val != NULL; i++ );
+		nattrs++;
+		nvals += i;
 	}
-
-#ifdef LDAP_CONNECTIONLESS
-	if ( op->o_conn && op->o_conn->c_is_udp ) {
-		/* CONNECTIONLESS */
-		if ( op->o_protocol == LDAP_VERSION2 ) {
-	    	rc = ber_printf(ber, "t{O{" /*}}*/,
-				LDAP_RES_SEARCH_ENTRY, &rs->sr_entry->e_name );
-		} else {
-	    	rc = ber_printf( ber, "{it{O{" /*}}}*/, op->o_msgid,
-				LDAP_RES_SEARCH_ENTRY, &rs->sr_entry->e_name );
-		}
-	} else
-#endif
-	if ( op->o_res_ber ) {
-		/* read back control */
-	    rc = ber_printf( ber, "t{O{" /*}}*/,
-			LDAP_RES_SEARCH_ENTRY, &rs->sr_entry->e_name );
-	} else {
-	    rc = ber_printf( ber, "{it{O{" /*}}}*/, op->o_msgid,
-			LDAP_RES_SEARCH_ENTRY, &rs->sr_entry->e_name );
+	for ( a = rs->sr_operational_attrs; a != NULL; a = a->a_next ) {
+		for ( i = 0; a->a_vals[i].bv_val != NULL; i++ );
+		nattrs++;
+		nvals += i;
 	}
-
-	if ( rc == -1 ) {
-		Debug( LDAP_DEBUG_ANY, 
-			"send_search_entry: conn %lu  ber_printf failed\n", 
-			op->o_connid );
-
-		if ( op->o_res_ber == NULL ) ber_free_buf( ber );
-		set_ldap_error( rs, LDAP_OTHER, "encoding DN error" );
-		rc = rs->sr_err;
-		goto error_return;
+	if ( nattrs ) {
+		eattrs = op->o_tmpalloc( nattrs * sizeof(EntryAttr) + nvals,
+			op->o_tmpmemctx );
+		vflags = (char *)(eattrs + nattrs);
 	}
 
-	/* check for special all user attributes ("*") type */
-	userattrs = SLAP_USERATTRS( rs->sr_attr_flags );
-
 	/* create an array of arrays of flags. Each flag corresponds
 	 * to particular value of attribute and equals 1 if value matches
 	 * to ValuesReturnFilter or 0 if not
@@ -1164,7 +1152,6 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 		    	Debug( LDAP_DEBUG_ANY, 
 					"send_search_entry: conn %lu slap_sl_calloc failed\n",
 					op->o_connid );
-				ber_free( ber, 1 );
 	
 				set_ldap_error( rs, LDAP_OTHER, "out of memory" );
 				goto error_return;
@@ -1182,7 +1169,6 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 			    	Debug( LDAP_DEBUG_ANY, "send_search_entry: "
 					"conn %lu matched values filtering failed\n",
 					op->o_connid );
-				if ( op->o_res_ber == NULL ) ber_free_buf( ber );
 				set_ldap_error( rs, LDAP_OTHER,
 					"matched values filtering error" );
 				rc = rs->sr_err;
@@ -1193,7 +1179,7 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 
 	for ( a = rs->sr_entry->e_attrs, j = 0; a != NULL; a = a->a_next, j++ ) {
 		AttributeDescription *desc = a->a_desc;
-		int finish = 0;
+		EntryAttr *ea;
 
 		if ( rs->sr_attrs == NULL ) {
 			/* all user attrs request, skip operational attributes */
@@ -1231,22 +1217,15 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 				continue;
 			}
 
-			if (( rc = ber_printf( ber, "{O[" /*]}*/ , &desc->ad_cname )) == -1 ) {
-				Debug( LDAP_DEBUG_ANY, 
-					"send_search_entry: conn %lu  ber_printf failed\n", 
-					op->o_connid );
-
-				if ( op->o_res_ber == NULL ) ber_free_buf( ber );
-				set_ldap_error( rs, LDAP_OTHER,
-					"encoding description error");
-				rc = rs->sr_err;
-				goto error_return;
-			}
-			finish = 1;
+			ea = &eattrs[neattrs++];
+			ea->ea_attr = a;
+			ea->ea_flags = NULL;
 
 		} else {
 			int first = 1;
 			for ( i = 0; a->a_nvals[i].bv_val != NULL; i++ ) {
+				vflags[i] = 0;
+
 				if ( ! access_allowed( op, rs->sr_entry,
 					desc, &a->a_nvals[i], ACL_READ, &acl_state ) )
 				{
@@ -1262,44 +1241,16 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 					continue;
 				}
 
-				if ( first ) {
-					first = 0;
-					finish = 1;
-					if (( rc = ber_printf( ber, "{O[" /*]}*/ , &desc->ad_cname )) == -1 ) {
-						Debug( LDAP_DEBUG_ANY,
-							"send_search_entry: conn %lu  ber_printf failed\n", 
-							op->o_connid );
-
-						if ( op->o_res_ber == NULL ) ber_free_buf( ber );
-						set_ldap_error( rs, LDAP_OTHER,
-							"encoding description error");
-						rc = rs->sr_err;
-						goto error_return;
-					}
-				}
-				if (( rc = ber_printf( ber, "O", &a->a_vals[i] )) == -1 ) {
-					Debug( LDAP_DEBUG_ANY,
-						"send_search_entry: conn %lu  "
-						"ber_printf failed.\n", op->o_connid );
-
-					if ( op->o_res_ber == NULL ) ber_free_buf( ber );
-					set_ldap_error( rs, LDAP_OTHER,
-						"encoding values error" );
-					rc = rs->sr_err;
-					goto error_return;
-				}
+				vflags[i] = 1;
+				first = 0;
 			}
-		}
 
-		if ( finish && ( rc = ber_printf( ber, /*{[*/ "]N}" )) == -1 ) {
-			Debug( LDAP_DEBUG_ANY,
-				"send_search_entry: conn %lu ber_printf failed\n", 
-				op->o_connid );
-
-			if ( op->o_res_ber == NULL ) ber_free_buf( ber );
-			set_ldap_error( rs, LDAP_OTHER, "encode end error" );
-			rc = rs->sr_err;
-			goto error_return;
+			if ( !first ) {
+				ea = &eattrs[neattrs++];
+				ea->ea_attr = a;
+				ea->ea_flags = vflags;
+				vflags += i;
+			}
 		}
 	}
 
@@ -1329,7 +1280,6 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 					"not enough memory "
 					"for matched values filtering\n",
 					op->o_connid );
-				if ( op->o_res_ber == NULL ) ber_free_buf( ber );
 				set_ldap_error( rs, LDAP_OTHER,
 					"not enough memory for matched values filtering" );
 				goto error_return;
@@ -1349,7 +1299,6 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 					"send_search_entry: conn %lu "
 					"matched values filtering failed\n", 
 					op->o_connid );
-				if ( op->o_res_ber == NULL ) ber_free_buf( ber );
 				set_ldap_error( rs, LDAP_OTHER,
 					"matched values filtering error" );
 				rc = rs->sr_err;
@@ -1360,6 +1309,7 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 
 	for (a = rs->sr_operational_attrs, j=0; a != NULL; a = a->a_next, j++ ) {
 		AttributeDescription *desc = a->a_desc;
+		EntryAttr *ea;
 
 		if ( rs->sr_attrs == NULL ) {
 			/* all user attrs request, skip operational attributes */
@@ -1397,21 +1347,14 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 			continue;
 		}
 
-		rc = ber_printf( ber, "{O[" /*]}*/ , &desc->ad_cname );
-		if ( rc == -1 ) {
-			Debug( LDAP_DEBUG_ANY,
-				"send_search_entry: conn %lu  "
-				"ber_printf failed\n", op->o_connid );
-
-			if ( op->o_res_ber == NULL ) ber_free_buf( ber );
-			set_ldap_error( rs, LDAP_OTHER,
-				"encoding description error" );
-			rc = rs->sr_err;
-			goto error_return;
-		}
+		ea = &eattrs[neattrs++];
+		ea->ea_attr = a;
+		ea->ea_flags = NULL;
 
 		if ( ! attrsonly ) {
 			for ( i = 0; a->a_vals[i].bv_val != NULL; i++ ) {
+				vflags[i] = 0;
+
 				if ( ! access_allowed( op, rs->sr_entry,
 					desc, &a->a_vals[i], ACL_READ, &acl_state ) )
 				{
@@ -1427,29 +1370,10 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 					continue;
 				}
 
-				if (( rc = ber_printf( ber, "O", &a->a_vals[i] )) == -1 ) {
-					Debug( LDAP_DEBUG_ANY,
-						"send_search_entry: conn %lu  ber_printf failed\n", 
-						op->o_connid );
-
-					if ( op->o_res_ber == NULL ) ber_free_buf( ber );
-					set_ldap_error( rs, LDAP_OTHER,
-						"encoding values error" );
-					rc = rs->sr_err;
-					goto error_return;
-				}
+				vflags[i] = 1;
 			}
-		}
-
-		if (( rc = ber_printf( ber, /*{[*/ "]N}" )) == -1 ) {
-			Debug( LDAP_DEBUG_ANY,
-				"send_search_entry: conn %lu  ber_printf failed\n",
-				op->o_connid );
-
-			if ( op->o_res_ber == NULL ) ber_free_buf( ber );
-			set_ldap_error( rs, LDAP_OTHER, "encode end error" );
-			rc = rs->sr_err;
-			goto error_return;
+			ea->ea_flags = vflags;
+			vflags += i;
 		}
 	}
 
@@ -1459,30 +1383,125 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 		e_flags = NULL;
 	}
 
-	rc = ber_printf( ber, /*{{*/ "}N}" );
+	/* Work out the lengths, innermost first */
+	attrs_len = 0;
+	for ( k = 0; k < neattrs; k++ ) {
+		EntryAttr *ea = &eattrs[k];
+		ber_len_t len;
 
-	if( rc != -1 ) {
-		rc = send_ldap_controls( op, ber, rs->sr_ctrls );
+		ea->ea_len = 0;
+		if ( ea->ea_flags ) {
+			for ( i = 0; ea->ea_attr->a_vals[i].bv_val != NULL; i++ ) {
+				if ( !ea->ea_flags[i] ) continue;
+				len = ea->ea_attr->a_vals[i].bv_len;
+				ea->ea_len += ber_sizeof_header( LBER_OCTETSTRING, len ) + len;
+			}
+		}
+		len = ea->ea_attr->a_desc->ad_cname.bv_len;
+		len += ber_sizeof_header( LBER_OCTETSTRING, len ) +
+			ber_sizeof_header( LBER_SET, ea->ea_len ) + ea->ea_len;
+		attrs_len += ber_sizeof_header( LBER_SEQUENCE, len ) + len;
+	}
+	entry_len = ber_sizeof_header( LBER_OCTETSTRING, rs->sr_entry->e_name.bv_len ) +
+		rs->sr_entry->e_name.bv_len +
+		ber_sizeof_header( LBER_SEQUENCE, attrs_len ) + attrs_len;
+	msg_len = ber_sizeof_header( LDAP_RES_SEARCH_ENTRY, entry_len ) + entry_len;
+
+	if ( rs->sr_ctrls ) {
+		/* Rare enough to go through ber_printf */
+		ber_init2( cber, NULL, LBER_USE_DER );
+		ber_set_option( cber, LBER_OPT_BER_MEMCTX, &op->o_tmpmemctx );
+		if ( send_ldap_controls( op, cber, rs->sr_ctrls ) == -1 ||
+			ber_flatten2( cber, &ctrls, 0 ) == -1 )
+		{
+			Debug( LDAP_DEBUG_ANY,
+				"send_search_entry: conn %lu op %lu "
+				"ber encoding of controls failed\n",
+				op->o_connid, op->o_opid );
+
+			ber_free_buf( cber );
+			set_ldap_error( rs, LDAP_OTHER, "encode entry end error" );
+			rc = rs->sr_err;
+			goto error_return;
+		}
+		msg_len += ctrls.bv_len;
 	}
 
-	if( rc != -1 ) {
+	/* The LDAPMessage envelope, except for the read back control and
+	 * connectionless LDAPv2
+	 */
 #ifdef LDAP_CONNECTIONLESS
-		if( op->o_conn && op->o_conn->c_is_udp ) {
-			if ( op->o_protocol != LDAP_VERSION2 ) {
-				rc = ber_printf( ber, /*{*/ "N}" );
-			}
-		} else
+	if ( op->o_conn && op->o_conn->c_is_udp ) {
+		envelope = op->o_protocol != LDAP_VERSION2;
+	} else
 #endif
-		if ( op->o_res_ber == NULL ) {
-			rc = ber_printf( ber, /*{*/ "N}" );
+	envelope = op->o_res_ber == NULL;
+	if ( envelope ) {
+		msg_len += ber_sizeof_int( op->o_msgid, LBER_INTEGER );
+	}
+
+	if ( op->o_res_ber ) {
+		/* read back control or LDAP_CONNECTIONLESS */
+	    ber = op->o_res_ber;
+	} else {
+		struct berval	bv;
+
+		bv.bv_len = msg_len;
+		if ( envelope ) {
+			bv.bv_len += ber_sizeof_header( LBER_SEQUENCE, msg_len );
+		}
+		bv.bv_val = op->o_tmpalloc( bv.bv_len, op->o_tmpmemctx );
+
+		ber_init2( ber, &bv, LBER_USE_DER );
+		ber_set_option( ber, LBER_OPT_BER_MEMCTX, &op->o_tmpmemctx );
+	}
+
+	rc = 0;
+	if ( envelope ) {
+		rc = ber_put_header( ber, LBER_SEQUENCE, msg_len );
+		if ( rc != -1 )
+			rc = ber_put_int( ber, op->o_msgid, LBER_INTEGER );
+	}
+	if ( rc != -1 )
+		rc = ber_put_header( ber, LDAP_RES_SEARCH_ENTRY, entry_len );
+	if ( rc != -1 )
+		rc = ber_put_berval( ber, &rs->sr_entry->e_name, LBER_OCTETSTRING );
+	if ( rc != -1 )
+		rc = ber_put_header( ber, LBER_SEQUENCE, attrs_len );
+
+	for ( k = 0; k < neattrs && rc != -1; k++ ) {
+		EntryAttr *ea = &eattrs[k];
+		struct berval *name = &ea->ea_attr->a_desc->ad_cname;
+
+		rc = ber_put_header( ber, LBER_SEQUENCE,
+			ber_sizeof_header( LBER_OCTETSTRING, name->bv_len ) + name->bv_len +
+			ber_sizeof_header( LBER_SET, ea->ea_len ) + ea->ea_len );
+		if ( rc != -1 )
+			rc = ber_put_berval( ber, name, LBER_OCTETSTRING );
+		if ( rc != -1 )
+			rc = ber_put_header( ber, LBER_SET, ea->ea_len );
+		if ( ea->ea_flags == NULL )
+			continue;
+		for ( i = 0; ea->ea_attr->a_vals[i].bv_val != NULL && rc != -1; i++ ) {
+			if ( ea->ea_flags[i] )
+				rc = ber_put_berval( ber, &ea->ea_attr->a_vals[i],
+					LBER_OCTETSTRING );
 		}
 	}
 
+	if ( rs->sr_ctrls ) {
+		if ( rc != -1 )
+			rc = ber_write( ber, ctrls.bv_val, ctrls.bv_len, 0 );
+		ber_free_buf( cber );
+	}
+
 	if ( rc == -1 ) {
-		Debug( LDAP_DEBUG_ANY, "ber_printf failed\n" );
+		Debug( LDAP_DEBUG_ANY,
+			"send_search_entry: conn %lu  ber encoding failed\n", 
+			op->o_connid );
 
 		if ( op->o_res_ber == NULL ) ber_free_buf( ber );
-		set_ldap_error( rs, LDAP_OTHER, "encode entry end error" );
+		set_ldap_error( rs, LDAP_OTHER, "encoding entry error" );
 		rc = rs->sr_err;
 		goto error_return;
 	}
@@ -1527,6 +1546,10 @@ error_return:;
 		slap_sl_free( e_flags, op->o_tmpmemctx );
 	}
 
+	if ( eattrs ) {
+		op->o_tmpfree( eattrs, op->o_tmpmemctx );
+	}
+
 	/* FIXME: Can break if rs now contains an extended response */
 	if ( rs->sr_operational_attrs ) {
 		attrs_free( rs->sr_operational_attrs );
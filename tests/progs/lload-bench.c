@@ -0,0 +1,836 @@
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1999-2024 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/*
+ * This tool measures the overhead lloadd adds to operations. It runs a fake
+ * LDAP server that answers every request with canned responses after a
+ * configurable delay, lloadd is expected to be configured with this server
+ * as its only backend. The same workload is then run against the fake server
+ * directly and through lloadd (-H) and the latency percentiles and throughput
+ * of both are reported, along with the difference.
+ */
+
+#include "portable.h"
+
+/* Requires libldap with threads */
+#ifndef NO_THREADS
+
+#include <stdio.h>
+#include "ldap_pvt_thread.h"
+
+#include "ac/stdlib.h"
+
+#include "ac/errno.h"
+#include "ac/signal.h"
+#include "ac/socket.h"
+#include "ac/string.h"
+#include "ac/time.h"
+#include "ac/unistd.h"
+
+#include <netinet/tcp.h>
+
+#include "ldap.h"
+#include "lutil.h"
+
+#include "ldap_pvt.h"
+
+#include "slapd-common.h"
+
+#define LOOPS	1000
+#define MAX_THREAD	1024
+#define MAX_LISTENERS	8
+#define BENCH_BASE	"dc=example,dc=com"
+#define BUSY_RETRIES	10
+
+enum {
+	WORKLOAD_BIND,
+	WORKLOAD_SEARCH,
+	WORKLOAD_PIPELINE
+};
+
+static const char *workloads[] = { "bind", "search", "pipeline", NULL };
+
+/*
+ * Fake upstream
+ */
+typedef struct bench_job {
+	struct bench_job *bj_next;
+	struct timeval bj_due;
+	ber_int_t bj_msgid;
+	ber_tag_t bj_tag;
+} bench_job;
+
+typedef struct bench_conn {
+	Sockbuf *bc_sb;
+	ldap_pvt_thread_mutex_t bc_mutex;
+	ldap_pvt_thread_cond_t bc_cond;
+	bench_job *bc_head, **bc_tail;
+	int bc_closing;
+} bench_conn;
+
+static int upstream_latency = 0;	/* microseconds */
+static int upstream_entries = 1;
+static struct berval upstream_value;
+
+/*
+ * Load generator
+ */
+typedef struct bench_thread {
+	ldap_pvt_thread_t bt_tid;
+	unsigned long *bt_latency;	/* microseconds, one per operation */
+	int bt_done, bt_failed;
+	int bt_busy;	/* busy results retried so far */
+} bench_thread;
+
+typedef struct bench_result {
+	double br_qps;
+	unsigned long br_percentile[5];	/* p50, p90, p99, p99.9, max */
+	int br_done, br_failed;
+} bench_result;
+
+static struct tester_conn_args *config;
+static int workload = WORKLOAD_SEARCH;
+static int threads = 1;
+static int depth = 8;
+static int verbose = 0;
+
+static bench_thread bthreads[MAX_THREAD];
+static ldap_pvt_thread_mutex_t start_mutex;
+static ldap_pvt_thread_cond_t start_cond;
+static int ready, started;
+
+static void
+usage( char *name, char opt )
+{
+	if ( opt ) {
+		fprintf( stderr, "%s: unable to handle option \'%c\'\n\n",
+			name, opt );
+	}
+
+	fprintf( stderr, "usage: %s " TESTER_COMMON_HELP
+		"-p <port> "
+		"[-B] "
+		"[-S] "
+		"[-v] "
+		"[-e <entries>] "
+		"[-m <threads>] "
+		"[-P <depth>] "
+		"[-s <value size>] "
+		"[-u <latency us>] "
+		"[-W bind|search|pipeline] "
+		"\n",
+		name );
+	exit( EXIT_FAILURE );
+}
+
+static void
+tv_add_us( struct timeval *tv, long us )
+{
+	tv->tv_usec += us;
+	tv->tv_sec += tv->tv_usec / 1000000;
+	tv->tv_usec %= 1000000;
+}
+
+static long
+tv_diff_us( struct timeval *end, struct timeval *start )
+{
+	return ( end->tv_sec - start->tv_sec ) * 1000000L +
+		( end->tv_usec - start->tv_usec );
+}
+
+static int
+upstream_respond( Sockbuf *sb, ber_int_t msgid, ber_tag_t tag )
+{
+	BerElement *ber;
+	ber_tag_t restag;
+	ber_int_t rc = LDAP_SUCCESS;
+	char dn[64];
+	int i;
+
+	switch ( tag ) {
+	case LDAP_REQ_BIND:
+		restag = LDAP_RES_BIND;
+		break;
+	case LDAP_REQ_SEARCH:
+		for ( i = 0; i < upstream_entries; i++ ) {
+			ber = ber_alloc_t( LBER_USE_DER );
+			if ( ber == NULL ) {
+				return -1;
+			}
+			snprintf( dn, sizeof(dn), "cn=entry %d," BENCH_BASE, i );
+			if ( ber_printf( ber, "{it{s{{s[O]}}}}", msgid,
+					LDAP_RES_SEARCH_ENTRY, dn, "description",
+					&upstream_value ) == -1 ||
+				ber_flush2( sb, ber, LBER_FLUSH_FREE_ALWAYS ) )
+			{
+				return -1;
+			}
+		}
+		restag = LDAP_RES_SEARCH_RESULT;
+		break;
+	case LDAP_REQ_EXTENDED:
+		restag = LDAP_RES_EXTENDED;
+		break;
+	case LDAP_REQ_ADD:
+		restag = LDAP_RES_ADD;
+		rc = LDAP_UNWILLING_TO_PERFORM;
+		break;
+	case LDAP_REQ_DELETE:
+		restag = LDAP_RES_DELETE;
+		rc = LDAP_UNWILLING_TO_PERFORM;
+		break;
+	case LDAP_REQ_MODIFY:
+		restag = LDAP_RES_MODIFY;
+		rc = LDAP_UNWILLING_TO_PERFORM;
+		break;
+	case LDAP_REQ_MODDN:
+		restag = LDAP_RES_MODDN;
+		rc = LDAP_UNWILLING_TO_PERFORM;
+		break;
+	case LDAP_REQ_COMPARE:
+		restag = LDAP_RES_COMPARE;
+		rc = LDAP_UNWILLING_TO_PERFORM;
+		break;
+	default:
+		return -1;
+	}
+
+	ber = ber_alloc_t( LBER_USE_DER );
+	if ( ber == NULL ) {
+		return -1;
+	}
+	if ( ber_printf( ber, "{it{ess}}", msgid, restag, rc, "", "" ) == -1 ) {
+		ber_free( ber, 1 );
+		return -1;
+	}
+	return ber_flush2( sb, ber, LBER_FLUSH_FREE_ALWAYS );
+}
+
+/*
+ * Sends the queued responses once they are due. The delay is the same for
+ * every request so the queue is always sorted.
+ */
+static void *
+upstream_writer( void *arg )
+{
+	bench_conn *bc = arg;
+	bench_job *job;
+	struct timeval now, tv;
+	long wait;
+
+	ldap_pvt_thread_mutex_lock( &bc->bc_mutex );
+	for ( ;; ) {
+		while ( !bc->bc_head && !bc->bc_closing ) {
+			ldap_pvt_thread_cond_wait( &bc->bc_cond, &bc->bc_mutex );
+		}
+		if ( !bc->bc_head ) {
+			break;
+		}
+		job = bc->bc_head;
+		ldap_pvt_thread_mutex_unlock( &bc->bc_mutex );
+
+		gettimeofday( &now, NULL );
+		wait = tv_diff_us( &job->bj_due, &now );
+		if ( wait > 0 ) {
+			tv.tv_sec = wait / 1000000;
+			tv.tv_usec = wait % 1000000;
+			select( 0, NULL, NULL, NULL, &tv );
+		}
+
+		ldap_pvt_thread_mutex_lock( &bc->bc_mutex );
+		bc->bc_head = job->bj_next;
+		if ( !bc->bc_head ) {
+			bc->bc_tail = &bc->bc_head;
+		}
+		ldap_pvt_thread_mutex_unlock( &bc->bc_mutex );
+
+		if ( upstream_respond( bc->bc_sb, job->bj_msgid, job->bj_tag ) ) {
+			/* The reader will notice the connection is gone */
+			ber_sockbuf_ctrl( bc->bc_sb, LBER_SB_OPT_DRAIN, NULL );
+		}
+		free( job );
+
+		ldap_pvt_thread_mutex_lock( &bc->bc_mutex );
+	}
+	ldap_pvt_thread_mutex_unlock( &bc->bc_mutex );
+	return NULL;
+}
+
+static void *
+upstream_conn( void *arg )
+{
+	bench_conn *bc = arg;
+	BerElement *ber = NULL;
+	ber_tag_t tag;
+	ber_len_t len;
+	ber_int_t msgid;
+	ldap_pvt_thread_t writer;
+	bench_job *job;
+
+	if ( upstream_latency ) {
+		ldap_pvt_thread_create( &writer, 0, upstream_writer, bc );
+	}
+
+	for ( ;; ) {
+		if ( ber == NULL && ( ber = ber_alloc() ) == NULL ) {
+			break;
+		}
+		tag = ber_get_next( bc->bc_sb, &len, ber );
+		if ( tag != LDAP_TAG_MESSAGE ) {
+			break;
+		}
+		if ( ber_get_int( ber, &msgid ) != LDAP_TAG_MSGID ) {
+			break;
+		}
+		tag = ber_peek_tag( ber, &len );
+		ber_free( ber, 1 );
+		ber = NULL;
+
+		if ( tag == LDAP_REQ_UNBIND ) {
+			break;
+		} else if ( tag == LDAP_REQ_ABANDON ) {
+			continue;
+		}
+
+		if ( !upstream_latency ) {
+			if ( upstream_respond( bc->bc_sb, msgid, tag ) ) {
+				break;
+			}
+			continue;
+		}
+
+		job = calloc( 1, sizeof(bench_job) );
+		if ( job == NULL ) {
+			break;
+		}
+		gettimeofday( &job->bj_due, NULL );
+		tv_add_us( &job->bj_due, upstream_latency );
+		job->bj_msgid = msgid;
+		job->bj_tag = tag;
+
+		ldap_pvt_thread_mutex_lock( &bc->bc_mutex );
+		*bc->bc_tail = job;
+		bc->bc_tail = &job->bj_next;
+		ldap_pvt_thread_cond_signal( &bc->bc_cond );
+		ldap_pvt_thread_mutex_unlock( &bc->bc_mutex );
+	}
+	if ( ber ) {
+		ber_free( ber, 1 );
+	}
+
+	if ( upstream_latency ) {
+		ldap_pvt_thread_mutex_lock( &bc->bc_mutex );
+		bc->bc_closing = 1;
+		ldap_pvt_thread_cond_signal( &bc->bc_cond );
+		ldap_pvt_thread_mutex_unlock( &bc->bc_mutex );
+		ldap_pvt_thread_join( writer, NULL );
+	}
+
+	ber_sockbuf_free( bc->bc_sb );
+	ldap_pvt_thread_cond_destroy( &bc->bc_cond );
+	ldap_pvt_thread_mutex_destroy( &bc->bc_mutex );
+	free( bc );
+	return NULL;
+}
+
+static void *
+upstream_listener( void *arg )
+{
+	ber_socket_t l = (ber_socket_t)(intptr_t)arg, s;
+	int on = 1;
+
+	for ( ;; ) {
+		ldap_pvt_thread_t tid;
+		bench_conn *bc;
+
+		s = accept( l, NULL, NULL );
+		if ( s == AC_SOCKET_INVALID ) {
+			if ( errno == EINTR ) {
+				continue;
+			}
+			tester_perror( "accept", NULL );
+			break;
+		}
+		(void)setsockopt( s, IPPROTO_TCP, TCP_NODELAY,
+			(char *)&on, sizeof(on) );
+
+		bc = calloc( 1, sizeof(bench_conn) );
+		if ( bc == NULL ) {
+			tcp_close( s );
+			continue;
+		}
+		bc->bc_sb = ber_sockbuf_alloc();
+		ber_sockbuf_add_io( bc->bc_sb, &ber_sockbuf_io_tcp,
+			LBER_SBIOD_LEVEL_PROVIDER, (void *)&s );
+		ldap_pvt_thread_mutex_init( &bc->bc_mutex );
+		ldap_pvt_thread_cond_init( &bc->bc_cond );
+		bc->bc_tail = &bc->bc_head;
+
+		ldap_pvt_thread_create( &tid, 1, upstream_conn, bc );
+	}
+	return NULL;
+}
+
+/*
+ * Listen on every address localhost resolves to, lloadd might pick any of
+ * them.
+ */
+static int
+upstream_start( char *port )
+{
+	struct addrinfo hints = {}, *res, *ai;
+	int n = 0, on = 1;
+
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+	if ( getaddrinfo( "localhost", port, &hints, &res ) ) {
+		tester_error( "unable to resolve localhost" );
+		return -1;
+	}
+
+	for ( ai = res; ai && n < MAX_LISTENERS; ai = ai->ai_next ) {
+		ldap_pvt_thread_t tid;
+		ber_socket_t l;
+
+		l = socket( ai->ai_family, ai->ai_socktype, ai->ai_protocol );
+		if ( l == AC_SOCKET_INVALID ) {
+			continue;
+		}
+		(void)setsockopt( l, SOL_SOCKET, SO_REUSEADDR,
+			(char *)&on, sizeof(on) );
+#ifdef IPV6_V6ONLY
+		if ( ai->ai_family == AF_INET6 ) {
+			(void)setsockopt( l, IPPROTO_IPV6, IPV6_V6ONLY,
+				(char *)&on, sizeof(on) );
+		}
+#endif
+		if ( bind( l, ai->ai_addr, ai->ai_addrlen ) ||
+			listen( l, SOMAXCONN ) )
+		{
+			tcp_close( l );
+			continue;
+		}
+		ldap_pvt_thread_create( &tid, 1, upstream_listener,
+			(void *)(intptr_t)l );
+		n++;
+	}
+	freeaddrinfo( res );
+
+	if ( !n ) {
+		tester_perror( "bind", "unable to listen on localhost" );
+		return -1;
+	}
+	return 0;
+}
+
+static int
+do_bind( LDAP *ld )
+{
+	return ldap_sasl_bind_s( ld, config->binddn, LDAP_SASL_SIMPLE,
+		&config->pass, NULL, NULL, NULL );
+}
+
+static int
+do_search( LDAP *ld )
+{
+	LDAPMessage *res = NULL;
+	int rc;
+
+	rc = ldap_search_ext_s( ld, BENCH_BASE, LDAP_SCOPE_SUBTREE,
+		"(objectClass=*)", NULL, 0, NULL, NULL, NULL,
+		LDAP_NO_LIMIT, &res );
+	ldap_msgfree( res );
+	return rc;
+}
+
+/*
+ * Keep up to depth searches outstanding, each one is timed from when it was
+ * sent to when its result arrived.
+ */
+static void
+do_pipeline( LDAP *ld, bench_thread *bt )
+{
+	struct {
+		int msgid;
+		struct timeval start;
+	} *window;
+	int i, sent = 0, outstanding = 0, rc, err;
+
+	window = calloc( depth, sizeof(*window) );
+	if ( window == NULL ) {
+		tester_error( "Memory error: pipeline window" );
+		exit( EXIT_FAILURE );
+	}
+
+	while ( bt->bt_done + bt->bt_failed < config->loops ) {
+		LDAPMessage *res = NULL;
+		struct timeval end;
+		int msgid;
+
+		while ( sent < config->loops && outstanding < depth ) {
+			for ( i = 0; window[i].msgid; i++ )
+				/* find a free slot */;
+			gettimeofday( &window[i].start, NULL );
+			rc = ldap_search_ext( ld, BENCH_BASE, LDAP_SCOPE_SUBTREE,
+				"(objectClass=*)", NULL, 0, NULL, NULL, NULL,
+				LDAP_NO_LIMIT, &window[i].msgid );
+			if ( rc != LDAP_SUCCESS ) {
+				tester_ldap_error( ld, "ldap_search_ext", NULL );
+				window[i].msgid = 0;
+				bt->bt_failed += config->loops - sent;
+				sent = config->loops;
+				break;
+			}
+			outstanding++;
+			sent++;
+		}
+		if ( !outstanding ) {
+			break;
+		}
+
+		rc = ldap_result( ld, LDAP_RES_ANY, LDAP_MSG_ALL, NULL, &res );
+		gettimeofday( &end, NULL );
+		if ( rc <= 0 ) {
+			tester_ldap_error( ld, "ldap_result", NULL );
+			bt->bt_failed += outstanding + config->loops - sent;
+			break;
+		}
+		msgid = ldap_msgid( res );
+		rc = ldap_parse_result( ld, res, &err, NULL, NULL, NULL, NULL, 1 );
+
+		for ( i = 0; i < depth && window[i].msgid != msgid; i++ )
+			/* find the request */;
+		if ( i == depth ) {
+			continue;
+		}
+		window[i].msgid = 0;
+		outstanding--;
+
+		/* lloadd says busy while its upstreams are backed up, send again */
+		if ( rc == LDAP_SUCCESS && err == LDAP_BUSY &&
+				bt->bt_busy++ < BUSY_RETRIES * config->loops ) {
+			sent--;
+			continue;
+		}
+		if ( rc != LDAP_SUCCESS || err != LDAP_SUCCESS ) {
+			bt->bt_failed++;
+			continue;
+		}
+		bt->bt_latency[bt->bt_done++] = tv_diff_us( &end, &window[i].start );
+	}
+	free( window );
+}
+
+static void *
+do_onethread( void *arg )
+{
+	bench_thread *bt = arg;
+	LDAP *ld = NULL;
+	int i, rc;
+
+	/* Bind once even for the bind workload so connecting can be retried */
+	tester_init_ld( &ld, config, 0 );
+
+	ldap_pvt_thread_mutex_lock( &start_mutex );
+	ready++;
+	ldap_pvt_thread_cond_broadcast( &start_cond );
+	while ( !started ) {
+		ldap_pvt_thread_cond_wait( &start_cond, &start_mutex );
+	}
+	ldap_pvt_thread_mutex_unlock( &start_mutex );
+
+	if ( workload == WORKLOAD_PIPELINE ) {
+		do_pipeline( ld, bt );
+	} else {
+		for ( i = 0; i < config->loops; i++ ) {
+			struct timeval start, end;
+
+			gettimeofday( &start, NULL );
+			do {
+				if ( workload == WORKLOAD_BIND ) {
+					rc = do_bind( ld );
+				} else {
+					rc = do_search( ld );
+				}
+			} while ( rc == LDAP_BUSY &&
+					bt->bt_busy++ < BUSY_RETRIES * config->loops );
+			gettimeofday( &end, NULL );
+
+			if ( rc != LDAP_SUCCESS ) {
+				if ( verbose ) {
+					tester_ldap_error( ld, workloads[workload], NULL );
+				}
+				bt->bt_failed++;
+				continue;
+			}
+			bt->bt_latency[bt->bt_done++] = tv_diff_us( &end, &start );
+		}
+	}
+
+	ldap_unbind_ext( ld, NULL, NULL );
+	return NULL;
+}
+
+static int
+latency_cmp( const void *a, const void *b )
+{
+	unsigned long x = *(const unsigned long *)a,
+		y = *(const unsigned long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void
+run_workload( char *uri, bench_result *br )
+{
+	static const double percentiles[] = { 0.5, 0.9, 0.99, 0.999, 1.0 };
+	unsigned long *all;
+	struct timeval start, end;
+	int i, n = 0;
+
+	config->uri = uri;
+	ready = started = 0;
+
+	for ( i = 0; i < threads; i++ ) {
+		bench_thread *bt = &bthreads[i];
+
+		bt->bt_done = bt->bt_failed = bt->bt_busy = 0;
+		bt->bt_latency = calloc( config->loops, sizeof(unsigned long) );
+		if ( bt->bt_latency == NULL ) {
+			tester_error( "Memory error: latency samples" );
+			exit( EXIT_FAILURE );
+		}
+		ldap_pvt_thread_create( &bt->bt_tid, 0, do_onethread, bt );
+	}
+
+	/* Only start the clock once every thread is connected */
+	ldap_pvt_thread_mutex_lock( &start_mutex );
+	while ( ready < threads ) {
+		ldap_pvt_thread_cond_wait( &start_cond, &start_mutex );
+	}
+	started = 1;
+	gettimeofday( &start, NULL );
+	ldap_pvt_thread_cond_broadcast( &start_cond );
+	ldap_pvt_thread_mutex_unlock( &start_mutex );
+
+	for ( i = 0; i < threads; i++ ) {
+		ldap_pvt_thread_join( bthreads[i].bt_tid, NULL );
+	}
+	gettimeofday( &end, NULL );
+
+	all = calloc( (size_t)threads * config->loops, sizeof(unsigned long) );
+	if ( all == NULL ) {
+		tester_error( "Memory error: latency samples" );
+		exit( EXIT_FAILURE );
+	}
+	memset( br, 0, sizeof(*br) );
+	for ( i = 0; i < threads; i++ ) {
+		bench_thread *bt = &bthreads[i];
+
+		memcpy( &all[n], bt->bt_latency, bt->bt_done * sizeof(unsigned long) );
+		n += bt->bt_done;
+		br->br_failed += bt->bt_failed;
+		free( bt->bt_latency );
+	}
+	br->br_done = n;
+	br->br_qps = n / ( tv_diff_us( &end, &start ) / 1000000.0 );
+
+	if ( n ) {
+		qsort( all, n, sizeof(unsigned long), latency_cmp );
+		for ( i = 0; i < 5; i++ ) {
+			br->br_percentile[i] = all[(size_t)( ( n - 1 ) * percentiles[i] )];
+		}
+	}
+	free( all );
+}
+
+static void
+print_result( const char *name, bench_result *br )
+{
+	printf( "%-10s %10.1f %9lu %9lu %9lu %9lu %9lu %8d\n", name,
+		br->br_qps, br->br_percentile[0], br->br_percentile[1],
+		br->br_percentile[2], br->br_percentile[3], br->br_percentile[4],
+		br->br_failed );
+}
+
+int
+main( int argc, char **argv )
+{
+	int		i;
+	char		*port = NULL, *uri;
+	char		baseline_uri[BUFSIZ];
+	int		serve_only = 0, baseline = 1;
+	int		size = 64;
+	bench_result	base_res, lload_res;
+
+	config = tester_init( "lload-bench", TESTER_SEARCH );
+	config->loops = LOOPS;
+
+	while ( (i = getopt( argc, argv, TESTER_COMMON_OPTS "Be:m:P:p:Ss:u:vW:" )) != EOF ) {
+		switch ( i ) {
+		case 'B':		/* skip the direct run */
+			baseline = 0;
+			break;
+
+		case 'e':		/* entries per search */
+			if ( lutil_atoi( &upstream_entries, optarg ) != 0 ||
+				upstream_entries < 0 ) {
+				usage( argv[0], i );
+			}
+			break;
+
+		case 'm':		/* the number of threads */
+			if ( lutil_atoi( &threads, optarg ) != 0 || threads < 1 ) {
+				usage( argv[0], i );
+			}
+			if ( threads > MAX_THREAD )
+				threads = MAX_THREAD;
+			break;
+
+		case 'P':		/* outstanding searches per connection */
+			if ( lutil_atoi( &depth, optarg ) != 0 || depth < 1 ) {
+				usage( argv[0], i );
+			}
+			break;
+
+		case 'p':		/* fake upstream port */
+			port = optarg;
+			break;
+
+		case 'S':		/* only run the fake upstream */
+			serve_only = 1;
+			break;
+
+		case 's':		/* size of the attribute value in each entry */
+			if ( lutil_atoi( &size, optarg ) != 0 || size < 0 ) {
+				usage( argv[0], i );
+			}
+			break;
+
+		case 'u':		/* upstream latency */
+			if ( lutil_atoi( &upstream_latency, optarg ) != 0 ||
+				upstream_latency < 0 ) {
+				usage( argv[0], i );
+			}
+			break;
+
+		case 'v':
+			verbose++;
+			break;
+
+		case 'W':
+			for ( workload = 0; workloads[workload]; workload++ ) {
+				if ( !strcasecmp( optarg, workloads[workload] ) ) {
+					break;
+				}
+			}
+			if ( !workloads[workload] ) {
+				usage( argv[0], i );
+			}
+			break;
+
+		default:
+			if ( tester_config_opt( config, i, optarg ) == LDAP_SUCCESS ) {
+				break;
+			}
+			usage( argv[0], i );
+			break;
+		}
+	}
+
+	if ( port == NULL ) {
+		usage( argv[0], 0 );
+	}
+	uri = config->uri;
+	if ( uri == NULL && !baseline && !serve_only ) {
+		usage( argv[0], 0 );
+	}
+	snprintf( baseline_uri, sizeof(baseline_uri), "ldap://localhost:%s/", port );
+
+	upstream_value.bv_len = size;
+	upstream_value.bv_val = malloc( size + 1 );
+	if ( upstream_value.bv_val == NULL ) {
+		tester_error( "Memory error: entry value" );
+		exit( EXIT_FAILURE );
+	}
+	memset( upstream_value.bv_val, 'x', size );
+	upstream_value.bv_val[size] = '\0';
+
+	tester_config_finish( config );
+	ldap_pvt_thread_initialize();
+	ldap_pvt_thread_mutex_init( &start_mutex );
+	ldap_pvt_thread_cond_init( &start_cond );
+
+#ifdef SIGPIPE
+	(void)SIGNAL( SIGPIPE, SIG_IGN );
+#endif
+
+	if ( upstream_start( port ) ) {
+		exit( EXIT_FAILURE );
+	}
+
+	if ( serve_only ) {
+		for ( ;; ) {
+			ldap_pvt_thread_sleep( 60 );
+		}
+	}
+
+	printf( "workload: %s, threads: %d, operations per thread: %d",
+		workloads[workload], threads, config->loops );
+	if ( workload == WORKLOAD_PIPELINE ) {
+		printf( ", depth: %d", depth );
+	}
+	printf( "\nupstream latency: %dus, entries: %d, value size: %d\n\n",
+		upstream_latency, upstream_entries, size );
+	printf( "%-10s %10s %9s %9s %9s %9s %9s %8s\n", "target", "ops/s",
+		"p50(us)", "p90", "p99", "p99.9", "max", "failed" );
+
+	if ( baseline ) {
+		run_workload( baseline_uri, &base_res );
+		print_result( "upstream", &base_res );
+	}
+	if ( uri ) {
+		run_workload( uri, &lload_res );
+		print_result( "lloadd", &lload_res );
+	}
+	if ( baseline && uri ) {
+		printf( "%-10s %10s", "added", "" );
+		for ( i = 0; i < 5; i++ ) {
+			printf( " %9ld", (long)lload_res.br_percentile[i] -
+				(long)base_res.br_percentile[i] );
+		}
+		printf( "\n" );
+	}
+
+	if ( ( baseline && base_res.br_failed ) || ( uri && lload_res.br_failed ) ) {
+		exit( EXIT_FAILURE );
+	}
+	exit( EXIT_SUCCESS );
+}
+
+#else /* NO_THREADS */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+int
+main( int argc, char **argv )
+{
+	fprintf( stderr, "%s: not available when configured --without-threads\n", argv[0] );
+	exit( EXIT_FAILURE );
+}
+
+#endif /* NO_THREADS */
@@ -0,0 +1,582 @@
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1999-2024 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/*
+ * Exercise ldap_async_register() and ldap_async_process(). Batches of
+ * searches are completed through their callbacks, one of them stopped
+ * early from its entry callback, checking the session's socket is left
+ * blocking for the synchronous calls made from the callbacks. Like an
+ * event loop, ldap_async_process() is only called when the descriptor
+ * is ready. A search left unsent by a full socket has to go out with the
+ * next one.
+ *
+ * Then a search is made to follow a referral onto a second connection of
+ * the session, which is broken while a search sent over the first one is
+ * still pending: only the operation using the broken connection may fail.
+ * Every connection gets a layer pushed by a connection callback, able to
+ * hold back what is read or to fail the reads.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+
+#include "ac/stdlib.h"
+
+#include "ac/ctype.h"
+#include "ac/errno.h"
+#include "ac/param.h"
+#include "ac/socket.h"
+#include "ac/string.h"
+#include "ac/unistd.h"
+#include "ac/wait.h"
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#include "ldap.h"
+#include "lutil.h"
+
+#include "ldap_pvt.h"
+
+#include "slapd-common.h"
+
+#define LOOPS	10
+#define RETRIES	0
+
+#define SEARCHES	8
+
+/* How long to keep calling ldap_async_process() for something to happen */
+#define ROUNDS	500
+
+typedef struct async_op {
+	int	ao_msgid;
+	int	ao_entries;
+	int	ao_stop;
+	int	ao_done;
+	int	ao_err;
+	int	ao_sync;	/* make a synchronous call from the callback */
+} async_op;
+
+/* What a connection's layer does with reads, or writes for CONN_NOWRITE */
+enum { CONN_PASS, CONN_HOLD, CONN_FAIL, CONN_NOWRITE };
+
+#define MAX_CONNS	4
+
+static Sockbuf *conn_sb[MAX_CONNS];
+static int conn_mode[MAX_CONNS];
+static int nconns;
+
+/* operations completed so far */
+static int ndone;
+
+static int
+conn_index( Sockbuf_IO_Desc *sbiod )
+{
+	int	i;
+
+	for ( i = 0; i < nconns; i++ ) {
+		if ( conn_sb[i] == sbiod->sbiod_sb ) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static int
+brk_setup( Sockbuf_IO_Desc *sbiod, void *arg )
+{
+	return 0;
+}
+
+static ber_slen_t
+brk_writev( Sockbuf_IO_Desc *sbiod, struct berval *bv, int nbv )
+{
+	int	i = conn_index( sbiod );
+
+	if ( i >= 0 && conn_mode[i] == CONN_NOWRITE ) {
+		sock_errset( EAGAIN );
+		return -1;
+	}
+	return LBER_SBIOD_WRITEV_NEXT( sbiod, bv, nbv );
+}
+
+static int
+brk_ctrl( Sockbuf_IO_Desc *sbiod, int opt, void *arg )
+{
+	int	i = conn_index( sbiod );
+
+	/* nothing to be read while held */
+	if ( opt == LBER_SB_OPT_DATA_READY && i >= 0 &&
+		conn_mode[i] != CONN_PASS && conn_mode[i] != CONN_NOWRITE )
+	{
+		return 0;
+	}
+	if ( opt == LBER_SB_OPT_GET_WRITEV ) {
+		return LBER_SB_WRITEV_REPLY( sbiod, arg, brk_writev );
+	}
+	return LBER_SBIOD_CTRL_NEXT( sbiod, opt, arg );
+}
+
+static ber_slen_t
+brk_read( Sockbuf_IO_Desc *sbiod, void *buf, ber_len_t len )
+{
+	int	i = conn_index( sbiod );
+
+	if ( i >= 0 && conn_mode[i] == CONN_HOLD ) {
+		sock_errset( EWOULDBLOCK );
+		return -1;
+	}
+	if ( i >= 0 && conn_mode[i] == CONN_FAIL ) {
+		sock_errset( ECONNRESET );
+		return -1;
+	}
+	return LBER_SBIOD_READ_NEXT( sbiod, buf, len );
+}
+
+static ber_slen_t
+brk_write( Sockbuf_IO_Desc *sbiod, void *buf, ber_len_t len )
+{
+	int	i = conn_index( sbiod );
+
+	if ( i >= 0 && conn_mode[i] == CONN_NOWRITE ) {
+		sock_errset( EAGAIN );
+		return -1;
+	}
+	return LBER_SBIOD_WRITE_NEXT( sbiod, buf, len );
+}
+
+static Sockbuf_IO brk_sbio = {
+	brk_setup,		/* sbi_setup */
+	NULL,			/* sbi_remove */
+	brk_ctrl,		/* sbi_ctrl */
+	brk_read,		/* sbi_read */
+	brk_write,		/* sbi_write */
+	NULL			/* sbi_close */
+};
+
+static int
+conn_add( LDAP *ld, Sockbuf *sb, LDAPURLDesc *srv, struct sockaddr *addr,
+	struct ldap_conncb *ctx )
+{
+	if ( nconns == MAX_CONNS ) {
+		return -1;
+	}
+	conn_sb[nconns] = sb;
+	conn_mode[nconns] = CONN_PASS;
+	nconns++;
+	return ber_sockbuf_add_io( sb, &brk_sbio,
+		LBER_SBIOD_LEVEL_APPLICATION, NULL );
+}
+
+static void
+conn_del( LDAP *ld, Sockbuf *sb, struct ldap_conncb *ctx )
+{
+	int	i;
+
+	for ( i = 0; i < nconns; i++ ) {
+		if ( conn_sb[i] == sb ) {
+			conn_sb[i] = NULL;
+		}
+	}
+}
+
+static ldap_conncb conn_cb = { conn_add, conn_del, NULL };
+
+static void
+usage( char *name, int opt )
+{
+	if ( opt ) {
+		fprintf( stderr, "%s: unable to handle option \'%c\'\n\n",
+			name, opt );
+	}
+
+	fprintf( stderr, "usage: %s " TESTER_COMMON_HELP
+		"-b <base> "
+		"-u <URI of the server as reached for a referral> "
+		"\n",
+		name );
+	exit( EXIT_FAILURE );
+}
+
+static void
+async_fail( const char *what )
+{
+	fprintf( stderr, "  PID=%ld - Async: %s\n", (long) pid, what );
+	exit( EXIT_FAILURE );
+}
+
+static int
+entry_cb( LDAP *ld, LDAPMessage *msg, void *arg )
+{
+	async_op	*ao = arg;
+
+	if ( ldap_msgtype( msg ) == LDAP_RES_SEARCH_ENTRY ) {
+		ao->ao_entries++;
+	}
+	return ao->ao_stop;
+}
+
+static void
+done_cb( LDAP *ld, int msgid, LDAPMessage *result, void *arg )
+{
+	async_op	*ao = arg;
+	struct berval	*authzid = NULL;
+
+	ndone++;
+	if ( ao->ao_done++ || msgid != ao->ao_msgid ) {
+		async_fail( "completion callback called for the wrong operation" );
+	}
+	if ( result == NULL ) {
+		ldap_get_option( ld, LDAP_OPT_RESULT_CODE, &ao->ao_err );
+	} else if ( ldap_parse_result( ld, result, &ao->ao_err,
+			NULL, NULL, NULL, NULL, 0 ) != LDAP_SUCCESS )
+	{
+		async_fail( "result could not be parsed" );
+	}
+
+	if ( ao->ao_sync ) {
+		if ( ldap_whoami_s( ld, &authzid, NULL, NULL ) != LDAP_SUCCESS ) {
+			async_fail( "synchronous call from a callback failed" );
+		}
+		ber_bvfree( authzid );
+	}
+}
+
+static void
+start_search( LDAP *ld, char *base, int scope, async_op *ao )
+{
+	int	rc;
+
+	rc = ldap_search_ext( ld, base, scope, NULL, NULL, 0,
+		NULL, NULL, NULL, LDAP_NO_LIMIT, &ao->ao_msgid );
+	if ( rc != LDAP_SUCCESS ) {
+		tester_ldap_error( ld, "ldap_search_ext", NULL );
+		exit( EXIT_FAILURE );
+	}
+	rc = ldap_async_register( ld, ao->ao_msgid, entry_cb, done_cb, ao );
+	if ( rc != LDAP_SUCCESS ) {
+		tester_ldap_error( ld, "ldap_async_register", NULL );
+		exit( EXIT_FAILURE );
+	}
+}
+
+/*
+ * Wait up to 10ms for the session's descriptor to be ready for what the
+ * last ldap_async_process() asked for.
+ */
+static int
+wait_ready( LDAP *ld, int want )
+{
+	ber_socket_t	fd = AC_SOCKET_INVALID;
+	fd_set		rfds, wfds;
+	struct timeval	tv = { 0, 10000 };
+
+	ldap_get_option( ld, LDAP_OPT_DESC, &fd );
+	if ( fd == AC_SOCKET_INVALID ) {
+		return 1;
+	}
+	FD_ZERO( &rfds );
+	FD_ZERO( &wfds );
+	if ( want & LDAP_ASYNC_WANT_READ ) {
+		FD_SET( fd, &rfds );
+	}
+	if ( want & LDAP_ASYNC_WANT_WRITE ) {
+		FD_SET( fd, &wfds );
+	}
+	return select( fd + 1, &rfds, &wfds, NULL, &tv ) > 0;
+}
+
+/*
+ * Call ldap_async_process() until *count reaches target or it fails,
+ * returns its last result. With wait set it is only called again once
+ * the descriptor is ready, as an application's event loop would: what
+ * has been read from the socket must not be left behind in a buffer.
+ */
+static int
+process_until( LDAP *ld, int *count, int target, int wait )
+{
+	ber_socket_t	fd = AC_SOCKET_INVALID;
+	int		i, rc = 0, want = 0;
+
+	for ( i = 0; i < ROUNDS && *count < target; i++ ) {
+		if ( wait && want && !( want & LDAP_ASYNC_CONNECTING ) ) {
+			if ( !wait_ready( ld, want ) ) {
+				continue;
+			}
+		}
+		rc = ldap_async_process( ld, &want );
+
+#if defined( HAVE_FCNTL ) && defined( O_NONBLOCK )
+		ldap_get_option( ld, LDAP_OPT_DESC, &fd );
+		if ( fd != AC_SOCKET_INVALID &&
+			( fcntl( fd, F_GETFL ) & O_NONBLOCK ) )
+		{
+			async_fail( "the session was left non-blocking" );
+		}
+#endif
+		if ( rc < 0 ) {
+			break;
+		}
+		if ( !wait ) {
+			usleep( 10000 );
+		}
+	}
+	return rc;
+}
+
+static int
+count_entries( LDAP *ld, char *base )
+{
+	LDAPMessage	*res = NULL;
+	int		rc, n;
+
+	rc = ldap_search_ext_s( ld, base, LDAP_SCOPE_SUBTREE, NULL, NULL, 0,
+		NULL, NULL, NULL, LDAP_NO_LIMIT, &res );
+	if ( rc != LDAP_SUCCESS ) {
+		tester_ldap_error( ld, "ldap_search_ext_s", NULL );
+		exit( EXIT_FAILURE );
+	}
+	n = ldap_count_entries( ld, res );
+	ldap_msgfree( res );
+	return n;
+}
+
+static void
+do_batch( LDAP *ld, char *base, int expected )
+{
+	async_op	ops[SEARCHES];
+	int		i, target = ndone + SEARCHES;
+
+	memset( ops, 0, sizeof( ops ) );
+	for ( i = 0; i < SEARCHES; i++ ) {
+		/* one stops after its first entry, one calls back into libldap */
+		ops[i].ao_stop = ( i == 1 );
+		ops[i].ao_sync = ( i == 2 );
+		start_search( ld, base, LDAP_SCOPE_SUBTREE, &ops[i] );
+	}
+
+	/* only the session's own connection is in use */
+	if ( process_until( ld, &ndone, target, 1 ) < 0 ) {
+		tester_ldap_error( ld, "ldap_async_process", NULL );
+		exit( EXIT_FAILURE );
+	}
+	if ( ndone != target ) {
+		async_fail( "an operation never completed" );
+	}
+
+	for ( i = 0; i < SEARCHES; i++ ) {
+		if ( ops[i].ao_stop ) {
+			if ( ops[i].ao_err != LDAP_USER_CANCELLED ||
+				ops[i].ao_entries != 1 )
+			{
+				async_fail( "stopping a search from its callback failed" );
+			}
+		} else if ( ops[i].ao_err != LDAP_SUCCESS ||
+			ops[i].ao_entries != expected )
+		{
+			fprintf( stderr, "  PID=%ld - Async: search %d gave %d, "
+				"%d of %d entries\n", (long) pid, i,
+				ops[i].ao_err, ops[i].ao_entries, expected );
+			exit( EXIT_FAILURE );
+		}
+	}
+}
+
+/*
+ * Leave a search unsent as if the socket was full, the next one is written
+ * along with it once the socket takes data again.
+ */
+static void
+do_held_write( LDAP *ld, char *base, int expected )
+{
+	async_op	ops[2];
+	int		i, target = ndone + 2;
+
+	memset( ops, 0, sizeof( ops ) );
+	conn_mode[0] = CONN_NOWRITE;
+	start_search( ld, base, LDAP_SCOPE_SUBTREE, &ops[0] );
+	conn_mode[0] = CONN_PASS;
+	start_search( ld, base, LDAP_SCOPE_SUBTREE, &ops[1] );
+
+	if ( process_until( ld, &ndone, target, 1 ) < 0 ) {
+		tester_ldap_error( ld, "ldap_async_process", NULL );
+		exit( EXIT_FAILURE );
+	}
+	for ( i = 0; i < 2; i++ ) {
+		if ( !ops[i].ao_done || ops[i].ao_err != LDAP_SUCCESS ||
+			ops[i].ao_entries != expected )
+		{
+			async_fail( "a search held back on write did not complete" );
+		}
+	}
+}
+
+/*
+ * Follow a referral onto a second connection and break it while a search
+ * on the first connection is held back: that search has to survive.
+ */
+static void
+do_conn_failure( LDAP *ld, char *base, char *refuri )
+{
+	async_op	chased = { 0 }, other = { 0 };
+	LDAPMod		oc, ou, ref, *mods[4];
+	LDAPControl	c = { LDAP_CONTROL_MANAGEDSAIT, BER_BVNULL, 1 },
+			*ctrls[2] = { &c, NULL };
+	char		*oc_vals[] = { "referral", "extensibleObject", NULL },
+			*ou_vals[] = { "Elsewhere", NULL },
+			*ref_vals[2] = { NULL, NULL },
+			*dn;
+	int		rc, first = nconns;
+
+	dn = malloc( strlen( base ) + sizeof( "ou=Elsewhere," ) );
+	sprintf( dn, "ou=Elsewhere,%s", base );
+	ref_vals[0] = malloc( strlen( refuri ) + strlen( base ) + 2 );
+	sprintf( ref_vals[0], "%s%s%s", refuri,
+		refuri[strlen( refuri ) - 1] == '/' ? "" : "/", base );
+
+	oc.mod_op = ou.mod_op = ref.mod_op = LDAP_MOD_ADD;
+	oc.mod_type = "objectClass";
+	oc.mod_values = oc_vals;
+	ou.mod_type = "ou";
+	ou.mod_values = ou_vals;
+	ref.mod_type = "ref";
+	ref.mod_values = ref_vals;
+	mods[0] = &oc;
+	mods[1] = &ou;
+	mods[2] = &ref;
+	mods[3] = NULL;
+
+	rc = ldap_add_ext_s( ld, dn, mods, ctrls, NULL );
+	if ( rc != LDAP_SUCCESS ) {
+		tester_ldap_error( ld, "ldap_add_ext_s", dn );
+		exit( EXIT_FAILURE );
+	}
+
+	/*
+	 * The referral is chased over a new connection, its reads fail once
+	 * the chase has rebound it.
+	 */
+	start_search( ld, dn, LDAP_SCOPE_BASE, &chased );
+	if ( process_until( ld, &nconns, first + 1, 0 ) < 0 ||
+		nconns != first + 1 || chased.ao_done )
+	{
+		async_fail( "the referral was not chased" );
+	}
+	conn_mode[first] = CONN_FAIL;
+
+	/* Held back, it is still pending when the other connection breaks */
+	conn_mode[0] = CONN_HOLD;
+	start_search( ld, base, LDAP_SCOPE_BASE, &other );
+
+	rc = process_until( ld, &chased.ao_done, 1, 0 );
+	if ( rc >= 0 || !chased.ao_done || chased.ao_err != LDAP_SERVER_DOWN ) {
+		async_fail( "losing the referral connection went unnoticed" );
+	}
+	if ( other.ao_done ) {
+		async_fail( "an operation on a working connection was failed" );
+	}
+
+	conn_mode[0] = CONN_PASS;
+	if ( process_until( ld, &other.ao_done, 1, 0 ) < 0 || !other.ao_done ) {
+		tester_ldap_error( ld, "ldap_async_process", NULL );
+		async_fail( "the held back search did not complete" );
+	}
+	if ( other.ao_err != LDAP_SUCCESS || other.ao_entries != 1 ) {
+		async_fail( "the held back search gave the wrong result" );
+	}
+
+	rc = ldap_delete_ext_s( ld, dn, ctrls, NULL );
+	if ( rc != LDAP_SUCCESS ) {
+		tester_ldap_error( ld, "ldap_delete_ext_s", dn );
+		exit( EXIT_FAILURE );
+	}
+	free( ref_vals[0] );
+	free( dn );
+}
+
+int
+main( int argc, char **argv )
+{
+	int		i, rc, expected;
+	char		*base = NULL, *refuri = NULL;
+	struct tester_conn_args	*config;
+	LDAP		*ld = NULL;
+
+	config = tester_init( "slapd-async", TESTER_SEARCH );
+
+	while ( (i = getopt( argc, argv, TESTER_COMMON_OPTS "b:u:" )) != EOF ) {
+		switch ( i ) {
+		case 'b':		/* base DN of a search */
+			base = optarg;
+			break;
+
+		case 'u':		/* URI used in the referral */
+			refuri = optarg;
+			break;
+
+		default:
+			if ( tester_config_opt( config, i, optarg ) == LDAP_SUCCESS ) {
+				break;
+			}
+			usage( argv[0], i );
+			break;
+		}
+	}
+
+	if ( base == NULL || refuri == NULL ) {
+		usage( argv[0], 0 );
+	}
+
+	tester_config_finish( config );
+	tester_init_ld( &ld, config, TESTER_INIT_ONLY );
+
+	(void) ldap_set_option( ld, LDAP_OPT_REFERRALS, LDAP_OPT_ON );
+	if ( ldap_set_option( ld, LDAP_OPT_CONNECT_CB, &conn_cb )
+		!= LDAP_OPT_SUCCESS )
+	{
+		async_fail( "connection callbacks could not be set" );
+	}
+	rc = ldap_sasl_bind_s( ld, config->binddn, LDAP_SASL_SIMPLE,
+		&config->pass, NULL, NULL, NULL );
+	if ( rc != LDAP_SUCCESS ) {
+		tester_ldap_error( ld, "ldap_sasl_bind_s", NULL );
+		exit( EXIT_FAILURE );
+	}
+
+	expected = count_entries( ld, base );
+	fprintf( stderr, "PID=%ld - Async(%d): base=\"%s\", %d entries.\n",
+		(long) pid, config->loops, base, expected );
+
+	for ( i = 0; i < config->loops; i++ ) {
+		do_batch( ld, base, expected );
+	}
+
+	do_held_write( ld, base, expected );
+
+	do_conn_failure( ld, base, refuri );
+
+	/* The session is still usable the usual way */
+	if ( count_entries( ld, base ) != expected ) {
+		async_fail( "plain search returned a different count" );
+	}
+
+	fprintf( stderr, "  PID=%ld - Async done.\n", (long) pid );
+
+	ldap_unbind_ext( ld, NULL, NULL );
+
+	exit( EXIT_SUCCESS );
+}
@@ -0,0 +1,302 @@
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1999-2024 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/*
+ * Exercise ber_flushv(). A batch of search requests, more than fit in one
+ * vectored write, is encoded by hand and sent with a single ber_flushv()
+ * on the session's Sockbuf, then the responses are read back and matched
+ * to their requests. The second half of the loops is run with a layer
+ * pushed into the stack that, like most layers outside liblber, only has
+ * sbi_write and forwards every control: all the data has to go through it
+ * even though the layers around it can write vectors.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+
+#include "ac/stdlib.h"
+
+#include "ac/ctype.h"
+#include "ac/errno.h"
+#include "ac/param.h"
+#include "ac/socket.h"
+#include "ac/string.h"
+#include "ac/unistd.h"
+#include "ac/wait.h"
+
+#include "ldap.h"
+#include "lutil.h"
+
+#include "ldap_pvt.h"
+
+#include "slapd-common.h"
+
+#define LOOPS	10
+#define RETRIES	0
+
+/* More than ber_flushv() hands down at once */
+#define REQUESTS	80
+#define MSGID_BASE	1000
+
+static ber_len_t counted;
+
+static int
+count_setup( Sockbuf_IO_Desc *sbiod, void *arg )
+{
+	return 0;
+}
+
+static int
+count_ctrl( Sockbuf_IO_Desc *sbiod, int opt, void *arg )
+{
+	return LBER_SBIOD_CTRL_NEXT( sbiod, opt, arg );
+}
+
+static ber_slen_t
+count_read( Sockbuf_IO_Desc *sbiod, void *buf, ber_len_t len )
+{
+	return LBER_SBIOD_READ_NEXT( sbiod, buf, len );
+}
+
+static ber_slen_t
+count_write( Sockbuf_IO_Desc *sbiod, void *buf, ber_len_t len )
+{
+	ber_slen_t	ret;
+
+	ret = LBER_SBIOD_WRITE_NEXT( sbiod, buf, len );
+	if ( ret > 0 ) {
+		counted += ret;
+	}
+	return ret;
+}
+
+static Sockbuf_IO count_sbio = {
+	count_setup,		/* sbi_setup */
+	NULL,			/* sbi_remove */
+	count_ctrl,		/* sbi_ctrl */
+	count_read,		/* sbi_read */
+	count_write,		/* sbi_write */
+	NULL			/* sbi_close */
+};
+
+static void
+usage( char *name, int opt )
+{
+	if ( opt ) {
+		fprintf( stderr, "%s: unable to handle option \'%c\'\n\n",
+			name, opt );
+	}
+
+	fprintf( stderr, "usage: %s " TESTER_COMMON_HELP
+		"-b <base> "
+		"\n",
+		name );
+	exit( EXIT_FAILURE );
+}
+
+/* Every third request only reads the base entry */
+static int
+request_scope( int i )
+{
+	return i % 3 ? LDAP_SCOPE_SUBTREE : LDAP_SCOPE_BASE;
+}
+
+static BerElement *
+encode_search( char *base, int i )
+{
+	BerElement	*ber;
+
+	ber = ber_alloc_t( LBER_USE_DER );
+	if ( ber == NULL ||
+		ber_printf( ber, "{it{seeiibts{N}N}N}", MSGID_BASE + i,
+			LDAP_REQ_SEARCH, base, (ber_int_t) request_scope( i ),
+			(ber_int_t) LDAP_DEREF_NEVER, 0, 0, 0,
+			LDAP_FILTER_PRESENT, "objectClass" ) == -1 )
+	{
+		fprintf( stderr, "  PID=%ld - Flushv: encoding failed\n",
+			(long) pid );
+		exit( EXIT_FAILURE );
+	}
+	return ber;
+}
+
+static int
+count_entries( LDAP *ld, char *base, int scope )
+{
+	LDAPMessage	*res = NULL;
+	int		rc, n;
+
+	rc = ldap_search_ext_s( ld, base, scope, NULL, NULL, 0,
+		NULL, NULL, NULL, LDAP_NO_LIMIT, &res );
+	if ( rc != LDAP_SUCCESS ) {
+		tester_ldap_error( ld, "ldap_search_ext_s", NULL );
+		exit( EXIT_FAILURE );
+	}
+	n = ldap_count_entries( ld, res );
+	ldap_msgfree( res );
+	return n;
+}
+
+/* Send the whole batch at once, then collect what came back for each */
+static void
+do_batch( Sockbuf *sb, char *base, int *entries, int *done,
+	ber_len_t *sent )
+{
+	BerElement	*bers[REQUESTS], *ber;
+	struct berval	bv;
+	ber_len_t	len;
+	ber_tag_t	tag;
+	ber_int_t	id, err;
+	int		i, pending = REQUESTS;
+
+	*sent = 0;
+	for ( i = 0; i < REQUESTS; i++ ) {
+		bers[i] = encode_search( base, i );
+		ber_flatten2( bers[i], &bv, 0 );
+		*sent += bv.bv_len;
+		entries[i] = done[i] = 0;
+	}
+
+	if ( ber_flushv( sb, bers, REQUESTS, LBER_FLUSH_FREE_ALWAYS ) != 0 ) {
+		fprintf( stderr, "  PID=%ld - Flushv: ber_flushv failed\n",
+			(long) pid );
+		exit( EXIT_FAILURE );
+	}
+
+	while ( pending ) {
+		ber = ber_alloc_t( LBER_USE_DER );
+		/* A short read leaves the message for the next call */
+		do {
+			tag = ber_get_next( sb, &len, ber );
+		} while ( tag == LBER_DEFAULT &&
+			( errno == EWOULDBLOCK || errno == EAGAIN ) );
+		if ( tag != LDAP_TAG_MESSAGE ||
+			ber_get_int( ber, &id ) == LBER_ERROR ||
+			id < MSGID_BASE || id >= MSGID_BASE + REQUESTS )
+		{
+			fprintf( stderr, "  PID=%ld - Flushv: unexpected response\n",
+				(long) pid );
+			exit( EXIT_FAILURE );
+		}
+		i = id - MSGID_BASE;
+
+		tag = ber_peek_tag( ber, &len );
+		if ( tag == LDAP_RES_SEARCH_ENTRY ) {
+			entries[i]++;
+		} else if ( tag == LDAP_RES_SEARCH_RESULT ) {
+			if ( ber_scanf( ber, "{e" /*}*/, &err ) == LBER_ERROR ||
+				err != LDAP_SUCCESS || done[i]++ )
+			{
+				fprintf( stderr, "  PID=%ld - Flushv: search %d "
+					"did not complete properly\n",
+					(long) pid, i );
+				exit( EXIT_FAILURE );
+			}
+			pending--;
+		}
+		ber_free( ber, 1 );
+	}
+}
+
+int
+main( int argc, char **argv )
+{
+	int		i, j, expected[2];
+	char		*base = NULL;
+	struct tester_conn_args	*config;
+	LDAP		*ld = NULL;
+	Sockbuf		*sb = NULL;
+	int		entries[REQUESTS], done[REQUESTS];
+	ber_len_t	sent;
+
+	config = tester_init( "slapd-flushv", TESTER_SEARCH );
+
+	while ( (i = getopt( argc, argv, TESTER_COMMON_OPTS "b:" )) != EOF ) {
+		switch ( i ) {
+		case 'b':		/* base DN of a search */
+			base = optarg;
+			break;
+
+		default:
+			if ( tester_config_opt( config, i, optarg ) == LDAP_SUCCESS ) {
+				break;
+			}
+			usage( argv[0], i );
+			break;
+		}
+	}
+
+	if ( base == NULL ) {
+		usage( argv[0], 0 );
+	}
+
+	tester_config_finish( config );
+	tester_init_ld( &ld, config, 0 );
+
+	expected[0] = count_entries( ld, base, LDAP_SCOPE_BASE );
+	expected[1] = count_entries( ld, base, LDAP_SCOPE_SUBTREE );
+
+	ldap_get_option( ld, LDAP_OPT_SOCKBUF, &sb );
+	if ( sb == NULL ) {
+		fprintf( stderr, "  PID=%ld - Flushv: no Sockbuf\n", (long) pid );
+		exit( EXIT_FAILURE );
+	}
+
+	fprintf( stderr, "PID=%ld - Flushv(%d): base=\"%s\", %d requests.\n",
+		(long) pid, config->loops, base, REQUESTS );
+
+	for ( i = 0; i < config->loops; i++ ) {
+		if ( i == config->loops / 2 ) {
+			ber_sockbuf_add_io( sb, &count_sbio,
+				LBER_SBIOD_LEVEL_APPLICATION, NULL );
+		}
+		counted = 0;
+
+		do_batch( sb, base, entries, done, &sent );
+
+		for ( j = 0; j < REQUESTS; j++ ) {
+			if ( entries[j] !=
+				expected[request_scope( j ) == LDAP_SCOPE_SUBTREE] )
+			{
+				fprintf( stderr, "  PID=%ld - Flushv: search %d "
+					"returned %d entries\n",
+					(long) pid, j, entries[j] );
+				exit( EXIT_FAILURE );
+			}
+		}
+
+		if ( i >= config->loops / 2 && counted != sent ) {
+			fprintf( stderr, "  PID=%ld - Flushv: %lu of %lu bytes "
+				"went through the added layer\n",
+				(long) pid, (unsigned long) counted,
+				(unsigned long) sent );
+			exit( EXIT_FAILURE );
+		}
+
+		/* The session is still usable the usual way */
+		if ( count_entries( ld, base, LDAP_SCOPE_SUBTREE ) != expected[1] ) {
+			fprintf( stderr, "  PID=%ld - Flushv: plain search "
+				"returned a different count\n", (long) pid );
+			exit( EXIT_FAILURE );
+		}
+	}
+
+	fprintf( stderr, "  PID=%ld - Flushv done.\n", (long) pid );
+
+	ldap_unbind_ext( ld, NULL, NULL );
+
+	exit( EXIT_SUCCESS );
+}
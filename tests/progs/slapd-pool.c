@@ -0,0 +1,220 @@
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1999-2024 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/*
+ * Exercise the ldap_pool_*() API: sessions are checked out and returned,
+ * more are checked out than the pool has members, and members have their
+ * connection broken behind the pool's back, both while lent out and while
+ * idle. Every session handed out has to be bound as the pool's identity.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+
+#include "ac/stdlib.h"
+
+#include "ac/ctype.h"
+#include "ac/param.h"
+#include "ac/signal.h"
+#include "ac/socket.h"
+#include "ac/string.h"
+#include "ac/unistd.h"
+#include "ac/wait.h"
+
+#include "ldap.h"
+#include "lutil.h"
+
+#include "ldap_pvt.h"
+
+#include "slapd-common.h"
+
+#define LOOPS	10
+#define RETRIES	0
+
+#define POOL_SIZE	2
+
+static char *binddn;
+
+static void
+usage( char *name, int opt )
+{
+	if ( opt ) {
+		fprintf( stderr, "%s: unable to handle option \'%c\'\n\n",
+			name, opt );
+	}
+
+	fprintf( stderr, "usage: %s " TESTER_COMMON_HELP "\n", name );
+	exit( EXIT_FAILURE );
+}
+
+static void
+pool_fail( const char *what )
+{
+	fprintf( stderr, "  PID=%ld - Pool: %s\n", (long) pid, what );
+	exit( EXIT_FAILURE );
+}
+
+static ber_socket_t
+session_fd( LDAP *ld )
+{
+	ber_socket_t	fd = AC_SOCKET_INVALID;
+
+	ldap_get_option( ld, LDAP_OPT_DESC, &fd );
+	return fd;
+}
+
+/* Lend out a session and check it is bound as the pool's identity */
+static LDAP *
+pool_get( LDAPPool *pool )
+{
+	LDAP		*ld;
+	struct berval	*authzid = NULL;
+	int		rc;
+
+	ld = ldap_pool_get( pool );
+	if ( ld == NULL ) {
+		pool_fail( "ldap_pool_get failed" );
+	}
+
+	rc = ldap_whoami_s( ld, &authzid, NULL, NULL );
+	if ( rc != LDAP_SUCCESS ) {
+		tester_ldap_error( ld, "ldap_whoami_s", NULL );
+		pool_fail( "session handed out is not usable" );
+	}
+	if ( authzid == NULL || authzid->bv_len != strlen( binddn ) + 3 ||
+		strncasecmp( authzid->bv_val + 3, binddn, strlen( binddn ) ) )
+	{
+		pool_fail( "session handed out has the wrong identity" );
+	}
+	ber_bvfree( authzid );
+
+	return ld;
+}
+
+static void
+pool_put( LDAPPool *pool, LDAP *ld )
+{
+	if ( ldap_pool_put( pool, ld ) != LDAP_SUCCESS ) {
+		pool_fail( "ldap_pool_put failed" );
+	}
+}
+
+int
+main( int argc, char **argv )
+{
+	int		i, rc;
+	struct tester_conn_args	*config;
+	LDAPPool	*pool;
+	LDAP		*ld[POOL_SIZE + 1], *other;
+	struct berval	*authzid = NULL;
+
+	config = tester_init( "slapd-pool", TESTER_BIND );
+
+	while ( (i = getopt( argc, argv, TESTER_COMMON_OPTS )) != EOF ) {
+		if ( tester_config_opt( config, i, optarg ) != LDAP_SUCCESS ) {
+			usage( argv[0], i );
+		}
+	}
+
+	tester_config_finish( config );
+	if ( config->binddn == NULL ) {
+		usage( argv[0], 0 );
+	}
+	binddn = config->binddn;
+
+#ifdef SIGPIPE
+	/* Writes to the connections broken below must not kill us */
+	(void) SIGNAL( SIGPIPE, SIG_IGN );
+#endif
+
+	fprintf( stderr, "PID=%ld - Pool(%d): uri=\"%s\", binddn=\"%s\".\n",
+		(long) pid, config->loops, config->uri, binddn );
+
+	/* Probe idle members that were not used for a second */
+	rc = ldap_pool_initialize( &pool, config->uri, POOL_SIZE, 1 );
+	if ( rc != LDAP_SUCCESS ) {
+		pool_fail( "ldap_pool_initialize failed" );
+	}
+	rc = ldap_pool_bind_s( pool, binddn, LDAP_SASL_SIMPLE, &config->pass );
+	if ( rc != LDAP_SUCCESS ) {
+		pool_fail( "ldap_pool_bind_s failed" );
+	}
+
+	for ( i = 0; i < config->loops; i++ ) {
+		/* Idle members are lent out first, each to one caller */
+		ld[0] = pool_get( pool );
+		ld[1] = pool_get( pool );
+		if ( session_fd( ld[0] ) == session_fd( ld[1] ) ) {
+			pool_fail( "an idle member was left unused" );
+		}
+
+		/* Once all are lent out, members get shared */
+		ld[2] = pool_get( pool );
+		if ( session_fd( ld[2] ) != session_fd( ld[0] ) &&
+			session_fd( ld[2] ) != session_fd( ld[1] ) )
+		{
+			pool_fail( "more connections than members" );
+		}
+		pool_put( pool, ld[2] );
+		pool_put( pool, ld[1] );
+
+		/* A session the pool did not hand out is refused */
+		ldap_initialize( &other, config->uri );
+		if ( ldap_pool_put( pool, other ) != LDAP_PARAM_ERROR ) {
+			pool_fail( "a foreign session was accepted" );
+		}
+		ldap_unbind_ext( other, NULL, NULL );
+
+		/*
+		 * Break a member while it is lent out, the failure is seen by
+		 * the borrower and the member is reopened and rebound.
+		 */
+		shutdown( session_fd( ld[0] ), SHUT_RDWR );
+		rc = ldap_whoami_s( ld[0], &authzid, NULL, NULL );
+		ber_bvfree( authzid );
+		authzid = NULL;
+		if ( rc == LDAP_SUCCESS ) {
+			pool_fail( "operation on a broken connection succeeded" );
+		}
+		pool_put( pool, ld[0] );
+
+		ld[0] = pool_get( pool );
+		ld[1] = pool_get( pool );
+		if ( session_fd( ld[0] ) == session_fd( ld[1] ) ) {
+			pool_fail( "a broken member was not reopened" );
+		}
+
+		/*
+		 * Break a member without the borrower noticing, it is only
+		 * found out by the check done before it is lent out again.
+		 */
+		shutdown( session_fd( ld[1] ), SHUT_RDWR );
+		pool_put( pool, ld[1] );
+		pool_put( pool, ld[0] );
+		sleep( 2 );
+
+		ld[0] = pool_get( pool );
+		ld[1] = pool_get( pool );
+		pool_put( pool, ld[1] );
+		pool_put( pool, ld[0] );
+	}
+
+	ldap_pool_destroy( pool );
+
+	fprintf( stderr, "  PID=%ld - Pool done.\n", (long) pid );
+
+	exit( EXIT_SUCCESS );
+}
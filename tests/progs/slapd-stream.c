@@ -0,0 +1,299 @@
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1999-2024 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/*
+ * Exercise ldap_result_stream(). An entry with a value larger than the
+ * stream read-ahead buffer is added under the base, then the subtree is
+ * searched with results streamed, once through to the end and once stopping
+ * after the first entry, checking in between that plain searches on the same
+ * handle still see the same data.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+
+#include "ac/stdlib.h"
+
+#include "ac/ctype.h"
+#include "ac/param.h"
+#include "ac/socket.h"
+#include "ac/string.h"
+#include "ac/unistd.h"
+#include "ac/wait.h"
+
+#include "ldap.h"
+#include "lutil.h"
+
+#include "ldap_pvt.h"
+
+#include "slapd-common.h"
+
+#define LOOPS	10
+#define RETRIES	0
+
+/* Large enough for the entry to span several reads */
+#define VALUE_SIZE	(200*1024)
+
+typedef struct stream_state {
+	char	*ss_dn;
+	int	ss_entries;
+	int	ss_found;
+	int	ss_stop;
+	int	ss_bad;
+} stream_state;
+
+static ber_len_t value_size = VALUE_SIZE;
+
+static void
+usage( char *name, int opt )
+{
+	if ( opt ) {
+		fprintf( stderr, "%s: unable to handle option \'%c\'\n\n",
+			name, opt );
+	}
+
+	fprintf( stderr, "usage: %s " TESTER_COMMON_HELP
+		"-b <base> "
+		"[-s <value size>] "
+		"\n",
+		name );
+	exit( EXIT_FAILURE );
+}
+
+static int
+check_value( struct berval *bv )
+{
+	ber_len_t	i;
+
+	if ( bv->bv_len != value_size ) {
+		return -1;
+	}
+	for ( i = 0; i < value_size; i++ ) {
+		if ( bv->bv_val[i] != 'a' + i % 26 ) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int
+stream_cb( LDAP *ld, LDAPMessage *msg, void *arg )
+{
+	stream_state	*ss = arg;
+	BerElement	*ber = NULL;
+	struct berval	dn, attr, *vals;
+	int		rc;
+
+	if ( ldap_msgtype( msg ) != LDAP_RES_SEARCH_ENTRY ) {
+		return 0;
+	}
+	ss->ss_entries++;
+
+	rc = ldap_get_dn_ber( ld, msg, &ber, &dn );
+	if ( rc != LDAP_SUCCESS ) {
+		ss->ss_bad++;
+		return 1;
+	}
+	if ( strcasecmp( dn.bv_val, ss->ss_dn ) == 0 ) {
+		for ( rc = ldap_get_attribute_ber( ld, msg, ber, &attr, &vals );
+			rc == LDAP_SUCCESS && attr.bv_val != NULL;
+			rc = ldap_get_attribute_ber( ld, msg, ber, &attr, &vals ) )
+		{
+			if ( strcasecmp( attr.bv_val, "description" ) == 0 ) {
+				if ( vals == NULL || vals[0].bv_val == NULL ||
+					check_value( &vals[0] ) )
+				{
+					ss->ss_bad++;
+				} else {
+					ss->ss_found++;
+				}
+			}
+			ber_memfree( vals );
+		}
+	}
+	ber_free( ber, 0 );
+
+	return ss->ss_stop;
+}
+
+static int
+count_entries( LDAP *ld, char *base )
+{
+	LDAPMessage	*res = NULL;
+	int		rc, n;
+
+	rc = ldap_search_ext_s( ld, base, LDAP_SCOPE_SUBTREE, NULL, NULL, 0,
+		NULL, NULL, NULL, LDAP_NO_LIMIT, &res );
+	if ( rc != LDAP_SUCCESS ) {
+		tester_ldap_error( ld, "ldap_search_ext_s", NULL );
+		exit( EXIT_FAILURE );
+	}
+	n = ldap_count_entries( ld, res );
+	ldap_msgfree( res );
+	return n;
+}
+
+static int
+do_stream( LDAP *ld, char *base, stream_state *ss, int stop )
+{
+	LDAPMessage	*res = NULL;
+	int		rc, msgid, err = LDAP_SUCCESS;
+
+	ss->ss_entries = ss->ss_found = ss->ss_bad = 0;
+	ss->ss_stop = stop;
+
+	rc = ldap_search_ext( ld, base, LDAP_SCOPE_SUBTREE, NULL, NULL, 0,
+		NULL, NULL, NULL, LDAP_NO_LIMIT, &msgid );
+	if ( rc != LDAP_SUCCESS ) {
+		tester_ldap_error( ld, "ldap_search_ext", NULL );
+		exit( EXIT_FAILURE );
+	}
+
+	rc = ldap_result_stream( ld, msgid, NULL, stream_cb, ss, &res );
+	if ( rc == -1 ) {
+		ldap_get_option( ld, LDAP_OPT_RESULT_CODE, &err );
+		return err;
+	}
+	if ( rc != LDAP_RES_SEARCH_RESULT ||
+		ldap_parse_result( ld, res, &err, NULL, NULL, NULL, NULL, 1 )
+			!= LDAP_SUCCESS )
+	{
+		tester_ldap_error( ld, "ldap_result_stream", NULL );
+		exit( EXIT_FAILURE );
+	}
+	return err;
+}
+
+int
+main( int argc, char **argv )
+{
+	int		i, rc, expected;
+	char		*base = NULL, *value;
+	int		size;
+	struct tester_conn_args	*config;
+	LDAP		*ld = NULL;
+	char		*oc_vals[] = { "organizationalRole", NULL };
+	char		*cn_vals[] = { "stream test", NULL };
+	struct berval	desc_bv, *desc_vals[] = { &desc_bv, NULL };
+	LDAPMod		oc = { LDAP_MOD_ADD, "objectClass", { oc_vals } },
+			cn = { LDAP_MOD_ADD, "cn", { cn_vals } },
+			desc = { LDAP_MOD_ADD | LDAP_MOD_BVALUES, "description" },
+			*mods[] = { &oc, &cn, &desc, NULL };
+	stream_state	ss = { 0 };
+
+	config = tester_init( "slapd-stream", TESTER_SEARCH );
+
+	while ( (i = getopt( argc, argv, TESTER_COMMON_OPTS "b:s:" )) != EOF ) {
+		switch ( i ) {
+		case 'b':		/* base DN of a search */
+			base = optarg;
+			break;
+
+		case 's':		/* size of the large value */
+			if ( lutil_atoi( &size, optarg ) != 0 || size <= 0 ) {
+				usage( argv[0], i );
+			}
+			value_size = size;
+			break;
+
+		default:
+			if ( tester_config_opt( config, i, optarg ) == LDAP_SUCCESS ) {
+				break;
+			}
+			usage( argv[0], i );
+			break;
+		}
+	}
+
+	if ( base == NULL ) {
+		usage( argv[0], 0 );
+	}
+
+	tester_config_finish( config );
+	tester_init_ld( &ld, config, 0 );
+
+	ss.ss_dn = malloc( strlen( base ) + sizeof("cn=stream test,") );
+	sprintf( ss.ss_dn, "cn=stream test,%s", base );
+
+	value = malloc( value_size );
+	for ( i = 0; i < value_size; i++ ) {
+		value[i] = 'a' + i % 26;
+	}
+	desc_bv.bv_val = value;
+	desc_bv.bv_len = value_size;
+	desc.mod_bvalues = desc_vals;
+
+	rc = ldap_add_ext_s( ld, ss.ss_dn, mods, NULL, NULL );
+	if ( rc != LDAP_SUCCESS ) {
+		tester_ldap_error( ld, "ldap_add_ext_s", ss.ss_dn );
+		exit( EXIT_FAILURE );
+	}
+
+	expected = count_entries( ld, base );
+	fprintf( stderr, "PID=%ld - Stream(%d): base=\"%s\", %d entries.\n",
+		(long) pid, config->loops, base, expected );
+
+	for ( i = 0; i < config->loops; i++ ) {
+		rc = do_stream( ld, base, &ss, 0 );
+		if ( rc != LDAP_SUCCESS || ss.ss_bad ||
+			ss.ss_entries != expected || ss.ss_found != 1 )
+		{
+			fprintf( stderr, "  PID=%ld - Stream: rc=%d, %d of %d entries, "
+				"large value found %d times, %d broken\n",
+				(long) pid, rc, ss.ss_entries, expected,
+				ss.ss_found, ss.ss_bad );
+			exit( EXIT_FAILURE );
+		}
+
+		/* The read-ahead layer must not lose what follows */
+		if ( count_entries( ld, base ) != expected ) {
+			fprintf( stderr, "  PID=%ld - Stream: plain search after "
+				"the stream returned a different count\n",
+				(long) pid );
+			exit( EXIT_FAILURE );
+		}
+
+		/* Stop after the first entry, the search gets abandoned */
+		rc = do_stream( ld, base, &ss, 1 );
+		if ( rc != LDAP_USER_CANCELLED || ss.ss_entries != 1 ) {
+			fprintf( stderr, "  PID=%ld - Stream: stopping after one "
+				"entry gave rc=%d with %d entries\n",
+				(long) pid, rc, ss.ss_entries );
+			exit( EXIT_FAILURE );
+		}
+
+		if ( count_entries( ld, base ) != expected ) {
+			fprintf( stderr, "  PID=%ld - Stream: plain search after "
+				"an abandoned stream returned a different count\n",
+				(long) pid );
+			exit( EXIT_FAILURE );
+		}
+	}
+
+	rc = ldap_delete_ext_s( ld, ss.ss_dn, NULL, NULL );
+	if ( rc != LDAP_SUCCESS ) {
+		tester_ldap_error( ld, "ldap_delete_ext_s", ss.ss_dn );
+		exit( EXIT_FAILURE );
+	}
+
+	fprintf( stderr, "  PID=%ld - Stream done.\n", (long) pid );
+
+	ldap_unbind_ext( ld, NULL, NULL );
+	free( value );
+	free( ss.ss_dn );
+
+	exit( EXIT_SUCCESS );
+}
@@ -139,6 +139,7 @@ DSEESYNC2CONF=$DATADIR/slapd-dsee-consumer2.conf
 REFCONSUMERCONF=$DATADIR/slapd-ref-consumer.conf
 SCHEMACONF=$DATADIR/slapd-schema.conf
 TLSCONF=$DATADIR/slapd-tls.conf
+TLSRESUMECONF=$DATADIR/slapd-tls-resume.conf
 TLSSASLCONF=$DATADIR/slapd-tls-sasl.conf
 GLUECONF=$DATADIR/slapd-glue.conf
 REFINTCONF=$DATADIR/slapd-refint.conf
@@ -164,7 +165,10 @@ METACONF=$DATADIR/slapd-meta.conf
 METACONF1=$DATADIR/slapd-meta-target1.conf
 METACONF2=$DATADIR/slapd-meta-target2.conf
 ASYNCMETACONF=$DATADIR/slapd-asyncmeta.conf
+ASYNCMETADNCACHECONF=$DATADIR/slapd-asyncmeta-dncache.conf
 GLUELDAPCONF=$DATADIR/slapd-glue-ldap.conf
+GLUELDAPMUXCONF=$DATADIR/slapd-glue-ldap-multiplex.conf
+LDAPMUXCONF=$DATADIR/slapd-ldap-multiplex.conf
 ACICONF=$DATADIR/slapd-aci.conf
 VALSORTCONF=$DATADIR/slapd-valsort.conf
 DEREFCONF=$DATADIR/slapd-deref.conf
@@ -269,6 +273,11 @@ LDAPEXOP="$CLIENTDIR/ldapexop $TOOLARGS"
 SLAPDTESTER=$PROGDIR/slapd-tester
 LDIFFILTER=$PROGDIR/ldif-filter
 SLAPDMTREAD=$PROGDIR/slapd-mtread
+LLOADBENCH=$PROGDIR/lload-bench
+SLAPDSTREAM=$PROGDIR/slapd-stream
+SLAPDPOOL=$PROGDIR/slapd-pool
+SLAPDFLUSHV=$PROGDIR/slapd-flushv
+SLAPDASYNC=$PROGDIR/slapd-async
 LVL=${SLAPD_DEBUG-0x4105}
 LOCALHOST=localhost
 LOCALIP=127.0.0.1